@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../test/test.h"
+#include "bench.h"
+
+#define BENCHMARK_ITERATIONS 20
+#define NUM_FILES 4
+#define ENTRIES_PER_FILE 2000
+/* Consecutive files overlap by half their entries. */
+#define ENTRIES_STRIDE (ENTRIES_PER_FILE / 2)
+
+static char *
+write_file(const char *dir, const char *type, int n)
+{
+    char *path;
+    FILE *file;
+
+    path = asprintf_safe("%s/%s/stress%d", dir, type, n);
+    assert(path);
+    file = fopen(path, "w");
+    assert(file);
+
+    if (strcmp(type, "compat") == 0) {
+        fprintf(file, "default xkb_compatibility \"stress%d\" {\n", n);
+        for (int i = 0; i < ENTRIES_PER_FILE; i++) {
+            int sym = 0x1000 + n * ENTRIES_STRIDE + i;
+            fprintf(file,
+                    "    interpret U%04X+AnyOf(all) {\n"
+                    "        action = SetMods(modifiers=Shift);\n"
+                    "    };\n"
+                    "    interpret U%04X+Exactly(Lock) {\n"
+                    "        repeat = False;\n"
+                    "    };\n",
+                    sym, sym);
+        }
+    }
+    else {
+        fprintf(file, "default xkb_types \"stress%d\" {\n", n);
+        for (int i = 0; i < ENTRIES_PER_FILE; i++)
+            fprintf(file,
+                    "    type \"T%d\" {\n"
+                    "        modifiers = Shift;\n"
+                    "        map[Shift] = Level2;\n"
+                    "        level_name[Level1] = \"1\";\n"
+                    "        level_name[Level2] = \"2\";\n"
+                    "    };\n",
+                    n * ENTRIES_STRIDE + i);
+    }
+    fprintf(file, "};\n");
+
+    fclose(file);
+    return path;
+}
+
+static void
+remove_tree(char *dir, char *paths[], int num_paths)
+{
+    char *subdir;
+
+    for (int i = 0; i < num_paths; i++) {
+        unlink(paths[i]);
+        free(paths[i]);
+    }
+    subdir = asprintf_safe("%s/compat", dir);
+    assert(subdir);
+    rmdir(subdir);
+    free(subdir);
+    subdir = asprintf_safe("%s/types", dir);
+    assert(subdir);
+    rmdir(subdir);
+    free(subdir);
+    rmdir(dir);
+}
+
+/*
+ * Compile keymaps whose types and compat sections include several
+ * synthetic files with thousands of entries each, most of which are
+ * redefined by the following file.
+ */
+int
+main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/xkbcommon-bench-compat-XXXXXX";
+    char *paths[2 * NUM_FILES];
+    char *subdir;
+    struct xkb_context *ctx;
+    struct xkb_keymap *keymap;
+    struct bench bench;
+    char *elapsed;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (int i = 0; i < 2; i++) {
+        subdir = asprintf_safe("%s/%s", dir, i == 0 ? "compat" : "types");
+        if (!subdir || mkdir(subdir, 0700) != 0) {
+            perror("mkdir");
+            return 1;
+        }
+        free(subdir);
+    }
+    for (int i = 0; i < NUM_FILES; i++) {
+        paths[2 * i] = write_file(dir, "compat", i);
+        paths[2 * i + 1] = write_file(dir, "types", i);
+    }
+
+    ctx = test_get_context(0);
+    assert(ctx);
+    if (!xkb_context_include_path_append(ctx, dir)) {
+        fprintf(stderr, "failed to add %s to the include paths\n", dir);
+        return 1;
+    }
+
+    xkb_context_set_log_level(ctx, XKB_LOG_LEVEL_CRITICAL);
+    xkb_context_set_log_verbosity(ctx, 0);
+
+    bench_start(&bench);
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        keymap = test_compile_string(ctx,
+            "xkb_keymap {\n"
+            "  xkb_keycodes { include \"evdev\" };\n"
+            "  xkb_types { include \"complete+stress0+stress1+stress2+stress3\" };\n"
+            "  xkb_compat { include \"complete+stress0+stress1+stress2+stress3\" };\n"
+            "  xkb_symbols { include \"pc+us\" };\n"
+            "};\n");
+        assert(keymap);
+        xkb_keymap_unref(keymap);
+    }
+    bench_stop(&bench);
+
+    elapsed = bench_elapsed_str(&bench);
+    fprintf(stderr, "compiled %d keymaps with %d stress files in %ss\n",
+            BENCHMARK_ITERATIONS, 2 * NUM_FILES, elapsed);
+    free(elapsed);
+
+    xkb_context_unref(ctx);
+    remove_tree(dir, paths, ARRAY_SIZE(paths));
+    return 0;
+}
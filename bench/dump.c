@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "../test/test.h"
+#include "bench.h"
+
+#define BENCHMARK_ITERATIONS 2000
+
+static int
+count_chunk(void *data, const char *chunk, size_t length)
+{
+    *(size_t *) data += length;
+    return 1;
+}
+
+static void
+bench_dump(struct xkb_keymap *keymap, const char *what)
+{
+    struct bench bench;
+    char *elapsed, *dump;
+    size_t size = 0;
+    int i;
+
+    bench_start(&bench);
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        dump = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+        assert(dump);
+        size = strlen(dump);
+        free(dump);
+    }
+    bench_stop(&bench);
+
+    elapsed = bench_elapsed_str(&bench);
+    fprintf(stderr, "dumped %s (%zu bytes) %d times in %ss\n",
+            what, size, BENCHMARK_ITERATIONS, elapsed);
+    free(elapsed);
+
+    bench_start(&bench);
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        size = 0;
+        if (!xkb_keymap_write(keymap, XKB_KEYMAP_FORMAT_TEXT_V1, 0,
+                              count_chunk, &size))
+            assert(!"failed to write the keymap");
+    }
+    bench_stop(&bench);
+
+    elapsed = bench_elapsed_str(&bench);
+    fprintf(stderr, "streamed %s (%zu bytes) %d times in %ss\n",
+            what, size, BENCHMARK_ITERATIONS, elapsed);
+    free(elapsed);
+}
+
+int
+main(void)
+{
+    struct xkb_context *ctx;
+    struct xkb_keymap *keymap;
+    const char *files[] = {
+        "keymaps/host.xkb",
+        "keymaps/stringcomp.data",
+    };
+
+    ctx = test_get_context(0);
+    assert(ctx);
+
+    xkb_context_set_log_level(ctx, XKB_LOG_LEVEL_CRITICAL);
+    xkb_context_set_log_verbosity(ctx, 0);
+
+    for (unsigned i = 0; i < ARRAY_SIZE(files); i++) {
+        keymap = test_compile_file(ctx, files[i]);
+        assert(keymap);
+        bench_dump(keymap, files[i]);
+        xkb_keymap_unref(keymap);
+    }
+
+    keymap = test_compile_rules(ctx, "evdev", "pc104", "us,ru,il,de",
+                                ",,,neo", "grp:menu_toggle");
+    assert(keymap);
+    bench_dump(keymap, "us,ru,il,de");
+    xkb_keymap_unref(keymap);
+
+    xkb_context_unref(ctx);
+    return 0;
+}
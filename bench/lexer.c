@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <time.h>
+
+#include "../test/test.h"
+#include "xkbcomp/xkbcomp-priv.h"
+#include "bench.h"
+
+#define BENCHMARK_ITERATIONS 200
+
+struct input {
+    char *name;
+    char *text;
+    size_t len;
+};
+typedef darray(struct input) darray_input;
+
+static void
+read_dir(darray_input *inputs, const char *dir_rel)
+{
+    char *path = test_get_path(dir_rel);
+    struct dirent *entry;
+    DIR *dir;
+
+    assert(path);
+    dir = opendir(path);
+    assert(dir);
+
+    while ((entry = readdir(dir))) {
+        struct input input;
+        char *rel;
+
+        if (entry->d_name[0] == '.')
+            continue;
+        rel = asprintf_safe("%s/%s", dir_rel, entry->d_name);
+        assert(rel);
+
+        if (entry->d_type == DT_DIR) {
+            read_dir(inputs, rel);
+            free(rel);
+            continue;
+        }
+
+        input.text = test_read_file(rel);
+        assert(input.text);
+        input.name = rel;
+        input.len = strlen(input.text);
+        darray_append(*inputs, input);
+    }
+
+    closedir(dir);
+    free(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const char *dirs[] = {
+        "keycodes", "types", "compat", "symbols", "keymaps",
+    };
+    struct xkb_context *ctx;
+    darray_input inputs = darray_new();
+    struct input *input;
+    struct bench bench;
+    struct bench_time elapsed;
+    char *elapsed_str;
+    size_t bytes = 0, tokens = 0;
+
+    ctx = test_get_context(0);
+    assert(ctx);
+
+    xkb_context_set_log_level(ctx, XKB_LOG_LEVEL_CRITICAL);
+    xkb_context_set_log_verbosity(ctx, 0);
+
+    for (unsigned i = 0; i < ARRAY_SIZE(dirs); i++)
+        read_dir(&inputs, dirs[i]);
+    assert(!darray_empty(inputs));
+
+    bench_start(&bench);
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        darray_foreach(input, inputs) {
+            int count = XkbLexString(ctx, input->text, input->len,
+                                     input->name);
+            if (count > 0)
+                tokens += count;
+            bytes += input->len;
+        }
+    }
+    bench_stop(&bench);
+
+    bench_elapsed(&bench, &elapsed);
+    elapsed_str = bench_elapsed_str(&bench);
+    fprintf(stderr, "lexed %zu bytes (%zu tokens) in %ss, %.1f MiB/s\n",
+            bytes, tokens, elapsed_str,
+            bytes / (1024.0 * 1024.0) /
+            (elapsed.seconds + elapsed.microseconds / 1000000.0));
+    free(elapsed_str);
+
+    darray_foreach(input, inputs) {
+        free(input->name);
+        free(input->text);
+    }
+    darray_free(inputs);
+    xkb_context_unref(ctx);
+    return 0;
+}
@@ -34,8 +34,11 @@ int
 main(int argc, char *argv[])
 {
     struct xkb_context *ctx;
-    struct xkb_keymap *keymap;
+    struct xkb_keymap *keymap, *base;
     struct bench bench;
+    const struct xkb_rule_names names = {
+        "evdev", "evdev", "us,de", "", "grp:alt_shift_toggle",
+    };
     char *elapsed;
     int i;
 
@@ -58,6 +61,24 @@ main(int argc, char *argv[])
             BENCHMARK_ITERATIONS, elapsed);
     free(elapsed);
 
+    /* Adding a layout and an option only changes the symbols. */
+    base = test_compile_rules(ctx, "evdev", "evdev", "us", "", "");
+    assert(base);
+
+    bench_start(&bench);
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        keymap = xkb_keymap_new_from_names_incremental(base, &names, 0);
+        assert(keymap);
+        xkb_keymap_unref(keymap);
+    }
+    bench_stop(&bench);
+
+    elapsed = bench_elapsed_str(&bench);
+    fprintf(stderr, "recompiled %d keymaps incrementally in %ss\n",
+            BENCHMARK_ITERATIONS, elapsed);
+    free(elapsed);
+
+    xkb_keymap_unref(base);
     xkb_context_unref(ctx);
     return 0;
 }
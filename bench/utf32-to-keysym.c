@@ -0,0 +1,60 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xkbcommon/xkbcommon.h"
+#include "bench.h"
+
+#define BENCHMARK_ITERATIONS 100
+
+int
+main(void)
+{
+    struct bench bench;
+    char *elapsed;
+    unsigned int legacy = 0;
+
+    /* The whole BMP, so that most lookups miss the legacy keysyms. */
+    bench_start(&bench);
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        legacy = 0;
+        for (uint32_t ucs = 0; ucs <= 0xffff; ucs++) {
+            xkb_keysym_t keysym = xkb_utf32_to_keysym(ucs);
+            if (keysym != XKB_KEY_NoSymbol && keysym < 0x01000000)
+                legacy++;
+        }
+    }
+    bench_stop(&bench);
+
+    elapsed = bench_elapsed_str(&bench);
+    fprintf(stderr, "converted the BMP (%u legacy keysyms) %d times in %ss\n",
+            legacy, BENCHMARK_ITERATIONS, elapsed);
+    free(elapsed);
+
+    return 0;
+}
@@ -138,6 +138,14 @@ struct xkb_compose_table;
  */
 struct xkb_compose_state;
 
+/**
+ * @struct xkb_compose_table_async
+ * A compose table being compiled in the background.
+ *
+ * @since 1.5.0
+ */
+struct xkb_compose_table_async;
+
 /** Flags affecting Compose file compilation. */
 enum xkb_compose_compile_flags {
     /** Do not apply any flags. */
@@ -237,6 +245,73 @@ xkb_compose_table_new_from_locale(struct xkb_context *context,
                                   const char *locale,
                                   enum xkb_compose_compile_flags flags);
 
+/**
+ * Start creating a compose table for a given locale in the background.
+ *
+ * This is equivalent to xkb_compose_table_new_from_locale(), but the
+ * Compose file is parsed on another thread; the context can be used as
+ * usual meanwhile.  Note that the log function of the context may be
+ * called on that thread, until the table is finished or cancelled.
+ *
+ * If threads are not supported on the platform, the table is created
+ * before this function returns.
+ *
+ * @returns The pending compose table, to be passed to
+ * xkb_compose_table_async_finish() or xkb_compose_table_async_cancel(),
+ * or NULL if the compilation could not be started.
+ *
+ * @sa xkb_keymap_new_from_names_async()
+ * @memberof xkb_compose_table_async
+ * @since 1.5.0
+ */
+struct xkb_compose_table_async *
+xkb_compose_table_new_from_locale_async(struct xkb_context *context,
+                                        const char *locale,
+                                        enum xkb_compose_compile_flags flags);
+
+/**
+ * Get a file descriptor which becomes readable once the compilation of
+ * a pending compose table is done.
+ *
+ * @returns The file descriptor, or -1 if it is not supported on the
+ * platform.
+ *
+ * @sa xkb_keymap_async_get_fd()
+ * @memberof xkb_compose_table_async
+ * @since 1.5.0
+ */
+int
+xkb_compose_table_async_get_fd(struct xkb_compose_table_async *async);
+
+/**
+ * Get the table of a pending compose table, and free the latter.
+ *
+ * If the compilation is not done yet, this blocks until it is.
+ *
+ * @returns The compose table, or NULL if the compilation failed or a
+ * Compose file was not found.
+ *
+ * @memberof xkb_compose_table_async
+ * @since 1.5.0
+ */
+struct xkb_compose_table *
+xkb_compose_table_async_finish(struct xkb_compose_table_async *async);
+
+/**
+ * Discard a pending compose table, without blocking.
+ *
+ * The log function of the context is not called for it anymore once this
+ * returns, so its user data can be freed then.
+ *
+ * @param async The pending compose table.  If it is NULL, this function
+ * does nothing.
+ *
+ * @memberof xkb_compose_table_async
+ * @since 1.5.0
+ */
+void
+xkb_compose_table_async_cancel(struct xkb_compose_table_async *async);
+
 /**
  * Create a new compose table from a Compose file.
  *
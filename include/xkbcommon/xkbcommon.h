@@ -133,6 +133,46 @@ struct xkb_keymap;
  */
 struct xkb_state;
 
+/**
+ * @struct xkb_keymap_builder
+ * Opaque keymap builder object.
+ *
+ * A keymap builder creates a keymap from keys, types and modifiers given
+ * directly, rather than from XKB files.
+ *
+ * @since 1.5.0
+ */
+struct xkb_keymap_builder;
+
+/**
+ * @struct xkb_static_keymap
+ * A keymap compiled into C source code.
+ *
+ * Such a source file is generated with `compile-keymap --emit-c`, the
+ * build of xkbcli-compile-keymap with access to the private APIs.  It
+ * uses the internal data structures of libxkbcommon, so it must be
+ * built against the headers of the same version of libxkbcommon, e.g.
+ * as part of it.  It defines an object which can be declared as:
+ *
+ * ~~~{.c}
+ *     extern struct xkb_static_keymap builtin_keymap;
+ * ~~~
+ *
+ * @since 1.5.0
+ */
+struct xkb_static_keymap;
+
+/**
+ * @struct xkb_keymap_async
+ * A keymap being compiled in the background.
+ *
+ * Created by xkb_keymap_new_from_names_async(), and freed by either
+ * xkb_keymap_async_finish() or xkb_keymap_async_cancel().
+ *
+ * @since 1.5.0
+ */
+struct xkb_keymap_async;
+
 /**
  * A number used to represent a physical key on a keyboard.
  *
@@ -378,6 +418,26 @@ struct xkb_rule_names {
     const char *options;
 };
 
+/**
+ * Component names, also known as KcCGST.
+ *
+ * These are the XKB files which make up a keymap, as given by the rules
+ * for some RMLVO names; see xkb_components_from_names_batch().  The
+ * strings are owned by the caller, and freed with free().
+ *
+ * @since 1.5.0
+ */
+struct xkb_component_names {
+    /** The keycodes, e.g. "evdev+aliases(qwerty)". */
+    char *keycodes;
+    /** The key types, e.g. "complete". */
+    char *types;
+    /** The compatibility map, e.g. "complete". */
+    char *compat;
+    /** The symbols, e.g. "pc+us+inet(evdev)". */
+    char *symbols;
+};
+
 /**
  * @defgroup keysyms Keysyms
  * Utility functions related to keysyms.
@@ -582,7 +642,33 @@ enum xkb_context_flags {
      * Don't take RMLVO names from the environment.
      * @since 0.3.0
      */
-    XKB_CONTEXT_NO_ENVIRONMENT_NAMES = (1 << 1)
+    XKB_CONTEXT_NO_ENVIRONMENT_NAMES = (1 << 1),
+    /**
+     * When compiling a keymap, read and parse the include trees of the
+     * keycodes, types, compat and symbols sections concurrently, each on
+     * its own thread.  Merging the parsed files into the keymap is still
+     * done on the calling thread.
+     *
+     * While the include files are being parsed, the log function may be
+     * called from these threads.  The flag is ignored if libxkbcommon was
+     * built without thread support.
+     *
+     * @since 1.5.0
+     */
+    XKB_CONTEXT_PARALLEL_COMPILE = (1 << 2),
+    /**
+     * Keep the components which the rules give for RMLVO names on disk,
+     * in `$XDG_CACHE_HOME/xkbcommon` (or `$HOME/.cache/xkbcommon`), and
+     * use them in later processes instead of reading the rules again.
+     *
+     * An entry is only used if the rules file and the files it includes
+     * did not change since it was written, as told by their inode, size
+     * and modification time.  Names which the rules do not recognize are
+     * not cached, so that they keep being reported.
+     *
+     * @since 1.5.0
+     */
+    XKB_CONTEXT_RULES_DISK_CACHE = (1 << 3)
 };
 
 /**
@@ -827,6 +913,106 @@ xkb_context_set_log_fn(struct xkb_context *context,
 
 /** @} */
 
+/**
+ * @defgroup profiling Compile Profiling
+ * Measuring where keymap compilation spends its time.
+ *
+ * @{
+ */
+
+/**
+ * Phases of keymap compilation, see xkb_context_get_compile_phase_time().
+ *
+ * The phases are exclusive: e.g. parsing a file included while compiling
+ * the symbols section is accounted to XKB_COMPILE_PHASE_PARSE, not to
+ * XKB_COMPILE_PHASE_SYMBOLS.
+ *
+ * @since 1.5.0
+ */
+enum xkb_compile_phase {
+    /** Resolving RMLVO names to keymap components using the rules. */
+    XKB_COMPILE_PHASE_RULES = 0,
+    /** Finding, opening and reading XKB files. */
+    XKB_COMPILE_PHASE_FILE_IO,
+    /** Lexing and parsing XKB files. */
+    XKB_COMPILE_PHASE_PARSE,
+    /** Compiling the keycodes section. */
+    XKB_COMPILE_PHASE_KEYCODES,
+    /** Compiling the types section. */
+    XKB_COMPILE_PHASE_TYPES,
+    /** Compiling the compat section. */
+    XKB_COMPILE_PHASE_COMPAT,
+    /** Compiling the symbols section, including merging its includes. */
+    XKB_COMPILE_PHASE_SYMBOLS,
+    /** Computing the derived keymap fields, e.g. applying interprets. */
+    XKB_COMPILE_PHASE_DERIVED
+};
+
+/**
+ * Counters of keymap compilation, see xkb_context_get_compile_counter().
+ *
+ * @since 1.5.0
+ */
+enum xkb_compile_counter {
+    /** Number of files opened, including rules files. */
+    XKB_COMPILE_COUNTER_FILES_OPENED = 0,
+    /** Number of bytes of XKB keymap source passed to the lexer. */
+    XKB_COMPILE_COUNTER_BYTES_LEXED,
+    /** Number of syntax tree nodes created by the parser. */
+    XKB_COMPILE_COUNTER_AST_NODES,
+    /**
+     * Number of heap allocations made for syntax trees, i.e. the nodes
+     * and the strings and arrays they own.
+     */
+    XKB_COMPILE_COUNTER_ALLOCATIONS
+};
+
+/**
+ * Enable or disable profiling of keymap compilation in this context.
+ *
+ * When enabled, the time spent in each compilation phase and some
+ * counters are accumulated over all the keymaps compiled in the context,
+ * until profiling is disabled.  Enabling profiling resets all the values.
+ *
+ * @param context The context.
+ * @param enable  Non-zero to enable profiling, zero to disable it.
+ *
+ * @returns 0 on success, or -1 if memory could not be allocated.
+ *
+ * @memberof xkb_context
+ * @since 1.5.0
+ */
+int
+xkb_context_set_compile_profiling(struct xkb_context *context, int enable);
+
+/**
+ * Get the time spent in a compilation phase, in nanoseconds.
+ *
+ * @returns The accumulated time, or 0 if profiling is not enabled or the
+ * phase is invalid.
+ *
+ * @memberof xkb_context
+ * @since 1.5.0
+ */
+uint64_t
+xkb_context_get_compile_phase_time(struct xkb_context *context,
+                                   enum xkb_compile_phase phase);
+
+/**
+ * Get the value of a compilation counter.
+ *
+ * @returns The accumulated value, or 0 if profiling is not enabled or the
+ * counter is invalid.
+ *
+ * @memberof xkb_context
+ * @since 1.5.0
+ */
+uint64_t
+xkb_context_get_compile_counter(struct xkb_context *context,
+                                enum xkb_compile_counter counter);
+
+/** @} */
+
 /**
  * @defgroup keymap Keymap Creation
  * Creating and destroying keymaps.
@@ -861,6 +1047,189 @@ xkb_keymap_new_from_names(struct xkb_context *context,
                           const struct xkb_rule_names *names,
                           enum xkb_keymap_compile_flags flags);
 
+/**
+ * Create a keymap from RMLVO names, reusing the parts of another keymap
+ * which do not change.
+ *
+ * This is equivalent to xkb_keymap_new_from_names() in the context of
+ * @p base, but is faster when @p base was itself created from RMLVO
+ * names, and the new names only change its symbols; for example, when
+ * a layout or an option such as `grp:alt_shift_toggle` is added.  In
+ * that case, the keycodes, types and compat sections of @p base are
+ * reused, and only the symbols section is compiled.  Otherwise, the
+ * keymap is compiled from scratch.
+ *
+ * @p base is not modified, and does not need to be kept around after
+ * this call.
+ *
+ * @param base    The keymap to reuse.
+ * @param names   The RMLVO names to use.  See xkb_rule_names.
+ * @param flags   Optional flags for the keymap, or 0.
+ *
+ * @returns A keymap compiled according to the RMLVO names, or NULL if
+ * the compilation failed.
+ *
+ * @sa xkb_keymap_new_from_names()
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+struct xkb_keymap *
+xkb_keymap_new_from_names_incremental(struct xkb_keymap *base,
+                                      const struct xkb_rule_names *names,
+                                      enum xkb_keymap_compile_flags flags);
+
+/**
+ * Create a keymap from RMLVO names, with only the keys of a device.
+ *
+ * This is equivalent to xkb_keymap_new_from_names(), but the keys which
+ * the device does not have are left out of the keymap, as if the
+ * keycodes section did not define them.  This makes the keymap smaller
+ * and faster to compile and serialize, which helps when each device
+ * gets its own keymap, and most devices only have a few keys.
+ *
+ * The keys of the device are given as the bitmap returned by the
+ * `EVIOCGBIT(EV_KEY, ...)` ioctl on its evdev node: the key with the
+ * evdev code n is kept if bit n is set, and its keycode is n + 8, like
+ * in the keycodes of the "evdev" rules.
+ *
+ * @param context       The context in which to create the keymap.
+ * @param names         The RMLVO names to use.  See xkb_rule_names.
+ * @param key_bits      The bitmap of the evdev key codes of the device.
+ * @param key_bits_size The size of @p key_bits in bytes.
+ * @param flags         Optional flags for the keymap, or 0.
+ *
+ * @returns A keymap compiled according to the RMLVO names, or NULL if
+ * the compilation failed.
+ *
+ * @sa xkb_keymap_new_from_names()
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+struct xkb_keymap *
+xkb_keymap_new_from_names_for_device(struct xkb_context *context,
+                                     const struct xkb_rule_names *names,
+                                     const unsigned long *key_bits,
+                                     size_t key_bits_size,
+                                     enum xkb_keymap_compile_flags flags);
+
+/**
+ * Start compiling a keymap from RMLVO names in the background.
+ *
+ * This is equivalent to xkb_keymap_new_from_names(), but the compilation
+ * runs on another thread, so that the caller, e.g. a compositor handling
+ * a hotplugged keyboard, can keep going meanwhile.  The context can be
+ * used as usual during the compilation, including to compile other
+ * keymaps.
+ *
+ * The compilation uses the include paths and the logging settings which
+ * the context has when this is called.  Note that the log function of
+ * the context may be called on the compiling thread, until the keymap is
+ * finished or cancelled.
+ *
+ * If threads are not supported on the platform, the keymap is compiled
+ * before this function returns.
+ *
+ * @param context The context in which to create the keymap.
+ * @param names   The RMLVO names to use.  See xkb_rule_names.
+ * @param flags   Optional flags for the keymap, or 0.
+ *
+ * @returns The pending keymap, to be passed to xkb_keymap_async_finish()
+ * or xkb_keymap_async_cancel(), or NULL if the compilation could not be
+ * started.
+ *
+ * @sa xkb_keymap_new_from_names()
+ * @memberof xkb_keymap_async
+ * @since 1.5.0
+ */
+struct xkb_keymap_async *
+xkb_keymap_new_from_names_async(struct xkb_context *context,
+                                const struct xkb_rule_names *names,
+                                enum xkb_keymap_compile_flags flags);
+
+/**
+ * Get a file descriptor which becomes readable once the compilation of
+ * a pending keymap is done.
+ *
+ * The file descriptor is meant to be added to an event loop, e.g. with
+ * poll(2); it must not be read from or closed, and is only valid until
+ * the pending keymap is finished or cancelled.
+ *
+ * @returns The file descriptor, or -1 if it is not supported on the
+ * platform.  In that case xkb_keymap_async_finish() blocks until the
+ * compilation is done.
+ *
+ * @memberof xkb_keymap_async
+ * @since 1.5.0
+ */
+int
+xkb_keymap_async_get_fd(struct xkb_keymap_async *async);
+
+/**
+ * Get the keymap of a pending keymap, and free the latter.
+ *
+ * If the compilation is not done yet, this blocks until it is.
+ *
+ * @returns The compiled keymap, in the context given to
+ * xkb_keymap_new_from_names_async(), or NULL if the compilation failed.
+ *
+ * @memberof xkb_keymap_async
+ * @since 1.5.0
+ */
+struct xkb_keymap *
+xkb_keymap_async_finish(struct xkb_keymap_async *async);
+
+/**
+ * Discard a pending keymap.
+ *
+ * This does not block: if the compilation is not done yet, it is left
+ * to run, and its result is freed once it is.  The log function of the
+ * context is not called for it anymore once this returns, so its user
+ * data can be freed then.
+ *
+ * @param async The pending keymap.  If it is NULL, this function does
+ * nothing.
+ *
+ * @memberof xkb_keymap_async
+ * @since 1.5.0
+ */
+void
+xkb_keymap_async_cancel(struct xkb_keymap_async *async);
+
+/**
+ * Look up the component names which the rules give for many RMLVO names.
+ *
+ * This is meant for tools which check a whole layout registry at once:
+ * the rules file is read once, and the names are matched against it by
+ * several threads, if threads are supported on the platform.  Nothing
+ * is compiled; use xkb_keymap_new_from_names() for that.
+ *
+ * The names are completed with the defaults as in
+ * xkb_keymap_new_from_names().  The messages about each of them, e.g.
+ * about unrecognized layouts, are logged in order by the calling thread.
+ *
+ * @param context    The context whose include paths are searched for the
+ * rules file.
+ * @param rules      The rules file to use for all the names.  If NULL or
+ * the empty string "", the default is used.  The rules field of the
+ * names is ignored.
+ * @param names      Array of @p count RMLVO names.
+ * @param count      Number of names.
+ * @param components Array of @p count component names, which receives
+ * the result for each of the names.  The fields of an element are all
+ * NULL if its names could not be resolved.
+ *
+ * @returns The number of names which could be resolved.
+ *
+ * @memberof xkb_context
+ * @since 1.5.0
+ */
+size_t
+xkb_components_from_names_batch(struct xkb_context *context,
+                                const char *rules,
+                                const struct xkb_rule_names *names,
+                                size_t count,
+                                struct xkb_component_names *components);
+
 /** The possible keymap formats. */
 enum xkb_keymap_format {
     /** The current/classic XKB text format, as generated by xkbcomp -xkb. */
@@ -967,6 +1336,501 @@ char *
 xkb_keymap_get_as_string(struct xkb_keymap *keymap,
                          enum xkb_keymap_format format);
 
+/**
+ * Flags for xkb_keymap_get_as_string_flags() and xkb_keymap_write().
+ *
+ * @since 1.5.0
+ */
+enum xkb_keymap_serialize_flags {
+    /** Do not apply any flags. */
+    XKB_KEYMAP_SERIALIZE_NO_FLAGS = 0,
+    /**
+     * Write only the key types which the keys use, and each distinct
+     * type only once, under the first of its names in alphabetical
+     * order.  The types are sorted by name, and a key's type is only
+     * given where it would not be the automatic one.
+     *
+     * The text is smaller, and equivalent keymaps give the same text,
+     * e.g. for caching or fingerprinting keymaps.  It compiles to a
+     * keymap which behaves the same, but which may differ in the types
+     * it has.
+     */
+    XKB_KEYMAP_SERIALIZE_CANONICAL_TYPES = (1 << 0)
+};
+
+/**
+ * Get the compiled keymap as a string, with flags.
+ *
+ * This is xkb_keymap_get_as_string(), with @p flags changing the text;
+ * see enum xkb_keymap_serialize_flags.
+ *
+ * @returns The keymap as a NUL-terminated string, or NULL if unsuccessful,
+ * e.g. if @p flags are invalid.
+ *
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+char *
+xkb_keymap_get_as_string_flags(struct xkb_keymap *keymap,
+                               enum xkb_keymap_format format,
+                               enum xkb_keymap_serialize_flags flags);
+
+/**
+ * The function which xkb_keymap_write() passes the keymap text to.
+ *
+ * @param data The data passed to xkb_keymap_write().
+ * @param chunk The next part of the text; it is not NUL-terminated, and
+ * is only valid during the call.
+ * @param length The length of @p chunk, never 0.
+ *
+ * @returns 1 if the chunk was written, or 0 to stop writing.
+ *
+ * @sa xkb_keymap_write
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+typedef int
+(*xkb_keymap_write_fn_t)(void *data, const char *chunk, size_t length);
+
+/**
+ * Write the compiled keymap, in chunks.
+ *
+ * This produces the same text as xkb_keymap_get_as_string(), without
+ * the terminating NUL byte, but passes it to @p write_fn in chunks of a
+ * few kilobytes as it goes, rather than building the whole string.
+ *
+ * @param keymap The keymap to write.
+ * @param format The keymap format to use, as in xkb_keymap_get_as_string().
+ * @param flags Optional flags for the text, or 0.
+ * @param write_fn The function which gets the chunks, in order.
+ * @param data Passed to @p write_fn.
+ *
+ * @returns 1 on success, or 0 if the format or flags are invalid, memory
+ * could not be allocated or @p write_fn returned 0.  In that case
+ * some of the text may have been written already.
+ *
+ * @sa xkb_keymap_write_to_fd()
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+int
+xkb_keymap_write(struct xkb_keymap *keymap, enum xkb_keymap_format format,
+                 enum xkb_keymap_serialize_flags flags,
+                 xkb_keymap_write_fn_t write_fn, void *data);
+
+/**
+ * Write the compiled keymap to a file descriptor.
+ *
+ * This is xkb_keymap_write() with write(2) as the write function; e.g. a
+ * Wayland compositor can write the keymap straight into the file it
+ * shares with clients.  Note that the terminating NUL byte, which
+ * clients usually expect to be part of the size sent to them, is not
+ * written.
+ *
+ * @returns 1 on success, or 0 on failure, e.g. if writing failed or the
+ * platform does not support it.
+ *
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+int
+xkb_keymap_write_to_fd(struct xkb_keymap *keymap,
+                       enum xkb_keymap_format format,
+                       enum xkb_keymap_serialize_flags flags, int fd);
+
+/** @} */
+
+/**
+ * @defgroup keymap-builder Keymap Builder
+ * Creating keymaps without going through the XKB text format.
+ *
+ * Programs which generate keymaps, such as virtual keyboards, may build
+ * them directly rather than writing them out in the XKB text format and
+ * compiling that with xkb_keymap_new_from_string().  The result is the
+ * same as compiling a keymap whose compat section is empty: actions are
+ * only bound to keys explicitly.
+ *
+ * Modifiers are referred to by their index in the keymap being built, as
+ * returned by xkb_keymap_builder_add_mod(); the 8 real modifiers have their
+ * usual indices, e.g. 0 for Shift.
+ *
+ * @{
+ */
+
+/**
+ * The types of actions which a keymap builder can bind to keys.
+ *
+ * @since 1.5.0
+ */
+enum xkb_keymap_builder_action_type {
+    /** No action. */
+    XKB_KEYMAP_BUILDER_ACTION_NONE = 0,
+    /** Set modifiers while the key is held, as SetMods(). */
+    XKB_KEYMAP_BUILDER_ACTION_MOD_SET,
+    /** Latch modifiers, as LatchMods(). */
+    XKB_KEYMAP_BUILDER_ACTION_MOD_LATCH,
+    /** Lock modifiers, as LockMods(). */
+    XKB_KEYMAP_BUILDER_ACTION_MOD_LOCK,
+    /** Set the layout while the key is held, as SetGroup(). */
+    XKB_KEYMAP_BUILDER_ACTION_GROUP_SET,
+    /** Latch the layout, as LatchGroup(). */
+    XKB_KEYMAP_BUILDER_ACTION_GROUP_LATCH,
+    /** Lock the layout, as LockGroup(). */
+    XKB_KEYMAP_BUILDER_ACTION_GROUP_LOCK
+};
+
+/**
+ * Flags for keymap builder actions.
+ *
+ * @since 1.5.0
+ */
+enum xkb_keymap_builder_action_flags {
+    /** Do not apply any flags. */
+    XKB_KEYMAP_BUILDER_ACTION_NO_FLAGS = 0,
+    /** Set and latch actions: clear the locks on release, as clearLocks. */
+    XKB_KEYMAP_BUILDER_ACTION_CLEAR_LOCKS = (1 << 0),
+    /** Latch actions: lock when already latched, as latchToLock. */
+    XKB_KEYMAP_BUILDER_ACTION_LATCH_TO_LOCK = (1 << 1),
+    /** Modifier actions: use the modifier map of the key, as
+     * modifiers=modMapMods. */
+    XKB_KEYMAP_BUILDER_ACTION_USE_MODMAP = (1 << 2),
+    /** Layout actions: the layout is an index rather than an offset from
+     * the current layout. */
+    XKB_KEYMAP_BUILDER_ACTION_ABSOLUTE_GROUP = (1 << 3)
+};
+
+/**
+ * An action for xkb_keymap_builder_key_set_action().
+ *
+ * @since 1.5.0
+ */
+struct xkb_keymap_builder_action {
+    /** The type of the action. */
+    enum xkb_keymap_builder_action_type type;
+    /** The flags of the action. */
+    enum xkb_keymap_builder_action_flags flags;
+    /** Modifier actions: the modifiers to set, latch or lock. */
+    xkb_mod_mask_t mods;
+    /** Layout actions: the layout index (0-based) with
+     * XKB_KEYMAP_BUILDER_ACTION_ABSOLUTE_GROUP, or the offset otherwise. */
+    int32_t group;
+};
+
+/**
+ * Create a new keymap builder.
+ *
+ * @param context The context in which to create the keymap.
+ * @param flags   Optional flags for the keymap, or 0.
+ *
+ * @returns A new, empty keymap builder, or NULL on failure.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+struct xkb_keymap_builder *
+xkb_keymap_builder_new(struct xkb_context *context,
+                       enum xkb_keymap_compile_flags flags);
+
+/**
+ * Free a keymap builder.
+ *
+ * Keymaps returned by xkb_keymap_builder_build() are not affected.
+ *
+ * @param builder The keymap builder.  If it is NULL, this function does
+ * nothing.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+void
+xkb_keymap_builder_destroy(struct xkb_keymap_builder *builder);
+
+/**
+ * Add a modifier to the keymap.
+ *
+ * @param builder The keymap builder.
+ * @param name    The name of the modifier.  If it is the name of a real
+ * modifier, or of a modifier which was already added, its index is
+ * returned; otherwise a new virtual modifier is added.
+ * @param mapping The real modifiers the virtual modifier is mapped to, in
+ * addition to those of the keys it is bound to with
+ * xkb_keymap_builder_key_set_mods().  Must be 0 for real modifiers.
+ *
+ * @returns The index of the modifier, or XKB_MOD_INVALID on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+xkb_mod_index_t
+xkb_keymap_builder_add_mod(struct xkb_keymap_builder *builder,
+                           const char *name, xkb_mod_mask_t mapping);
+
+/**
+ * Add a key type to the keymap.
+ *
+ * Keys whose type is not set with xkb_keymap_builder_key_set_type() get
+ * one of the usual automatic types, such as `ONE_LEVEL`, `TWO_LEVEL` or
+ * `ALPHABETIC`, if it was added, and the first type otherwise.  If no type
+ * is added, a default one-level type is used for all keys.
+ *
+ * @param builder    The keymap builder.
+ * @param name       The name of the type, which must be unique.
+ * @param mods       The modifiers the type depends on.
+ * @param num_levels The number of levels of the type, at least 1.
+ *
+ * @returns The index of the type, or -1 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_add_type(struct xkb_keymap_builder *builder,
+                            const char *name, xkb_mod_mask_t mods,
+                            xkb_level_index_t num_levels);
+
+/**
+ * Map a combination of modifiers to a level of a key type.
+ *
+ * Modifiers which the type does not depend on are ignored.  If the
+ * combination is already mapped, its entry is replaced.
+ *
+ * @param builder  The keymap builder.
+ * @param type     The index of the type.
+ * @param mods     The combination of modifiers.
+ * @param level    The level (0-based) it maps to.
+ * @param preserve The modifiers of the combination which should not be
+ * consumed.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_type_add_entry(struct xkb_keymap_builder *builder,
+                                  int type, xkb_mod_mask_t mods,
+                                  xkb_level_index_t level,
+                                  xkb_mod_mask_t preserve);
+
+/**
+ * Add a key to the keymap.
+ *
+ * @param builder The keymap builder.
+ * @param key     The keycode of the key.
+ * @param name    The name of the key, e.g. "AE01", which must be unique.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_add_key(struct xkb_keymap_builder *builder,
+                           xkb_keycode_t key, const char *name);
+
+/**
+ * Set the type of a layout of a key.
+ *
+ * @param builder The keymap builder.
+ * @param key     The keycode of a key added with xkb_keymap_builder_add_key().
+ * @param layout  The layout (0-based).
+ * @param type    The index of the type.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_key_set_type(struct xkb_keymap_builder *builder,
+                                xkb_keycode_t key, xkb_layout_index_t layout,
+                                int type);
+
+/**
+ * Set the keysyms of a level of a key.
+ *
+ * Levels beyond those of the type of the layout are ignored when the
+ * keymap is built.
+ *
+ * @param builder  The keymap builder.
+ * @param key      The keycode of a key added with xkb_keymap_builder_add_key().
+ * @param layout   The layout (0-based).
+ * @param level    The level (0-based).
+ * @param syms     The keysyms.
+ * @param num_syms The number of keysyms, or 0 to clear the level.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_key_set_syms(struct xkb_keymap_builder *builder,
+                                xkb_keycode_t key, xkb_layout_index_t layout,
+                                xkb_level_index_t level,
+                                const xkb_keysym_t *syms, int num_syms);
+
+/**
+ * Set the action of a level of a key.
+ *
+ * @param builder The keymap builder.
+ * @param key     The keycode of a key added with xkb_keymap_builder_add_key().
+ * @param layout  The layout (0-based).
+ * @param level   The level (0-based).
+ * @param action  The action.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_key_set_action(struct xkb_keymap_builder *builder,
+                                  xkb_keycode_t key,
+                                  xkb_layout_index_t layout,
+                                  xkb_level_index_t level,
+                                  const struct xkb_keymap_builder_action *action);
+
+/**
+ * Set the modifiers a key is bound to.
+ *
+ * This is the `modifier_map` for real modifiers, and the `vmods` of the
+ * key for virtual modifiers.
+ *
+ * @param builder The keymap builder.
+ * @param key     The keycode of a key added with xkb_keymap_builder_add_key().
+ * @param mods    The modifiers.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_key_set_mods(struct xkb_keymap_builder *builder,
+                                xkb_keycode_t key, xkb_mod_mask_t mods);
+
+/**
+ * Set whether a key repeats.
+ *
+ * By default, keys without actions repeat.
+ *
+ * @param builder The keymap builder.
+ * @param key     The keycode of a key added with xkb_keymap_builder_add_key().
+ * @param repeats 1 if the key repeats, 0 otherwise.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_key_set_repeats(struct xkb_keymap_builder *builder,
+                                   xkb_keycode_t key, int repeats);
+
+/**
+ * Set the name of a layout.
+ *
+ * @param builder The keymap builder.
+ * @param layout  The layout (0-based).
+ * @param name    The name of the layout.
+ *
+ * @returns 1 on success, or 0 on error.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+int
+xkb_keymap_builder_set_layout_name(struct xkb_keymap_builder *builder,
+                                   xkb_layout_index_t layout,
+                                   const char *name);
+
+/**
+ * Build the keymap.
+ *
+ * The keymap gets the same checks and derived fields as a compiled
+ * keymap.  After this call, the builder is empty again, and may be used
+ * to build another keymap.
+ *
+ * @param builder The keymap builder.
+ *
+ * @returns The keymap, or NULL on failure.
+ *
+ * @memberof xkb_keymap_builder
+ * @since 1.5.0
+ */
+struct xkb_keymap *
+xkb_keymap_builder_build(struct xkb_keymap_builder *builder);
+
+/**
+ * A key to replace with xkb_keymap_new_patched().
+ *
+ * @since 1.5.0
+ */
+struct xkb_keymap_key_patch {
+    /** The keycode of the key. */
+    xkb_keycode_t key;
+    /** The keysyms of the levels of the key, one per level. */
+    const xkb_keysym_t *syms;
+    /** The number of levels, or 0 to leave the key without keysyms. */
+    xkb_level_index_t num_levels;
+};
+
+/**
+ * Create a keymap from another one, with some keys replaced.
+ *
+ * This is meant for servers which need to type a keysym that the keymap
+ * lacks, by binding it to an unused key.  Each patched key gets a single
+ * layout with the given keysyms, whose type is picked the same way as
+ * for a key without an explicit type in a symbols file.  The actions of
+ * the key are bound from the compat interpretations of @p base; its
+ * modifier maps are kept.
+ *
+ * Everything else, including the types and the other keys, is shared
+ * with @p base rather than copied, which is kept alive as long as the
+ * new keymap is.
+ *
+ * @param base        The keymap to patch.  It is not modified.
+ * @param patches     The keys to replace.  If a keycode appears more
+ * than once, the last patch wins.
+ * @param num_patches The number of keys to replace.
+ *
+ * @returns The new keymap, or NULL on error, e.g. if a keycode is out of
+ * the range of @p base.
+ *
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+struct xkb_keymap *
+xkb_keymap_new_patched(struct xkb_keymap *base,
+                       const struct xkb_keymap_key_patch *patches,
+                       size_t num_patches);
+
+/**
+ * Create a keymap from a keymap compiled into C source code.
+ *
+ * The keymap is not parsed nor copied: the returned keymap is the one
+ * in @p data, so this does not allocate memory besides interning its
+ * names into the context.  This is meant for systems which have a
+ * single, built-in keymap and should not need the XKB data files.
+ *
+ * A static keymap can only be used with one context at a time: until
+ * all the references to the keymap are released, this fails for
+ * another context.
+ *
+ * @param context The context in which to create the keymap.
+ * @param data    The compiled keymap.
+ *
+ * @returns A keymap, or NULL if @p data was compiled for another version
+ * of libxkbcommon or is in use with another context.
+ *
+ * @memberof xkb_keymap
+ * @since 1.5.0
+ */
+struct xkb_keymap *
+xkb_keymap_new_from_static(struct xkb_context *context,
+                           struct xkb_static_keymap *data);
+
 /** @} */
 
 /**
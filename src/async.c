@@ -0,0 +1,242 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#include "async.h"
+
+static bool
+open_signal_fd(struct async_job *job)
+{
+#if defined(HAVE_EVENTFD)
+    job->fd = job->signal_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    return job->fd >= 0;
+#elif HAVE_UNISTD_H
+    int fds[2];
+
+    if (pipe(fds) != 0)
+        return false;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+    }
+    job->fd = fds[0];
+    job->signal_fd = fds[1];
+    return true;
+#else
+    /* Nothing to poll; async_job_finish() blocks instead. */
+    job->fd = job->signal_fd = -1;
+    return true;
+#endif
+}
+
+static void
+close_signal_fd(struct async_job *job)
+{
+#if HAVE_UNISTD_H
+    if (job->fd >= 0)
+        close(job->fd);
+    if (job->signal_fd >= 0 && job->signal_fd != job->fd)
+        close(job->signal_fd);
+#endif
+}
+
+static void
+signal_done(struct async_job *job)
+{
+#if defined(HAVE_EVENTFD)
+    const uint64_t one = 1;
+    ssize_t ret;
+
+    do {
+        ret = write(job->signal_fd, &one, sizeof(one));
+    } while (ret < 0 && errno == EINTR);
+#elif HAVE_UNISTD_H
+    const char one = 1;
+    ssize_t ret;
+
+    do {
+        ret = write(job->signal_fd, &one, sizeof(one));
+    } while (ret < 0 && errno == EINTR);
+#else
+    (void) job;
+#endif
+}
+
+static void
+destroy_job(struct async_job *job)
+{
+    if (job->result)
+        job->free_result(job->result);
+    close_signal_fd(job);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&job->lock);
+#endif
+    xkb_context_unref(job->worker_ctx);
+    xkb_context_unref(job->ctx);
+    job->free(job);
+}
+
+/* The log function of the worker context. */
+ATTR_PRINTF(3, 0) static void
+log_job(struct xkb_context *worker_ctx, enum xkb_log_level level,
+        const char *fmt, va_list args)
+{
+    struct async_job *job = xkb_context_get_user_data(worker_ctx);
+
+    /*
+     * Hold the lock while logging, so that async_job_cancel() waits for
+     * the message; once cancelled, job->ctx is gone and nothing is logged.
+     */
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&job->lock);
+#endif
+    if (!job->cancelled)
+        job->log_fn(job->ctx, level, fmt, args);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&job->lock);
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+run_job(void *data)
+{
+    struct async_job *job = data;
+    void *result = job->run(job);
+    bool cancelled;
+
+    pthread_mutex_lock(&job->lock);
+    job->result = result;
+    job->done = true;
+    cancelled = job->cancelled;
+    if (!cancelled)
+        signal_done(job);
+    pthread_mutex_unlock(&job->lock);
+
+    /* The thread was detached; nobody else will touch the job. */
+    if (cancelled)
+        destroy_job(job);
+
+    return NULL;
+}
+#endif
+
+bool
+async_job_start(struct async_job *job)
+{
+    job->result = NULL;
+    job->done = false;
+    job->cancelled = false;
+    job->worker_ctx = NULL;
+    xkb_context_ref(job->ctx);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&job->lock, NULL);
+    job->threaded = false;
+#endif
+
+    if (!open_signal_fd(job)) {
+        log_err(job->ctx, "Couldn't create the completion fd: %s\n",
+                strerror(errno));
+        job->fd = job->signal_fd = -1;
+        destroy_job(job);
+        return false;
+    }
+
+    job->worker_ctx = xkb_context_new_worker(job->ctx);
+    if (!job->worker_ctx) {
+        destroy_job(job);
+        return false;
+    }
+    job->log_fn = job->ctx->log_fn;
+    xkb_context_set_log_fn(job->worker_ctx, log_job);
+    xkb_context_set_user_data(job->worker_ctx, job);
+
+#ifdef HAVE_PTHREAD
+    job->threaded = pthread_create(&job->thread, NULL, run_job, job) == 0;
+    if (job->threaded)
+        return true;
+#endif
+
+    /* No thread: do it now. */
+    job->result = job->run(job);
+    job->done = true;
+    signal_done(job);
+    return true;
+}
+
+void *
+async_job_finish(struct async_job *job)
+{
+    void *result;
+
+#ifdef HAVE_PTHREAD
+    if (job->threaded)
+        pthread_join(job->thread, NULL);
+#endif
+
+    result = job->result;
+    job->result = NULL;
+    if (result)
+        result = job->adopt(job, result);
+
+    destroy_job(job);
+    return result;
+}
+
+void
+async_job_cancel(struct async_job *job)
+{
+#ifdef HAVE_PTHREAD
+    if (job->threaded) {
+        bool done;
+
+        pthread_mutex_lock(&job->lock);
+        done = job->done;
+        job->cancelled = true;
+        /*
+         * If not done, run_job() frees the job once it is.  The caller's
+         * context is released here, since it is not thread-safe.
+         */
+        if (!done) {
+            pthread_detach(job->thread);
+            xkb_context_unref(job->ctx);
+            job->ctx = NULL;
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        if (!done)
+            return;
+        pthread_join(job->thread, NULL);
+    }
+#endif
+
+    destroy_job(job);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "xkbcommon/xkbcommon.h"
+#include "utils.h"
+#include "context.h"
+
+/*
+ * A compilation running on a worker thread, for the *_async() APIs.
+ *
+ * The job runs with a worker context (see xkb_context_new_worker()), so
+ * that the context of the caller can keep being used meanwhile.  The
+ * caller polls fd, which becomes readable once the job is done, then
+ * collects the result with async_job_finish(), or drops it with
+ * async_job_cancel() at any time.
+ *
+ * The worker context logs through the job, which passes the messages on
+ * to the log function of ctx until the job is cancelled: the caller may
+ * free its log data right after cancelling.
+ */
+struct async_job {
+    /* The context of the caller. */
+    struct xkb_context *ctx;
+    struct xkb_context *worker_ctx;
+
+    /* Compiles the result with worker_ctx, on the worker thread. */
+    void *(*run)(struct async_job *job);
+    /* The log function of ctx when the job was started. */
+    ATTR_PRINTF(3, 0) void (*log_fn)(struct xkb_context *ctx,
+                                     enum xkb_log_level level,
+                                     const char *fmt, va_list args);
+    /* Moves the result to ctx, on the calling thread. */
+    void *(*adopt)(struct async_job *job, void *result);
+    void (*free_result)(void *result);
+    /* Frees the job, including the arguments of run. */
+    void (*free)(struct async_job *job);
+
+    void *result;
+    bool done;
+    bool cancelled;
+
+    /* Readable once the job is done; signal_fd is written to. */
+    int fd;
+    int signal_fd;
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+    pthread_t thread;
+    bool threaded;
+#endif
+};
+
+/*
+ * Start the job, whose ctx and callbacks are set.  If threads are not
+ * available, it runs to completion before this returns.  On failure, the
+ * job is freed.
+ */
+bool
+async_job_start(struct async_job *job);
+
+/* Wait for the job, free it, and return its result in the caller's context. */
+void *
+async_job_finish(struct async_job *job);
+
+/* Free the job and its result, now or once the worker thread is done. */
+void
+async_job_cancel(struct async_job *job);
+
+#endif
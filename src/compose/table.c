@@ -27,6 +27,7 @@
 #include "table.h"
 #include "parser.h"
 #include "paths.h"
+#include "async.h"
 
 static struct xkb_compose_table *
 xkb_compose_table_new(struct xkb_context *ctx,
@@ -154,21 +155,16 @@ xkb_compose_table_new_from_buffer(struct xkb_context *ctx,
     return table;
 }
 
-XKB_EXPORT struct xkb_compose_table *
-xkb_compose_table_new_from_locale(struct xkb_context *ctx,
-                                  const char *locale,
-                                  enum xkb_compose_compile_flags flags)
+static struct xkb_compose_table *
+compose_table_new_from_locale(struct xkb_context *ctx,
+                              const char *locale,
+                              enum xkb_compose_compile_flags flags)
 {
     struct xkb_compose_table *table;
     char *path;
     FILE *file;
     bool ok;
 
-    if (flags & ~(XKB_COMPOSE_COMPILE_NO_FLAGS)) {
-        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
-        return NULL;
-    }
-
     table = xkb_compose_table_new(ctx, locale, XKB_COMPOSE_FORMAT_TEXT_V1,
                                   flags);
     if (!table)
@@ -226,3 +222,116 @@ found_path:
     free(path);
     return table;
 }
+
+XKB_EXPORT struct xkb_compose_table *
+xkb_compose_table_new_from_locale(struct xkb_context *ctx,
+                                  const char *locale,
+                                  enum xkb_compose_compile_flags flags)
+{
+    if (flags & ~(XKB_COMPOSE_COMPILE_NO_FLAGS)) {
+        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
+    return compose_table_new_from_locale(ctx, locale, flags);
+}
+
+struct xkb_compose_table_async {
+    struct async_job job;
+    enum xkb_compose_compile_flags flags;
+    char *locale;
+};
+
+static void *
+compose_table_async_run(struct async_job *job)
+{
+    struct xkb_compose_table_async *async =
+        (struct xkb_compose_table_async *) job;
+
+    return compose_table_new_from_locale(job->worker_ctx, async->locale,
+                                         async->flags);
+}
+
+static void *
+compose_table_async_adopt(struct async_job *job, void *result)
+{
+    struct xkb_compose_table *table = result;
+
+    /* The table holds no atoms, so only the context needs moving. */
+    xkb_context_unref(table->ctx);
+    table->ctx = xkb_context_ref(job->ctx);
+
+    return table;
+}
+
+static void
+compose_table_async_free_result(void *result)
+{
+    xkb_compose_table_unref(result);
+}
+
+static void
+compose_table_async_free(struct async_job *job)
+{
+    struct xkb_compose_table_async *async =
+        (struct xkb_compose_table_async *) job;
+
+    free(async->locale);
+    free(async);
+}
+
+XKB_EXPORT struct xkb_compose_table_async *
+xkb_compose_table_new_from_locale_async(struct xkb_context *ctx,
+                                        const char *locale,
+                                        enum xkb_compose_compile_flags flags)
+{
+    struct xkb_compose_table_async *async;
+
+    if (flags & ~(XKB_COMPOSE_COMPILE_NO_FLAGS)) {
+        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
+    async = calloc(1, sizeof(*async));
+    if (!async)
+        return NULL;
+
+    async->locale = strdup(locale);
+    if (!async->locale) {
+        free(async);
+        return NULL;
+    }
+
+    async->flags = flags;
+    async->job.ctx = ctx;
+    async->job.run = compose_table_async_run;
+    async->job.adopt = compose_table_async_adopt;
+    async->job.free_result = compose_table_async_free_result;
+    async->job.free = compose_table_async_free;
+
+    if (!async_job_start(&async->job))
+        return NULL;
+
+    return async;
+}
+
+XKB_EXPORT int
+xkb_compose_table_async_get_fd(struct xkb_compose_table_async *async)
+{
+    return async->job.fd;
+}
+
+XKB_EXPORT struct xkb_compose_table *
+xkb_compose_table_async_finish(struct xkb_compose_table_async *async)
+{
+    return async_job_finish(&async->job);
+}
+
+XKB_EXPORT void
+xkb_compose_table_async_cancel(struct xkb_compose_table_async *async)
+{
+    if (!async)
+        return;
+
+    async_job_cancel(&async->job);
+}
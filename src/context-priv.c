@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
 
 #include "xkbcommon/xkbcommon.h"
 #include "utils.h"
@@ -50,22 +51,178 @@ xkb_context_failed_include_path_get(struct xkb_context *ctx,
     return darray_item(ctx->failed_includes, idx);
 }
 
+#ifdef HAVE_PTHREAD
+static inline void
+context_lock(struct xkb_context *ctx)
+{
+    if (ctx->threaded)
+        pthread_mutex_lock(&ctx->lock);
+}
+
+static inline void
+context_unlock(struct xkb_context *ctx)
+{
+    if (ctx->threaded)
+        pthread_mutex_unlock(&ctx->lock);
+}
+#else
+#define context_lock(ctx) ((void) (ctx))
+#define context_unlock(ctx) ((void) (ctx))
+#endif
+
+bool
+xkb_context_set_threaded(struct xkb_context *ctx, bool threaded)
+{
+#ifdef HAVE_PTHREAD
+    ctx->threaded = threaded;
+    return true;
+#else
+    return !threaded;
+#endif
+}
+
+struct xkb_context *
+xkb_context_new_worker(struct xkb_context *parent)
+{
+    struct xkb_context *ctx;
+    char **path;
+
+    ctx = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES |
+                          XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+    if (!ctx)
+        return NULL;
+
+    ctx->log_fn = parent->log_fn;
+    ctx->log_level = parent->log_level;
+    ctx->log_verbosity = parent->log_verbosity;
+    ctx->user_data = parent->user_data;
+    /* Carry over every flag of @parent which affects compiling. */
+    ctx->parallel_compile = parent->parallel_compile;
+    ctx->rules_disk_cache = parent->rules_disk_cache;
+
+    /* The paths were checked when they were added to @parent. */
+    darray_foreach(path, parent->includes) {
+        char *copy = strdup(*path);
+        if (!copy) {
+            xkb_context_unref(ctx);
+            return NULL;
+        }
+        darray_append(ctx->includes, copy);
+    }
+
+    return ctx;
+}
+
 xkb_atom_t
 xkb_atom_lookup(struct xkb_context *ctx, const char *string)
 {
-    return atom_intern(ctx->atom_table, string, strlen(string), false);
+    xkb_atom_t atom;
+
+    context_lock(ctx);
+    atom = atom_intern(ctx->atom_table, string, strlen(string), false);
+    context_unlock(ctx);
+
+    return atom;
 }
 
 xkb_atom_t
 xkb_atom_intern(struct xkb_context *ctx, const char *string, size_t len)
 {
-    return atom_intern(ctx->atom_table, string, len, true);
+    xkb_atom_t atom;
+
+    context_lock(ctx);
+    atom = atom_intern(ctx->atom_table, string, len, true);
+    context_unlock(ctx);
+
+    return atom;
 }
 
 const char *
 xkb_atom_text(struct xkb_context *ctx, xkb_atom_t atom)
 {
-    return atom_text(ctx->atom_table, atom);
+    const char *text;
+
+    /* The strings themselves never move, only the array holding them. */
+    context_lock(ctx);
+    text = atom_text(ctx->atom_table, atom);
+    context_unlock(ctx);
+
+    return text;
+}
+
+static uint64_t
+profile_now(void)
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+int
+xkb_context_profile_switch_phase(struct xkb_context *ctx, int phase)
+{
+    struct xkb_compile_profile *profile = ctx->profile;
+    int prev_phase = profile->phase;
+    uint64_t now;
+
+    /*
+     * Worker threads are timed as part of the phase of the thread which
+     * waits for them.
+     */
+    if (ctx->threaded)
+        return prev_phase;
+
+    now = profile_now();
+    if (prev_phase != PROFILE_NO_PHASE)
+        profile->phase_time[prev_phase] += now - profile->phase_start;
+    profile->phase = phase;
+    profile->phase_start = now;
+
+    return prev_phase;
+}
+
+void
+xkb_context_profile_count(struct xkb_context *ctx,
+                          enum xkb_compile_counter counter, uint64_t n)
+{
+    context_lock(ctx);
+    ctx->profile->counters[counter] += n;
+    context_unlock(ctx);
+}
+
+/* Keysyms are at most 29 bits, so this bit is free to mark memo entries. */
+#define KEYSYM_MEMO_RESOLVED 0x80000000
+
+xkb_keysym_t
+xkb_keysym_from_atom(struct xkb_context *ctx, xkb_atom_t atom)
+{
+    const char *name;
+    xkb_keysym_t sym = 0;
+
+    context_lock(ctx);
+    if (atom < darray_size(ctx->keysym_memo))
+        sym = darray_item(ctx->keysym_memo, atom);
+    context_unlock(ctx);
+    if (sym & KEYSYM_MEMO_RESOLVED)
+        return sym & ~KEYSYM_MEMO_RESOLVED;
+
+    name = xkb_atom_text(ctx, atom);
+    if (!name)
+        return XKB_KEY_NoSymbol;
+
+    sym = xkb_keysym_from_name(name, XKB_KEYSYM_NO_FLAGS);
+
+    context_lock(ctx);
+    if (atom >= darray_size(ctx->keysym_memo))
+        darray_resize0(ctx->keysym_memo, atom + 1);
+    darray_item(ctx->keysym_memo, atom) = sym | KEYSYM_MEMO_RESOLVED;
+    context_unlock(ctx);
+
+    return sym;
 }
 
 void
@@ -211,11 +211,53 @@ xkb_context_unref(struct xkb_context *ctx)
         return;
 
     free(ctx->x11_atom_cache);
+    xkb_context_free_rules_cache(ctx);
     xkb_context_include_path_clear(ctx);
     atom_table_free(ctx->atom_table);
+    darray_free(ctx->keysym_memo);
+    free(ctx->profile);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&ctx->lock);
+#endif
     free(ctx);
 }
 
+XKB_EXPORT int
+xkb_context_set_compile_profiling(struct xkb_context *ctx, int enable)
+{
+    free(ctx->profile);
+    ctx->profile = NULL;
+
+    if (enable) {
+        ctx->profile = calloc(1, sizeof(*ctx->profile));
+        if (!ctx->profile)
+            return -1;
+        ctx->profile->phase = PROFILE_NO_PHASE;
+    }
+
+    return 0;
+}
+
+XKB_EXPORT uint64_t
+xkb_context_get_compile_phase_time(struct xkb_context *ctx,
+                                   enum xkb_compile_phase phase)
+{
+    if (!ctx->profile || phase < 0 || phase >= _XKB_COMPILE_PHASE_NUM)
+        return 0;
+
+    return ctx->profile->phase_time[phase];
+}
+
+XKB_EXPORT uint64_t
+xkb_context_get_compile_counter(struct xkb_context *ctx,
+                                enum xkb_compile_counter counter)
+{
+    if (!ctx->profile || counter < 0 || counter >= _XKB_COMPILE_COUNTER_NUM)
+        return 0;
+
+    return ctx->profile->counters[counter];
+}
+
 static const char *
 log_level_to_prefix(enum xkb_log_level level)
 {
@@ -295,6 +337,9 @@ xkb_context_new(enum xkb_context_flags flags)
         return NULL;
 
     ctx->refcnt = 1;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&ctx->lock, NULL);
+#endif
     ctx->log_fn = default_log_fn;
     ctx->log_level = XKB_LOG_LEVEL_ERROR;
     ctx->log_verbosity = 0;
@@ -317,6 +362,8 @@ xkb_context_new(enum xkb_context_flags flags)
     }
 
     ctx->use_environment_names = !(flags & XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+    ctx->parallel_compile = !!(flags & XKB_CONTEXT_PARALLEL_COMPILE);
+    ctx->rules_disk_cache = !!(flags & XKB_CONTEXT_RULES_DISK_CACHE);
 
     ctx->atom_table = atom_table_new();
     if (!ctx->atom_table) {
@@ -26,8 +26,26 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include "atom.h"
 
+#define _XKB_COMPILE_PHASE_NUM (XKB_COMPILE_PHASE_DERIVED + 1)
+#define _XKB_COMPILE_COUNTER_NUM (XKB_COMPILE_COUNTER_ALLOCATIONS + 1)
+
+/* No phase is being timed. */
+#define PROFILE_NO_PHASE (-1)
+
+struct xkb_compile_profile {
+    uint64_t phase_time[_XKB_COMPILE_PHASE_NUM];
+    uint64_t counters[_XKB_COMPILE_COUNTER_NUM];
+    /* The phase currently being timed, and since when. */
+    int phase;
+    uint64_t phase_start;
+};
+
 struct xkb_context {
     int refcnt;
 
@@ -45,6 +63,31 @@ struct xkb_context {
 
     struct atom_table *atom_table;
 
+    /*
+     * Memoized xkb_keysym_from_name() results, indexed by the atom of the
+     * name; see xkb_keysym_from_atom(). Entries with KEYSYM_MEMO_RESOLVED
+     * unset were not looked up yet.
+     */
+    darray(xkb_keysym_t) keysym_memo;
+
+#ifdef HAVE_PTHREAD
+    /*
+     * Guards the atom table and the keysym memo while the compiler runs
+     * worker threads; see xkb_context_set_threaded().
+     */
+    pthread_mutex_t lock;
+#endif
+    bool threaded;
+
+    /* NULL unless compile profiling is enabled. */
+    struct xkb_compile_profile *profile;
+
+    /* Parsed include files prepared by the compiler; see include.c. */
+    void *include_cache;
+
+    /* Compiled rules files, kept until they change; see rules.c. */
+    void *rules_cache;
+
     /* Used and allocated by xkbcommon-x11, free()d with the context. */
     void *x11_atom_cache;
 
@@ -53,6 +96,8 @@ struct xkb_context {
     size_t text_next;
 
     unsigned int use_environment_names : 1;
+    unsigned int parallel_compile : 1;
+    unsigned int rules_disk_cache : 1;
 };
 
 unsigned int
@@ -93,9 +138,72 @@ xkb_atom_steal(struct xkb_context *ctx, char *string);
 const char *
 xkb_atom_text(struct xkb_context *ctx, xkb_atom_t atom);
 
+/*
+ * Same as xkb_keysym_from_name(xkb_atom_text(ctx, atom), 0), but
+ * memoized on the context, since keymaps refer to the same keysym
+ * names over and over.
+ */
+xkb_keysym_t
+xkb_keysym_from_atom(struct xkb_context *ctx, xkb_atom_t atom);
+
 char *
 xkb_context_get_buffer(struct xkb_context *ctx, size_t size);
 
+int
+xkb_context_profile_switch_phase(struct xkb_context *ctx, int phase);
+
+void
+xkb_context_profile_count(struct xkb_context *ctx,
+                          enum xkb_compile_counter counter, uint64_t n);
+
+/*
+ * Start timing @phase, returning the phase which was being timed before;
+ * pass that to profile_leave_phase() when done. This nests, and time is
+ * only accounted to the innermost phase.
+ */
+static inline int
+profile_enter_phase(struct xkb_context *ctx, enum xkb_compile_phase phase)
+{
+    if (likely(!ctx->profile))
+        return PROFILE_NO_PHASE;
+    return xkb_context_profile_switch_phase(ctx, phase);
+}
+
+static inline void
+profile_leave_phase(struct xkb_context *ctx, int prev_phase)
+{
+    if (unlikely(ctx->profile))
+        xkb_context_profile_switch_phase(ctx, prev_phase);
+}
+
+static inline void
+profile_count(struct xkb_context *ctx, enum xkb_compile_counter counter,
+              uint64_t n)
+{
+    if (unlikely(ctx->profile))
+        xkb_context_profile_count(ctx, counter, n);
+}
+
+/*
+ * Enable or disable locking of the shared context state used by the
+ * parser (atoms and the keysym memo), around running worker threads.
+ * Returns false if locking is not supported in this build.
+ */
+bool
+xkb_context_set_threaded(struct xkb_context *ctx, bool threaded);
+
+/*
+ * Create a context with the include paths and the logging settings of
+ * @parent, but otherwise independent of it, for compiling on another
+ * thread while @parent is in use; see async.c.
+ */
+struct xkb_context *
+xkb_context_new_worker(struct xkb_context *parent);
+
+/* Free the compiled rules files of the context; see rules.c. */
+void
+xkb_context_free_rules_cache(struct xkb_context *ctx);
+
 ATTR_PRINTF(4, 5) void
 xkb_log(struct xkb_context *ctx, enum xkb_log_level level, int verbosity,
         const char *fmt, ...);
@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "atom.h"
+
+/*
+ * Open addressing hash tables, with linear probing.
+ *
+ * The tables have a power of two size and are kept at most half full.
+ * The keys are mostly atoms and keysyms, which are small and often
+ * consecutive integers.  They are multiplied by an odd constant, and the
+ * low bits of the product give the slot; since the low bits of the
+ * product only depend on the low bits of the key, consecutive keys still
+ * get distinct slots.
+ */
+
+static inline unsigned int
+hash_int(uint32_t key)
+{
+    return key * 2654435761u;
+}
+
+/* The size of a table for @count entries, at least @min_size. */
+static inline unsigned int
+hash_table_size(unsigned int count, unsigned int min_size)
+{
+    unsigned int size = min_size;
+
+    while (size < count * 2)
+        size <<= 1;
+
+    return size;
+}
+
+/* Whether a table of @size is too small for @count entries. */
+static inline bool
+hash_table_is_full(unsigned int count, unsigned int size)
+{
+    return count * 2 > size;
+}
+
+static inline unsigned int
+hash_table_next_slot(unsigned int slot, unsigned int size)
+{
+    return (slot + 1) & (size - 1);
+}
+
+/*
+ * An index of the items of an array: a table of their positions in the
+ * array, plus one, or 0 for the empty slots.
+ */
+struct hash_index {
+    unsigned int *slots;
+    unsigned int size;
+};
+
+#define HASH_INDEX_NONE ((unsigned int) -1)
+
+/* Whether the item at @pos of @array is @key. */
+typedef bool (*hash_index_match_fn)(const void *array, unsigned int pos,
+                                    const void *key);
+/* The hash of the item at @pos of @array. */
+typedef unsigned int (*hash_index_hash_fn)(const void *array,
+                                           unsigned int pos);
+
+static inline void
+hash_index_free(struct hash_index *index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->size = 0;
+}
+
+/* The position of the item which is @key, or HASH_INDEX_NONE. */
+static inline unsigned int
+hash_index_find(const struct hash_index *index, unsigned int hash,
+                hash_index_match_fn match, const void *array,
+                const void *key)
+{
+    unsigned int slot;
+
+    if (index->size == 0)
+        return HASH_INDEX_NONE;
+
+    for (slot = hash & (index->size - 1); index->slots[slot] != 0;
+         slot = hash_table_next_slot(slot, index->size))
+        if (match(array, index->slots[slot] - 1, key))
+            return index->slots[slot] - 1;
+
+    return HASH_INDEX_NONE;
+}
+
+/* Put the item at @pos, which is not in the index yet, in a free slot. */
+static inline void
+hash_index_insert(struct hash_index *index, unsigned int hash,
+                  unsigned int pos)
+{
+    unsigned int slot = hash & (index->size - 1);
+
+    while (index->slots[slot] != 0)
+        slot = hash_table_next_slot(slot, index->size);
+
+    index->slots[slot] = pos + 1;
+}
+
+/*
+ * Add the last of the @count items of @array to the index, growing it
+ * if need be.
+ */
+static inline bool
+hash_index_add_last(struct hash_index *index, hash_index_hash_fn hash,
+                    const void *array, unsigned int count,
+                    unsigned int min_size)
+{
+    if (hash_table_is_full(count, index->size)) {
+        unsigned int size = hash_table_size(count, min_size);
+        unsigned int *slots = calloc(size, sizeof(*slots));
+        if (!slots)
+            return false;
+
+        free(index->slots);
+        index->slots = slots;
+        index->size = size;
+        for (unsigned int pos = 0; pos < count; pos++)
+            hash_index_insert(index, hash(array, pos), pos);
+        return true;
+    }
+
+    hash_index_insert(index, hash(array, count - 1), count - 1);
+    return true;
+}
+
+/*
+ * A set of atoms.  XKB_ATOM_NONE marks the empty slots, so it cannot be
+ * in the set.
+ */
+struct hash_atom_set {
+    xkb_atom_t *atoms;
+    unsigned int size;
+    unsigned int count;
+};
+
+static inline void
+hash_atom_set_free(struct hash_atom_set *set)
+{
+    free(set->atoms);
+    set->atoms = NULL;
+    set->size = set->count = 0;
+}
+
+static inline bool
+hash_atom_set_contains(const struct hash_atom_set *set, xkb_atom_t atom)
+{
+    unsigned int slot;
+
+    if (set->count == 0)
+        return false;
+
+    for (slot = hash_int(atom) & (set->size - 1);
+         set->atoms[slot] != XKB_ATOM_NONE;
+         slot = hash_table_next_slot(slot, set->size))
+        if (set->atoms[slot] == atom)
+            return true;
+
+    return false;
+}
+
+/* Put @atom, which is not in the set yet, in a free slot. */
+static inline void
+hash_atom_set_put(struct hash_atom_set *set, xkb_atom_t atom)
+{
+    unsigned int slot = hash_int(atom) & (set->size - 1);
+
+    while (set->atoms[slot] != XKB_ATOM_NONE)
+        slot = hash_table_next_slot(slot, set->size);
+
+    set->atoms[slot] = atom;
+    set->count++;
+}
+
+/* Add @atom to the set, growing it if need be. */
+static inline bool
+hash_atom_set_insert(struct hash_atom_set *set, xkb_atom_t atom)
+{
+    if (hash_atom_set_contains(set, atom))
+        return true;
+
+    if (hash_table_is_full(set->count + 1, set->size)) {
+        xkb_atom_t *old = set->atoms;
+        unsigned int old_size = set->size;
+        unsigned int size = hash_table_size(set->count + 1, 16);
+        xkb_atom_t *atoms = calloc(size, sizeof(*atoms));
+        if (!atoms)
+            return false;
+
+        set->atoms = atoms;
+        set->size = size;
+        set->count = 0;
+        for (unsigned int i = 0; i < old_size; i++)
+            if (old[i] != XKB_ATOM_NONE)
+                hash_atom_set_put(set, old[i]);
+        free(old);
+    }
+
+    hash_atom_set_put(set, atom);
+    return true;
+}
+
+#endif
@@ -150,3 +150,34 @@ XkbLevelsSameSyms(const struct xkb_level *a, const struct xkb_level *b)
         return a->u.sym == b->u.sym;
     return memcmp(a->u.syms, b->u.syms, sizeof(*a->u.syms) * a->num_syms) == 0;
 }
+
+void
+XkbMapKeymapAtoms(struct xkb_keymap *keymap,
+                  xkb_atom_t (*map)(void *data, xkb_atom_t atom), void *data)
+{
+    struct xkb_key *key;
+    struct xkb_mod *mod;
+    struct xkb_led *led;
+
+    xkb_keys_foreach(key, keymap)
+        key->name = map(data, key->name);
+    for (unsigned i = 0; i < keymap->num_key_aliases; i++) {
+        keymap->key_aliases[i].real = map(data, keymap->key_aliases[i].real);
+        keymap->key_aliases[i].alias = map(data, keymap->key_aliases[i].alias);
+    }
+    for (unsigned i = 0; i < keymap->num_types; i++) {
+        struct xkb_key_type *type = &keymap->types[i];
+        type->name = map(data, type->name);
+        for (unsigned j = 0; j < type->num_level_names; j++)
+            type->level_names[j] = map(data, type->level_names[j]);
+    }
+    xkb_mods_foreach(mod, &keymap->mods)
+        mod->name = map(data, mod->name);
+    for (xkb_layout_index_t i = 0; i < keymap->num_group_names; i++)
+        keymap->group_names[i] = map(data, keymap->group_names[i]);
+    xkb_leds_foreach(led, keymap)
+        led->name = map(data, led->name);
+    if (keymap->components)
+        xkb_mods_foreach(mod, &keymap->components->mods)
+            mod->name = map(data, mod->name);
+}
@@ -52,9 +52,51 @@
 
 #include "config.h"
 
+#include "async.h"
 #include "keymap.h"
 #include "text.h"
 
+static xkb_atom_t
+static_index_to_atom(void *priv, xkb_atom_t index)
+{
+    struct xkb_static_keymap *data = priv;
+
+    return index == XKB_ATOM_NONE ? XKB_ATOM_NONE : data->atoms[index - 1];
+}
+
+static xkb_atom_t
+static_atom_to_index(void *priv, xkb_atom_t atom)
+{
+    struct xkb_static_keymap *data = priv;
+    const char *name = xkb_atom_text(data->keymap.ctx, atom);
+    unsigned int lo = 0, hi = data->num_names;
+
+    if (!name)
+        return XKB_ATOM_NONE;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(name, data->names[mid]);
+        if (cmp == 0)
+            return mid + 1;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return XKB_ATOM_NONE;
+}
+
+/* Turn the atoms of a static keymap back into indices, and release it. */
+static void
+unbind_static_keymap(struct xkb_static_keymap *data)
+{
+    XkbMapKeymapAtoms(&data->keymap, static_atom_to_index, data);
+    xkb_context_unref(data->keymap.ctx);
+    data->keymap.ctx = NULL;
+}
+
 XKB_EXPORT struct xkb_keymap *
 xkb_keymap_ref(struct xkb_keymap *keymap)
 {
@@ -68,9 +110,18 @@ xkb_keymap_unref(struct xkb_keymap *keymap)
     if (!keymap || --keymap->refcnt > 0)
         return;
 
+    if (keymap->static_keymap) {
+        unbind_static_keymap(keymap->static_keymap);
+        return;
+    }
+
     if (keymap->keys) {
         struct xkb_key *key;
         xkb_keys_foreach(key, keymap) {
+            /* Unpatched keys are shared with the parent. */
+            if (keymap->parent &&
+                key->groups == keymap->parent->keys[key->keycode].groups)
+                continue;
             if (key->groups) {
                 for (unsigned i = 0; i < key->num_groups; i++) {
                     if (key->groups[i].levels) {
@@ -85,6 +136,13 @@ xkb_keymap_unref(struct xkb_keymap *keymap)
         }
         free(keymap->keys);
     }
+    /* A patched keymap shares the rest with its parent. */
+    if (keymap->parent) {
+        xkb_keymap_unref(keymap->parent);
+        xkb_context_unref(keymap->ctx);
+        free(keymap);
+        return;
+    }
     if (keymap->types) {
         for (unsigned i = 0; i < keymap->num_types; i++) {
             free(keymap->types[i].entries);
@@ -99,6 +157,13 @@ xkb_keymap_unref(struct xkb_keymap *keymap)
     free(keymap->symbols_section_name);
     free(keymap->types_section_name);
     free(keymap->compat_section_name);
+    if (keymap->components) {
+        free(keymap->components->keycodes);
+        free(keymap->components->types);
+        free(keymap->components->compat);
+        free(keymap->components->symbols);
+        free(keymap->components);
+    }
     xkb_context_unref(keymap->ctx);
     free(keymap);
 }
@@ -116,15 +181,180 @@ get_keymap_format_ops(enum xkb_keymap_format format)
     return keymap_format_ops[(int) format];
 }
 
+static struct xkb_keymap *
+keymap_new_from_names(struct xkb_context *ctx,
+                      enum xkb_keymap_format format,
+                      const struct xkb_keymap_format_ops *ops,
+                      const struct xkb_rule_names *rmlvo_in,
+                      const unsigned long *device_keys,
+                      size_t device_keys_size,
+                      enum xkb_keymap_compile_flags flags)
+{
+    struct xkb_keymap *keymap;
+    struct xkb_rule_names rmlvo;
+    bool ok;
+
+    keymap = xkb_keymap_new(ctx, format, flags);
+    if (!keymap)
+        return NULL;
+
+    if (rmlvo_in)
+        rmlvo = *rmlvo_in;
+    else
+        memset(&rmlvo, 0, sizeof(rmlvo));
+    xkb_context_sanitize_rule_names(ctx, &rmlvo);
+
+    keymap->device_keys = device_keys;
+    keymap->device_keys_size = device_keys_size;
+    ok = ops->keymap_new_from_names(keymap, &rmlvo);
+    keymap->device_keys = NULL;
+    keymap->device_keys_size = 0;
+    if (!ok) {
+        xkb_keymap_unref(keymap);
+        return NULL;
+    }
+
+    return keymap;
+}
+
 XKB_EXPORT struct xkb_keymap *
 xkb_keymap_new_from_names(struct xkb_context *ctx,
                           const struct xkb_rule_names *rmlvo_in,
                           enum xkb_keymap_compile_flags flags)
 {
-    struct xkb_keymap *keymap;
+    const enum xkb_keymap_format format = XKB_KEYMAP_FORMAT_TEXT_V1;
+    const struct xkb_keymap_format_ops *ops;
+
+    ops = get_keymap_format_ops(format);
+    if (!ops || !ops->keymap_new_from_names) {
+        log_err_func(ctx, "unsupported keymap format: %d\n", format);
+        return NULL;
+    }
+
+    if (flags & ~(XKB_KEYMAP_COMPILE_NO_FLAGS)) {
+        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
+    return keymap_new_from_names(ctx, format, ops, rmlvo_in, NULL, 0, flags);
+}
+
+XKB_EXPORT struct xkb_keymap *
+xkb_keymap_new_from_names_for_device(struct xkb_context *ctx,
+                                     const struct xkb_rule_names *rmlvo_in,
+                                     const unsigned long *key_bits,
+                                     size_t key_bits_size,
+                                     enum xkb_keymap_compile_flags flags)
+{
+    const enum xkb_keymap_format format = XKB_KEYMAP_FORMAT_TEXT_V1;
+    const struct xkb_keymap_format_ops *ops;
+
+    ops = get_keymap_format_ops(format);
+    if (!ops || !ops->keymap_new_from_names) {
+        log_err_func(ctx, "unsupported keymap format: %d\n", format);
+        return NULL;
+    }
+
+    if (flags & ~(XKB_KEYMAP_COMPILE_NO_FLAGS)) {
+        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
+    if (!key_bits) {
+        log_err_func1(ctx, "no key bitmap specified\n");
+        return NULL;
+    }
+
+    return keymap_new_from_names(ctx, format, ops, rmlvo_in,
+                                 key_bits, key_bits_size, flags);
+}
+
+struct xkb_keymap_async {
+    struct async_job job;
+    const struct xkb_keymap_format_ops *ops;
+    enum xkb_keymap_format format;
+    enum xkb_keymap_compile_flags flags;
+    /* Sanitized with the caller's context; owned. */
     struct xkb_rule_names rmlvo;
+    /* Set if an atom could not be moved to the caller's context. */
+    bool atom_failed;
+};
+
+static void *
+keymap_async_run(struct async_job *job)
+{
+    struct xkb_keymap_async *async = (struct xkb_keymap_async *) job;
+
+    return keymap_new_from_names(job->worker_ctx, async->format, async->ops,
+                                 &async->rmlvo, NULL, 0, async->flags);
+}
+
+static xkb_atom_t
+keymap_async_map_atom(void *priv, xkb_atom_t atom)
+{
+    struct xkb_keymap_async *async = priv;
+    struct async_job *job = &async->job;
+    const char *text;
+    xkb_atom_t mapped;
+
+    if (atom == XKB_ATOM_NONE)
+        return XKB_ATOM_NONE;
+
+    text = xkb_atom_text(job->worker_ctx, atom);
+    mapped = xkb_atom_intern(job->ctx, text, strlen(text));
+    if (mapped == XKB_ATOM_NONE)
+        async->atom_failed = true;
+    return mapped;
+}
+
+static void *
+keymap_async_adopt(struct async_job *job, void *result)
+{
+    struct xkb_keymap_async *async = (struct xkb_keymap_async *) job;
+    struct xkb_keymap *keymap = result;
+
+    /* The atoms are those of the worker context; intern them in ours. */
+    async->atom_failed = false;
+    XkbMapKeymapAtoms(keymap, keymap_async_map_atom, async);
+    if (async->atom_failed) {
+        log_err(job->ctx, "Failed to intern the names of the keymap\n");
+        xkb_keymap_unref(keymap);
+        return NULL;
+    }
+    xkb_context_unref(keymap->ctx);
+    keymap->ctx = xkb_context_ref(job->ctx);
+
+    return keymap;
+}
+
+static void
+keymap_async_free_result(void *result)
+{
+    xkb_keymap_unref(result);
+}
+
+static void
+keymap_async_free(struct async_job *job)
+{
+    struct xkb_keymap_async *async = (struct xkb_keymap_async *) job;
+
+    free((char *) async->rmlvo.rules);
+    free((char *) async->rmlvo.model);
+    free((char *) async->rmlvo.layout);
+    free((char *) async->rmlvo.variant);
+    free((char *) async->rmlvo.options);
+    free(async);
+}
+
+XKB_EXPORT struct xkb_keymap_async *
+xkb_keymap_new_from_names_async(struct xkb_context *ctx,
+                                const struct xkb_rule_names *rmlvo_in,
+                                enum xkb_keymap_compile_flags flags)
+{
     const enum xkb_keymap_format format = XKB_KEYMAP_FORMAT_TEXT_V1;
     const struct xkb_keymap_format_ops *ops;
+    struct xkb_keymap_async *async;
+    struct xkb_rule_names rmlvo;
 
     ops = get_keymap_format_ops(format);
     if (!ops || !ops->keymap_new_from_names) {
@@ -137,6 +367,88 @@ xkb_keymap_new_from_names(struct xkb_context *ctx,
         return NULL;
     }
 
+    async = calloc(1, sizeof(*async));
+    if (!async)
+        return NULL;
+
+    /* The defaults come from our context, not the worker's. */
+    if (rmlvo_in)
+        rmlvo = *rmlvo_in;
+    else
+        memset(&rmlvo, 0, sizeof(rmlvo));
+    xkb_context_sanitize_rule_names(ctx, &rmlvo);
+    async->rmlvo.rules = strdup_safe(rmlvo.rules);
+    async->rmlvo.model = strdup_safe(rmlvo.model);
+    async->rmlvo.layout = strdup_safe(rmlvo.layout);
+    async->rmlvo.variant = strdup_safe(rmlvo.variant);
+    async->rmlvo.options = strdup_safe(rmlvo.options);
+    if ((rmlvo.rules && !async->rmlvo.rules) ||
+        (rmlvo.model && !async->rmlvo.model) ||
+        (rmlvo.layout && !async->rmlvo.layout) ||
+        (rmlvo.variant && !async->rmlvo.variant) ||
+        (rmlvo.options && !async->rmlvo.options)) {
+        keymap_async_free(&async->job);
+        return NULL;
+    }
+
+    async->ops = ops;
+    async->format = format;
+    async->flags = flags;
+    async->job.ctx = ctx;
+    async->job.run = keymap_async_run;
+    async->job.adopt = keymap_async_adopt;
+    async->job.free_result = keymap_async_free_result;
+    async->job.free = keymap_async_free;
+
+    if (!async_job_start(&async->job))
+        return NULL;
+
+    return async;
+}
+
+XKB_EXPORT int
+xkb_keymap_async_get_fd(struct xkb_keymap_async *async)
+{
+    return async->job.fd;
+}
+
+XKB_EXPORT struct xkb_keymap *
+xkb_keymap_async_finish(struct xkb_keymap_async *async)
+{
+    return async_job_finish(&async->job);
+}
+
+XKB_EXPORT void
+xkb_keymap_async_cancel(struct xkb_keymap_async *async)
+{
+    if (!async)
+        return;
+
+    async_job_cancel(&async->job);
+}
+
+XKB_EXPORT struct xkb_keymap *
+xkb_keymap_new_from_names_incremental(struct xkb_keymap *base,
+                                      const struct xkb_rule_names *rmlvo_in,
+                                      enum xkb_keymap_compile_flags flags)
+{
+    struct xkb_keymap *keymap;
+    struct xkb_rule_names rmlvo;
+    const enum xkb_keymap_format format = XKB_KEYMAP_FORMAT_TEXT_V1;
+    const struct xkb_keymap_format_ops *ops;
+    struct xkb_context *ctx = base->ctx;
+
+    ops = get_keymap_format_ops(format);
+    if (!ops || !ops->keymap_new_from_names_incremental) {
+        log_err_func(ctx, "unsupported keymap format: %d\n", format);
+        return NULL;
+    }
+
+    if (flags & ~(XKB_KEYMAP_COMPILE_NO_FLAGS)) {
+        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
     keymap = xkb_keymap_new(ctx, format, flags);
     if (!keymap)
         return NULL;
@@ -147,7 +459,7 @@ xkb_keymap_new_from_names(struct xkb_context *ctx,
         memset(&rmlvo, 0, sizeof(rmlvo));
     xkb_context_sanitize_rule_names(ctx, &rmlvo);
 
-    if (!ops->keymap_new_from_names(keymap, &rmlvo)) {
+    if (!ops->keymap_new_from_names_incremental(keymap, base, &rmlvo)) {
         xkb_keymap_unref(keymap);
         return NULL;
     }
@@ -239,12 +551,71 @@ xkb_keymap_new_from_file(struct xkb_context *ctx,
     return keymap;
 }
 
+XKB_EXPORT struct xkb_keymap *
+xkb_keymap_new_from_static(struct xkb_context *ctx,
+                           struct xkb_static_keymap *data)
+{
+    struct xkb_keymap *keymap;
+
+    if (!data) {
+        log_err_func1(ctx, "no static keymap specified\n");
+        return NULL;
+    }
+
+    if (data->version != XKB_STATIC_KEYMAP_VERSION ||
+        data->size != sizeof(*data)) {
+        log_err_func1(ctx,
+                      "static keymap was compiled for another version of libxkbcommon\n");
+        return NULL;
+    }
+
+    keymap = &data->keymap;
+    if (keymap->refcnt > 0) {
+        if (keymap->ctx != ctx) {
+            log_err_func1(ctx, "static keymap is in use with another context\n");
+            return NULL;
+        }
+        return xkb_keymap_ref(keymap);
+    }
+
+    /* Intern all the names first, so that failing leaves data untouched. */
+    for (unsigned int i = 0; i < data->num_names; i++) {
+        data->atoms[i] = xkb_atom_intern(ctx, data->names[i],
+                                         strlen(data->names[i]));
+        if (data->atoms[i] == XKB_ATOM_NONE) {
+            log_err_func(ctx, "failed to intern name \"%s\"\n",
+                         data->names[i]);
+            return NULL;
+        }
+    }
+
+    keymap->ctx = xkb_context_ref(ctx);
+    keymap->refcnt = 1;
+    XkbMapKeymapAtoms(keymap, static_index_to_atom, data);
+
+    return keymap;
+}
+
 XKB_EXPORT char *
 xkb_keymap_get_as_string(struct xkb_keymap *keymap,
                          enum xkb_keymap_format format)
+{
+    return xkb_keymap_get_as_string_flags(keymap, format,
+                                          XKB_KEYMAP_SERIALIZE_NO_FLAGS);
+}
+
+XKB_EXPORT char *
+xkb_keymap_get_as_string_flags(struct xkb_keymap *keymap,
+                               enum xkb_keymap_format format,
+                               enum xkb_keymap_serialize_flags flags)
 {
     const struct xkb_keymap_format_ops *ops;
 
+    if (flags & ~(XKB_KEYMAP_SERIALIZE_CANONICAL_TYPES)) {
+        log_err_func(keymap->ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
     if (format == XKB_KEYMAP_USE_ORIGINAL_FORMAT)
         format = keymap->format;
 
@@ -254,7 +625,81 @@ xkb_keymap_get_as_string(struct xkb_keymap *keymap,
         return NULL;
     }
 
-    return ops->keymap_get_as_string(keymap);
+    return ops->keymap_get_as_string(keymap, flags);
+}
+
+XKB_EXPORT int
+xkb_keymap_write(struct xkb_keymap *keymap, enum xkb_keymap_format format,
+                 enum xkb_keymap_serialize_flags flags,
+                 xkb_keymap_write_fn_t write_fn, void *data)
+{
+    const struct xkb_keymap_format_ops *ops;
+
+    if (flags & ~(XKB_KEYMAP_SERIALIZE_CANONICAL_TYPES)) {
+        log_err_func(keymap->ctx, "unrecognized flags: %#x\n", flags);
+        return 0;
+    }
+
+    if (!write_fn) {
+        log_err_func1(keymap->ctx, "no write function specified\n");
+        return 0;
+    }
+
+    if (format == XKB_KEYMAP_USE_ORIGINAL_FORMAT)
+        format = keymap->format;
+
+    ops = get_keymap_format_ops(format);
+    if (!ops || !ops->keymap_write) {
+        log_err_func(keymap->ctx, "unsupported keymap format: %d\n", format);
+        return 0;
+    }
+
+    return ops->keymap_write(keymap, flags, write_fn, data);
+}
+
+#ifdef HAVE_UNISTD_H
+static int
+write_to_fd(void *data, const char *chunk, size_t length)
+{
+    const int fd = *(int *) data;
+
+    while (length > 0) {
+        ssize_t ret = write(fd, chunk, length);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return 0;
+        chunk += ret;
+        length -= ret;
+    }
+
+    return 1;
+}
+#endif
+
+XKB_EXPORT int
+xkb_keymap_write_to_fd(struct xkb_keymap *keymap,
+                       enum xkb_keymap_format format,
+                       enum xkb_keymap_serialize_flags flags, int fd)
+{
+#ifdef HAVE_UNISTD_H
+    if (fd < 0) {
+        log_err_func(keymap->ctx, "invalid file descriptor: %d\n", fd);
+        return 0;
+    }
+
+    if (!xkb_keymap_write(keymap, format, flags, write_to_fd, &fd)) {
+        log_err_func(keymap->ctx, "failed to write to file descriptor %d\n",
+                     fd);
+        return 0;
+    }
+
+    return 1;
+#else
+    log_err_func1(keymap->ctx,
+                  "writing to a file descriptor is not supported\n");
+    return 0;
+#endif
 }
 
 /**
@@ -358,6 +358,20 @@ struct xkb_mod_set {
     unsigned int num_mods;
 };
 
+/*
+ * The KcCGST components a keymap was compiled from, if it was compiled
+ * from RMLVO names, so that xkb_keymap_new_from_names_incremental() can
+ * tell which sections need to be compiled again.
+ */
+struct xkb_keymap_components {
+    char *keycodes;
+    char *types;
+    char *compat;
+    char *symbols;
+    /* keymap->mods before the symbols section was compiled. */
+    struct xkb_mod_set mods;
+};
+
 /* Common keyboard description structure */
 struct xkb_keymap {
     struct xkb_context *ctx;
@@ -397,8 +411,54 @@ struct xkb_keymap {
     char *symbols_section_name;
     char *types_section_name;
     char *compat_section_name;
+
+    struct xkb_keymap_components *components;
+
+    /*
+     * The keymap this one was patched from, see xkb_keymap_new_patched().
+     * Everything but the keys array and the groups of the patched keys
+     * is shared with it.
+     */
+    struct xkb_keymap *parent;
+
+    /*
+     * The static keymap this one is, see xkb_keymap_new_from_static().
+     * Nothing in it is owned by the keymap.
+     */
+    struct xkb_static_keymap *static_keymap;
+
+    /*
+     * While compiling a keymap for a device, the EVIOCGBIT bitmap of its
+     * keys, see xkb_keymap_new_from_names_for_device().  The other keys
+     * are left out.
+     */
+    const unsigned long *device_keys;
+    size_t device_keys_size;
 };
 
+/*
+ * A keymap compiled into C source code by keymap_get_as_c_source().
+ * While the keymap is not in use, its atom fields hold the index of
+ * their string in names plus one rather than an atom.
+ */
+struct xkb_static_keymap {
+    /* XKB_STATIC_KEYMAP_VERSION when the keymap was compiled. */
+    unsigned int version;
+    size_t size;
+    /* Sorted with strcmp(). */
+    const char *const *names;
+    unsigned int num_names;
+    /* Room for the atoms of names while binding the keymap. */
+    xkb_atom_t *atoms;
+    struct xkb_keymap keymap;
+};
+
+/*
+ * Bump when the layout of the keymap structures changes, so that the
+ * static keymaps compiled before are rejected.
+ */
+#define XKB_STATIC_KEYMAP_VERSION 1
+
 #define xkb_keys_foreach(iter, keymap) \
     for ((iter) = (keymap)->keys + (keymap)->min_key_code; \
          (iter) <= (keymap)->keys + (keymap)->max_key_code; \
@@ -432,6 +492,24 @@ XkbKey(struct xkb_keymap *keymap, xkb_keycode_t kc)
     return &keymap->keys[kc];
 }
 
+/* Whether a key is kept when compiling the keymap, see device_keys. */
+static inline bool
+XkbKeycodeOnDevice(const struct xkb_keymap *keymap, xkb_keycode_t kc)
+{
+    const size_t long_bits = sizeof(*keymap->device_keys) * 8;
+    xkb_keycode_t code;
+
+    if (!keymap->device_keys)
+        return true;
+    if (kc < 8)
+        return false;
+
+    code = kc - 8;
+    if (code / long_bits >= keymap->device_keys_size / sizeof(long))
+        return false;
+    return keymap->device_keys[code / long_bits] & (1ul << (code % long_bits));
+}
+
 static inline xkb_level_index_t
 XkbKeyNumLevels(const struct xkb_key *key, xkb_layout_index_t layout)
 {
@@ -476,16 +554,31 @@ XkbWrapGroupIntoRange(int32_t group,
                       enum xkb_range_exceed_type out_of_range_group_action,
                       xkb_layout_index_t out_of_range_group_number);
 
+/*
+ * Replace every atom in the keymap with map(data, atom), e.g. to move it
+ * to another context.
+ */
+void
+XkbMapKeymapAtoms(struct xkb_keymap *keymap,
+                  xkb_atom_t (*map)(void *data, xkb_atom_t atom), void *data);
+
 xkb_mod_mask_t
 mod_mask_get_effective(struct xkb_keymap *keymap, xkb_mod_mask_t mods);
 
 struct xkb_keymap_format_ops {
     bool (*keymap_new_from_names)(struct xkb_keymap *keymap,
                                   const struct xkb_rule_names *names);
+    bool (*keymap_new_from_names_incremental)(struct xkb_keymap *keymap,
+                                              const struct xkb_keymap *base,
+                                              const struct xkb_rule_names *names);
     bool (*keymap_new_from_string)(struct xkb_keymap *keymap,
                                    const char *string, size_t length);
     bool (*keymap_new_from_file)(struct xkb_keymap *keymap, FILE *file);
-    char *(*keymap_get_as_string)(struct xkb_keymap *keymap);
+    char *(*keymap_get_as_string)(struct xkb_keymap *keymap,
+                                  enum xkb_keymap_serialize_flags flags);
+    bool (*keymap_write)(struct xkb_keymap *keymap,
+                         enum xkb_keymap_serialize_flags flags,
+                         xkb_keymap_write_fn_t write_fn, void *data);
 };
 
 extern const struct xkb_keymap_format_ops text_v1_keymap_format_ops;
@@ -838,6 +838,13 @@ static const struct codepair keysymtab[] = {
     { 0x20ac, 0x20ac }, /*                    EuroSign € EURO SIGN */
 };
 
+/*
+ * ucstab[] is keysymtab[] sorted by Unicode value, with only the first
+ * keysym of keysymtab[] for each value.  Regenerate it with
+ * scripts/makeutf32 whenever keysymtab[] changes.
+ */
+#include "ks_utf_tables.h"
+
 /* binary search with range check */
 static uint32_t
 bin_search(const struct codepair *table, size_t length, xkb_keysym_t keysym)
@@ -917,10 +924,22 @@ xkb_utf32_to_keysym(uint32_t ucs)
         ucs > 0x10ffff || (ucs & 0xfffe) == 0xfffe)
         return XKB_KEY_NoSymbol;
 
-    /* search main table */
-    for (size_t i = 0; i < ARRAY_SIZE(keysymtab); i++)
-        if (keysymtab[i].ucs == ucs)
-            return keysymtab[i].keysym;
+    /* binary search in the table sorted by Unicode value */
+    if (ucs >= ucstab[0].ucs && ucs <= ucstab[ARRAY_SIZE(ucstab) - 1].ucs) {
+        size_t first = 0;
+        size_t last = ARRAY_SIZE(ucstab);
+
+        while (first < last) {
+            size_t mid = (first + last) / 2;
+            if (ucstab[mid].ucs < ucs)
+                first = mid + 1;
+            else
+                last = mid;
+        }
+
+        if (ucstab[first].ucs == ucs)
+            return ucstab[first].keysym;
+    }
 
     /* Use direct encoding if everything else fails */
     return ucs | 0x01000000;
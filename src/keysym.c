@@ -61,14 +61,9 @@ get_name(const struct name_keysym *entry)
     return keysym_names + entry->offset;
 }
 
-XKB_EXPORT int
-xkb_keysym_get_name(xkb_keysym_t ks, char *buffer, size_t size)
+const char *
+xkb_keysym_name(xkb_keysym_t ks)
 {
-    if ((ks & ((unsigned long) ~0x1fffffff)) != 0) {
-        snprintf(buffer, size, "Invalid");
-        return -1;
-    }
-
     int32_t lo = 0, hi = ARRAY_SIZE(keysym_to_name) - 1;
     while (hi >= lo) {
         int32_t mid = (lo + hi) / 2;
@@ -77,10 +72,27 @@ xkb_keysym_get_name(xkb_keysym_t ks, char *buffer, size_t size)
         } else if (ks < keysym_to_name[mid].keysym) {
             hi = mid - 1;
         } else {
-            return snprintf(buffer, size, "%s", get_name(&keysym_to_name[mid]));
+            return get_name(&keysym_to_name[mid]);
         }
     }
 
+    return NULL;
+}
+
+XKB_EXPORT int
+xkb_keysym_get_name(xkb_keysym_t ks, char *buffer, size_t size)
+{
+    const char *name;
+
+    if ((ks & ((unsigned long) ~0x1fffffff)) != 0) {
+        snprintf(buffer, size, "Invalid");
+        return -1;
+    }
+
+    name = xkb_keysym_name(ks);
+    if (name)
+        return snprintf(buffer, size, "%s", name);
+
     /* Unnamed Unicode codepoint. */
     if (ks >= 0x01000100 && ks <= 0x0110ffff) {
         const int width = (ks & 0xff0000UL) ? 8 : 4;
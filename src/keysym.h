@@ -50,6 +50,10 @@
 #ifndef KEYSYM_H
 #define KEYSYM_H
 
+/* The name of @ks in the keysym table, or NULL if it has none. */
+const char *
+xkb_keysym_name(xkb_keysym_t ks);
+
 bool
 xkb_keysym_is_lower(xkb_keysym_t keysym);
 
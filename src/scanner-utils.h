@@ -24,6 +24,12 @@
 #ifndef XKBCOMP_SCANNER_UTILS_H
 #define XKBCOMP_SCANNER_UTILS_H
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* Point to some substring in the file; used to avoid copying. */
 struct sval {
     const char *start;
@@ -43,25 +49,184 @@ svaleq_prefix(struct sval s1, struct sval s2)
     return s1.len <= s2.len && memcmp(s1.start, s2.start, s1.len) == 0;
 }
 
+/*
+ * Bulk character class scanning.
+ *
+ * These return the length of the longest prefix of p[0..n) whose
+ * characters all belong to some class. When available, 32 (AVX2) or
+ * 16 (SSE2) characters are classified at a time; the remainder, and
+ * builds without these instruction sets, use the scalar predicates.
+ * Chars >= 0x80 are negative when compared as signed, so they never
+ * fall inside the ASCII ranges tested below.
+ */
+
+#if defined(__AVX2__)
+#define SIMD256_SET(c) _mm256_set1_epi8(c)
+#define SIMD256_IN_RANGE(v, lo, hi) _mm256_and_si256( \
+    _mm256_cmpgt_epi8((v), SIMD256_SET((lo) - 1)), \
+    _mm256_cmpgt_epi8(SIMD256_SET((hi) + 1), (v)))
+#endif
+#if defined(__SSE2__)
+#define SIMD128_SET(c) _mm_set1_epi8(c)
+#define SIMD128_IN_RANGE(v, lo, hi) _mm_and_si128( \
+    _mm_cmpgt_epi8((v), SIMD128_SET((lo) - 1)), \
+    _mm_cmpgt_epi8(SIMD128_SET((hi) + 1), (v)))
+#endif
+
+/* is_space(). */
+static inline size_t
+span_space(const char *p, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+        const __m256i m = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, SIMD256_SET(' ')),
+            SIMD256_IN_RANGE(v, '\t', '\r'));
+        const uint32_t stop = ~(uint32_t) _mm256_movemask_epi8(m);
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        const __m128i m = _mm_or_si128(
+            _mm_cmpeq_epi8(v, SIMD128_SET(' ')),
+            SIMD128_IN_RANGE(v, '\t', '\r'));
+        const uint32_t stop = ~(uint32_t) _mm_movemask_epi8(m) & 0xffff;
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#endif
+    while (i < n && is_space(p[i]))
+        i++;
+    return i;
+}
+
+/* is_alnum() or '_'. */
+static inline size_t
+span_ident(const char *p, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+        /* Setting bit 0x20 folds upper case into lower case. */
+        const __m256i lower = _mm256_or_si256(v, SIMD256_SET(0x20));
+        const __m256i m = _mm256_or_si256(
+            _mm256_or_si256(SIMD256_IN_RANGE(lower, 'a', 'z'),
+                            SIMD256_IN_RANGE(v, '0', '9')),
+            _mm256_cmpeq_epi8(v, SIMD256_SET('_')));
+        const uint32_t stop = ~(uint32_t) _mm256_movemask_epi8(m);
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        const __m128i lower = _mm_or_si128(v, SIMD128_SET(0x20));
+        const __m128i m = _mm_or_si128(
+            _mm_or_si128(SIMD128_IN_RANGE(lower, 'a', 'z'),
+                         SIMD128_IN_RANGE(v, '0', '9')),
+            _mm_cmpeq_epi8(v, SIMD128_SET('_')));
+        const uint32_t stop = ~(uint32_t) _mm_movemask_epi8(m) & 0xffff;
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#endif
+    while (i < n && (is_alnum(p[i]) || p[i] == '_'))
+        i++;
+    return i;
+}
+
+/* Anything but '"', '\\' and '\n', i.e. plain string literal contents. */
+static inline size_t
+span_string(const char *p, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+        const __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, SIMD256_SET('"')),
+                            _mm256_cmpeq_epi8(v, SIMD256_SET('\\'))),
+            _mm256_cmpeq_epi8(v, SIMD256_SET('\n')));
+        const uint32_t stop = (uint32_t) _mm256_movemask_epi8(m);
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        const __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, SIMD128_SET('"')),
+                         _mm_cmpeq_epi8(v, SIMD128_SET('\\'))),
+            _mm_cmpeq_epi8(v, SIMD128_SET('\n')));
+        const uint32_t stop = (uint32_t) _mm_movemask_epi8(m);
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#endif
+    while (i < n && p[i] != '"' && p[i] != '\\' && p[i] != '\n')
+        i++;
+    return i;
+}
+
 struct scanner {
     const char *s;
     size_t pos;
     size_t len;
     char buf[1024];
     size_t buf_pos;
-    size_t line, column;
-    /* The line/column of the start of the current token. */
-    size_t token_line, token_column;
+    /* The offset of the start of the current token. */
+    size_t token_pos;
+    /*
+     * Line and column numbers are only needed for diagnostics, so they
+     * are not tracked while scanning; instead they are computed on demand
+     * from the token offset, see scanner_token_location(). These cache
+     * the last computed location, so that successive lookups only need
+     * to look at the text in between.
+     */
+    size_t cached_pos, cached_line, cached_line_start;
     const char *file_name;
     struct xkb_context *ctx;
     void *priv;
 };
 
-#define scanner_log(scanner, level, fmt, ...) \
+static inline void
+scanner_token_location(struct scanner *s, size_t *line, size_t *column)
+{
+    const char *p, *end, *nl;
+
+    if (s->token_pos < s->cached_pos) {
+        s->cached_pos = s->cached_line_start = 0;
+        s->cached_line = 1;
+    }
+
+    p = s->s + s->cached_pos;
+    end = s->s + s->token_pos;
+    while ((nl = memchr(p, '\n', end - p))) {
+        s->cached_line++;
+        s->cached_line_start = nl - s->s + 1;
+        p = nl + 1;
+    }
+    s->cached_pos = s->token_pos;
+
+    *line = s->cached_line;
+    *column = s->token_pos - s->cached_line_start + 1;
+}
+
+#define scanner_log(scanner, level, fmt, ...) do { \
+    size_t line_, column_; \
+    scanner_token_location((scanner), &line_, &column_); \
     xkb_log((scanner)->ctx, (level), 0, \
             "%s:%zu:%zu: " fmt "\n", \
-             (scanner)->file_name, \
-             (scanner)->token_line, (scanner)->token_column, ##__VA_ARGS__)
+            (scanner)->file_name, line_, column_, ##__VA_ARGS__); \
+} while (0)
 
 #define scanner_err(scanner, fmt, ...) \
     scanner_log(scanner, XKB_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
@@ -77,8 +242,9 @@ scanner_init(struct scanner *s, struct xkb_context *ctx,
     s->s = string;
     s->len = len;
     s->pos = 0;
-    s->line = s->column = 1;
-    s->token_line = s->token_column = 1;
+    s->token_pos = 0;
+    s->cached_pos = s->cached_line_start = 0;
+    s->cached_line = 1;
     s->file_name = file_name;
     s->ctx = ctx;
     s->priv = priv;
@@ -108,9 +274,7 @@ static inline void
 skip_to_eol(struct scanner *s)
 {
     const char *nl = memchr(s->s + s->pos, '\n', s->len - s->pos);
-    const size_t new_pos = nl ? (size_t) (nl - s->s) : s->len;
-    s->column += new_pos - s->pos;
-    s->pos = new_pos;
+    s->pos = nl ? (size_t) (nl - s->s) : s->len;
 }
 
 static inline char
@@ -118,13 +282,6 @@ next(struct scanner *s)
 {
     if (unlikely(eof(s)))
         return '\0';
-    if (unlikely(eol(s))) {
-        s->line++;
-        s->column = 1;
-    }
-    else {
-        s->column++;
-    }
     return s->s[s->pos++];
 }
 
@@ -133,7 +290,7 @@ chr(struct scanner *s, char ch)
 {
     if (likely(peek(s) != ch))
         return false;
-    s->pos++; s->column++;
+    s->pos++;
     return true;
 }
 
@@ -144,10 +301,16 @@ str(struct scanner *s, const char *string, size_t len)
         return false;
     if (memcmp(s->s + s->pos, string, len) != 0)
         return false;
-    s->pos += len; s->column += len;
+    s->pos += len;
     return true;
 }
 
+static inline void
+skip_space(struct scanner *s)
+{
+    s->pos += span_space(s->s + s->pos, s->len - s->pos);
+}
+
 #define lit(s, literal) str(s, literal, sizeof(literal) - 1)
 
 static inline bool
@@ -159,6 +322,21 @@ buf_append(struct scanner *s, char ch)
     return true;
 }
 
+/* Like buf_append(), for a run of characters. */
+static inline bool
+buf_appendn(struct scanner *s, const char *chars, size_t len)
+{
+    if (s->buf_pos + len >= sizeof(s->buf)) {
+        len = sizeof(s->buf) - 1 - s->buf_pos;
+        memcpy(s->buf + s->buf_pos, chars, len);
+        s->buf_pos += len;
+        return false;
+    }
+    memcpy(s->buf + s->buf_pos, chars, len);
+    s->buf_pos += len;
+    return true;
+}
+
 static inline bool
 buf_appends(struct scanner *s, const char *str)
 {
@@ -0,0 +1,151 @@
+
+/**
+ * This file was generated by scripts/makelookup from src/text.c
+ * Run scripts/update-lookup to regenerate it.
+ */
+
+static size_t
+lookup_hash_f(const char *key, const char *T, size_t NG)
+{
+    size_t sum = 0;
+    for (size_t i = 0; key[i] != '\0'; i++) {
+        char c = key[i];
+        if (c >= 'A' && c <= 'Z')
+            c = (char) (c - 'A' + 'a');
+        sum += T[i % 32] * c;
+    }
+    return sum % NG;
+}
+
+static const uint8_t ctrlMaskEntries_G[] = {
+    0, 17, 16, 1, 12, 0, 10, 8, 7, 12, 4, 11, 6, 17, 6, 14,
+    1, 6
+};
+
+static size_t
+ctrlMaskEntries_perfect_hash(const char *key)
+{
+    return (
+        ctrlMaskEntries_G[lookup_hash_f(key, "vwHPMZzENLFkro37sksBPUQ5DclC3ehF", 18)] +
+        ctrlMaskEntries_G[lookup_hash_f(key, "4skpcNyJZjjbz4By8C2S90deSwqUlD09", 18)]
+    ) % 18;
+}
+
+static const uint8_t modComponentMaskEntries_G[] = {
+    0, 2, 4, 4, 1, 2, 6, 5
+};
+
+static size_t
+modComponentMaskEntries_perfect_hash(const char *key)
+{
+    return (
+        modComponentMaskEntries_G[lookup_hash_f(key, "213leYWhVCIFSAwrfWzfpibMiSsF7DYt", 8)] +
+        modComponentMaskEntries_G[lookup_hash_f(key, "cl9nsujneuorEBvA1fFt9ujCjcExAuvS", 8)]
+    ) % 8;
+}
+
+static const uint8_t groupComponentMaskEntries_G[] = {
+    0, 3, 6, 5, 6, 3, 2
+};
+
+static size_t
+groupComponentMaskEntries_perfect_hash(const char *key)
+{
+    return (
+        groupComponentMaskEntries_G[lookup_hash_f(key, "CKjQytVR4LAtbgTti3dxfxYW4kJogtrl", 7)] +
+        groupComponentMaskEntries_G[lookup_hash_f(key, "PRcg6uJjdqIqfTBoMj7yg1jIMsMG9fnx", 7)]
+    ) % 7;
+}
+
+static const uint8_t groupMaskEntries_G[] = {
+    0, 6, 9, 9, 1, 7, 5, 6, 4, 10, 2
+};
+
+static size_t
+groupMaskEntries_perfect_hash(const char *key)
+{
+    return (
+        groupMaskEntries_G[lookup_hash_f(key, "XJigJNwGJl5pklCBQ0eo6lL9qbIqUDm0", 11)] +
+        groupMaskEntries_G[lookup_hash_f(key, "mJ6wa81x6EYbbeQxOgF95zHEr6D3EuM1", 11)]
+    ) % 11;
+}
+
+static const uint8_t groupEntries_G[] = {
+    0, 4, 2, 6, 1, 5, 0, 1, 5
+};
+
+static size_t
+groupEntries_perfect_hash(const char *key)
+{
+    return (
+        groupEntries_G[lookup_hash_f(key, "xk5mVPGJ6GBnXYHK9987qZtDONLY0HS2", 9)] +
+        groupEntries_G[lookup_hash_f(key, "dEep8bJxw25XFwVV85xGR37aInDf6eRh", 9)]
+    ) % 9;
+}
+
+static const uint8_t levelEntries_G[] = {
+    0, 2, 2, 3, 4, 6, 7, 7, 0
+};
+
+static size_t
+levelEntries_perfect_hash(const char *key)
+{
+    return (
+        levelEntries_G[lookup_hash_f(key, "tQCgqSfckAHigv6sg8o0xXhMzYLJEUzJ", 9)] +
+        levelEntries_G[lookup_hash_f(key, "mx0zLGlBNEsNmMn8qqH05w0VItHR29lF", 9)]
+    ) % 9;
+}
+
+static const uint8_t buttonEntries_G[] = {
+    0, 1, 2, 0, 4, 5, 6
+};
+
+static size_t
+buttonEntries_perfect_hash(const char *key)
+{
+    return (
+        buttonEntries_G[lookup_hash_f(key, "bS9pdGaOPTeVKKjzPpXcD5sAjvbWEWm2", 7)] +
+        buttonEntries_G[lookup_hash_f(key, "TH9Nsnk2Im6nLMLAtsKDdurjKv2hjQMc", 7)]
+    ) % 7;
+}
+
+static const uint8_t useModMapValueEntries_G[] = {
+    0, 1, 0, 3, 1
+};
+
+static size_t
+useModMapValueEntries_perfect_hash(const char *key)
+{
+    return (
+        useModMapValueEntries_G[lookup_hash_f(key, "JQ4O1gxHVlVtwaMSJG2wyxjnfZgsyfOe", 5)] +
+        useModMapValueEntries_G[lookup_hash_f(key, "utwhqDG9TSw1TJNyF17ZQSZ1786NqmsG", 5)]
+    ) % 5;
+}
+
+static const uint8_t actionTypeEntries_G[] = {
+    0, 51, 40, 0, 7, 51, 12, 0, 53, 27, 0, 3, 40, 1, 43, 1,
+    0, 17, 20, 0, 49, 6, 11, 0, 13, 14, 32, 47, 13, 36, 41, 9, 0, 0, 23, 0,
+    42, 50, 9, 0, 7, 15, 42, 49, 53, 15, 0, 22, 21, 18, 15, 26, 0, 30
+};
+
+static size_t
+actionTypeEntries_perfect_hash(const char *key)
+{
+    return (
+        actionTypeEntries_G[lookup_hash_f(key, "Pzzjxq6ebQyr4PhXN76d5m6QVs8x3zZG", 54)] +
+        actionTypeEntries_G[lookup_hash_f(key, "UX94AQVv47S6745XsPmpUuyrRsma4Wrx", 54)]
+    ) % 54;
+}
+
+static const uint8_t symInterpretMatchMaskEntries_G[] = {
+    0, 2, 2, 0, 1, 5
+};
+
+static size_t
+symInterpretMatchMaskEntries_perfect_hash(const char *key)
+{
+    return (
+        symInterpretMatchMaskEntries_G[lookup_hash_f(key, "kbs3bN4e1BiNuAOh7GHsQjE18HhqwbHM", 6)] +
+        symInterpretMatchMaskEntries_G[lookup_hash_f(key, "U4fYQPTor9Rx9VVxGavULSKiLrJ5tVzP", 6)]
+    ) % 6;
+}
@@ -28,15 +28,25 @@
 
 #include "keymap.h"
 #include "text.h"
+#include "text-lookup.h"
 
 bool
-LookupString(const LookupEntry tab[], const char *string,
+LookupString(const LookupTable *tab, const char *string,
               unsigned int *value_rtrn)
 {
     if (!string)
         return false;
 
-    for (const LookupEntry *entry = tab; entry->name; entry++) {
+    if (tab->perfect_hash) {
+        size_t pos = tab->perfect_hash(string);
+        if (pos < tab->num_entries && istreq(tab->entries[pos].name, string)) {
+            *value_rtrn = tab->entries[pos].value;
+            return true;
+        }
+        return false;
+    }
+
+    for (const LookupEntry *entry = tab->entries; entry->name; entry++) {
         if (istreq(entry->name, string)) {
             *value_rtrn = entry->value;
             return true;
@@ -47,16 +57,16 @@ LookupString(const LookupEntry tab[], const char *string,
 }
 
 const char *
-LookupValue(const LookupEntry tab[], unsigned int value)
+LookupValue(const LookupTable *tab, unsigned int value)
 {
-    for (const LookupEntry *entry = tab; entry->name; entry++)
+    for (const LookupEntry *entry = tab->entries; entry->name; entry++)
         if (entry->value == value)
             return entry->name;
 
     return NULL;
 }
 
-const LookupEntry ctrlMaskNames[] = {
+static const LookupEntry ctrlMaskEntries[] = {
     { "RepeatKeys", CONTROL_REPEAT },
     { "Repeat", CONTROL_REPEAT },
     { "AutoRepeat", CONTROL_REPEAT },
@@ -77,7 +87,9 @@ const LookupEntry ctrlMaskNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry modComponentMaskNames[] = {
+const LookupTable ctrlMaskNames = LOOKUP_TABLE(ctrlMaskEntries);
+
+static const LookupEntry modComponentMaskEntries[] = {
     { "base", XKB_STATE_MODS_DEPRESSED },
     { "latched", XKB_STATE_MODS_LATCHED },
     { "locked", XKB_STATE_MODS_LOCKED },
@@ -88,7 +100,9 @@ const LookupEntry modComponentMaskNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry groupComponentMaskNames[] = {
+const LookupTable modComponentMaskNames = LOOKUP_TABLE(modComponentMaskEntries);
+
+static const LookupEntry groupComponentMaskEntries[] = {
     { "base", XKB_STATE_LAYOUT_DEPRESSED },
     { "latched", XKB_STATE_LAYOUT_LATCHED },
     { "locked", XKB_STATE_LAYOUT_LOCKED },
@@ -98,7 +112,9 @@ const LookupEntry groupComponentMaskNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry groupMaskNames[] = {
+const LookupTable groupComponentMaskNames = LOOKUP_TABLE(groupComponentMaskEntries);
+
+static const LookupEntry groupMaskEntries[] = {
     { "Group1", 0x01 },
     { "Group2", 0x02 },
     { "Group3", 0x04 },
@@ -112,7 +128,9 @@ const LookupEntry groupMaskNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry groupNames[] = {
+const LookupTable groupMaskNames = LOOKUP_TABLE(groupMaskEntries);
+
+static const LookupEntry groupEntries[] = {
     { "Group1", 1 },
     { "Group2", 2 },
     { "Group3", 3 },
@@ -124,7 +142,9 @@ const LookupEntry groupNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry levelNames[] = {
+const LookupTable groupNames = LOOKUP_TABLE(groupEntries);
+
+static const LookupEntry levelEntries[] = {
     { "Level1", 1 },
     { "Level2", 2 },
     { "Level3", 3 },
@@ -136,7 +156,9 @@ const LookupEntry levelNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry buttonNames[] = {
+const LookupTable levelNames = LOOKUP_TABLE(levelEntries);
+
+static const LookupEntry buttonEntries[] = {
     { "Button1", 1 },
     { "Button2", 2 },
     { "Button3", 3 },
@@ -146,7 +168,9 @@ const LookupEntry buttonNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry useModMapValueNames[] = {
+const LookupTable buttonNames = LOOKUP_TABLE(buttonEntries);
+
+static const LookupEntry useModMapValueEntries[] = {
     { "LevelOne", 1 },
     { "Level1", 1 },
     { "AnyLevel", 0 },
@@ -154,7 +178,9 @@ const LookupEntry useModMapValueNames[] = {
     { NULL, 0 }
 };
 
-const LookupEntry actionTypeNames[] = {
+const LookupTable useModMapValueNames = LOOKUP_TABLE(useModMapValueEntries);
+
+static const LookupEntry actionTypeEntries[] = {
     { "NoAction", ACTION_TYPE_NONE },
     { "SetMods", ACTION_TYPE_MOD_SET },
     { "LatchMods", ACTION_TYPE_MOD_LATCH },
@@ -200,7 +226,9 @@ const LookupEntry actionTypeNames[] = {
     { NULL, 0 },
 };
 
-const LookupEntry symInterpretMatchMaskNames[] = {
+const LookupTable actionTypeNames = LOOKUP_TABLE(actionTypeEntries);
+
+static const LookupEntry symInterpretMatchMaskEntries[] = {
     { "NoneOf", MATCH_NONE },
     { "AnyOfOrNone", MATCH_ANY_OR_NONE },
     { "AnyOf", MATCH_ANY },
@@ -209,6 +237,8 @@ const LookupEntry symInterpretMatchMaskNames[] = {
     { NULL, 0 },
 };
 
+const LookupTable symInterpretMatchMaskNames = LOOKUP_TABLE(symInterpretMatchMaskEntries);
+
 const char *
 ModIndexText(struct xkb_context *ctx, const struct xkb_mod_set *mods,
              xkb_mod_index_t ndx)
@@ -225,7 +255,7 @@ ModIndexText(struct xkb_context *ctx, const struct xkb_mod_set *mods,
 const char *
 ActionTypeText(enum xkb_action_type type)
 {
-    const char *name = LookupValue(actionTypeNames, type);
+    const char *name = LookupValue(&actionTypeNames, type);
     return name ? name : "Private";
 }
 
@@ -250,7 +280,7 @@ KeyNameText(struct xkb_context *ctx, xkb_atom_t name)
 const char *
 SIMatchText(enum xkb_match_operation type)
 {
-    return LookupValue(symInterpretMatchMaskNames, type);
+    return LookupValue(&symInterpretMatchMaskNames, type);
 }
 
 const char *
@@ -305,7 +335,7 @@ LedStateMaskText(struct xkb_context *ctx, enum xkb_state_component mask)
 
         ret = snprintf(buf + pos, sizeof(buf) - pos, "%s%s",
                        pos == 0 ? "" : "+",
-                       LookupValue(modComponentMaskNames, 1u << i));
+                       LookupValue(&modComponentMaskNames, 1u << i));
         if (ret <= 0 || pos + ret >= sizeof(buf))
             break;
         else
@@ -337,7 +367,7 @@ ControlMaskText(struct xkb_context *ctx, enum xkb_action_controls mask)
 
         ret = snprintf(buf + pos, sizeof(buf) - pos, "%s%s",
                        pos == 0 ? "" : "+",
-                       LookupValue(ctrlMaskNames, 1u << i));
+                       LookupValue(&ctrlMaskNames, 1u << i));
         if (ret <= 0 || pos + ret >= sizeof(buf))
             break;
         else
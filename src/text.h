@@ -29,23 +29,40 @@ typedef struct {
     unsigned int value;
 } LookupEntry;
 
+/*
+ * A NULL-terminated array of entries, along with a case-insensitive perfect
+ * hash of their names generated by scripts/makelookup, if any. Tables
+ * without a hash are searched linearly.
+ */
+typedef struct {
+    const LookupEntry *entries;
+    size_t num_entries;
+    size_t (*perfect_hash)(const char *name);
+} LookupTable;
+
+#define LOOKUP_TABLE(entries) \
+    { (entries), ARRAY_SIZE(entries) - 1, entries##_perfect_hash }
+
+#define LOOKUP_TABLE_LINEAR(entries) \
+    { (entries), ARRAY_SIZE(entries) - 1, NULL }
+
 bool
-LookupString(const LookupEntry tab[], const char *string,
+LookupString(const LookupTable *tab, const char *string,
               unsigned int *value_rtrn);
 
 const char *
-LookupValue(const LookupEntry tab[], unsigned int value);
-
-extern const LookupEntry ctrlMaskNames[];
-extern const LookupEntry modComponentMaskNames[];
-extern const LookupEntry groupComponentMaskNames[];
-extern const LookupEntry groupMaskNames[];
-extern const LookupEntry groupNames[];
-extern const LookupEntry levelNames[];
-extern const LookupEntry buttonNames[];
-extern const LookupEntry useModMapValueNames[];
-extern const LookupEntry actionTypeNames[];
-extern const LookupEntry symInterpretMatchMaskNames[];
+LookupValue(const LookupTable *tab, unsigned int value);
+
+extern const LookupTable ctrlMaskNames;
+extern const LookupTable modComponentMaskNames;
+extern const LookupTable groupComponentMaskNames;
+extern const LookupTable groupMaskNames;
+extern const LookupTable groupNames;
+extern const LookupTable levelNames;
+extern const LookupTable buttonNames;
+extern const LookupTable useModMapValueNames;
+extern const LookupTable actionTypeNames;
+extern const LookupTable symInterpretMatchMaskNames;
 
 const char *
 ModMaskText(struct xkb_context *ctx, const struct xkb_mod_set *mods,
@@ -0,0 +1,59 @@
+
+/**
+ * This file was generated by scripts/makelookup from src/xkbcomp/action.c
+ * Run scripts/update-lookup to regenerate it.
+ */
+
+static size_t
+lookup_hash_f(const char *key, const char *T, size_t NG)
+{
+    size_t sum = 0;
+    for (size_t i = 0; key[i] != '\0'; i++) {
+        char c = key[i];
+        if (c >= 'A' && c <= 'Z')
+            c = (char) (c - 'A' + 'a');
+        sum += T[i % 32] * c;
+    }
+    return sum % NG;
+}
+
+static const uint8_t fieldEntries_G[] = {
+    0, 0, 36, 18, 20, 14, 0, 13, 0, 1, 11, 0, 36, 0, 7, 11,
+    15, 32, 28, 13, 15, 25, 5, 17, 18, 4, 12, 16, 3, 25, 24, 11, 26, 12, 0,
+    32, 17, 9, 15
+};
+
+static size_t
+fieldEntries_perfect_hash(const char *key)
+{
+    return (
+        fieldEntries_G[lookup_hash_f(key, "9SHkSHq9xSIjnmAMBEww7UZDqElMW4vs", 39)] +
+        fieldEntries_G[lookup_hash_f(key, "u0ZAZMvj07qovtjTNHA6L3dL76tWjUUi", 39)]
+    ) % 39;
+}
+
+static const uint8_t lockWhichEntries_G[] = {
+    0, 2, 4, 2, 1
+};
+
+static size_t
+lockWhichEntries_perfect_hash(const char *key)
+{
+    return (
+        lockWhichEntries_G[lookup_hash_f(key, "gpqRivyDifQs6QpDwNKsFIy8kCVHe0zY", 5)] +
+        lockWhichEntries_G[lookup_hash_f(key, "TOQDx7zifFLt4uXTxSrSCJs0m35mlP3O", 5)]
+    ) % 5;
+}
+
+static const uint8_t ptrDfltEntries_G[] = {
+    0, 3, 0, 2
+};
+
+static size_t
+ptrDfltEntries_perfect_hash(const char *key)
+{
+    return (
+        ptrDfltEntries_G[lookup_hash_f(key, "Ea6BfgjBpkdPdEXgsKL937yjWRoKLYq6", 4)] +
+        ptrDfltEntries_G[lookup_hash_f(key, "Sv3901rvGdjOuEtFUeRozQhx0RCj3jfn", 4)]
+    ) % 4;
+}
@@ -57,6 +57,7 @@
 #include "text.h"
 #include "expr.h"
 #include "action.h"
+#include "action-lookup.h"
 
 static const ExprBoolean constTrue = {
     .expr = {
@@ -132,7 +133,7 @@ FreeActionsInfo(ActionsInfo *info)
     free(info);
 }
 
-static const LookupEntry fieldStrings[] = {
+static const LookupEntry fieldEntries[] = {
     { "clearLocks",       ACTION_FIELD_CLEAR_LOCKS   },
     { "latchToLock",      ACTION_FIELD_LATCH_TO_LOCK },
     { "genKeyEvent",      ACTION_FIELD_GEN_KEY_EVENT },
@@ -169,22 +170,24 @@ static const LookupEntry fieldStrings[] = {
     { NULL,               0                          }
 };
 
+static const LookupTable fieldStrings = LOOKUP_TABLE(fieldEntries);
+
 static bool
 stringToAction(const char *str, enum xkb_action_type *type_rtrn)
 {
-    return LookupString(actionTypeNames, str, type_rtrn);
+    return LookupString(&actionTypeNames, str, type_rtrn);
 }
 
 static bool
 stringToField(const char *str, enum action_field *field_rtrn)
 {
-    return LookupString(fieldStrings, str, field_rtrn);
+    return LookupString(&fieldStrings, str, field_rtrn);
 }
 
 static const char *
 fieldText(enum action_field field)
 {
-    return LookupValue(fieldStrings, field);
+    return LookupValue(&fieldStrings, field);
 }
 
 /***====================================================================***/
@@ -281,7 +284,7 @@ CheckModifierField(struct xkb_context *ctx, const struct xkb_mod_set *mods,
     return true;
 }
 
-static const LookupEntry lockWhich[] = {
+static const LookupEntry lockWhichEntries[] = {
     { "both", 0 },
     { "lock", ACTION_LOCK_NO_UNLOCK },
     { "neither", (ACTION_LOCK_NO_LOCK | ACTION_LOCK_NO_UNLOCK) },
@@ -289,6 +292,8 @@ static const LookupEntry lockWhich[] = {
     { NULL, 0 }
 };
 
+static const LookupTable lockWhich = LOOKUP_TABLE(lockWhichEntries);
+
 static bool
 CheckAffectField(struct xkb_context *ctx, enum xkb_action_type action,
                  const ExprDef *array_ndx, const ExprDef *value,
@@ -299,7 +304,7 @@ CheckAffectField(struct xkb_context *ctx, enum xkb_action_type action,
     if (array_ndx)
         return ReportActionNotArray(ctx, action, ACTION_FIELD_AFFECT);
 
-    if (!ExprResolveEnum(ctx, value, &flags, lockWhich))
+    if (!ExprResolveEnum(ctx, value, &flags, &lockWhich))
         return ReportMismatch(ctx, action, ACTION_FIELD_AFFECT,
                               "lock, unlock, both, neither");
 
@@ -503,13 +508,15 @@ HandlePtrBtn(struct xkb_context *ctx, const struct xkb_mod_set *mods,
     return ReportIllegal(ctx, action->type, field);
 }
 
-static const LookupEntry ptrDflts[] = {
+static const LookupEntry ptrDfltEntries[] = {
     { "dfltbtn", 1 },
     { "defaultbutton", 1 },
     { "button", 1 },
     { NULL, 0 }
 };
 
+static const LookupTable ptrDflts = LOOKUP_TABLE(ptrDfltEntries);
+
 static bool
 HandleSetPtrDflt(struct xkb_context *ctx, const struct xkb_mod_set *mods,
                  union xkb_action *action, enum action_field field,
@@ -523,7 +530,7 @@ HandleSetPtrDflt(struct xkb_context *ctx, const struct xkb_mod_set *mods,
         if (array_ndx)
             return ReportActionNotArray(ctx, action->type, field);
 
-        if (!ExprResolveEnum(ctx, value, &val, ptrDflts))
+        if (!ExprResolveEnum(ctx, value, &val, &ptrDflts))
             return ReportMismatch(ctx, action->type, field,
                                   "pointer component");
         return true;
@@ -629,7 +636,7 @@ HandleSetLockControls(struct xkb_context *ctx, const struct xkb_mod_set *mods,
         if (array_ndx)
             return ReportActionNotArray(ctx, action->type, field);
 
-        if (!ExprResolveMask(ctx, value, &mask, ctrlMaskNames))
+        if (!ExprResolveMask(ctx, value, &mask, &ctrlMaskNames))
             return ReportMismatch(ctx, action->type, field,
                                   "controls mask");
 
@@ -744,6 +744,143 @@ FreeXkbFile(XkbFile *file)
     }
 }
 
+/*
+ * The walkers below mirror the Free* functions above; they count every
+ * node, and every separately allocated block, that those would free.
+ */
+
+static void
+CountStmt(const ParseCommon *stmt, struct ast_stats *stats);
+
+static void
+CountExpr(const ExprDef *expr, struct ast_stats *stats)
+{
+    switch (expr->expr.op) {
+    case EXPR_NEGATE:
+    case EXPR_UNARY_PLUS:
+    case EXPR_NOT:
+    case EXPR_INVERT:
+        CountStmt((ParseCommon *) expr->unary.child, stats);
+        break;
+
+    case EXPR_DIVIDE:
+    case EXPR_ADD:
+    case EXPR_SUBTRACT:
+    case EXPR_MULTIPLY:
+    case EXPR_ASSIGN:
+        CountStmt((ParseCommon *) expr->binary.left, stats);
+        CountStmt((ParseCommon *) expr->binary.right, stats);
+        break;
+
+    case EXPR_ACTION_DECL:
+        CountStmt((ParseCommon *) expr->action.args, stats);
+        break;
+
+    case EXPR_ACTION_LIST:
+        CountStmt((ParseCommon *) expr->actions.actions, stats);
+        break;
+
+    case EXPR_ARRAY_REF:
+        CountStmt((ParseCommon *) expr->array_ref.entry, stats);
+        break;
+
+    case EXPR_KEYSYM_LIST:
+        stats->allocations += !darray_empty(expr->keysym_list.syms);
+        stats->allocations += !darray_empty(expr->keysym_list.symsMapIndex);
+        stats->allocations += !darray_empty(expr->keysym_list.symsNumEntries);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void
+CountStmt(const ParseCommon *stmt, struct ast_stats *stats)
+{
+    const IncludeStmt *incl;
+
+    for (; stmt; stmt = stmt->next) {
+        stats->nodes++;
+        stats->allocations++;
+
+        switch (stmt->type) {
+        case STMT_INCLUDE:
+            for (incl = (IncludeStmt *) stmt; incl; incl = incl->next_incl) {
+                if (incl != (IncludeStmt *) stmt) {
+                    stats->nodes++;
+                    stats->allocations++;
+                }
+                stats->allocations += (incl->file != NULL) +
+                                      (incl->map != NULL) +
+                                      (incl->modifier != NULL) +
+                                      (incl->stmt != NULL);
+            }
+            break;
+        case STMT_EXPR:
+            CountExpr((ExprDef *) stmt, stats);
+            break;
+        case STMT_VAR:
+            CountStmt((ParseCommon *) ((VarDef *) stmt)->name, stats);
+            CountStmt((ParseCommon *) ((VarDef *) stmt)->value, stats);
+            break;
+        case STMT_TYPE:
+            CountStmt((ParseCommon *) ((KeyTypeDef *) stmt)->body, stats);
+            break;
+        case STMT_INTERP:
+            CountStmt((ParseCommon *) ((InterpDef *) stmt)->match, stats);
+            CountStmt((ParseCommon *) ((InterpDef *) stmt)->def, stats);
+            break;
+        case STMT_VMOD:
+            CountStmt((ParseCommon *) ((VModDef *) stmt)->value, stats);
+            break;
+        case STMT_SYMBOLS:
+            CountStmt((ParseCommon *) ((SymbolsDef *) stmt)->symbols, stats);
+            break;
+        case STMT_MODMAP:
+            CountStmt((ParseCommon *) ((ModMapDef *) stmt)->keys, stats);
+            break;
+        case STMT_GROUP_COMPAT:
+            CountStmt((ParseCommon *) ((GroupCompatDef *) stmt)->def, stats);
+            break;
+        case STMT_LED_MAP:
+            CountStmt((ParseCommon *) ((LedMapDef *) stmt)->body, stats);
+            break;
+        case STMT_LED_NAME:
+            CountStmt((ParseCommon *) ((LedNameDef *) stmt)->name, stats);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void
+CountXkbFile(const XkbFile *file, struct ast_stats *stats)
+{
+    for (; file; file = (XkbFile *) file->common.next) {
+        stats->nodes++;
+        stats->allocations += 1 + (file->name != NULL);
+
+        switch (file->file_type) {
+        case FILE_TYPE_KEYMAP:
+            CountXkbFile((XkbFile *) file->defs, stats);
+            break;
+
+        case FILE_TYPE_TYPES:
+        case FILE_TYPE_COMPAT:
+        case FILE_TYPE_SYMBOLS:
+        case FILE_TYPE_KEYCODES:
+        case FILE_TYPE_GEOMETRY:
+            CountStmt(file->defs, stats);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
 static const char *xkb_file_type_strings[_FILE_TYPE_NUM_ENTRIES] = {
     [FILE_TYPE_KEYCODES] = "xkb_keycodes",
     [FILE_TYPE_TYPES] = "xkb_types",
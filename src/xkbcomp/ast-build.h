@@ -122,4 +122,13 @@ XkbFileCreate(enum xkb_file_type type, char *name, ParseCommon *defs,
 void
 FreeStmt(ParseCommon *stmt);
 
+struct ast_stats {
+    uint64_t nodes;
+    uint64_t allocations;
+};
+
+/* Add up the nodes and heap blocks owned by a parsed file, for profiling. */
+void
+CountXkbFile(const XkbFile *file, struct ast_stats *stats);
+
 #endif
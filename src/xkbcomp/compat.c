@@ -50,6 +50,7 @@
 #include "config.h"
 
 #include "xkbcomp-priv.h"
+#include "hash.h"
 #include "text.h"
 #include "expr.h"
 #include "action.h"
@@ -88,6 +89,8 @@ typedef struct {
     int errorCount;
     SymInterpInfo default_interp;
     darray(SymInterpInfo) interps;
+    /* Index of interps by (sym, mods, match). */
+    struct hash_index interp_index;
     LedInfo default_led;
     LedInfo leds[XKB_MAX_LEDS];
     unsigned int num_leds;
@@ -162,20 +165,55 @@ ClearCompatInfo(CompatInfo *info)
 {
     free(info->name);
     darray_free(info->interps);
+    hash_index_free(&info->interp_index);
+}
+
+static inline bool
+InterpsMatch(const SymInterpInfo *a, const SymInterpInfo *b)
+{
+    return a->interp.sym == b->interp.sym &&
+           a->interp.mods == b->interp.mods &&
+           a->interp.match == b->interp.match;
+}
+
+static unsigned
+InterpHash(const SymInterpInfo *si)
+{
+    return hash_int(si->interp.sym) ^ (si->interp.mods * 40503u) ^
+           si->interp.match;
+}
+
+static bool
+InterpIndexMatch(const void *interps, unsigned pos, const void *key)
+{
+    return InterpsMatch(&((const SymInterpInfo *) interps)[pos], key);
+}
+
+static unsigned
+InterpIndexHash(const void *interps, unsigned pos)
+{
+    return InterpHash(&((const SymInterpInfo *) interps)[pos]);
 }
 
 static SymInterpInfo *
 FindMatchingInterp(CompatInfo *info, SymInterpInfo *new)
 {
-    SymInterpInfo *old;
+    unsigned pos = hash_index_find(&info->interp_index, InterpHash(new),
+                                   InterpIndexMatch,
+                                   info->interps.item, new);
+    if (pos == HASH_INDEX_NONE)
+        return NULL;
 
-    darray_foreach(old, info->interps)
-        if (old->interp.sym == new->interp.sym &&
-            old->interp.mods == new->interp.mods &&
-            old->interp.match == new->interp.match)
-            return old;
+    return &darray_item(info->interps, pos);
+}
 
-    return NULL;
+/* Add the last interpretation in info->interps to the index. */
+static bool
+IndexLastInterp(CompatInfo *info)
+{
+    return hash_index_add_last(&info->interp_index, InterpIndexHash,
+                               info->interps.item,
+                               darray_size(info->interps), 64);
 }
 
 static bool
@@ -248,6 +286,10 @@ AddInterp(CompatInfo *info, SymInterpInfo *new, bool same_file)
     }
 
     darray_append(info->interps, *new);
+    if (!IndexLastInterp(info)) {
+        log_err(info->ctx, "Couldn't allocate the interpretations index\n");
+        return false;
+    }
     return true;
 }
 
@@ -266,7 +308,7 @@ ResolveStateAndPredicate(ExprDef *expr, enum xkb_match_operation *pred_rtrn,
     *pred_rtrn = MATCH_EXACTLY;
     if (expr->expr.op == EXPR_ACTION_DECL) {
         const char *pred_txt = xkb_atom_text(info->ctx, expr->action.name);
-        if (!LookupString(symInterpretMatchMaskNames, pred_txt, pred_rtrn) ||
+        if (!LookupString(&symInterpretMatchMaskNames, pred_txt, pred_rtrn) ||
             !expr->action.args || expr->action.args->common.next) {
             log_err(info->ctx,
                     "Illegal modifier predicate \"%s\"; Ignored\n", pred_txt);
@@ -395,6 +437,9 @@ MergeIncludedCompatMaps(CompatInfo *into, CompatInfo *from,
     if (darray_empty(into->interps)) {
         into->interps = from->interps;
         darray_init(from->interps);
+        hash_index_free(&into->interp_index);
+        into->interp_index = from->interp_index;
+        from->interp_index = (struct hash_index) { NULL, 0 };
     }
     else {
         SymInterpInfo *si;
@@ -515,7 +560,7 @@ SetInterpField(CompatInfo *info, SymInterpInfo *si, const char *field,
         if (arrayNdx)
             return ReportSINotArray(info, si, field);
 
-        if (!ExprResolveEnum(info->ctx, value, &val, useModMapValueNames))
+        if (!ExprResolveEnum(info->ctx, value, &val, &useModMapValueNames))
             return ReportSIBadType(info, si, field, "level specification");
 
         si->interp.level_one_only = val;
@@ -551,7 +596,7 @@ SetLedMapField(CompatInfo *info, LedInfo *ledi, const char *field,
         if (arrayNdx)
             return ReportLedNotArray(info, ledi, field);
 
-        if (!ExprResolveMask(info->ctx, value, &mask, groupMaskNames))
+        if (!ExprResolveMask(info->ctx, value, &mask, &groupMaskNames))
             return ReportLedBadType(info, ledi, field, "group mask");
 
         ledi->led.groups = mask;
@@ -563,7 +608,7 @@ SetLedMapField(CompatInfo *info, LedInfo *ledi, const char *field,
         if (arrayNdx)
             return ReportLedNotArray(info, ledi, field);
 
-        if (!ExprResolveMask(info->ctx, value, &mask, ctrlMaskNames))
+        if (!ExprResolveMask(info->ctx, value, &mask, &ctrlMaskNames))
             return ReportLedBadType(info, ledi, field, "controls mask");
 
         ledi->led.ctrls = mask;
@@ -582,7 +627,7 @@ SetLedMapField(CompatInfo *info, LedInfo *ledi, const char *field,
             return ReportLedNotArray(info, ledi, field);
 
         if (!ExprResolveMask(info->ctx, value, &mask,
-                             modComponentMaskNames))
+                             &modComponentMaskNames))
             return ReportLedBadType(info, ledi, field,
                                     "mask of modifier state components");
 
@@ -595,7 +640,7 @@ SetLedMapField(CompatInfo *info, LedInfo *ledi, const char *field,
             return ReportLedNotArray(info, ledi, field);
 
         if (!ExprResolveMask(info->ctx, value, &mask,
-                             groupComponentMaskNames))
+                             &groupComponentMaskNames))
             return ReportLedBadType(info, ledi, field,
                                     "mask of group state components");
 
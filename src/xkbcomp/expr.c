@@ -70,21 +70,10 @@ static bool
 SimpleLookup(struct xkb_context *ctx, const void *priv, xkb_atom_t field,
              enum expr_value_type type, unsigned int *val_rtrn)
 {
-    const LookupEntry *entry;
-    const char *str;
-
     if (!priv || field == XKB_ATOM_NONE || type != EXPR_TYPE_INT)
         return false;
 
-    str = xkb_atom_text(ctx, field);
-    for (entry = priv; entry && entry->name; entry++) {
-        if (istreq(str, entry->name)) {
-            *val_rtrn = entry->value;
-            return true;
-        }
-    }
-
-    return false;
+    return LookupString(priv, xkb_atom_text(ctx, field), val_rtrn);
 }
 
 /* Data passed in the *priv argument for LookupModMask. */
@@ -401,7 +390,7 @@ ExprResolveGroup(struct xkb_context *ctx, const ExprDef *expr,
     int result;
 
     ok = ExprResolveIntegerLookup(ctx, expr, &result, SimpleLookup,
-                                  groupNames);
+                                  &groupNames);
     if (!ok)
         return false;
 
@@ -423,7 +412,7 @@ ExprResolveLevel(struct xkb_context *ctx, const ExprDef *expr,
     int result;
 
     ok = ExprResolveIntegerLookup(ctx, expr, &result, SimpleLookup,
-                                  levelNames);
+                                  &levelNames);
     if (!ok)
         return false;
 
@@ -441,7 +430,7 @@ bool
 ExprResolveButton(struct xkb_context *ctx, const ExprDef *expr, int *btn_rtrn)
 {
     return ExprResolveIntegerLookup(ctx, expr, btn_rtrn, SimpleLookup,
-                                    buttonNames);
+                                    &buttonNames);
 }
 
 bool
@@ -496,7 +485,7 @@ ExprResolveString(struct xkb_context *ctx, const ExprDef *expr,
 
 bool
 ExprResolveEnum(struct xkb_context *ctx, const ExprDef *expr,
-                unsigned int *val_rtrn, const LookupEntry *values)
+                unsigned int *val_rtrn, const LookupTable *values)
 {
     if (expr->expr.op != EXPR_IDENT) {
         log_err(ctx, "Found a %s where an enumerated value was expected\n",
@@ -508,11 +497,8 @@ ExprResolveEnum(struct xkb_context *ctx, const ExprDef *expr,
                       val_rtrn)) {
         log_err(ctx, "Illegal identifier %s; expected one of:\n",
                 xkb_atom_text(ctx, expr->ident.ident));
-        while (values && values->name)
-        {
-            log_err(ctx, "\t%s\n", values->name);
-            values++;
-        }
+        for (const LookupEntry *entry = values->entries; entry->name; entry++)
+            log_err(ctx, "\t%s\n", entry->name);
         return false;
     }
 
@@ -626,7 +612,7 @@ ExprResolveMaskLookup(struct xkb_context *ctx, const ExprDef *expr,
 
 bool
 ExprResolveMask(struct xkb_context *ctx, const ExprDef *expr,
-                unsigned int *mask_rtrn, const LookupEntry *values)
+                unsigned int *mask_rtrn, const LookupTable *values)
 {
     return ExprResolveMaskLookup(ctx, expr, mask_rtrn, SimpleLookup, values);
 }
@@ -647,8 +633,7 @@ ExprResolveKeySym(struct xkb_context *ctx, const ExprDef *expr,
     int val;
 
     if (expr->expr.op == EXPR_IDENT) {
-        const char *str = xkb_atom_text(ctx, expr->ident.ident);
-        *sym_rtrn = xkb_keysym_from_name(str, 0);
+        *sym_rtrn = xkb_keysym_from_atom(ctx, expr->ident.ident);
         if (*sym_rtrn != XKB_KEY_NoSymbol)
             return true;
     }
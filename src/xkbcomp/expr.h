@@ -72,11 +72,11 @@ ExprResolveString(struct xkb_context *ctx, const ExprDef *expr,
 
 bool
 ExprResolveEnum(struct xkb_context *ctx, const ExprDef *expr,
-                unsigned int *val_rtrn, const LookupEntry *values);
+                unsigned int *val_rtrn, const LookupTable *values);
 
 bool
 ExprResolveMask(struct xkb_context *ctx, const ExprDef *expr,
-                unsigned int *mask_rtrn, const LookupEntry *values);
+                unsigned int *mask_rtrn, const LookupTable *values);
 
 bool
 ExprResolveKeySym(struct xkb_context *ctx, const ExprDef *expr,
@@ -52,6 +52,9 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "xkbcomp-priv.h"
 #include "include.h"
@@ -239,7 +242,9 @@ FindFileInXkbPath(struct xkb_context *ctx, const char *name,
     FILE *file = NULL;
     char *buf = NULL;
     const char *typeDir;
+    int prev_phase;
 
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_FILE_IO);
     typeDir = DirectoryForInclude(type);
 
     for (i = *offset; i < xkb_context_num_include_paths(ctx); i++) {
@@ -253,6 +258,7 @@ FindFileInXkbPath(struct xkb_context *ctx, const char *name,
 
         file = fopen(buf, "rb");
         if (file) {
+            profile_count(ctx, XKB_COMPILE_COUNTER_FILES_OPENED, 1);
             if (pathRtrn) {
                 *pathRtrn = buf;
                 buf = NULL;
@@ -271,9 +277,14 @@ FindFileInXkbPath(struct xkb_context *ctx, const char *name,
 
 out:
     free(buf);
+    profile_leave_phase(ctx, prev_phase);
     return file;
 }
 
+static XkbFile *
+TakePrefetchedFile(struct xkb_context *ctx, IncludeStmt *stmt,
+                   enum xkb_file_type file_type, bool *found);
+
 XkbFile *
 ProcessIncludeFile(struct xkb_context *ctx, IncludeStmt *stmt,
                    enum xkb_file_type file_type)
@@ -281,6 +292,13 @@ ProcessIncludeFile(struct xkb_context *ctx, IncludeStmt *stmt,
     FILE *file;
     XkbFile *xkb_file = NULL;
     unsigned int offset = 0;
+    bool found;
+
+    if (ctx->include_cache) {
+        xkb_file = TakePrefetchedFile(ctx, stmt, file_type, &found);
+        if (found)
+            return xkb_file;
+    }
 
     file = FindFileInXkbPath(ctx, stmt->file, file_type, NULL, &offset);
     if (!file)
@@ -321,3 +339,184 @@ ProcessIncludeFile(struct xkb_context *ctx, IncludeStmt *stmt,
 
     return xkb_file;
 }
+
+/***====================================================================***/
+
+/*
+ * Parallel parsing of include trees.
+ *
+ * The include trees of the keycodes, types, compat and symbols sections
+ * are independent of each other, but merging them is not (e.g. symbols
+ * refer to virtual modifiers declared in compat). So only the reading and
+ * parsing of the files is done up-front, one thread per section. The
+ * parsed files are kept in a cache on the context, from which
+ * ProcessIncludeFile() then takes them as the sections are compiled in
+ * order. Includes which were not prefetched are handled as usual.
+ */
+
+/* Guard against include loops; the compiler itself does not. */
+#define MAX_PREFETCH_DEPTH 15
+
+struct prefetched_file {
+    char *file;
+    char *map;
+    XkbFile *xkb_file;
+    bool taken;
+};
+
+struct include_prefetch {
+    struct xkb_context *ctx;
+    enum xkb_file_type file_type;
+    XkbFile *section;
+    darray(struct prefetched_file) files;
+};
+
+struct include_cache {
+    struct include_prefetch sections[LAST_KEYMAP_FILE_TYPE + 1];
+};
+
+static struct prefetched_file *
+FindPrefetchedFile(struct include_prefetch *prefetch, const IncludeStmt *stmt)
+{
+    struct prefetched_file *pf;
+
+    darray_foreach(pf, prefetch->files)
+        if (streq(pf->file, stmt->file) && streq_null(pf->map, stmt->map))
+            return pf;
+
+    return NULL;
+}
+
+static void
+PrefetchIncludes(struct include_prefetch *prefetch, IncludeStmt *include,
+                 unsigned depth)
+{
+    for (IncludeStmt *stmt = include; stmt; stmt = stmt->next_incl) {
+        struct prefetched_file pf;
+
+        if (!stmt->file || FindPrefetchedFile(prefetch, stmt))
+            continue;
+
+        pf.file = strdup(stmt->file);
+        pf.map = strdup_safe(stmt->map);
+        pf.xkb_file = ProcessIncludeFile(prefetch->ctx, stmt,
+                                         prefetch->file_type);
+        pf.taken = false;
+        darray_append(prefetch->files, pf);
+
+        if (!pf.xkb_file || depth >= MAX_PREFETCH_DEPTH)
+            continue;
+
+        for (ParseCommon *def = pf.xkb_file->defs; def; def = def->next)
+            if (def->type == STMT_INCLUDE)
+                PrefetchIncludes(prefetch, (IncludeStmt *) def, depth + 1);
+    }
+}
+
+static void *
+PrefetchSection(void *data)
+{
+    struct include_prefetch *prefetch = data;
+
+    for (ParseCommon *def = prefetch->section->defs; def; def = def->next)
+        if (def->type == STMT_INCLUDE)
+            PrefetchIncludes(prefetch, (IncludeStmt *) def, 0);
+
+    return NULL;
+}
+
+static XkbFile *
+TakePrefetchedFile(struct xkb_context *ctx, IncludeStmt *stmt,
+                   enum xkb_file_type file_type, bool *found)
+{
+    struct include_cache *cache = ctx->include_cache;
+    struct prefetched_file *pf;
+
+    *found = false;
+    if (file_type > LAST_KEYMAP_FILE_TYPE || !stmt->file)
+        return NULL;
+
+    pf = FindPrefetchedFile(&cache->sections[file_type], stmt);
+    if (!pf || pf->taken)
+        return NULL;
+
+    /* Each prefetched file is consumed once; repeated includes reparse. */
+    pf->taken = true;
+    *found = true;
+    return pf->xkb_file;
+}
+
+bool
+PrefetchKeymapIncludes(struct xkb_context *ctx,
+                       XkbFile *sections[LAST_KEYMAP_FILE_TYPE + 1])
+{
+#ifdef HAVE_PTHREAD
+    struct include_cache *cache;
+    pthread_t threads[LAST_KEYMAP_FILE_TYPE + 1];
+    bool started[LAST_KEYMAP_FILE_TYPE + 1] = { false };
+    enum xkb_file_type type;
+
+    if (ctx->include_cache)
+        return false;
+
+    cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return false;
+
+    if (!xkb_context_set_threaded(ctx, true)) {
+        free(cache);
+        return false;
+    }
+
+    for (type = FIRST_KEYMAP_FILE_TYPE; type <= LAST_KEYMAP_FILE_TYPE; type++) {
+        struct include_prefetch *prefetch = &cache->sections[type];
+
+        prefetch->ctx = ctx;
+        prefetch->file_type = type;
+        prefetch->section = sections[type];
+        darray_init(prefetch->files);
+
+        /* The last section is handled by the calling thread. */
+        if (type < LAST_KEYMAP_FILE_TYPE)
+            started[type] = pthread_create(&threads[type], NULL,
+                                           PrefetchSection, prefetch) == 0;
+    }
+
+    for (type = FIRST_KEYMAP_FILE_TYPE; type <= LAST_KEYMAP_FILE_TYPE; type++)
+        if (!started[type])
+            PrefetchSection(&cache->sections[type]);
+
+    for (type = FIRST_KEYMAP_FILE_TYPE; type <= LAST_KEYMAP_FILE_TYPE; type++)
+        if (started[type])
+            pthread_join(threads[type], NULL);
+
+    xkb_context_set_threaded(ctx, false);
+    ctx->include_cache = cache;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void
+ClearPrefetchedIncludes(struct xkb_context *ctx)
+{
+    struct include_cache *cache = ctx->include_cache;
+    struct prefetched_file *pf;
+
+    if (!cache)
+        return;
+
+    for (unsigned i = 0; i < ARRAY_SIZE(cache->sections); i++) {
+        darray_foreach(pf, cache->sections[i].files) {
+            if (!pf->taken)
+                FreeXkbFile(pf->xkb_file);
+            free(pf->file);
+            free(pf->map);
+        }
+        darray_free(cache->sections[i].files);
+    }
+
+    free(cache);
+    ctx->include_cache = NULL;
+}
@@ -40,4 +40,11 @@ XkbFile *
 ProcessIncludeFile(struct xkb_context *ctx, IncludeStmt *stmt,
                    enum xkb_file_type file_type);
 
+bool
+PrefetchKeymapIncludes(struct xkb_context *ctx,
+                       XkbFile *sections[LAST_KEYMAP_FILE_TYPE + 1]);
+
+void
+ClearPrefetchedIncludes(struct xkb_context *ctx);
+
 #endif
@@ -534,6 +534,17 @@ CopyKeyNamesToKeymap(struct xkb_keymap *keymap, KeyNamesInfo *info)
 
     min_key_code = info->min_key_code;
     max_key_code = info->max_key_code;
+    /* Shrink the range to the keys of the device, if any. */
+    if (keymap->device_keys && min_key_code != XKB_KEYCODE_INVALID) {
+        while (min_key_code <= max_key_code &&
+               !XkbKeycodeOnDevice(keymap, min_key_code))
+            min_key_code++;
+        while (max_key_code > min_key_code &&
+               !XkbKeycodeOnDevice(keymap, max_key_code))
+            max_key_code--;
+        if (min_key_code > max_key_code)
+            min_key_code = XKB_KEYCODE_INVALID;
+    }
     /* If the keymap has no keys, let's just use the safest pair we know. */
     if (min_key_code == XKB_KEYCODE_INVALID) {
         min_key_code = 8;
@@ -548,7 +559,8 @@ CopyKeyNamesToKeymap(struct xkb_keymap *keymap, KeyNamesInfo *info)
         keys[kc].keycode = kc;
 
     for (kc = info->min_key_code; kc <= info->max_key_code; kc++)
-        keys[kc].name = darray_item(info->key_names, kc);
+        if (XkbKeycodeOnDevice(keymap, kc))
+            keys[kc].name = darray_item(info->key_names, kc);
 
     keymap->min_key_code = min_key_code;
     keymap->max_key_code = max_key_code;
@@ -571,10 +583,13 @@ CopyKeyAliasesToKeymap(struct xkb_keymap *keymap, KeyNamesInfo *info)
     darray_foreach(alias, info->aliases) {
         /* Check that ->real is a key. */
         if (!XkbKeyByName(keymap, alias->real, false)) {
-            log_vrb(info->ctx, 5,
-                    "Attempt to alias %s to non-existent key %s; Ignored\n",
-                    KeyNameText(info->ctx, alias->alias),
-                    KeyNameText(info->ctx, alias->real));
+            /* Aliases of keys the device lacks are expected. */
+            if (!keymap->device_keys ||
+                FindKeyByName(info, alias->real) == XKB_KEYCODE_INVALID)
+                log_vrb(info->ctx, 5,
+                        "Attempt to alias %s to non-existent key %s; Ignored\n",
+                        KeyNameText(info->ctx, alias->alias),
+                        KeyNameText(info->ctx, alias->real));
             alias->real = XKB_ATOM_NONE;
             continue;
         }
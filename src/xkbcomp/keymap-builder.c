@@ -0,0 +1,955 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Builds a struct xkb_keymap from keys, types and modifiers given through
+ * the xkb_keymap_builder API, the way the compiler does from XKB files.
+ * Modifiers go straight into the keymap; types and keys are collected
+ * first, since a key's levels depend on a type which may be set later.
+ */
+
+#include "config.h"
+
+#include "xkbcomp-priv.h"
+#include "text.h"
+
+struct builder_group {
+    /* Index in builder->types, or -1 for an automatic type. */
+    int type;
+    bool defined;
+    darray(struct xkb_level) levels;
+};
+
+struct builder_key {
+    /* XKB_ATOM_NONE if the key was not added. */
+    xkb_atom_t name;
+    xkb_mod_mask_t mods;
+    enum xkb_explicit_components explicit;
+    bool repeats;
+    darray(struct builder_group) groups;
+};
+
+struct xkb_keymap_builder {
+    struct xkb_context *ctx;
+    enum xkb_keymap_compile_flags flags;
+
+    struct xkb_keymap *keymap;
+    darray(struct xkb_key_type) types;
+    /* Indexed by keycode. */
+    darray(struct builder_key) keys;
+    darray(xkb_atom_t) group_names;
+};
+
+static void
+ClearLevel(struct xkb_level *level)
+{
+    if (level->num_syms > 1)
+        free(level->u.syms);
+    level->num_syms = 0;
+}
+
+static void
+ClearBuilderKey(struct builder_key *key)
+{
+    struct builder_group *group;
+    struct xkb_level *level;
+
+    darray_foreach(group, key->groups) {
+        darray_foreach(level, group->levels)
+            ClearLevel(level);
+        darray_free(group->levels);
+    }
+    darray_free(key->groups);
+}
+
+static void
+ClearBuilder(struct xkb_keymap_builder *builder)
+{
+    struct xkb_key_type *type;
+    struct builder_key *key;
+
+    darray_foreach(type, builder->types)
+        free(type->entries);
+    darray_free(builder->types);
+    darray_foreach(key, builder->keys)
+        ClearBuilderKey(key);
+    darray_free(builder->keys);
+    darray_free(builder->group_names);
+    xkb_keymap_unref(builder->keymap);
+    builder->keymap = NULL;
+}
+
+static bool
+ResetBuilder(struct xkb_keymap_builder *builder)
+{
+    darray_init(builder->types);
+    darray_init(builder->keys);
+    darray_init(builder->group_names);
+    builder->keymap = xkb_keymap_new(builder->ctx, XKB_KEYMAP_FORMAT_TEXT_V1,
+                                     builder->flags);
+    return builder->keymap != NULL;
+}
+
+XKB_EXPORT struct xkb_keymap_builder *
+xkb_keymap_builder_new(struct xkb_context *ctx,
+                       enum xkb_keymap_compile_flags flags)
+{
+    struct xkb_keymap_builder *builder;
+
+    if (flags & ~(XKB_KEYMAP_COMPILE_NO_FLAGS)) {
+        log_err_func(ctx, "unrecognized flags: %#x\n", flags);
+        return NULL;
+    }
+
+    builder = calloc(1, sizeof(*builder));
+    if (!builder)
+        return NULL;
+
+    builder->ctx = xkb_context_ref(ctx);
+    builder->flags = flags;
+    if (!ResetBuilder(builder)) {
+        xkb_context_unref(builder->ctx);
+        free(builder);
+        return NULL;
+    }
+
+    return builder;
+}
+
+XKB_EXPORT void
+xkb_keymap_builder_destroy(struct xkb_keymap_builder *builder)
+{
+    if (!builder)
+        return;
+
+    ClearBuilder(builder);
+    xkb_context_unref(builder->ctx);
+    free(builder);
+}
+
+static bool
+CheckModMask(struct xkb_keymap_builder *builder, xkb_mod_mask_t mods)
+{
+    const xkb_mod_index_t num_mods = builder->keymap->mods.num_mods;
+
+    if (num_mods < XKB_MAX_MODS && (mods >> num_mods) != 0) {
+        log_err(builder->ctx,
+                "Modifier mask %#x refers to modifiers which were not added\n",
+                mods);
+        return false;
+    }
+
+    return true;
+}
+
+XKB_EXPORT xkb_mod_index_t
+xkb_keymap_builder_add_mod(struct xkb_keymap_builder *builder,
+                           const char *name, xkb_mod_mask_t mapping)
+{
+    struct xkb_mod_set *mods = &builder->keymap->mods;
+    xkb_atom_t atom;
+    xkb_mod_index_t idx;
+
+    if (!name || !*name) {
+        log_err_func1(builder->ctx, "no modifier name specified\n");
+        return XKB_MOD_INVALID;
+    }
+
+    if (mapping & ~MOD_REAL_MASK_ALL) {
+        log_err(builder->ctx,
+                "Modifier %s can only be mapped to real modifiers\n", name);
+        return XKB_MOD_INVALID;
+    }
+
+    atom = xkb_atom_intern(builder->ctx, name, strlen(name));
+    idx = XkbModNameToIndex(mods, atom, MOD_BOTH);
+    if (idx != XKB_MOD_INVALID) {
+        if (mods->mods[idx].type == MOD_REAL && mapping != 0) {
+            log_err(builder->ctx,
+                    "Can't map the real modifier %s to other modifiers\n",
+                    name);
+            return XKB_MOD_INVALID;
+        }
+        mods->mods[idx].mapping |= mapping;
+        return idx;
+    }
+
+    if (mods->num_mods >= XKB_MAX_MODS) {
+        log_err(builder->ctx,
+                "Too many modifiers defined (maximum %u)\n", XKB_MAX_MODS);
+        return XKB_MOD_INVALID;
+    }
+
+    idx = mods->num_mods++;
+    mods->mods[idx].name = atom;
+    mods->mods[idx].type = MOD_VIRT;
+    mods->mods[idx].mapping = mapping;
+    return idx;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_add_type(struct xkb_keymap_builder *builder,
+                            const char *name, xkb_mod_mask_t mods,
+                            xkb_level_index_t num_levels)
+{
+    struct xkb_key_type *type;
+    xkb_atom_t atom;
+
+    if (!name || !*name) {
+        log_err_func1(builder->ctx, "no type name specified\n");
+        return -1;
+    }
+
+    if (num_levels < 1) {
+        log_err(builder->ctx, "Type %s must have at least one level\n", name);
+        return -1;
+    }
+
+    if (!CheckModMask(builder, mods))
+        return -1;
+
+    atom = xkb_atom_intern(builder->ctx, name, strlen(name));
+    darray_foreach(type, builder->types) {
+        if (type->name == atom) {
+            log_err(builder->ctx, "Type %s was already added\n", name);
+            return -1;
+        }
+    }
+
+    darray_resize0(builder->types, darray_size(builder->types) + 1);
+    type = &darray_item(builder->types, darray_size(builder->types) - 1);
+    type->name = atom;
+    type->mods.mods = mods;
+    type->num_levels = num_levels;
+    return (int) darray_size(builder->types) - 1;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_type_add_entry(struct xkb_keymap_builder *builder,
+                                  int type_index, xkb_mod_mask_t mods,
+                                  xkb_level_index_t level,
+                                  xkb_mod_mask_t preserve)
+{
+    struct xkb_key_type *type;
+    struct xkb_key_type_entry *entry, *entries;
+
+    if (type_index < 0 || (unsigned) type_index >= darray_size(builder->types)) {
+        log_err_func(builder->ctx, "invalid type index: %d\n", type_index);
+        return 0;
+    }
+    type = &darray_item(builder->types, type_index);
+
+    if (level >= type->num_levels) {
+        log_err(builder->ctx,
+                "Level %u is out of range for type %s, which has %u levels\n",
+                level + 1, xkb_atom_text(builder->ctx, type->name),
+                type->num_levels);
+        return 0;
+    }
+
+    /* As in types.c, ignore the modifiers the type does not use. */
+    mods &= type->mods.mods;
+    preserve &= mods;
+
+    for (unsigned i = 0; i < type->num_entries; i++) {
+        if (type->entries[i].mods.mods == mods) {
+            type->entries[i].level = level;
+            type->entries[i].preserve.mods = preserve;
+            return 1;
+        }
+    }
+
+    entries = realloc(type->entries,
+                      (type->num_entries + 1) * sizeof(*type->entries));
+    if (!entries)
+        return 0;
+    type->entries = entries;
+
+    entry = &type->entries[type->num_entries++];
+    memset(entry, 0, sizeof(*entry));
+    entry->level = level;
+    entry->mods.mods = mods;
+    entry->preserve.mods = preserve;
+    return 1;
+}
+
+static struct builder_key *
+GetBuilderKey(struct xkb_keymap_builder *builder, xkb_keycode_t kc)
+{
+    struct builder_key *key;
+
+    if (kc >= darray_size(builder->keys) ||
+        darray_item(builder->keys, kc).name == XKB_ATOM_NONE) {
+        log_err(builder->ctx, "Key %u was not added to the keymap\n", kc);
+        return NULL;
+    }
+
+    key = &darray_item(builder->keys, kc);
+    return key;
+}
+
+static struct builder_group *
+GetBuilderGroup(struct xkb_keymap_builder *builder, xkb_keycode_t kc,
+                xkb_layout_index_t layout)
+{
+    struct builder_key *key = GetBuilderKey(builder, kc);
+    struct builder_group *group;
+
+    if (!key)
+        return NULL;
+
+    if (layout >= XKB_MAX_GROUPS) {
+        log_err(builder->ctx,
+                "Layout %u of key %s is out of range (1..%d)\n",
+                layout + 1, KeyNameText(builder->ctx, key->name),
+                XKB_MAX_GROUPS);
+        return NULL;
+    }
+
+    while (darray_size(key->groups) <= layout) {
+        darray_resize0(key->groups, darray_size(key->groups) + 1);
+        darray_item(key->groups, darray_size(key->groups) - 1).type = -1;
+    }
+
+    group = &darray_item(key->groups, layout);
+    group->defined = true;
+    return group;
+}
+
+static struct xkb_level *
+GetBuilderLevel(struct xkb_keymap_builder *builder, xkb_keycode_t kc,
+                xkb_layout_index_t layout, xkb_level_index_t level)
+{
+    struct builder_group *group = GetBuilderGroup(builder, kc, layout);
+
+    if (!group)
+        return NULL;
+
+    if (darray_size(group->levels) <= level)
+        darray_resize0(group->levels, level + 1);
+
+    return &darray_item(group->levels, level);
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_add_key(struct xkb_keymap_builder *builder,
+                           xkb_keycode_t kc, const char *name)
+{
+    struct builder_key *key;
+    xkb_atom_t atom;
+
+    if (!name || !*name) {
+        log_err_func1(builder->ctx, "no key name specified\n");
+        return 0;
+    }
+
+    if (kc > XKB_KEYCODE_MAX) {
+        log_err(builder->ctx, "Illegal keycode %u: must be between 0..%u\n",
+                kc, XKB_KEYCODE_MAX);
+        return 0;
+    }
+
+    atom = xkb_atom_intern(builder->ctx, name, strlen(name));
+    darray_foreach(key, builder->keys) {
+        if (key->name == atom) {
+            log_err(builder->ctx, "Key name %s assigned to multiple keys\n",
+                    KeyNameText(builder->ctx, atom));
+            return 0;
+        }
+    }
+
+    if (kc < darray_size(builder->keys) &&
+        darray_item(builder->keys, kc).name != XKB_ATOM_NONE) {
+        log_err(builder->ctx, "Keycode %u was already added as %s\n", kc,
+                KeyNameText(builder->ctx, darray_item(builder->keys, kc).name));
+        return 0;
+    }
+
+    if (kc >= darray_size(builder->keys))
+        darray_resize0(builder->keys, kc + 1);
+
+    darray_item(builder->keys, kc).name = atom;
+    return 1;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_key_set_type(struct xkb_keymap_builder *builder,
+                                xkb_keycode_t kc, xkb_layout_index_t layout,
+                                int type)
+{
+    struct builder_group *group;
+
+    if (type < 0 || (unsigned) type >= darray_size(builder->types)) {
+        log_err_func(builder->ctx, "invalid type index: %d\n", type);
+        return 0;
+    }
+
+    group = GetBuilderGroup(builder, kc, layout);
+    if (!group)
+        return 0;
+
+    group->type = type;
+    return 1;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_key_set_syms(struct xkb_keymap_builder *builder,
+                                xkb_keycode_t kc, xkb_layout_index_t layout,
+                                xkb_level_index_t level_index,
+                                const xkb_keysym_t *syms, int num_syms)
+{
+    struct xkb_level *level;
+
+    if (num_syms < 0 || (num_syms > 0 && !syms)) {
+        log_err_func(builder->ctx, "invalid keysyms: %d\n", num_syms);
+        return 0;
+    }
+
+    level = GetBuilderLevel(builder, kc, layout, level_index);
+    if (!level)
+        return 0;
+
+    ClearLevel(level);
+    if (num_syms == 1) {
+        level->u.sym = syms[0];
+    }
+    else if (num_syms > 1) {
+        level->u.syms = memdup(syms, num_syms, sizeof(*syms));
+        if (!level->u.syms)
+            return 0;
+    }
+    level->num_syms = num_syms;
+    return 1;
+}
+
+static const enum xkb_action_type builder_action_types[] = {
+    [XKB_KEYMAP_BUILDER_ACTION_NONE] = ACTION_TYPE_NONE,
+    [XKB_KEYMAP_BUILDER_ACTION_MOD_SET] = ACTION_TYPE_MOD_SET,
+    [XKB_KEYMAP_BUILDER_ACTION_MOD_LATCH] = ACTION_TYPE_MOD_LATCH,
+    [XKB_KEYMAP_BUILDER_ACTION_MOD_LOCK] = ACTION_TYPE_MOD_LOCK,
+    [XKB_KEYMAP_BUILDER_ACTION_GROUP_SET] = ACTION_TYPE_GROUP_SET,
+    [XKB_KEYMAP_BUILDER_ACTION_GROUP_LATCH] = ACTION_TYPE_GROUP_LATCH,
+    [XKB_KEYMAP_BUILDER_ACTION_GROUP_LOCK] = ACTION_TYPE_GROUP_LOCK,
+};
+
+XKB_EXPORT int
+xkb_keymap_builder_key_set_action(struct xkb_keymap_builder *builder,
+                                  xkb_keycode_t kc, xkb_layout_index_t layout,
+                                  xkb_level_index_t level_index,
+                                  const struct xkb_keymap_builder_action *in)
+{
+    const enum xkb_keymap_builder_action_flags all_flags =
+        XKB_KEYMAP_BUILDER_ACTION_CLEAR_LOCKS |
+        XKB_KEYMAP_BUILDER_ACTION_LATCH_TO_LOCK |
+        XKB_KEYMAP_BUILDER_ACTION_USE_MODMAP |
+        XKB_KEYMAP_BUILDER_ACTION_ABSOLUTE_GROUP;
+    enum xkb_action_flags flags = 0;
+    union xkb_action action;
+    struct xkb_level *level;
+
+    if (!in || (int) in->type < 0 ||
+        (int) in->type >= (int) ARRAY_SIZE(builder_action_types)) {
+        log_err_func(builder->ctx, "invalid action type: %d\n",
+                     in ? (int) in->type : -1);
+        return 0;
+    }
+
+    if (in->flags & ~all_flags) {
+        log_err_func(builder->ctx, "unrecognized action flags: %#x\n",
+                     in->flags);
+        return 0;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.type = builder_action_types[in->type];
+
+    /* Same as the fields the action parser accepts for each type. */
+    if (in->flags & XKB_KEYMAP_BUILDER_ACTION_CLEAR_LOCKS &&
+        (action.type == ACTION_TYPE_MOD_SET ||
+         action.type == ACTION_TYPE_MOD_LATCH ||
+         action.type == ACTION_TYPE_GROUP_SET ||
+         action.type == ACTION_TYPE_GROUP_LATCH))
+        flags |= ACTION_LOCK_CLEAR;
+    if (in->flags & XKB_KEYMAP_BUILDER_ACTION_LATCH_TO_LOCK &&
+        (action.type == ACTION_TYPE_MOD_LATCH ||
+         action.type == ACTION_TYPE_GROUP_LATCH))
+        flags |= ACTION_LATCH_TO_LOCK;
+
+    switch (action.type) {
+    case ACTION_TYPE_MOD_SET:
+    case ACTION_TYPE_MOD_LATCH:
+    case ACTION_TYPE_MOD_LOCK:
+        if (!CheckModMask(builder, in->mods))
+            return 0;
+        if (in->flags & XKB_KEYMAP_BUILDER_ACTION_USE_MODMAP)
+            flags |= ACTION_MODS_LOOKUP_MODMAP;
+        else
+            action.mods.mods.mods = in->mods;
+        action.mods.flags = flags;
+        break;
+    case ACTION_TYPE_GROUP_SET:
+    case ACTION_TYPE_GROUP_LATCH:
+    case ACTION_TYPE_GROUP_LOCK:
+        if (in->flags & XKB_KEYMAP_BUILDER_ACTION_ABSOLUTE_GROUP) {
+            if (in->group < 0 || in->group >= XKB_MAX_GROUPS) {
+                log_err(builder->ctx,
+                        "Layout %d is out of range (1..%d)\n",
+                        in->group + 1, XKB_MAX_GROUPS);
+                return 0;
+            }
+            flags |= ACTION_ABSOLUTE_SWITCH;
+        }
+        action.group.group = in->group;
+        action.group.flags = flags;
+        break;
+    default:
+        break;
+    }
+
+    level = GetBuilderLevel(builder, kc, layout, level_index);
+    if (!level)
+        return 0;
+
+    level->action = action;
+    darray_item(builder->keys, kc).explicit |= EXPLICIT_INTERP;
+    return 1;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_key_set_mods(struct xkb_keymap_builder *builder,
+                                xkb_keycode_t kc, xkb_mod_mask_t mods)
+{
+    struct builder_key *key = GetBuilderKey(builder, kc);
+
+    if (!key || !CheckModMask(builder, mods))
+        return 0;
+
+    key->mods = mods;
+    if (mods & ~MOD_REAL_MASK_ALL)
+        key->explicit |= EXPLICIT_VMODMAP;
+    else
+        key->explicit &= ~EXPLICIT_VMODMAP;
+    return 1;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_key_set_repeats(struct xkb_keymap_builder *builder,
+                                   xkb_keycode_t kc, int repeats)
+{
+    struct builder_key *key = GetBuilderKey(builder, kc);
+
+    if (!key)
+        return 0;
+
+    key->repeats = repeats;
+    key->explicit |= EXPLICIT_REPEAT;
+    return 1;
+}
+
+XKB_EXPORT int
+xkb_keymap_builder_set_layout_name(struct xkb_keymap_builder *builder,
+                                   xkb_layout_index_t layout,
+                                   const char *name)
+{
+    if (!name) {
+        log_err_func1(builder->ctx, "no layout name specified\n");
+        return 0;
+    }
+
+    if (layout >= XKB_MAX_GROUPS) {
+        log_err(builder->ctx, "Layout %u is out of range (1..%d)\n",
+                layout + 1, XKB_MAX_GROUPS);
+        return 0;
+    }
+
+    if (darray_size(builder->group_names) <= layout)
+        darray_resize0(builder->group_names, layout + 1);
+
+    darray_item(builder->group_names, layout) =
+        xkb_atom_intern(builder->ctx, name, strlen(name));
+    return 1;
+}
+
+/***====================================================================***/
+
+static bool
+CopyTypesToKeymap(struct xkb_keymap_builder *builder,
+                  struct xkb_keymap *keymap)
+{
+    /* As in types.c, a default one-level type is used if none is given. */
+    if (darray_empty(builder->types)) {
+        struct xkb_key_type type = {
+            .name = xkb_atom_intern_literal(builder->ctx, "default"),
+            .num_levels = 1,
+        };
+        darray_append(builder->types, type);
+    }
+
+    darray_steal(builder->types, &keymap->types, &keymap->num_types);
+    return true;
+}
+
+/* As FindTypeForGroup() in symbols.c, for a group without a set type. */
+static const struct xkb_key_type *
+FindAutomaticKeyType(struct xkb_keymap *keymap, xkb_atom_t key_name,
+                     const struct xkb_level *levels, xkb_level_index_t width,
+                     xkb_layout_index_t group, bool *explicit_type)
+{
+    xkb_atom_t type_name;
+
+    type_name = FindAutomaticType(keymap->ctx, levels, width);
+    if (type_name == XKB_ATOM_NONE) {
+        log_warn(keymap->ctx,
+                 "Couldn't find an automatic type for key '%s' group %d with %u levels; "
+                 "Using the default type\n",
+                 KeyNameText(keymap->ctx, key_name), group + 1, width);
+        *explicit_type = true;
+        return &keymap->types[0];
+    }
+
+    *explicit_type = false;
+    for (unsigned i = 0; i < keymap->num_types; i++)
+        if (keymap->types[i].name == type_name)
+            return &keymap->types[i];
+
+    log_warn(keymap->ctx,
+             "The type \"%s\" for key '%s' group %d was not previously defined; "
+             "Using the default type\n",
+             xkb_atom_text(keymap->ctx, type_name),
+             KeyNameText(keymap->ctx, key_name), group + 1);
+    return &keymap->types[0];
+}
+
+static const struct xkb_key_type *
+FindTypeForGroup(struct xkb_keymap *keymap, const struct builder_key *keyi,
+                 const struct builder_group *groupi,
+                 xkb_layout_index_t group, bool *explicit_type)
+{
+    if (groupi->type >= 0) {
+        *explicit_type = true;
+        return &keymap->types[groupi->type];
+    }
+
+    return FindAutomaticKeyType(keymap, keyi->name, groupi->levels.item,
+                                darray_size(groupi->levels), group,
+                                explicit_type);
+}
+
+static bool
+CopyKeyToKeymap(struct xkb_keymap *keymap, struct builder_key *keyi,
+                struct xkb_key *key)
+{
+    struct builder_group *groupi;
+    xkb_layout_index_t i;
+
+    key->name = keyi->name;
+    key->modmap = keyi->mods & MOD_REAL_MASK_ALL;
+    key->vmodmap = keyi->mods & ~MOD_REAL_MASK_ALL;
+    key->explicit = keyi->explicit;
+    key->repeats = keyi->repeats;
+
+    if (darray_empty(keyi->groups))
+        return true;
+
+    /*
+     * As in symbols.c, fill the empty groups between non-empty ones with
+     * the first group.
+     */
+    darray_foreach_from(groupi, keyi->groups, 1) {
+        const struct builder_group *group0 = &darray_item(keyi->groups, 0);
+        struct xkb_level *leveli;
+        xkb_level_index_t j;
+
+        if (groupi->defined)
+            continue;
+
+        groupi->type = group0->type;
+        darray_copy(groupi->levels, group0->levels);
+        darray_enumerate(j, leveli, groupi->levels) {
+            if (leveli->num_syms <= 1)
+                continue;
+
+            leveli->u.syms = memdup(leveli->u.syms, leveli->num_syms,
+                                    sizeof(*leveli->u.syms));
+            if (!leveli->u.syms) {
+                /* The rest still point to the first group's keysyms. */
+                darray_foreach_from(leveli, groupi->levels, j)
+                    leveli->num_syms = 0;
+                return false;
+            }
+        }
+    }
+
+    key->groups = calloc(darray_size(keyi->groups), sizeof(*key->groups));
+    if (!key->groups)
+        return false;
+    key->num_groups = darray_size(keyi->groups);
+
+    darray_enumerate(i, groupi, keyi->groups) {
+        const struct xkb_key_type *type;
+        bool explicit_type;
+
+        type = FindTypeForGroup(keymap, keyi, groupi, i, &explicit_type);
+
+        /* Always have as many levels as the type specifies. */
+        if (type->num_levels < darray_size(groupi->levels)) {
+            struct xkb_level *leveli;
+
+            log_vrb(keymap->ctx, 1,
+                    "Type \"%s\" has %d levels, but %s has %d levels; "
+                    "Ignoring extra symbols\n",
+                    xkb_atom_text(keymap->ctx, type->name), type->num_levels,
+                    KeyNameText(keymap->ctx, keyi->name),
+                    (int) darray_size(groupi->levels));
+
+            darray_foreach_from(leveli, groupi->levels, type->num_levels)
+                ClearLevel(leveli);
+        }
+        darray_resize0(groupi->levels, type->num_levels);
+
+        key->groups[i].explicit_type = explicit_type;
+        key->groups[i].type = type;
+        darray_steal(groupi->levels, &key->groups[i].levels, NULL);
+    }
+
+    return true;
+}
+
+static bool
+CopyKeysToKeymap(struct xkb_keymap_builder *builder,
+                 struct xkb_keymap *keymap)
+{
+    xkb_keycode_t min_key_code = XKB_KEYCODE_INVALID, max_key_code = 0, kc;
+    struct builder_key *keyi;
+
+    darray_enumerate(kc, keyi, builder->keys) {
+        if (keyi->name == XKB_ATOM_NONE)
+            continue;
+        min_key_code = MIN(min_key_code, kc);
+        max_key_code = kc;
+    }
+
+    /* As in keycodes.c, use the safest pair we know if there is no key. */
+    if (min_key_code == XKB_KEYCODE_INVALID) {
+        min_key_code = 8;
+        max_key_code = 255;
+    }
+
+    keymap->keys = calloc(max_key_code + 1, sizeof(*keymap->keys));
+    if (!keymap->keys)
+        return false;
+    keymap->min_key_code = min_key_code;
+    keymap->max_key_code = max_key_code;
+
+    for (kc = min_key_code; kc <= max_key_code; kc++)
+        keymap->keys[kc].keycode = kc;
+
+    darray_enumerate(kc, keyi, builder->keys) {
+        if (keyi->name == XKB_ATOM_NONE)
+            continue;
+        if (!CopyKeyToKeymap(keymap, keyi, &keymap->keys[kc]))
+            return false;
+    }
+
+    return true;
+}
+
+XKB_EXPORT struct xkb_keymap *
+xkb_keymap_builder_build(struct xkb_keymap_builder *builder)
+{
+    struct xkb_keymap *keymap = builder->keymap;
+    bool ok;
+
+    ok = CopyTypesToKeymap(builder, keymap) &&
+         CopyKeysToKeymap(builder, keymap);
+
+    if (ok && !darray_empty(builder->group_names))
+        darray_steal(builder->group_names, &keymap->group_names,
+                     &keymap->num_group_names);
+
+    if (ok)
+        ok = UpdateDerivedKeymapFields(keymap);
+
+    /* The keymap is handed over; start over with an empty one. */
+    builder->keymap = NULL;
+    if (!ok) {
+        log_err(builder->ctx, "Failed to build keymap\n");
+        xkb_keymap_unref(keymap);
+        keymap = NULL;
+    }
+
+    ClearBuilder(builder);
+    if (!ResetBuilder(builder)) {
+        xkb_keymap_unref(keymap);
+        return NULL;
+    }
+
+    return keymap;
+}
+
+/***====================================================================***/
+
+static void
+FreeKeyGroups(struct xkb_key *key)
+{
+    for (xkb_layout_index_t i = 0; i < key->num_groups; i++) {
+        for (xkb_level_index_t j = 0; j < XkbKeyNumLevels(key, i); j++)
+            ClearLevel(&key->groups[i].levels[j]);
+        free(key->groups[i].levels);
+    }
+    free(key->groups);
+    key->groups = NULL;
+    key->num_groups = 0;
+}
+
+static bool
+PatchKey(struct xkb_keymap *keymap, struct xkb_key *key,
+         const struct xkb_keymap_key_patch *patch)
+{
+    const struct xkb_key_type *type;
+    struct xkb_level *levels;
+    bool explicit_type;
+
+    /* The key is replaced as a whole, but for its modifier maps. */
+    key->explicit &= ~(EXPLICIT_INTERP | EXPLICIT_REPEAT);
+    key->repeats = false;
+
+    if (patch->num_levels == 0)
+        return true;
+
+    levels = calloc(patch->num_levels, sizeof(*levels));
+    if (!levels)
+        return false;
+    for (xkb_level_index_t i = 0; i < patch->num_levels; i++) {
+        levels[i].num_syms = (patch->syms[i] != XKB_KEY_NoSymbol);
+        levels[i].u.sym = patch->syms[i];
+    }
+
+    type = FindAutomaticKeyType(keymap, key->name, levels, patch->num_levels,
+                                0, &explicit_type);
+
+    /* Always have as many levels as the type specifies. */
+    if (type->num_levels != patch->num_levels) {
+        struct xkb_level *resized;
+
+        if (type->num_levels < patch->num_levels)
+            log_vrb(keymap->ctx, 1,
+                    "Type \"%s\" has %d levels, but %s has %d levels; "
+                    "Ignoring extra symbols\n",
+                    xkb_atom_text(keymap->ctx, type->name), type->num_levels,
+                    KeyNameText(keymap->ctx, key->name),
+                    (int) patch->num_levels);
+
+        resized = realloc(levels, type->num_levels * sizeof(*levels));
+        if (!resized) {
+            free(levels);
+            return false;
+        }
+        levels = resized;
+        for (xkb_level_index_t i = patch->num_levels; i < type->num_levels; i++)
+            memset(&levels[i], 0, sizeof(levels[i]));
+    }
+
+    key->groups = calloc(1, sizeof(*key->groups));
+    if (!key->groups) {
+        free(levels);
+        return false;
+    }
+    key->groups[0].explicit_type = explicit_type;
+    key->groups[0].type = type;
+    key->groups[0].levels = levels;
+    key->num_groups = 1;
+    return true;
+}
+
+XKB_EXPORT struct xkb_keymap *
+xkb_keymap_new_patched(struct xkb_keymap *base,
+                       const struct xkb_keymap_key_patch *patches,
+                       size_t num_patches)
+{
+    struct xkb_keymap *keymap;
+    xkb_keycode_t *keycodes;
+
+    if (num_patches > 0 && !patches) {
+        log_err_func1(base->ctx, "no patches specified\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num_patches; i++) {
+        if (patches[i].key < base->min_key_code ||
+            patches[i].key > base->max_key_code) {
+            log_err(base->ctx,
+                    "Keycode %u is out of the range of the keymap (%u..%u)\n",
+                    patches[i].key, base->min_key_code, base->max_key_code);
+            return NULL;
+        }
+        if (patches[i].num_levels > 0 && !patches[i].syms) {
+            log_err_func(base->ctx, "no keysyms specified for key %u\n",
+                         patches[i].key);
+            return NULL;
+        }
+    }
+
+    keymap = malloc(sizeof(*keymap));
+    if (!keymap)
+        return NULL;
+
+    /* Share everything, then take over the keys array. */
+    *keymap = *base;
+    keymap->refcnt = 1;
+    keymap->ctx = xkb_context_ref(base->ctx);
+    keymap->parent = xkb_keymap_ref(base);
+    /* These belong to the base keymap. */
+    keymap->static_keymap = NULL;
+    keymap->components = NULL;
+    keymap->keys = memdup(base->keys, base->max_key_code + 1,
+                          sizeof(*base->keys));
+    keycodes = calloc(MAX(num_patches, 1), sizeof(*keycodes));
+    if (!keymap->keys || !keycodes)
+        goto err;
+
+    for (size_t i = 0; i < num_patches; i++) {
+        struct xkb_key *key = &keymap->keys[patches[i].key];
+
+        if (key->groups != base->keys[key->keycode].groups)
+            FreeKeyGroups(key);
+        key->groups = NULL;
+        key->num_groups = 0;
+
+        if (!PatchKey(keymap, key, &patches[i]))
+            goto err;
+        keycodes[i] = key->keycode;
+    }
+
+    if (!UpdateDerivedKeyFields(keymap, keycodes, num_patches))
+        goto err;
+
+    free(keycodes);
+    return keymap;
+
+err:
+    log_err(base->ctx, "Failed to patch keymap\n");
+    free(keycodes);
+    xkb_keymap_unref(keymap);
+    return NULL;
+}
@@ -52,6 +52,7 @@
 #include "config.h"
 
 #include "xkbcomp-priv.h"
+#include "keysym.h"
 #include "text.h"
 
 #define BUF_CHUNK_SIZE 4096
@@ -60,25 +61,242 @@ struct buf {
     char *buf;
     size_t size;
     size_t alloc;
+    /*
+     * If set, the text is streamed: whenever the buffer is full, it is
+     * passed to write_fn and emptied, rather than grown.
+     */
+    xkb_keymap_write_fn_t write_fn;
+    void *data;
 };
 
+static void
+buf_fail(struct buf *buf)
+{
+    free(buf->buf);
+    buf->buf = NULL;
+    buf->size = buf->alloc = 0;
+}
+
+/* Pass the contents of a streamed buffer on. */
+static bool
+buf_flush(struct buf *buf)
+{
+    if (buf->size > 0 && !buf->write_fn(buf->data, buf->buf, buf->size)) {
+        buf_fail(buf);
+        return false;
+    }
+
+    buf->size = 0;
+    return true;
+}
+
+/*
+ * Make room for @len more bytes and the terminating NUL.  The buffer
+ * doubles, so that the copies stay linear in the size of the keymap.
+ * A streamed buffer is flushed instead, and only grows for a single
+ * piece of text larger than it.
+ */
 static bool
-do_realloc(struct buf *buf, size_t at_least)
+buf_reserve(struct buf *buf, size_t len)
 {
+    size_t alloc = buf->alloc > 0 ? buf->alloc : BUF_CHUNK_SIZE;
     char *new;
 
-    buf->alloc += BUF_CHUNK_SIZE;
-    if (at_least >= BUF_CHUNK_SIZE)
-        buf->alloc += at_least;
+    if (buf->size + len < buf->alloc)
+        return true;
+
+    if (buf->write_fn && buf->buf) {
+        if (!buf_flush(buf))
+            return false;
+        if (len < buf->alloc)
+            return true;
+    }
 
-    new = realloc(buf->buf, buf->alloc);
-    if (!new)
+    while (alloc <= buf->size + len)
+        alloc *= 2;
+
+    new = realloc(buf->buf, alloc);
+    if (!new) {
+        buf_fail(buf);
         return false;
+    }
 
     buf->buf = new;
+    buf->alloc = alloc;
+    return true;
+}
+
+static bool
+buf_append(struct buf *buf, const char *str, size_t len)
+{
+    if (!buf_reserve(buf, len))
+        return false;
+
+    memcpy(buf->buf + buf->size, str, len);
+    buf->size += len;
+    buf->buf[buf->size] = '\0';
     return true;
 }
 
+/*
+ * Append @str, padded with spaces to the absolute value of @width; as in
+ * printf(), a negative width aligns it to the left.
+ */
+static bool
+buf_append_padded(struct buf *buf, const char *str, size_t len, int width)
+{
+    size_t pad = 0;
+
+    if (width < 0 && len < (size_t) -width)
+        pad = (size_t) -width - len;
+    else if (width > 0 && len < (size_t) width)
+        pad = (size_t) width - len;
+
+    if (!buf_reserve(buf, len + pad))
+        return false;
+
+    if (width > 0) {
+        memset(buf->buf + buf->size, ' ', pad);
+        buf->size += pad;
+    }
+    memcpy(buf->buf + buf->size, str, len);
+    buf->size += len;
+    if (width < 0) {
+        memset(buf->buf + buf->size, ' ', pad);
+        buf->size += pad;
+    }
+    buf->buf[buf->size] = '\0';
+    return true;
+}
+
+/* Append the strings given, up to a NULL one. */
+ATTR_NULL_SENTINEL static bool
+buf_append_strs(struct buf *buf, ...)
+{
+    va_list args;
+    const char *str;
+    bool ok = true;
+
+    va_start(args, buf);
+    while (ok && (str = va_arg(args, const char *)))
+        ok = buf_append(buf, str, strlen(str));
+    va_end(args);
+
+    return ok;
+}
+
+static bool
+buf_append_uint(struct buf *buf, unsigned int value)
+{
+    char digits[16];
+    size_t pos = sizeof(digits);
+
+    do {
+        digits[--pos] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    return buf_append(buf, digits + pos, sizeof(digits) - pos);
+}
+
+static bool
+buf_append_int(struct buf *buf, int value)
+{
+    if (value < 0)
+        return buf_append(buf, "-", 1) &&
+               buf_append_uint(buf, 0u - (unsigned int) value);
+
+    return buf_append_uint(buf, value);
+}
+
+/* Append @value as 0x followed by at least @num_digits hex digits. */
+static bool
+buf_append_hex(struct buf *buf, unsigned int value, unsigned int num_digits)
+{
+    static const char hex[] = "0123456789abcdef";
+    char digits[16];
+    size_t pos = sizeof(digits);
+
+    do {
+        digits[--pos] = hex[value & 0xf];
+        value >>= 4;
+    } while (value > 0 || sizeof(digits) - pos < num_digits);
+    digits[--pos] = 'x';
+    digits[--pos] = '0';
+
+    return buf_append(buf, digits + pos, sizeof(digits) - pos);
+}
+
+static bool
+buf_append_atom(struct buf *buf, struct xkb_context *ctx, xkb_atom_t atom)
+{
+    const char *str = xkb_atom_text(ctx, atom);
+
+    return buf_append(buf, strempty(str), strlen_safe(str));
+}
+
+/* Append the key name @name in angle brackets, padded as above. */
+static bool
+buf_append_key_name(struct buf *buf, struct xkb_context *ctx,
+                    xkb_atom_t name, int width)
+{
+    const char *str = xkb_atom_text(ctx, name);
+    size_t len = strlen_safe(str);
+    char stack[64];
+    char *text = len + 2 <= sizeof(stack) ? stack : malloc(len + 2);
+    bool ok;
+
+    if (!text)
+        return false;
+
+    text[0] = '<';
+    memcpy(text + 1, strempty(str), len);
+    text[len + 1] = '>';
+    ok = buf_append_padded(buf, text, len + 2, width);
+
+    if (text != stack)
+        free(text);
+    return ok;
+}
+
+/* Append the name of @ks, as xkb_keysym_get_name() gives it, padded. */
+static bool
+buf_append_keysym(struct buf *buf, xkb_keysym_t ks, int width)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const char *name;
+    char text[16];
+    size_t len = 0;
+
+    if ((ks & ~0x1fffffffu) != 0)
+        return buf_append_padded(buf, "Invalid", 7, width);
+
+    name = xkb_keysym_name(ks);
+    if (name)
+        return buf_append_padded(buf, name, strlen(name), width);
+
+    if (ks >= 0x01000100 && ks <= 0x0110ffff) {
+        /* Unnamed Unicode codepoint. */
+        const int num_digits = (ks & 0xff0000) ? 8 : 4;
+        text[len++] = 'U';
+        for (int i = num_digits - 1; i >= 0; i--)
+            text[len++] = hex[(ks & 0xffffff) >> (4 * i) & 0xf];
+        return buf_append_padded(buf, text, len, width);
+    }
+
+    /* Unnamed, non-Unicode, symbol (shouldn't generally happen). */
+    text[len++] = '0';
+    text[len++] = 'x';
+    for (int i = 7; i >= 0; i--)
+        text[len++] = hex[ks >> (4 * i) & 0xf] | 0x20;
+    return buf_append_padded(buf, text, len, width);
+}
+
+/*
+ * Formatted output, for what the primitives above do not cover.  With
+ * the buffer growing geometrically, the string is rarely formatted
+ * twice.
+ */
 ATTR_PRINTF(2, 3) static bool
 check_write_buf(struct buf *buf, const char *fmt, ...)
 {
@@ -86,35 +304,38 @@ check_write_buf(struct buf *buf, const char *fmt, ...)
     int printed;
     size_t available;
 
+    if (!buf_reserve(buf, 0))
+        return false;
+
     available = buf->alloc - buf->size;
     va_start(args, fmt);
     printed = vsnprintf(buf->buf + buf->size, available, fmt, args);
     va_end(args);
 
-    if (printed < 0)
-        goto err;
+    if (printed < 0) {
+        buf_fail(buf);
+        return false;
+    }
 
-    if ((size_t) printed >= available)
-        if (!do_realloc(buf, printed))
-            goto err;
+    if ((size_t) printed >= available) {
+        if (!buf_reserve(buf, printed))
+            return false;
 
-    /* The buffer has enough space now. */
+        /* The buffer has enough space now. */
 
-    available = buf->alloc - buf->size;
-    va_start(args, fmt);
-    printed = vsnprintf(buf->buf + buf->size, available, fmt, args);
-    va_end(args);
+        available = buf->alloc - buf->size;
+        va_start(args, fmt);
+        printed = vsnprintf(buf->buf + buf->size, available, fmt, args);
+        va_end(args);
 
-    if (printed < 0 || (size_t) printed >= available)
-        goto err;
+        if (printed < 0 || (size_t) printed >= available) {
+            buf_fail(buf);
+            return false;
+        }
+    }
 
     buf->size += printed;
     return true;
-
-err:
-    free(buf->buf);
-    buf->buf = NULL;
-    return false;
 }
 
 #define write_buf(buf, ...) do { \
@@ -122,6 +343,41 @@ err:
         return false; \
 } while (0)
 
+#define write_strs(buf, ...) do { \
+    if (!buf_append_strs(buf, __VA_ARGS__, (const char *) NULL)) \
+        return false; \
+} while (0)
+
+#define write_uint(buf, value) do { \
+    if (!buf_append_uint(buf, value)) \
+        return false; \
+} while (0)
+
+#define write_int(buf, value) do { \
+    if (!buf_append_int(buf, value)) \
+        return false; \
+} while (0)
+
+#define write_hex(buf, value, num_digits) do { \
+    if (!buf_append_hex(buf, value, num_digits)) \
+        return false; \
+} while (0)
+
+#define write_atom(buf, ctx, atom) do { \
+    if (!buf_append_atom(buf, ctx, atom)) \
+        return false; \
+} while (0)
+
+#define write_key_name(buf, ctx, name, width) do { \
+    if (!buf_append_key_name(buf, ctx, name, width)) \
+        return false; \
+} while (0)
+
+#define write_keysym(buf, ks, width) do { \
+    if (!buf_append_keysym(buf, ks, width)) \
+        return false; \
+} while (0)
+
 static bool
 write_vmods(struct xkb_keymap *keymap, struct buf *buf)
 {
@@ -133,15 +389,27 @@ write_vmods(struct xkb_keymap *keymap, struct buf *buf)
             continue;
 
         if (num_vmods == 0)
-            write_buf(buf, "\tvirtual_modifiers ");
+            write_strs(buf, "\tvirtual_modifiers ");
         else
-            write_buf(buf, ",");
-        write_buf(buf, "%s", xkb_atom_text(keymap->ctx, mod->name));
+            write_strs(buf, ",");
+        write_atom(buf, keymap->ctx, mod->name);
         num_vmods++;
     }
 
     if (num_vmods > 0)
-        write_buf(buf, ";\n\n");
+        write_strs(buf, ";\n\n");
+
+    return true;
+}
+
+/* Write the section header: @type, then the name if any. */
+static bool
+write_section_start(struct buf *buf, const char *type, const char *name)
+{
+    if (name)
+        write_strs(buf, type, " \"", name, "\" {\n");
+    else
+        write_strs(buf, type, " {\n");
 
     return true;
 }
@@ -153,92 +421,298 @@ write_keycodes(struct xkb_keymap *keymap, struct buf *buf)
     xkb_led_index_t idx;
     const struct xkb_led *led;
 
-    if (keymap->keycodes_section_name)
-        write_buf(buf, "xkb_keycodes \"%s\" {\n",
-                  keymap->keycodes_section_name);
-    else
-        write_buf(buf, "xkb_keycodes {\n");
+    if (!write_section_start(buf, "xkb_keycodes",
+                             keymap->keycodes_section_name))
+        return false;
 
     /* xkbcomp and X11 really want to see keymaps with a minimum of 8, and
      * a maximum of at least 255, else XWayland really starts hating life.
      * If this is a problem and people really need strictly bounded keymaps,
      * we should probably control this with a flag. */
-    write_buf(buf, "\tminimum = %u;\n", MIN(keymap->min_key_code, 8));
-    write_buf(buf, "\tmaximum = %u;\n", MAX(keymap->max_key_code, 255));
+    write_strs(buf, "\tminimum = ");
+    write_uint(buf, MIN(keymap->min_key_code, 8));
+    write_strs(buf, ";\n\tmaximum = ");
+    write_uint(buf, MAX(keymap->max_key_code, 255));
+    write_strs(buf, ";\n");
 
     xkb_keys_foreach(key, keymap) {
         if (key->name == XKB_ATOM_NONE)
             continue;
 
-        write_buf(buf, "\t%-20s = %u;\n",
-                  KeyNameText(keymap->ctx, key->name), key->keycode);
+        write_strs(buf, "\t");
+        write_key_name(buf, keymap->ctx, key->name, -20);
+        write_strs(buf, " = ");
+        write_uint(buf, key->keycode);
+        write_strs(buf, ";\n");
     }
 
-    xkb_leds_enumerate(idx, led, keymap)
-        if (led->name != XKB_ATOM_NONE)
-            write_buf(buf, "\tindicator %u = \"%s\";\n",
-                      idx + 1, xkb_atom_text(keymap->ctx, led->name));
+    xkb_leds_enumerate(idx, led, keymap) {
+        if (led->name == XKB_ATOM_NONE)
+            continue;
 
+        write_strs(buf, "\tindicator ");
+        write_uint(buf, idx + 1);
+        write_strs(buf, " = \"");
+        write_atom(buf, keymap->ctx, led->name);
+        write_strs(buf, "\";\n");
+    }
 
-    for (unsigned i = 0; i < keymap->num_key_aliases; i++)
-        write_buf(buf, "\talias %-14s = %s;\n",
-                  KeyNameText(keymap->ctx, keymap->key_aliases[i].alias),
-                  KeyNameText(keymap->ctx, keymap->key_aliases[i].real));
 
-    write_buf(buf, "};\n\n");
+    for (unsigned i = 0; i < keymap->num_key_aliases; i++) {
+        write_strs(buf, "\talias ");
+        write_key_name(buf, keymap->ctx, keymap->key_aliases[i].alias, -14);
+        write_strs(buf, " = ");
+        write_key_name(buf, keymap->ctx, keymap->key_aliases[i].real, 0);
+        write_strs(buf, ";\n");
+    }
+
+    write_strs(buf, "};\n\n");
     return true;
 }
 
+/*
+ * With XKB_KEYMAP_SERIALIZE_CANONICAL_TYPES, only the types which the keys
+ * use are written, and identical types only once, under the first of
+ * their names.  They are sorted by name, and their entries by modifiers,
+ * so that equivalent keymaps give the same text.
+ */
+struct canonical_types {
+    /* The type written in place of each type of the keymap. */
+    const struct xkb_key_type **written;
+    /* The sorted entries of each type written. */
+    struct xkb_key_type_entry **entries;
+    /* The types written, by name. */
+    const struct xkb_key_type **sorted;
+    unsigned int num_sorted;
+};
+
+static int
+cmp_type_entries(const void *a, const void *b)
+{
+    const struct xkb_key_type_entry *ea = a, *eb = b;
+
+    if (ea->mods.mods != eb->mods.mods)
+        return ea->mods.mods < eb->mods.mods ? -1 : 1;
+    if (ea->level != eb->level)
+        return ea->level < eb->level ? -1 : 1;
+    if (ea->preserve.mods != eb->preserve.mods)
+        return ea->preserve.mods < eb->preserve.mods ? -1 : 1;
+    return 0;
+}
+
+static xkb_atom_t
+level_name(const struct xkb_key_type *type, xkb_level_index_t level)
+{
+    return level < type->num_level_names ? type->level_names[level]
+                                         : XKB_ATOM_NONE;
+}
+
 static bool
-write_types(struct xkb_keymap *keymap, struct buf *buf)
+types_equal(const struct xkb_key_type *a,
+            const struct xkb_key_type_entry *a_entries,
+            const struct xkb_key_type *b,
+            const struct xkb_key_type_entry *b_entries)
 {
-    if (keymap->types_section_name)
-        write_buf(buf, "xkb_types \"%s\" {\n",
-                  keymap->types_section_name);
-    else
-        write_buf(buf, "xkb_types {\n");
+    if (a->mods.mods != b->mods.mods || a->num_levels != b->num_levels ||
+        a->num_entries != b->num_entries)
+        return false;
 
-    write_vmods(keymap, buf);
+    for (unsigned i = 0; i < a->num_entries; i++)
+        if (cmp_type_entries(&a_entries[i], &b_entries[i]) != 0)
+            return false;
 
-    for (unsigned i = 0; i < keymap->num_types; i++) {
-        const struct xkb_key_type *type = &keymap->types[i];
+    for (xkb_level_index_t level = 0;
+         level < MAX(a->num_level_names, b->num_level_names); level++)
+        if (level_name(a, level) != level_name(b, level))
+            return false;
 
-        write_buf(buf, "\ttype \"%s\" {\n",
-                  xkb_atom_text(keymap->ctx, type->name));
+    return true;
+}
 
-        write_buf(buf, "\t\tmodifiers= %s;\n",
-                  ModMaskText(keymap->ctx, &keymap->mods, type->mods.mods));
+static int
+cmp_type_names(struct xkb_context *ctx, const struct xkb_key_type *a,
+               const struct xkb_key_type *b)
+{
+    return strcmp(strempty(xkb_atom_text(ctx, a->name)),
+                  strempty(xkb_atom_text(ctx, b->name)));
+}
 
-        for (unsigned j = 0; j < type->num_entries; j++) {
-            const char *str;
-            const struct xkb_key_type_entry *entry = &type->entries[j];
+static void
+canonical_types_free(struct canonical_types *canon, unsigned int num_types)
+{
+    if (canon->entries)
+        for (unsigned i = 0; i < num_types; i++)
+            free(canon->entries[i]);
+    free(canon->written);
+    free(canon->entries);
+    free(canon->sorted);
+}
 
-            /*
-             * Printing level 1 entries is redundant, it's the default,
-             * unless there's preserve info.
-             */
-            if (entry->level == 0 && entry->preserve.mods == 0)
-                continue;
+static bool
+canonical_types_init(struct canonical_types *canon,
+                     struct xkb_keymap *keymap)
+{
+    const struct xkb_key *key;
+    const unsigned int num_types = keymap->num_types;
+    unsigned int *class = NULL;
+    bool *used = NULL;
+
+    canon->written = calloc(num_types, sizeof(*canon->written));
+    canon->entries = calloc(num_types, sizeof(*canon->entries));
+    canon->sorted = calloc(num_types, sizeof(*canon->sorted));
+    canon->num_sorted = 0;
+    class = calloc(num_types, sizeof(*class));
+    used = calloc(num_types, sizeof(*used));
+    if (!canon->written || !canon->entries || !canon->sorted ||
+        !class || !used)
+        goto err;
 
-            str = ModMaskText(keymap->ctx, &keymap->mods, entry->mods.mods);
-            write_buf(buf, "\t\tmap[%s]= %u;\n",
-                      str, entry->level + 1);
+    xkb_keys_foreach(key, keymap)
+        for (xkb_layout_index_t group = 0; group < key->num_groups; group++)
+            used[key->groups[group].type - keymap->types] = true;
+
+    /*
+     * Group all the types by their definitions, so that a type gets the
+     * same name whichever of the identical types the keys use.  The
+     * first type of a group stands for it, and has the written type,
+     * the one with the smallest name.
+     */
+    for (unsigned i = 0; i < num_types; i++) {
+        const struct xkb_key_type *type = &keymap->types[i];
+        struct xkb_key_type_entry *entries;
+        unsigned j;
 
-            if (entry->preserve.mods)
-                write_buf(buf, "\t\tpreserve[%s]= %s;\n",
-                          str, ModMaskText(keymap->ctx, &keymap->mods,
-                                           entry->preserve.mods));
+        entries = malloc((type->num_entries + 1) * sizeof(*entries));
+        if (!entries)
+            goto err;
+        if (type->num_entries > 0) {
+            memcpy(entries, type->entries,
+                   type->num_entries * sizeof(*entries));
+            qsort(entries, type->num_entries, sizeof(*entries),
+                  cmp_type_entries);
         }
+        canon->entries[i] = entries;
+
+        for (j = 0; j < i; j++)
+            if (class[j] == j &&
+                types_equal(type, entries,
+                            &keymap->types[j], canon->entries[j]))
+                break;
+        class[i] = j;
+        if (j == i)
+            canon->written[i] = type;
+        else if (cmp_type_names(keymap->ctx, type, canon->written[j]) < 0)
+            canon->written[j] = type;
+        if (used[i])
+            used[j] = true;
+    }
+
+    for (unsigned i = 0; i < num_types; i++) {
+        const struct xkb_key_type *type;
+        unsigned j;
 
-        for (xkb_level_index_t n = 0; n < type->num_level_names; n++)
-            if (type->level_names[n])
-                write_buf(buf, "\t\tlevel_name[%u]= \"%s\";\n", n + 1,
-                          xkb_atom_text(keymap->ctx, type->level_names[n]));
+        canon->written[i] = canon->written[class[i]];
+        if (class[i] != i || !used[i])
+            continue;
 
-        write_buf(buf, "\t};\n");
+        /* There are few types; sort them by insertion. */
+        type = canon->written[i];
+        for (j = canon->num_sorted;
+             j > 0 && cmp_type_names(keymap->ctx, type,
+                                     canon->sorted[j - 1]) < 0;
+             j--)
+            canon->sorted[j] = canon->sorted[j - 1];
+        canon->sorted[j] = type;
+        canon->num_sorted++;
     }
 
-    write_buf(buf, "};\n\n");
+    free(class);
+    free(used);
+    return true;
+
+err:
+    free(class);
+    free(used);
+    canonical_types_free(canon, num_types);
+    return false;
+}
+
+static bool
+write_type(struct xkb_keymap *keymap, struct buf *buf,
+           const struct xkb_key_type *type,
+           const struct xkb_key_type_entry *entries)
+{
+    write_strs(buf, "\ttype \"");
+    write_atom(buf, keymap->ctx, type->name);
+    write_strs(buf, "\" {\n\t\tmodifiers= ",
+               ModMaskText(keymap->ctx, &keymap->mods, type->mods.mods),
+               ";\n");
+
+    for (unsigned j = 0; j < type->num_entries; j++) {
+        const char *str;
+        const struct xkb_key_type_entry *entry = &entries[j];
+
+        /*
+         * Printing level 1 entries is redundant, it's the default,
+         * unless there's preserve info.
+         */
+        if (entry->level == 0 && entry->preserve.mods == 0)
+            continue;
+
+        str = ModMaskText(keymap->ctx, &keymap->mods, entry->mods.mods);
+        write_strs(buf, "\t\tmap[", str, "]= ");
+        write_uint(buf, entry->level + 1);
+        write_strs(buf, ";\n");
+
+        if (entry->preserve.mods)
+            write_strs(buf, "\t\tpreserve[", str, "]= ",
+                       ModMaskText(keymap->ctx, &keymap->mods,
+                                   entry->preserve.mods),
+                       ";\n");
+    }
+
+    for (xkb_level_index_t n = 0; n < type->num_level_names; n++) {
+        if (!type->level_names[n])
+            continue;
+
+        write_strs(buf, "\t\tlevel_name[");
+        write_uint(buf, n + 1);
+        write_strs(buf, "]= \"");
+        write_atom(buf, keymap->ctx, type->level_names[n]);
+        write_strs(buf, "\";\n");
+    }
+
+    write_strs(buf, "\t};\n");
+    return true;
+}
+
+static bool
+write_types(struct xkb_keymap *keymap, struct buf *buf,
+            const struct canonical_types *canon)
+{
+    if (!write_section_start(buf, "xkb_types", keymap->types_section_name))
+        return false;
+
+    if (!write_vmods(keymap, buf))
+        return false;
+
+    if (canon) {
+        for (unsigned i = 0; i < canon->num_sorted; i++) {
+            const struct xkb_key_type *type = canon->sorted[i];
+            if (!write_type(keymap, buf, type,
+                            canon->entries[type - keymap->types]))
+                return false;
+        }
+    }
+    else {
+        for (unsigned i = 0; i < keymap->num_types; i++) {
+            const struct xkb_key_type *type = &keymap->types[i];
+            if (!write_type(keymap, buf, type, type->entries))
+                return false;
+        }
+    }
+
+    write_strs(buf, "};\n\n");
     return true;
 }
 
@@ -246,33 +720,38 @@ static bool
 write_led_map(struct xkb_keymap *keymap, struct buf *buf,
               const struct xkb_led *led)
 {
-    write_buf(buf, "\tindicator \"%s\" {\n",
-              xkb_atom_text(keymap->ctx, led->name));
+    write_strs(buf, "\tindicator \"");
+    write_atom(buf, keymap->ctx, led->name);
+    write_strs(buf, "\" {\n");
 
     if (led->which_groups) {
         if (led->which_groups != XKB_STATE_LAYOUT_EFFECTIVE) {
-            write_buf(buf, "\t\twhichGroupState= %s;\n",
-                      LedStateMaskText(keymap->ctx, led->which_groups));
+            write_strs(buf, "\t\twhichGroupState= ",
+                       LedStateMaskText(keymap->ctx, led->which_groups),
+                       ";\n");
         }
-        write_buf(buf, "\t\tgroups= 0x%02x;\n",
-                  led->groups);
+        write_strs(buf, "\t\tgroups= ");
+        write_hex(buf, led->groups, 2);
+        write_strs(buf, ";\n");
     }
 
     if (led->which_mods) {
         if (led->which_mods != XKB_STATE_MODS_EFFECTIVE) {
-            write_buf(buf, "\t\twhichModState= %s;\n",
-                      LedStateMaskText(keymap->ctx, led->which_mods));
+            write_strs(buf, "\t\twhichModState= ",
+                       LedStateMaskText(keymap->ctx, led->which_mods),
+                       ";\n");
         }
-        write_buf(buf, "\t\tmodifiers= %s;\n",
-                  ModMaskText(keymap->ctx, &keymap->mods, led->mods.mods));
+        write_strs(buf, "\t\tmodifiers= ",
+                   ModMaskText(keymap->ctx, &keymap->mods, led->mods.mods),
+                   ";\n");
     }
 
     if (led->ctrls) {
-        write_buf(buf, "\t\tcontrols= %s;\n",
-                  ControlMaskText(keymap->ctx, led->ctrls));
+        write_strs(buf, "\t\tcontrols= ",
+                   ControlMaskText(keymap->ctx, led->ctrls), ";\n");
     }
 
-    write_buf(buf, "\t};\n");
+    write_strs(buf, "\t};\n");
     return true;
 }
 
@@ -292,6 +771,13 @@ affect_lock_text(enum xkb_action_flags flags, bool show_both)
     return "";
 }
 
+/* "+" if @value is written as a relative, non-negative, value. */
+static const char *
+relative_sign(bool absolute, bool positive)
+{
+    return !absolute && positive ? "+" : "";
+}
+
 static bool
 write_action(struct xkb_keymap *keymap, struct buf *buf,
              const union xkb_action *action,
@@ -316,90 +802,101 @@ write_action(struct xkb_keymap *keymap, struct buf *buf,
         else
             args = ModMaskText(keymap->ctx, &keymap->mods,
                                action->mods.mods.mods);
-        write_buf(buf, "%s%s(modifiers=%s%s%s%s)%s", prefix, type, args,
-                  (action->type != ACTION_TYPE_MOD_LOCK && (action->mods.flags & ACTION_LOCK_CLEAR)) ? ",clearLocks" : "",
-                  (action->type != ACTION_TYPE_MOD_LOCK && (action->mods.flags & ACTION_LATCH_TO_LOCK)) ? ",latchToLock" : "",
-                  (action->type == ACTION_TYPE_MOD_LOCK) ? affect_lock_text(action->mods.flags, false) : "",
-                  suffix);
+        write_strs(buf, prefix, type, "(modifiers=", args,
+                   (action->type != ACTION_TYPE_MOD_LOCK && (action->mods.flags & ACTION_LOCK_CLEAR)) ? ",clearLocks" : "",
+                   (action->type != ACTION_TYPE_MOD_LOCK && (action->mods.flags & ACTION_LATCH_TO_LOCK)) ? ",latchToLock" : "",
+                   (action->type == ACTION_TYPE_MOD_LOCK) ? affect_lock_text(action->mods.flags, false) : "",
+                   ")", suffix);
         break;
 
     case ACTION_TYPE_GROUP_SET:
     case ACTION_TYPE_GROUP_LATCH:
     case ACTION_TYPE_GROUP_LOCK:
-        write_buf(buf, "%s%s(group=%s%d%s%s)%s", prefix, type,
-                  (!(action->group.flags & ACTION_ABSOLUTE_SWITCH) && action->group.group > 0) ? "+" : "",
-                  (action->group.flags & ACTION_ABSOLUTE_SWITCH) ? action->group.group + 1 : action->group.group,
-                  (action->type != ACTION_TYPE_GROUP_LOCK && (action->group.flags & ACTION_LOCK_CLEAR)) ? ",clearLocks" : "",
-                  (action->type != ACTION_TYPE_GROUP_LOCK && (action->group.flags & ACTION_LATCH_TO_LOCK)) ? ",latchToLock" : "",
-                  suffix);
+        write_strs(buf, prefix, type, "(group=",
+                   relative_sign(action->group.flags & ACTION_ABSOLUTE_SWITCH,
+                                 action->group.group > 0));
+        write_int(buf, (action->group.flags & ACTION_ABSOLUTE_SWITCH) ? action->group.group + 1 : action->group.group);
+        write_strs(buf,
+                   (action->type != ACTION_TYPE_GROUP_LOCK && (action->group.flags & ACTION_LOCK_CLEAR)) ? ",clearLocks" : "",
+                   (action->type != ACTION_TYPE_GROUP_LOCK && (action->group.flags & ACTION_LATCH_TO_LOCK)) ? ",latchToLock" : "",
+                   ")", suffix);
         break;
 
     case ACTION_TYPE_TERMINATE:
-        write_buf(buf, "%s%s()%s", prefix, type, suffix);
+        write_strs(buf, prefix, type, "()", suffix);
         break;
 
     case ACTION_TYPE_PTR_MOVE:
-        write_buf(buf, "%s%s(x=%s%d,y=%s%d%s)%s", prefix, type,
-                  (!(action->ptr.flags & ACTION_ABSOLUTE_X) && action->ptr.x >= 0) ? "+" : "",
-                  action->ptr.x,
-                  (!(action->ptr.flags & ACTION_ABSOLUTE_Y) && action->ptr.y >= 0) ? "+" : "",
-                  action->ptr.y,
-                  (action->ptr.flags & ACTION_ACCEL) ? "" : ",!accel",
-                  suffix);
+        write_strs(buf, prefix, type, "(x=",
+                   relative_sign(action->ptr.flags & ACTION_ABSOLUTE_X,
+                                 action->ptr.x >= 0));
+        write_int(buf, action->ptr.x);
+        write_strs(buf, ",y=",
+                   relative_sign(action->ptr.flags & ACTION_ABSOLUTE_Y,
+                                 action->ptr.y >= 0));
+        write_int(buf, action->ptr.y);
+        write_strs(buf, (action->ptr.flags & ACTION_ACCEL) ? "" : ",!accel",
+                   ")", suffix);
         break;
 
     case ACTION_TYPE_PTR_LOCK:
         args = affect_lock_text(action->btn.flags, true);
         /* fallthrough */
     case ACTION_TYPE_PTR_BUTTON:
-        write_buf(buf, "%s%s(button=", prefix, type);
+        write_strs(buf, prefix, type, "(button=");
         if (action->btn.button > 0 && action->btn.button <= 5)
-            write_buf(buf, "%d", action->btn.button);
+            write_int(buf, action->btn.button);
         else
-            write_buf(buf, "default");
-        if (action->btn.count)
-            write_buf(buf, ",count=%d", action->btn.count);
+            write_strs(buf, "default");
+        if (action->btn.count) {
+            write_strs(buf, ",count=");
+            write_int(buf, action->btn.count);
+        }
         if (args)
-            write_buf(buf, "%s", args);
-        write_buf(buf, ")%s", suffix);
+            write_strs(buf, args);
+        write_strs(buf, ")", suffix);
         break;
 
     case ACTION_TYPE_PTR_DEFAULT:
-        write_buf(buf, "%s%s(", prefix, type);
-        write_buf(buf, "affect=button,button=%s%d",
-                  (!(action->dflt.flags & ACTION_ABSOLUTE_SWITCH) && action->dflt.value >= 0) ? "+" : "",
-                  action->dflt.value);
-        write_buf(buf, ")%s", suffix);
+        write_strs(buf, prefix, type, "(affect=button,button=",
+                   relative_sign(action->dflt.flags & ACTION_ABSOLUTE_SWITCH,
+                                 action->dflt.value >= 0));
+        write_int(buf, action->dflt.value);
+        write_strs(buf, ")", suffix);
         break;
 
     case ACTION_TYPE_SWITCH_VT:
-        write_buf(buf, "%s%s(screen=%s%d,%ssame)%s", prefix, type,
-                  (!(action->screen.flags & ACTION_ABSOLUTE_SWITCH) && action->screen.screen >= 0) ? "+" : "",
-                  action->screen.screen,
-                  (action->screen.flags & ACTION_SAME_SCREEN) ? "" : "!",
-                  suffix);
+        write_strs(buf, prefix, type, "(screen=",
+                   relative_sign(action->screen.flags & ACTION_ABSOLUTE_SWITCH,
+                                 action->screen.screen >= 0));
+        write_int(buf, action->screen.screen);
+        write_strs(buf, ",",
+                   (action->screen.flags & ACTION_SAME_SCREEN) ? "" : "!",
+                   "same)", suffix);
         break;
 
     case ACTION_TYPE_CTRL_SET:
     case ACTION_TYPE_CTRL_LOCK:
-        write_buf(buf, "%s%s(controls=%s%s)%s", prefix, type,
-                  ControlMaskText(keymap->ctx, action->ctrls.ctrls),
-                  (action->type == ACTION_TYPE_CTRL_LOCK) ? affect_lock_text(action->ctrls.flags, false) : "",
-                  suffix);
+        write_strs(buf, prefix, type, "(controls=",
+                   ControlMaskText(keymap->ctx, action->ctrls.ctrls),
+                   (action->type == ACTION_TYPE_CTRL_LOCK) ? affect_lock_text(action->ctrls.flags, false) : "",
+                   ")", suffix);
         break;
 
     case ACTION_TYPE_NONE:
-        write_buf(buf, "%sNoAction()%s", prefix, suffix);
+        write_strs(buf, prefix, "NoAction()", suffix);
         break;
 
     default:
-        write_buf(buf,
-                  "%s%s(type=0x%02x,data[0]=0x%02x,data[1]=0x%02x,data[2]=0x%02x,data[3]=0x%02x,data[4]=0x%02x,data[5]=0x%02x,data[6]=0x%02x)%s",
-                  prefix, type, action->type, action->priv.data[0],
-                  action->priv.data[1], action->priv.data[2],
-                  action->priv.data[3], action->priv.data[4],
-                  action->priv.data[5], action->priv.data[6],
-                  suffix);
+        write_strs(buf, prefix, type, "(type=");
+        write_hex(buf, action->type, 2);
+        for (unsigned i = 0; i < ARRAY_SIZE(action->priv.data); i++) {
+            char data[] = ",data[0]=";
+            data[6] = '0' + i;
+            write_strs(buf, data);
+            write_hex(buf, action->priv.data[i], 2);
+        }
+        write_strs(buf, ")", suffix);
         break;
     }
 
@@ -411,46 +908,52 @@ write_compat(struct xkb_keymap *keymap, struct buf *buf)
 {
     const struct xkb_led *led;
 
-    if (keymap->compat_section_name)
-        write_buf(buf, "xkb_compatibility \"%s\" {\n",
-                  keymap->compat_section_name);
-    else
-        write_buf(buf, "xkb_compatibility {\n");
+    if (!write_section_start(buf, "xkb_compatibility",
+                             keymap->compat_section_name))
+        return false;
 
-    write_vmods(keymap, buf);
+    if (!write_vmods(keymap, buf))
+        return false;
 
-    write_buf(buf, "\tinterpret.useModMapMods= AnyLevel;\n");
-    write_buf(buf, "\tinterpret.repeat= False;\n");
+    write_strs(buf, "\tinterpret.useModMapMods= AnyLevel;\n");
+    write_strs(buf, "\tinterpret.repeat= False;\n");
 
     for (unsigned i = 0; i < keymap->num_sym_interprets; i++) {
         const struct xkb_sym_interpret *si = &keymap->sym_interprets[i];
 
-        write_buf(buf, "\tinterpret %s+%s(%s) {\n",
-                  si->sym ? KeysymText(keymap->ctx, si->sym) : "Any",
-                  SIMatchText(si->match),
-                  ModMaskText(keymap->ctx, &keymap->mods, si->mods));
+        write_strs(buf, "\tinterpret ");
+        if (si->sym)
+            write_keysym(buf, si->sym, 0);
+        else
+            write_strs(buf, "Any");
+        write_strs(buf, "+", SIMatchText(si->match), "(",
+                   ModMaskText(keymap->ctx, &keymap->mods, si->mods),
+                   ") {\n");
 
         if (si->virtual_mod != XKB_MOD_INVALID)
-            write_buf(buf, "\t\tvirtualModifier= %s;\n",
-                      ModIndexText(keymap->ctx, &keymap->mods,
-                                   si->virtual_mod));
+            write_strs(buf, "\t\tvirtualModifier= ",
+                       ModIndexText(keymap->ctx, &keymap->mods,
+                                    si->virtual_mod),
+                       ";\n");
 
         if (si->level_one_only)
-            write_buf(buf, "\t\tuseModMapMods=level1;\n");
+            write_strs(buf, "\t\tuseModMapMods=level1;\n");
 
         if (si->repeat)
-            write_buf(buf, "\t\trepeat= True;\n");
+            write_strs(buf, "\t\trepeat= True;\n");
 
-        write_action(keymap, buf, &si->action, "\t\taction= ", ";\n");
-        write_buf(buf, "\t};\n");
+        if (!write_action(keymap, buf, &si->action, "\t\taction= ", ";\n"))
+            return false;
+        write_strs(buf, "\t};\n");
     }
 
     xkb_leds_foreach(led, keymap)
         if (led->which_groups || led->groups || led->which_mods ||
             led->mods.mods || led->ctrls)
-            write_led_map(keymap, buf, led);
+            if (!write_led_map(keymap, buf, led))
+                return false;
 
-    write_buf(buf, "};\n\n");
+    write_strs(buf, "};\n\n");
 
     return true;
 }
@@ -465,24 +968,24 @@ write_keysyms(struct xkb_keymap *keymap, struct buf *buf,
         int num_syms;
 
         if (level != 0)
-            write_buf(buf, ", ");
+            write_strs(buf, ", ");
 
         num_syms = xkb_keymap_key_get_syms_by_level(keymap, key->keycode,
                                                     group, level, &syms);
         if (num_syms == 0) {
-            write_buf(buf, "%15s", "NoSymbol");
+            write_strs(buf, "       NoSymbol");
         }
         else if (num_syms == 1) {
-            write_buf(buf, "%15s", KeysymText(keymap->ctx, syms[0]));
+            write_keysym(buf, syms[0], 15);
         }
         else {
-            write_buf(buf, "{ ");
+            write_strs(buf, "{ ");
             for (int s = 0; s < num_syms; s++) {
                 if (s != 0)
-                    write_buf(buf, ", ");
-                write_buf(buf, "%s", KeysymText(keymap->ctx, syms[s]));
+                    write_strs(buf, ", ");
+                write_keysym(buf, syms[s], 0);
             }
-            write_buf(buf, " }");
+            write_strs(buf, " }");
         }
     }
 
@@ -491,21 +994,43 @@ write_keysyms(struct xkb_keymap *keymap, struct buf *buf,
 
 static bool
 write_key(struct xkb_keymap *keymap, struct buf *buf,
-          const struct xkb_key *key)
+          const struct canonical_types *canon, const struct xkb_key *key)
 {
     xkb_layout_index_t group;
     bool simple = true;
     bool explicit_types = false;
     bool multi_type = false;
     bool show_actions;
+    const struct xkb_key_type *types[XKB_MAX_GROUPS];
+    bool show_type[XKB_MAX_GROUPS];
 
-    write_buf(buf, "\tkey %-20s {", KeyNameText(keymap->ctx, key->name));
+    write_strs(buf, "\tkey ");
+    write_key_name(buf, keymap->ctx, key->name, -20);
+    write_strs(buf, " {");
 
     for (group = 0; group < key->num_groups; group++) {
-        if (key->groups[group].explicit_type)
+        const struct xkb_group *g = &key->groups[group];
+
+        /*
+         * The canonical types are only written where the key would not
+         * get them automatically, whether they were explicit or not.
+         */
+        if (canon) {
+            types[group] = canon->written[g->type - keymap->types];
+            show_type[group] =
+                FindAutomaticType(keymap->ctx, g->levels,
+                                  types[group]->num_levels) !=
+                types[group]->name;
+        }
+        else {
+            types[group] = g->type;
+            show_type[group] = g->explicit_type;
+        }
+
+        if (show_type[group])
             explicit_types = true;
 
-        if (group != 0 && key->groups[group].type != key->groups[0].type)
+        if (group != 0 && types[group] != types[0])
             multi_type = true;
     }
 
@@ -515,42 +1040,47 @@ write_key(struct xkb_keymap *keymap, struct buf *buf,
 
         if (multi_type) {
             for (group = 0; group < key->num_groups; group++) {
-                if (!key->groups[group].explicit_type)
+                if (!show_type[group])
                     continue;
 
-                type = key->groups[group].type;
-                write_buf(buf, "\n\t\ttype[Group%u]= \"%s\",",
-                            group + 1,
-                            xkb_atom_text(keymap->ctx, type->name));
+                type = types[group];
+                write_strs(buf, "\n\t\ttype[Group");
+                write_uint(buf, group + 1);
+                write_strs(buf, "]= \"");
+                write_atom(buf, keymap->ctx, type->name);
+                write_strs(buf, "\",");
             }
         }
         else {
-            type = key->groups[0].type;
-            write_buf(buf, "\n\t\ttype= \"%s\",",
-                        xkb_atom_text(keymap->ctx, type->name));
+            type = types[0];
+            write_strs(buf, "\n\t\ttype= \"");
+            write_atom(buf, keymap->ctx, type->name);
+            write_strs(buf, "\",");
         }
     }
 
     if (key->explicit & EXPLICIT_REPEAT) {
         if (key->repeats)
-            write_buf(buf, "\n\t\trepeat= Yes,");
+            write_strs(buf, "\n\t\trepeat= Yes,");
         else
-            write_buf(buf, "\n\t\trepeat= No,");
+            write_strs(buf, "\n\t\trepeat= No,");
         simple = false;
     }
 
     if (key->vmodmap && (key->explicit & EXPLICIT_VMODMAP))
-        write_buf(buf, "\n\t\tvirtualMods= %s,",
-                  ModMaskText(keymap->ctx, &keymap->mods, key->vmodmap));
+        write_strs(buf, "\n\t\tvirtualMods= ",
+                   ModMaskText(keymap->ctx, &keymap->mods, key->vmodmap),
+                   ",");
 
     switch (key->out_of_range_group_action) {
     case RANGE_SATURATE:
-        write_buf(buf, "\n\t\tgroupsClamp,");
+        write_strs(buf, "\n\t\tgroupsClamp,");
         break;
 
     case RANGE_REDIRECT:
-        write_buf(buf, "\n\t\tgroupsRedirect= Group%u,",
-                    key->out_of_range_group_number + 1);
+        write_strs(buf, "\n\t\tgroupsRedirect= Group");
+        write_uint(buf, key->out_of_range_group_number + 1);
+        write_strs(buf, ",");
         break;
 
     default:
@@ -563,103 +1093,666 @@ write_key(struct xkb_keymap *keymap, struct buf *buf,
         simple = false;
 
     if (simple) {
-        write_buf(buf, "\t[ ");
+        write_strs(buf, "\t[ ");
         if (!write_keysyms(keymap, buf, key, 0))
             return false;
-        write_buf(buf, " ] };\n");
+        write_strs(buf, " ] };\n");
     }
     else {
         xkb_level_index_t level;
 
         for (group = 0; group < key->num_groups; group++) {
             if (group != 0)
-                write_buf(buf, ",");
-            write_buf(buf, "\n\t\tsymbols[Group%u]= [ ", group + 1);
+                write_strs(buf, ",");
+            write_strs(buf, "\n\t\tsymbols[Group");
+            write_uint(buf, group + 1);
+            write_strs(buf, "]= [ ");
             if (!write_keysyms(keymap, buf, key, group))
                 return false;
-            write_buf(buf, " ]");
+            write_strs(buf, " ]");
             if (show_actions) {
-                write_buf(buf, ",\n\t\tactions[Group%u]= [ ", group + 1);
+                write_strs(buf, ",\n\t\tactions[Group");
+                write_uint(buf, group + 1);
+                write_strs(buf, "]= [ ");
                 for (level = 0; level < XkbKeyNumLevels(key, group); level++) {
                     if (level != 0)
-                        write_buf(buf, ", ");
-                    write_action(keymap, buf,
-                                    &key->groups[group].levels[level].action,
-                                    NULL, NULL);
+                        write_strs(buf, ", ");
+                    if (!write_action(keymap, buf,
+                                      &key->groups[group].levels[level].action,
+                                      NULL, NULL))
+                        return false;
                 }
-                write_buf(buf, " ]");
+                write_strs(buf, " ]");
             }
         }
-        write_buf(buf, "\n\t};\n");
+        write_strs(buf, "\n\t};\n");
     }
 
     return true;
 }
 
 static bool
-write_symbols(struct xkb_keymap *keymap, struct buf *buf)
+write_symbols(struct xkb_keymap *keymap, struct buf *buf,
+              const struct canonical_types *canon)
 {
     const struct xkb_key *key;
     xkb_layout_index_t group;
     xkb_mod_index_t i;
     const struct xkb_mod *mod;
 
-    if (keymap->symbols_section_name)
-        write_buf(buf, "xkb_symbols \"%s\" {\n",
-                  keymap->symbols_section_name);
-    else
-        write_buf(buf, "xkb_symbols {\n");
+    if (!write_section_start(buf, "xkb_symbols",
+                             keymap->symbols_section_name))
+        return false;
+
+    for (group = 0; group < keymap->num_group_names; group++) {
+        if (!keymap->group_names[group])
+            continue;
 
-    for (group = 0; group < keymap->num_group_names; group++)
-        if (keymap->group_names[group])
-            write_buf(buf,
-                      "\tname[Group%u]=\"%s\";\n", group + 1,
-                      xkb_atom_text(keymap->ctx, keymap->group_names[group]));
+        write_strs(buf, "\tname[Group");
+        write_uint(buf, group + 1);
+        write_strs(buf, "]=\"");
+        write_atom(buf, keymap->ctx, keymap->group_names[group]);
+        write_strs(buf, "\";\n");
+    }
     if (group > 0)
-        write_buf(buf, "\n");
+        write_strs(buf, "\n");
 
     xkb_keys_foreach(key, keymap)
-        if (key->num_groups > 0)
-            write_key(keymap, buf, key);
+        if (key->num_groups > 0 && !write_key(keymap, buf, canon, key))
+            return false;
 
     xkb_mods_enumerate(i, mod, &keymap->mods) {
         bool had_any = false;
         xkb_keys_foreach(key, keymap) {
             if (key->modmap & (1u << i)) {
-                if (!had_any)
-                    write_buf(buf, "\tmodifier_map %s { ",
-                              xkb_atom_text(keymap->ctx, mod->name));
-                write_buf(buf, "%s%s",
-                          had_any ? ", " : "",
-                          KeyNameText(keymap->ctx, key->name));
+                if (!had_any) {
+                    write_strs(buf, "\tmodifier_map ");
+                    write_atom(buf, keymap->ctx, mod->name);
+                    write_strs(buf, " { ");
+                }
+                else {
+                    write_strs(buf, ", ");
+                }
+                write_key_name(buf, keymap->ctx, key->name, 0);
                 had_any = true;
             }
         }
         if (had_any)
+            write_strs(buf, " };\n");
+    }
+
+    write_strs(buf, "};\n\n");
+    return true;
+}
+
+static bool
+write_keymap(struct xkb_keymap *keymap, struct buf *buf,
+             enum xkb_keymap_serialize_flags flags)
+{
+    struct canonical_types canon_types;
+    const struct canonical_types *canon = NULL;
+    bool ok;
+
+    if (flags & XKB_KEYMAP_SERIALIZE_CANONICAL_TYPES) {
+        if (!canonical_types_init(&canon_types, keymap))
+            return false;
+        canon = &canon_types;
+    }
+
+    ok = (buf_append_strs(buf, "xkb_keymap {\n", (const char *) NULL) &&
+          write_keycodes(keymap, buf) &&
+          write_types(keymap, buf, canon) &&
+          write_compat(keymap, buf) &&
+          write_symbols(keymap, buf, canon) &&
+          buf_append_strs(buf, "};\n", (const char *) NULL));
+
+    if (canon)
+        canonical_types_free(&canon_types, keymap->num_types);
+    return ok;
+}
+
+/*
+ * A guess of the size of the text of @keymap, a bit above what the usual
+ * keymaps take, so that the buffer is rarely grown.
+ */
+static size_t
+estimate_keymap_size(struct xkb_keymap *keymap)
+{
+    const struct xkb_key *key;
+    size_t size = BUF_CHUNK_SIZE;
+
+    size += keymap->num_types * 256;
+    size += keymap->num_sym_interprets * 96;
+    size += keymap->num_key_aliases * 48;
+    xkb_keys_foreach(key, keymap) {
+        size += 32;
+        for (xkb_layout_index_t group = 0; group < key->num_groups; group++)
+            size += 32 + XkbKeyNumLevels(key, group) * 24;
+    }
+
+    return size;
+}
+
+char *
+text_v1_keymap_get_as_string(struct xkb_keymap *keymap,
+                             enum xkb_keymap_serialize_flags flags)
+{
+    struct buf buf = { NULL, 0, 0, NULL, NULL };
+
+    buf.alloc = estimate_keymap_size(keymap);
+    buf.buf = malloc(buf.alloc);
+    if (!buf.buf)
+        return NULL;
+
+    if (!write_keymap(keymap, &buf, flags)) {
+        free(buf.buf);
+        return NULL;
+    }
+
+    return buf.buf;
+}
+
+bool
+text_v1_keymap_write(struct xkb_keymap *keymap,
+                     enum xkb_keymap_serialize_flags flags,
+                     xkb_keymap_write_fn_t write_fn, void *data)
+{
+    struct buf buf = { NULL, 0, 0, write_fn, data };
+    bool ok;
+
+    buf.alloc = BUF_CHUNK_SIZE;
+    buf.buf = malloc(buf.alloc);
+    if (!buf.buf)
+        return false;
+
+    ok = write_keymap(keymap, &buf, flags) && buf_flush(&buf);
+    free(buf.buf);
+    return ok;
+}
+
+/*
+ * C source output, for xkb_keymap_new_from_static().
+ *
+ * The keymap is written as static tables of the internal structures.
+ * Everything which holds an atom is writable, since the atoms are bound
+ * to the context when the keymap is loaded; the atoms are written as the
+ * index of their string in a sorted table plus one.
+ */
+
+typedef darray(const char *) darray_names;
+
+static int
+cmp_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+static void
+add_name(struct xkb_keymap *keymap, darray_names *names, xkb_atom_t atom)
+{
+    if (atom != XKB_ATOM_NONE)
+        darray_append(*names, xkb_atom_text(keymap->ctx, atom));
+}
+
+/* Collect the strings of all the atom fields, sorted and unique. */
+static void
+collect_names(struct xkb_keymap *keymap, darray_names *names)
+{
+    const struct xkb_key *key;
+    const struct xkb_mod *mod;
+    const struct xkb_led *led;
+    unsigned int num_unique = 0;
+
+    xkb_keys_foreach(key, keymap)
+        add_name(keymap, names, key->name);
+    for (unsigned i = 0; i < keymap->num_key_aliases; i++) {
+        add_name(keymap, names, keymap->key_aliases[i].real);
+        add_name(keymap, names, keymap->key_aliases[i].alias);
+    }
+    for (unsigned i = 0; i < keymap->num_types; i++) {
+        add_name(keymap, names, keymap->types[i].name);
+        for (unsigned j = 0; j < keymap->types[i].num_level_names; j++)
+            add_name(keymap, names, keymap->types[i].level_names[j]);
+    }
+    xkb_mods_foreach(mod, &keymap->mods)
+        add_name(keymap, names, mod->name);
+    for (xkb_layout_index_t i = 0; i < keymap->num_group_names; i++)
+        add_name(keymap, names, keymap->group_names[i]);
+    xkb_leds_foreach(led, keymap)
+        add_name(keymap, names, led->name);
+
+    if (darray_empty(*names))
+        return;
+
+    qsort(names->item, darray_size(*names), sizeof(const char *),
+          cmp_names);
+    for (unsigned i = 0; i < darray_size(*names); i++)
+        if (num_unique == 0 ||
+            strcmp(darray_item(*names, i),
+                   darray_item(*names, num_unique - 1)) != 0)
+            darray_item(*names, num_unique++) = darray_item(*names, i);
+    darray_resize(*names, num_unique);
+}
+
+static unsigned int
+name_index(struct xkb_keymap *keymap, const darray_names *names,
+           xkb_atom_t atom)
+{
+    const char *name;
+    const char **found;
+
+    if (atom == XKB_ATOM_NONE)
+        return 0;
+
+    name = xkb_atom_text(keymap->ctx, atom);
+    found = bsearch(&name, names->item, darray_size(*names),
+                    sizeof(const char *), cmp_names);
+    return found - names->item + 1;
+}
+
+static bool
+emit_string(struct buf *buf, const char *string)
+{
+    write_buf(buf, "\"");
+    for (const unsigned char *c = (const unsigned char *) string; *c; c++) {
+        if (*c == '"' || *c == '\\' || *c == '?')
+            write_buf(buf, "\\%c", *c);
+        else if (*c >= 0x20 && *c < 0x7f)
+            write_buf(buf, "%c", *c);
+        else
+            write_buf(buf, "\\%03o", *c);
+    }
+    write_buf(buf, "\"");
+    return true;
+}
+
+static const char *
+action_type_enum_name(enum xkb_action_type type)
+{
+    static const char *const names[] = {
+        [ACTION_TYPE_NONE] = "ACTION_TYPE_NONE",
+        [ACTION_TYPE_MOD_SET] = "ACTION_TYPE_MOD_SET",
+        [ACTION_TYPE_MOD_LATCH] = "ACTION_TYPE_MOD_LATCH",
+        [ACTION_TYPE_MOD_LOCK] = "ACTION_TYPE_MOD_LOCK",
+        [ACTION_TYPE_GROUP_SET] = "ACTION_TYPE_GROUP_SET",
+        [ACTION_TYPE_GROUP_LATCH] = "ACTION_TYPE_GROUP_LATCH",
+        [ACTION_TYPE_GROUP_LOCK] = "ACTION_TYPE_GROUP_LOCK",
+        [ACTION_TYPE_PTR_MOVE] = "ACTION_TYPE_PTR_MOVE",
+        [ACTION_TYPE_PTR_BUTTON] = "ACTION_TYPE_PTR_BUTTON",
+        [ACTION_TYPE_PTR_LOCK] = "ACTION_TYPE_PTR_LOCK",
+        [ACTION_TYPE_PTR_DEFAULT] = "ACTION_TYPE_PTR_DEFAULT",
+        [ACTION_TYPE_TERMINATE] = "ACTION_TYPE_TERMINATE",
+        [ACTION_TYPE_SWITCH_VT] = "ACTION_TYPE_SWITCH_VT",
+        [ACTION_TYPE_CTRL_SET] = "ACTION_TYPE_CTRL_SET",
+        [ACTION_TYPE_CTRL_LOCK] = "ACTION_TYPE_CTRL_LOCK",
+        [ACTION_TYPE_PRIVATE] = "ACTION_TYPE_PRIVATE",
+    };
+
+    if ((unsigned) type >= ARRAY_SIZE(names))
+        return NULL;
+    return names[type];
+}
+
+static bool
+emit_action(struct buf *buf, const union xkb_action *action)
+{
+    const char *type = action_type_enum_name(action->type);
+
+    switch (action->type) {
+    case ACTION_TYPE_NONE:
+    case ACTION_TYPE_TERMINATE:
+        write_buf(buf, "{ .type = %s }", type);
+        break;
+
+    case ACTION_TYPE_MOD_SET:
+    case ACTION_TYPE_MOD_LATCH:
+    case ACTION_TYPE_MOD_LOCK:
+        write_buf(buf, "{ .mods = { %s, 0x%x, { 0x%x, 0x%x } } }", type,
+                  action->mods.flags, action->mods.mods.mods,
+                  action->mods.mods.mask);
+        break;
+
+    case ACTION_TYPE_GROUP_SET:
+    case ACTION_TYPE_GROUP_LATCH:
+    case ACTION_TYPE_GROUP_LOCK:
+        write_buf(buf, "{ .group = { %s, 0x%x, %d } }", type,
+                  action->group.flags, action->group.group);
+        break;
+
+    case ACTION_TYPE_PTR_MOVE:
+        write_buf(buf, "{ .ptr = { %s, 0x%x, %d, %d } }", type,
+                  action->ptr.flags, action->ptr.x, action->ptr.y);
+        break;
+
+    case ACTION_TYPE_PTR_BUTTON:
+    case ACTION_TYPE_PTR_LOCK:
+        write_buf(buf, "{ .btn = { %s, 0x%x, %u, %u } }", type,
+                  action->btn.flags, action->btn.count, action->btn.button);
+        break;
+
+    case ACTION_TYPE_PTR_DEFAULT:
+        write_buf(buf, "{ .dflt = { %s, 0x%x, %d } }", type,
+                  action->dflt.flags, action->dflt.value);
+        break;
+
+    case ACTION_TYPE_SWITCH_VT:
+        write_buf(buf, "{ .screen = { %s, 0x%x, %d } }", type,
+                  action->screen.flags, action->screen.screen);
+        break;
+
+    case ACTION_TYPE_CTRL_SET:
+    case ACTION_TYPE_CTRL_LOCK:
+        write_buf(buf, "{ .ctrls = { %s, 0x%x, 0x%x } }", type,
+                  action->ctrls.flags, action->ctrls.ctrls);
+        break;
+
+    default:
+        if (type)
+            write_buf(buf, "{ .priv = { %s, {", type);
+        else
+            write_buf(buf, "{ .priv = { (enum xkb_action_type) %d, {",
+                      action->type);
+        for (unsigned i = 0; i < ARRAY_SIZE(action->priv.data); i++)
+            write_buf(buf, "%s0x%02x", i ? ", " : " ",
+                      action->priv.data[i]);
+        write_buf(buf, " } } }");
+        break;
+    }
+
+    return true;
+}
+
+static bool
+emit_names(struct buf *buf, const darray_names *names)
+{
+    const char *const *name;
+
+    if (darray_empty(*names))
+        return true;
+
+    write_buf(buf, "static const char *const names[] = {\n");
+    darray_foreach(name, *names) {
+        write_buf(buf, "    ");
+        if (!emit_string(buf, *name))
+            return false;
+        write_buf(buf, ",\n");
+    }
+    write_buf(buf, "};\n\n");
+    write_buf(buf, "static xkb_atom_t atoms[ARRAY_SIZE(names)];\n\n");
+    return true;
+}
+
+static bool
+emit_types(struct xkb_keymap *keymap, struct buf *buf,
+           const darray_names *names)
+{
+    for (unsigned i = 0; i < keymap->num_types; i++) {
+        const struct xkb_key_type *type = &keymap->types[i];
+
+        if (type->num_entries > 0) {
+            write_buf(buf, "static const struct xkb_key_type_entry "
+                      "type_entries_%u[] = {\n", i);
+            for (unsigned j = 0; j < type->num_entries; j++) {
+                const struct xkb_key_type_entry *entry = &type->entries[j];
+                write_buf(buf, "    { %u, { 0x%x, 0x%x }, { 0x%x, 0x%x } },\n",
+                          entry->level, entry->mods.mods, entry->mods.mask,
+                          entry->preserve.mods, entry->preserve.mask);
+            }
+            write_buf(buf, "};\n\n");
+        }
+
+        if (type->num_level_names > 0) {
+            write_buf(buf, "static xkb_atom_t type_level_names_%u[] = {", i);
+            for (unsigned j = 0; j < type->num_level_names; j++)
+                write_buf(buf, "%s%u", j ? ", " : " ",
+                          name_index(keymap, names, type->level_names[j]));
+            write_buf(buf, " };\n\n");
+        }
+    }
+
+    if (keymap->num_types == 0)
+        return true;
+
+    write_buf(buf, "static struct xkb_key_type types[] = {\n");
+    for (unsigned i = 0; i < keymap->num_types; i++) {
+        const struct xkb_key_type *type = &keymap->types[i];
+
+        write_buf(buf, "    {\n");
+        write_buf(buf, "        .name = %u,\n",
+                  name_index(keymap, names, type->name));
+        write_buf(buf, "        .mods = { 0x%x, 0x%x },\n",
+                  type->mods.mods, type->mods.mask);
+        write_buf(buf, "        .num_levels = %u,\n", type->num_levels);
+        if (type->num_level_names > 0)
+            write_buf(buf, "        .num_level_names = %u,\n"
+                      "        .level_names = type_level_names_%u,\n",
+                      type->num_level_names, i);
+        if (type->num_entries > 0)
+            write_buf(buf, "        .num_entries = %u,\n"
+                      "        .entries = (struct xkb_key_type_entry *) type_entries_%u,\n",
+                      type->num_entries, i);
+        write_buf(buf, "    },\n");
+    }
+    write_buf(buf, "};\n\n");
+    return true;
+}
+
+static bool
+emit_sym_interprets(struct xkb_keymap *keymap, struct buf *buf)
+{
+    if (keymap->num_sym_interprets == 0)
+        return true;
+
+    write_buf(buf, "static const struct xkb_sym_interpret sym_interprets[] = {\n");
+    for (unsigned i = 0; i < keymap->num_sym_interprets; i++) {
+        const struct xkb_sym_interpret *si = &keymap->sym_interprets[i];
+
+        write_buf(buf, "    { 0x%x, %d, 0x%x, %u, ", si->sym, si->match,
+                  si->mods, si->virtual_mod);
+        if (!emit_action(buf, &si->action))
+            return false;
+        write_buf(buf, ", %s, %s },\n", si->level_one_only ? "true" : "false",
+                  si->repeat ? "true" : "false");
+    }
+    write_buf(buf, "};\n\n");
+    return true;
+}
+
+static bool
+emit_key_groups(struct xkb_keymap *keymap, struct buf *buf,
+                const struct xkb_key *key)
+{
+    for (xkb_layout_index_t group = 0; group < key->num_groups; group++) {
+        xkb_level_index_t num_levels = XkbKeyNumLevels(key, group);
+        const struct xkb_level *levels = key->groups[group].levels;
+
+        for (xkb_level_index_t level = 0; level < num_levels; level++) {
+            if (levels[level].num_syms <= 1)
+                continue;
+            write_buf(buf, "static const xkb_keysym_t syms_%u_%u_%u[] = {",
+                      key->keycode, group, level);
+            for (unsigned i = 0; i < levels[level].num_syms; i++)
+                write_buf(buf, "%s0x%x", i ? ", " : " ",
+                          levels[level].u.syms[i]);
             write_buf(buf, " };\n");
+        }
+
+        write_buf(buf, "static const struct xkb_level levels_%u_%u[] = {\n",
+                  key->keycode, group);
+        for (xkb_level_index_t level = 0; level < num_levels; level++) {
+            write_buf(buf, "    { ");
+            if (!emit_action(buf, &levels[level].action))
+                return false;
+            if (levels[level].num_syms == 0)
+                write_buf(buf, ", 0, { 0 } },\n");
+            else if (levels[level].num_syms == 1)
+                write_buf(buf, ", 1, { .sym = 0x%x } },\n",
+                          levels[level].u.sym);
+            else
+                write_buf(buf, ", %u, { .syms = (xkb_keysym_t *) syms_%u_%u_%u } },\n",
+                          levels[level].num_syms, key->keycode, group, level);
+        }
+        write_buf(buf, "};\n");
     }
 
+    write_buf(buf, "static const struct xkb_group groups_%u[] = {\n",
+              key->keycode);
+    for (xkb_layout_index_t group = 0; group < key->num_groups; group++)
+        write_buf(buf, "    { %s, &types[%td], (struct xkb_level *) levels_%u_%u },\n",
+                  key->groups[group].explicit_type ? "true" : "false",
+                  key->groups[group].type - keymap->types,
+                  key->keycode, group);
     write_buf(buf, "};\n\n");
     return true;
 }
 
 static bool
-write_keymap(struct xkb_keymap *keymap, struct buf *buf)
+emit_keys(struct xkb_keymap *keymap, struct buf *buf,
+          const darray_names *names)
 {
-    return (check_write_buf(buf, "xkb_keymap {\n") &&
-            write_keycodes(keymap, buf) &&
-            write_types(keymap, buf) &&
-            write_compat(keymap, buf) &&
-            write_symbols(keymap, buf) &&
-            check_write_buf(buf, "};\n"));
+    const struct xkb_key *key;
+
+    xkb_keys_foreach(key, keymap)
+        if (key->num_groups > 0 && !emit_key_groups(keymap, buf, key))
+            return false;
+
+    write_buf(buf, "static struct xkb_key keys[%u] = {\n",
+              keymap->max_key_code + 1);
+    xkb_keys_foreach(key, keymap) {
+        write_buf(buf, "    [%u] = { %u, %u, 0x%x, 0x%x, 0x%x, %s, %d, %u, %u, ",
+                  key->keycode, key->keycode,
+                  name_index(keymap, names, key->name),
+                  key->explicit, key->modmap, key->vmodmap,
+                  key->repeats ? "true" : "false",
+                  key->out_of_range_group_action,
+                  key->out_of_range_group_number, key->num_groups);
+        if (key->num_groups > 0)
+            write_buf(buf, "(struct xkb_group *) groups_%u },\n", key->keycode);
+        else
+            write_buf(buf, "NULL },\n");
+    }
+    write_buf(buf, "};\n\n");
+    return true;
+}
+
+static bool
+emit_keymap(struct xkb_keymap *keymap, struct buf *buf, const char *name,
+            const darray_names *names)
+{
+    const struct xkb_mod *mod;
+    const struct xkb_led *led;
+    const struct {
+        const char *field;
+        const char *value;
+    } section_names[] = {
+        { "keycodes_section_name", keymap->keycodes_section_name },
+        { "symbols_section_name", keymap->symbols_section_name },
+        { "types_section_name", keymap->types_section_name },
+        { "compat_section_name", keymap->compat_section_name },
+    };
+
+    if (keymap->num_key_aliases > 0) {
+        write_buf(buf, "static struct xkb_key_alias key_aliases[] = {\n");
+        for (unsigned i = 0; i < keymap->num_key_aliases; i++)
+            write_buf(buf, "    { %u, %u },\n",
+                      name_index(keymap, names, keymap->key_aliases[i].real),
+                      name_index(keymap, names, keymap->key_aliases[i].alias));
+        write_buf(buf, "};\n\n");
+    }
+
+    if (keymap->num_group_names > 0) {
+        write_buf(buf, "static xkb_atom_t group_names[] = {");
+        for (xkb_layout_index_t i = 0; i < keymap->num_group_names; i++)
+            write_buf(buf, "%s%u", i ? ", " : " ",
+                      name_index(keymap, names, keymap->group_names[i]));
+        write_buf(buf, " };\n\n");
+    }
+
+    write_buf(buf, "struct xkb_static_keymap %s = {\n", name);
+    write_buf(buf, "    .version = XKB_STATIC_KEYMAP_VERSION,\n");
+    write_buf(buf, "    .size = sizeof(struct xkb_static_keymap),\n");
+    if (!darray_empty(*names))
+        write_buf(buf, "    .names = names,\n"
+                  "    .num_names = ARRAY_SIZE(names),\n"
+                  "    .atoms = atoms,\n");
+    write_buf(buf, "    .keymap = {\n");
+    write_buf(buf, "        .flags = 0x%x,\n", keymap->flags);
+    write_buf(buf, "        .format = %d,\n", keymap->format);
+    write_buf(buf, "        .enabled_ctrls = 0x%x,\n", keymap->enabled_ctrls);
+    write_buf(buf, "        .min_key_code = %u,\n", keymap->min_key_code);
+    write_buf(buf, "        .max_key_code = %u,\n", keymap->max_key_code);
+    write_buf(buf, "        .keys = keys,\n");
+    if (keymap->num_key_aliases > 0)
+        write_buf(buf, "        .num_key_aliases = %u,\n"
+                  "        .key_aliases = key_aliases,\n",
+                  keymap->num_key_aliases);
+    if (keymap->num_types > 0)
+        write_buf(buf, "        .types = types,\n"
+                  "        .num_types = %u,\n", keymap->num_types);
+    if (keymap->num_sym_interprets > 0)
+        write_buf(buf, "        .num_sym_interprets = %u,\n"
+                  "        .sym_interprets = (struct xkb_sym_interpret *) sym_interprets,\n",
+                  keymap->num_sym_interprets);
+    write_buf(buf, "        .mods = {\n");
+    write_buf(buf, "            .mods = {\n");
+    xkb_mods_foreach(mod, &keymap->mods)
+        write_buf(buf, "                { %u, %d, 0x%x },\n",
+                  name_index(keymap, names, mod->name), mod->type,
+                  mod->mapping);
+    write_buf(buf, "            },\n");
+    write_buf(buf, "            .num_mods = %u,\n", keymap->mods.num_mods);
+    write_buf(buf, "        },\n");
+    write_buf(buf, "        .num_groups = %u,\n", keymap->num_groups);
+    if (keymap->num_group_names > 0)
+        write_buf(buf, "        .num_group_names = %u,\n"
+                  "        .group_names = group_names,\n",
+                  keymap->num_group_names);
+    write_buf(buf, "        .leds = {\n");
+    xkb_leds_foreach(led, keymap)
+        write_buf(buf, "            { %u, 0x%x, 0x%x, 0x%x, { 0x%x, 0x%x }, 0x%x },\n",
+                  name_index(keymap, names, led->name), led->which_groups,
+                  led->groups, led->which_mods, led->mods.mods,
+                  led->mods.mask, led->ctrls);
+    write_buf(buf, "        },\n");
+    write_buf(buf, "        .num_leds = %u,\n", keymap->num_leds);
+    for (unsigned i = 0; i < ARRAY_SIZE(section_names); i++) {
+        if (!section_names[i].value)
+            continue;
+        write_buf(buf, "        .%s = (char *) ", section_names[i].field);
+        if (!emit_string(buf, section_names[i].value))
+            return false;
+        write_buf(buf, ",\n");
+    }
+    write_buf(buf, "        .static_keymap = &%s,\n", name);
+    write_buf(buf, "    },\n");
+    write_buf(buf, "};\n");
+    return true;
 }
 
 char *
-text_v1_keymap_get_as_string(struct xkb_keymap *keymap)
+keymap_get_as_c_source(struct xkb_keymap *keymap, const char *name)
 {
     struct buf buf = { NULL, 0, 0 };
-
-    if (!write_keymap(keymap, &buf)) {
+    darray_names names = darray_new();
+    bool ok;
+
+    collect_names(keymap, &names);
+
+    ok = (check_write_buf(&buf,
+                          "/* Generated by compile-keymap --emit-c, do not edit. */\n"
+                          "\n"
+                          "#include \"config.h\"\n"
+                          "\n"
+                          "#include \"keymap.h\"\n"
+                          "\n") &&
+          emit_names(&buf, &names) &&
+          emit_types(keymap, &buf, &names) &&
+          emit_sym_interprets(keymap, &buf) &&
+          emit_keys(keymap, &buf, &names) &&
+          emit_keymap(keymap, &buf, name, &names));
+
+    darray_free(names);
+    if (!ok) {
         free(buf.buf);
         return NULL;
     }
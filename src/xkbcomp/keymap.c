@@ -30,6 +30,8 @@
 #include "config.h"
 
 #include "xkbcomp-priv.h"
+#include "hash.h"
+#include "include.h"
 
 static void
 ComputeEffectiveMask(struct xkb_keymap *keymap, struct xkb_mods *mods)
@@ -63,63 +65,170 @@ static const struct xkb_sym_interpret default_interpret = {
     .action = { .type = ACTION_TYPE_NONE },
 };
 
+/*
+ * Index of keymap->sym_interprets by keysym, so that finding the
+ * interpretation of a level doesn't need to go through all of them.
+ *
+ * The interprets for each keysym, and the XKB_KEY_NoSymbol wildcards, are
+ * chained through next[] in increasing index order, i.e. from the most
+ * specific to the least specific, as set up by compat.c.
+ */
+#define INTERP_NONE UINT_MAX
+
+struct interp_index {
+    /* Open addressing hash table, keyed on the first interpret's sym. */
+    unsigned *heads;
+    unsigned size_mask;
+    unsigned *next;
+    unsigned wildcards;
+};
+
+static bool
+InitInterpIndex(struct interp_index *index, const struct xkb_keymap *keymap)
+{
+    unsigned size;
+
+    index->heads = NULL;
+    index->next = NULL;
+    index->wildcards = INTERP_NONE;
+
+    if (keymap->num_sym_interprets == 0) {
+        index->size_mask = 0;
+        return true;
+    }
+
+    size = hash_table_size(keymap->num_sym_interprets, 1);
+    index->size_mask = size - 1;
+
+    index->heads = malloc(size * sizeof(*index->heads));
+    index->next = malloc(keymap->num_sym_interprets * sizeof(*index->next));
+    if (!index->heads || !index->next) {
+        free(index->heads);
+        free(index->next);
+        return false;
+    }
+    for (unsigned i = 0; i < size; i++)
+        index->heads[i] = INTERP_NONE;
+
+    /* Prepend in reverse, so that the chains end up in order. */
+    for (unsigned i = keymap->num_sym_interprets; i-- > 0;) {
+        const xkb_keysym_t sym = keymap->sym_interprets[i].sym;
+        unsigned *head;
+
+        if (sym == XKB_KEY_NoSymbol) {
+            head = &index->wildcards;
+        }
+        else {
+            unsigned slot = hash_int(sym) & index->size_mask;
+            while (index->heads[slot] != INTERP_NONE &&
+                   keymap->sym_interprets[index->heads[slot]].sym != sym)
+                slot = hash_table_next_slot(slot, size);
+            head = &index->heads[slot];
+        }
+
+        index->next[i] = *head;
+        *head = i;
+    }
+
+    return true;
+}
+
+static void
+FreeInterpIndex(struct interp_index *index)
+{
+    free(index->heads);
+    free(index->next);
+}
+
+static unsigned
+LookupInterpIndex(const struct interp_index *index,
+                  const struct xkb_keymap *keymap, xkb_keysym_t sym)
+{
+    unsigned slot;
+
+    if (!index->heads)
+        return INTERP_NONE;
+
+    slot = hash_int(sym) & index->size_mask;
+    while (index->heads[slot] != INTERP_NONE) {
+        if (keymap->sym_interprets[index->heads[slot]].sym == sym)
+            return index->heads[slot];
+        slot = hash_table_next_slot(slot, index->size_mask + 1);
+    }
+
+    return INTERP_NONE;
+}
+
+static bool
+InterpMatchesMods(const struct xkb_sym_interpret *interp,
+                  xkb_mod_mask_t mods)
+{
+    switch (interp->match) {
+    case MATCH_NONE:
+        return !(interp->mods & mods);
+    case MATCH_ANY_OR_NONE:
+        return (!mods || (interp->mods & mods));
+    case MATCH_ANY:
+        return (interp->mods & mods);
+    case MATCH_ALL:
+        return ((interp->mods & mods) == interp->mods);
+    case MATCH_EXACTLY:
+        return (interp->mods == mods);
+    }
+
+    return false;
+}
+
 /**
  * Find an interpretation which applies to this particular level, either by
  * finding an exact match for the symbol and modifier combination, or a
  * generic XKB_KEY_NoSymbol match.
  */
 static const struct xkb_sym_interpret *
-FindInterpForKey(struct xkb_keymap *keymap, const struct xkb_key *key,
+FindInterpForKey(struct xkb_keymap *keymap, const struct interp_index *index,
+                 const struct xkb_key *key,
                  xkb_layout_index_t group, xkb_level_index_t level)
 {
     const xkb_keysym_t *syms;
     int num_syms;
+    unsigned exact, wildcard;
 
     num_syms = xkb_keymap_key_get_syms_by_level(keymap, key->keycode, group,
                                                 level, &syms);
     if (num_syms == 0)
         return NULL;
 
+    /* Only single keysym levels have exact matches. */
+    exact = (num_syms == 1 ? LookupInterpIndex(index, keymap, syms[0])
+                           : INTERP_NONE);
+    wildcard = index->wildcards;
+
     /*
      * There may be multiple matchings interprets; we should always return
      * the most specific. Here we rely on compat.c to set up the
      * sym_interprets array from the most specific to the least specific,
-     * such that when we find a match we return immediately.
+     * such that when we find a match we return immediately. Walking both
+     * chains in index order keeps that order.
      */
-    for (unsigned i = 0; i < keymap->num_sym_interprets; i++) {
-        const struct xkb_sym_interpret *interp = &keymap->sym_interprets[i];
-
+    while (exact != INTERP_NONE || wildcard != INTERP_NONE) {
+        const struct xkb_sym_interpret *interp;
         xkb_mod_mask_t mods;
-        bool found = false;
 
-        if ((num_syms > 1 || interp->sym != syms[0]) &&
-            interp->sym != XKB_KEY_NoSymbol)
-            continue;
+        if (exact < wildcard) {
+            interp = &keymap->sym_interprets[exact];
+            exact = index->next[exact];
+        }
+        else {
+            interp = &keymap->sym_interprets[wildcard];
+            wildcard = index->next[wildcard];
+        }
 
         if (interp->level_one_only && level != 0)
             mods = 0;
         else
             mods = key->modmap;
 
-        switch (interp->match) {
-        case MATCH_NONE:
-            found = !(interp->mods & mods);
-            break;
-        case MATCH_ANY_OR_NONE:
-            found = (!mods || (interp->mods & mods));
-            break;
-        case MATCH_ANY:
-            found = (interp->mods & mods);
-            break;
-        case MATCH_ALL:
-            found = ((interp->mods & mods) == interp->mods);
-            break;
-        case MATCH_EXACTLY:
-            found = (interp->mods == mods);
-            break;
-        }
-
-        if (found)
+        if (InterpMatchesMods(interp, mods))
             return interp;
     }
 
@@ -127,7 +236,8 @@ FindInterpForKey(struct xkb_keymap *keymap, const struct xkb_key *key,
 }
 
 static bool
-ApplyInterpsToKey(struct xkb_keymap *keymap, struct xkb_key *key)
+ApplyInterpsToKey(struct xkb_keymap *keymap, const struct interp_index *index,
+                  struct xkb_key *key)
 {
     xkb_mod_mask_t vmodmap = 0;
     xkb_layout_index_t group;
@@ -141,7 +251,7 @@ ApplyInterpsToKey(struct xkb_keymap *keymap, struct xkb_key *key)
         for (level = 0; level < XkbKeyNumLevels(key, group); level++) {
             const struct xkb_sym_interpret *interp;
 
-            interp = FindInterpForKey(keymap, key, group, level);
+            interp = FindInterpForKey(keymap, index, key, group, level);
             if (!interp)
                 continue;
 
@@ -171,19 +281,28 @@ ApplyInterpsToKey(struct xkb_keymap *keymap, struct xkb_key *key)
  * your actions and types are a lot more useful when any of your modifiers
  * other than Shift actually do something ...
  */
-static bool
+bool
 UpdateDerivedKeymapFields(struct xkb_keymap *keymap)
 {
     struct xkb_key *key;
     struct xkb_mod *mod;
     struct xkb_led *led;
+    struct interp_index index;
     unsigned int i, j;
 
+    if (!InitInterpIndex(&index, keymap))
+        return false;
+
     /* Find all the interprets for the key and bind them to actions,
      * which will also update the vmodmap. */
-    xkb_keys_foreach(key, keymap)
-        if (!ApplyInterpsToKey(keymap, key))
+    xkb_keys_foreach(key, keymap) {
+        if (!ApplyInterpsToKey(keymap, &index, key)) {
+            FreeInterpIndex(&index);
             return false;
+        }
+    }
+
+    FreeInterpIndex(&index);
 
     /* Update keymap->mods, the virtual -> real mod mapping. */
     xkb_keys_foreach(key, keymap)
@@ -219,6 +338,43 @@ UpdateDerivedKeymapFields(struct xkb_keymap *keymap)
     return true;
 }
 
+/*
+ * Bind the interprets to some keys of an otherwise complete keymap, and
+ * update their actions. The modifier maps of the keys are kept, so that
+ * the virtual modifier mappings, and all the masks computed from them,
+ * stay the same.
+ */
+bool
+UpdateDerivedKeyFields(struct xkb_keymap *keymap,
+                       const xkb_keycode_t *keycodes, size_t num_keycodes)
+{
+    struct interp_index index;
+
+    if (!InitInterpIndex(&index, keymap))
+        return false;
+
+    for (size_t k = 0; k < num_keycodes; k++) {
+        struct xkb_key *key = &keymap->keys[keycodes[k]];
+        const xkb_mod_mask_t vmodmap = key->vmodmap;
+
+        if (!ApplyInterpsToKey(keymap, &index, key)) {
+            FreeInterpIndex(&index);
+            return false;
+        }
+        key->vmodmap = vmodmap;
+
+        for (xkb_layout_index_t i = 0; i < key->num_groups; i++)
+            for (xkb_level_index_t j = 0; j < XkbKeyNumLevels(key, i); j++)
+                UpdateActionMods(keymap, &key->groups[i].levels[j].action,
+                                 key->modmap);
+
+        keymap->num_groups = MAX(keymap->num_groups, key->num_groups);
+    }
+
+    FreeInterpIndex(&index);
+    return true;
+}
+
 typedef bool (*compile_file_fn)(XkbFile *file,
                                 struct xkb_keymap *keymap,
                                 enum merge_mode merge);
@@ -230,6 +386,13 @@ static const compile_file_fn compile_file_fns[LAST_KEYMAP_FILE_TYPE + 1] = {
     [FILE_TYPE_SYMBOLS] = CompileSymbols,
 };
 
+static const enum xkb_compile_phase compile_file_phases[LAST_KEYMAP_FILE_TYPE + 1] = {
+    [FILE_TYPE_KEYCODES] = XKB_COMPILE_PHASE_KEYCODES,
+    [FILE_TYPE_TYPES] = XKB_COMPILE_PHASE_TYPES,
+    [FILE_TYPE_COMPAT] = XKB_COMPILE_PHASE_COMPAT,
+    [FILE_TYPE_SYMBOLS] = XKB_COMPILE_PHASE_SYMBOLS,
+};
+
 bool
 CompileKeymap(XkbFile *file, struct xkb_keymap *keymap, enum merge_mode merge)
 {
@@ -237,6 +400,7 @@ CompileKeymap(XkbFile *file, struct xkb_keymap *keymap, enum merge_mode merge)
     XkbFile *files[LAST_KEYMAP_FILE_TYPE + 1] = { NULL };
     enum xkb_file_type type;
     struct xkb_context *ctx = keymap->ctx;
+    int prev_phase;
 
     /* Collect section files and check for duplicates. */
     for (file = (XkbFile *) file->defs; file;
@@ -281,6 +445,13 @@ CompileKeymap(XkbFile *file, struct xkb_keymap *keymap, enum merge_mode merge)
     if (!ok)
         return false;
 
+    /* Parse the include trees of the sections concurrently, if asked to. */
+    if (ctx->parallel_compile) {
+        prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_PARSE);
+        PrefetchKeymapIncludes(ctx, files);
+        profile_leave_phase(ctx, prev_phase);
+    }
+
     /* Compile sections. */
     for (type = FIRST_KEYMAP_FILE_TYPE;
          type <= LAST_KEYMAP_FILE_TYPE;
@@ -288,13 +459,158 @@ CompileKeymap(XkbFile *file, struct xkb_keymap *keymap, enum merge_mode merge)
         log_dbg(ctx, "Compiling %s \"%s\"\n",
                 xkb_file_type_to_string(type), files[type]->name);
 
+        /* Remember what the symbols are compiled on top of. */
+        if (type == FILE_TYPE_SYMBOLS && keymap->components)
+            keymap->components->mods = keymap->mods;
+
+        prev_phase = profile_enter_phase(ctx, compile_file_phases[type]);
         ok = compile_file_fns[type](files[type], keymap, merge);
+        profile_leave_phase(ctx, prev_phase);
         if (!ok) {
             log_err(ctx, "Failed to compile %s\n",
                     xkb_file_type_to_string(type));
+            break;
+        }
+    }
+
+    ClearPrefetchedIncludes(ctx);
+    if (!ok)
+        return false;
+
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_DERIVED);
+    ok = UpdateDerivedKeymapFields(keymap);
+    profile_leave_phase(ctx, prev_phase);
+
+    return ok;
+}
+
+/*
+ * Copy the keycodes, types and compat sections of base to a new keymap,
+ * as they were before the symbols section was compiled on top of them.
+ */
+static bool
+CopyKeymapSections(struct xkb_keymap *keymap, const struct xkb_keymap *base)
+{
+    xkb_keycode_t kc;
+
+    keymap->keys = calloc(base->max_key_code + 1, sizeof(*keymap->keys));
+    if (!keymap->keys)
+        return false;
+    for (kc = base->min_key_code; kc <= base->max_key_code; kc++) {
+        keymap->keys[kc].keycode = kc;
+        keymap->keys[kc].name = base->keys[kc].name;
+    }
+    keymap->min_key_code = base->min_key_code;
+    keymap->max_key_code = base->max_key_code;
+
+    if (base->num_key_aliases > 0) {
+        keymap->key_aliases = memdup(base->key_aliases, base->num_key_aliases,
+                                     sizeof(*base->key_aliases));
+        if (!keymap->key_aliases)
             return false;
+        keymap->num_key_aliases = base->num_key_aliases;
+    }
+
+    if (base->num_types > 0) {
+        keymap->types = calloc(base->num_types, sizeof(*keymap->types));
+        if (!keymap->types)
+            return false;
+        keymap->num_types = base->num_types;
+
+        for (unsigned i = 0; i < base->num_types; i++) {
+            const struct xkb_key_type *from = &base->types[i];
+            struct xkb_key_type *to = &keymap->types[i];
+
+            *to = *from;
+            to->entries = NULL;
+            to->level_names = NULL;
+
+            if (from->num_entries > 0) {
+                to->entries = memdup(from->entries, from->num_entries,
+                                     sizeof(*from->entries));
+                if (!to->entries)
+                    return false;
+            }
+            if (from->num_level_names > 0) {
+                to->level_names = memdup(from->level_names,
+                                         from->num_level_names,
+                                         sizeof(*from->level_names));
+                if (!to->level_names)
+                    return false;
+            }
+        }
+    }
+
+    if (base->num_sym_interprets > 0) {
+        keymap->sym_interprets = memdup(base->sym_interprets,
+                                        base->num_sym_interprets,
+                                        sizeof(*base->sym_interprets));
+        if (!keymap->sym_interprets)
+            return false;
+        keymap->num_sym_interprets = base->num_sym_interprets;
+    }
+
+    memcpy(keymap->leds, base->leds, sizeof(keymap->leds));
+    keymap->num_leds = base->num_leds;
+
+    keymap->mods = base->components->mods;
+
+    keymap->keycodes_section_name = strdup_safe(base->keycodes_section_name);
+    keymap->types_section_name = strdup_safe(base->types_section_name);
+    keymap->compat_section_name = strdup_safe(base->compat_section_name);
+
+    return true;
+}
+
+/*
+ * Compile only the symbols section of a keymap file, on top of the other
+ * sections of a keymap which was compiled from the same components.
+ */
+bool
+CompileKeymapSymbols(XkbFile *file, struct xkb_keymap *keymap,
+                     const struct xkb_keymap *base, enum merge_mode merge)
+{
+    bool ok;
+    XkbFile *symbols = NULL;
+    struct xkb_context *ctx = keymap->ctx;
+    int prev_phase;
+
+    for (file = (XkbFile *) file->defs; file;
+         file = (XkbFile *) file->common.next) {
+        if (file->file_type == FILE_TYPE_SYMBOLS) {
+            symbols = file;
+            break;
         }
     }
+    if (!symbols) {
+        log_err(ctx, "Required section %s missing from keymap\n",
+                xkb_file_type_to_string(FILE_TYPE_SYMBOLS));
+        return false;
+    }
+
+    if (!CopyKeymapSections(keymap, base)) {
+        log_err(ctx, "Failed to copy the sections of the base keymap\n");
+        return false;
+    }
+
+    log_dbg(ctx, "Compiling %s \"%s\"\n",
+            xkb_file_type_to_string(FILE_TYPE_SYMBOLS), symbols->name);
+
+    if (keymap->components)
+        keymap->components->mods = keymap->mods;
+
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_SYMBOLS);
+    ok = CompileSymbols(symbols, keymap, merge);
+    profile_leave_phase(ctx, prev_phase);
+    if (!ok) {
+        log_err(ctx, "Failed to compile %s\n",
+                xkb_file_type_to_string(FILE_TYPE_SYMBOLS));
+        return false;
+    }
+
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_DERIVED);
+    ok = UpdateDerivedKeymapFields(keymap);
+    profile_leave_phase(ctx, prev_phase);
 
-    return UpdateDerivedKeymapFields(keymap);
+    return ok;
 }
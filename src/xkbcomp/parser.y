@@ -58,23 +58,30 @@ _xkbcommon_error(struct parser_param *param, const char *msg)
 }
 
 static bool
-resolve_keysym(const char *name, xkb_keysym_t *sym_rtrn)
+resolve_keysym(struct xkb_context *ctx, xkb_atom_t atom,
+               xkb_keysym_t *sym_rtrn)
 {
+    const char *name;
     xkb_keysym_t sym;
 
-    if (!name || istreq(name, "any") || istreq(name, "nosymbol")) {
-        *sym_rtrn = XKB_KEY_NoSymbol;
+    /* Most names are real keysym names, so try the (memoized) lookup first. */
+    sym = xkb_keysym_from_atom(ctx, atom);
+    if (sym != XKB_KEY_NoSymbol) {
+        *sym_rtrn = sym;
         return true;
     }
 
-    if (istreq(name, "none") || istreq(name, "voidsymbol")) {
-        *sym_rtrn = XKB_KEY_VoidSymbol;
+    name = xkb_atom_text(ctx, atom);
+    if (!name)
+        return false;
+
+    if (istreq(name, "any") || istreq(name, "nosymbol")) {
+        *sym_rtrn = XKB_KEY_NoSymbol;
         return true;
     }
 
-    sym = xkb_keysym_from_name(name, XKB_KEYSYM_NO_FLAGS);
-    if (sym != XKB_KEY_NoSymbol) {
-        *sym_rtrn = sym;
+    if (istreq(name, "none") || istreq(name, "voidsymbol")) {
+        *sym_rtrn = XKB_KEY_VoidSymbol;
         return true;
     }
 
@@ -726,7 +733,8 @@ KeySyms         :       OBRACE KeySymList CBRACE
 
 KeySym          :       IDENT
                         {
-                            if (!resolve_keysym($1, &$$)) {
+                            xkb_atom_t atom = xkb_atom_intern(param->ctx, $1, strlen($1));
+                            if (!resolve_keysym(param->ctx, atom, &$$)) {
                                 parser_warn(param, "unrecognized keysym \"%s\"", $1);
                                 $$ = XKB_KEY_NoSymbol;
                             }
@@ -745,7 +753,8 @@ KeySym          :       IDENT
                             else {
                                 char buf[32];
                                 snprintf(buf, sizeof(buf), "0x%"PRIx64, $1);
-                                if (!resolve_keysym(buf, &$$)) {
+                                $$ = xkb_keysym_from_name(buf, XKB_KEYSYM_NO_FLAGS);
+                                if ($$ == XKB_KEY_NoSymbol) {
                                     parser_warn(param, "unrecognized keysym \"%s\"", buf);
                                     $$ = XKB_KEY_NoSymbol;
                                 }
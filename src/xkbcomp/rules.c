@@ -49,8 +49,13 @@
 
 #include "config.h"
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
 #include "xkbcomp-priv.h"
 #include "rules.h"
+#include "hash.h"
 #include "include.h"
 #include "scanner-utils.h"
 
@@ -115,8 +120,7 @@ skip_more_whitespace_and_comments:
     if (eof(s)) return TOK_END_OF_FILE;
 
     /* New token. */
-    s->token_line = s->line;
-    s->token_column = s->column;
+    s->token_pos = s->pos;
 
     /* Operators and punctuation. */
     if (chr(s, '!')) return TOK_BANG;
@@ -197,6 +201,8 @@ static const struct sval rules_kccgst_svals[_KCCGST_NUM_ENTRIES] = {
  * we warn the user that his preference was ignored. */
 struct matched_sval {
     struct sval sval;
+    /* The value in the atoms of the rules database, if any. */
+    xkb_atom_t atom;
     bool matched;
 };
 typedef darray(struct matched_sval) darray_matched_sval;
@@ -212,9 +218,13 @@ struct rule_names {
     darray_matched_sval options;
 };
 
+/*
+ * The elements of a group are kept in a hash set, so that testing
+ * membership is a single probe in the common case.
+ */
 struct group {
-    struct sval name;
-    darray_sval elements;
+    xkb_atom_t name;
+    struct hash_atom_set elements;
 };
 
 struct mapping {
@@ -235,30 +245,109 @@ enum mlvo_match_type {
 };
 
 struct rule {
-    struct sval mlvo_value_at_pos[_MLVO_NUM_ENTRIES];
+    xkb_atom_t mlvo_value_at_pos[_MLVO_NUM_ENTRIES];
     enum mlvo_match_type match_type_at_pos[_MLVO_NUM_ENTRIES];
+    /* For MLVO_MATCH_GROUP, the index of the group, or -1 if undeclared. */
+    int group_at_pos[_MLVO_NUM_ENTRIES];
     unsigned int num_mlvo_values;
-    struct sval kccgst_value_at_pos[_KCCGST_NUM_ENTRIES];
+    /* XKB_ATOM_NONE if the value has an invalid %-expansion. */
+    xkb_atom_t kccgst_value_at_pos[_KCCGST_NUM_ENTRIES];
     unsigned int num_kccgst_values;
     bool skip;
 };
 
+struct rule_ref {
+    xkb_atom_t value;
+    unsigned int rule;
+};
+
+/*
+ * A mapping line with its rules.  The rules whose first value is a
+ * literal are indexed by it, so that only the rules which may match
+ * a given RMLVO are tried.
+ */
+struct rule_set {
+    struct mapping mapping;
+    darray(struct rule) rules;
+    /* The literal rules, sorted by value then position. */
+    darray(struct rule_ref) by_value;
+    /* The wildcard and group rules, by position. */
+    darray(unsigned int) others;
+};
+
+/* What is needed to tell whether a file changed since it was read. */
+struct rules_file_id {
+    char *path;
+    bool exists;
+    struct stat st;
+};
+
+/*
+ * A rules file, with its included files, compiled for matching; see
+ * xkb_components_from_rules().  It is kept on the context until the
+ * files change.
+ */
+struct rules_db {
+    /* The main file first, then the included ones. */
+    darray(struct rules_file_id) files;
+    /* The names and values found in the files. */
+    struct atom_table *atoms;
+    darray(struct group) groups;
+    darray(struct rule_set) sets;
+    /*
+     * The keys of the disk cache entries which were checked or written
+     * with this database, so that they are not read again.
+     */
+    darray(darray_char) disk_cache_keys;
+
+    /* Parser state. */
+    struct xkb_context *ctx;
+    union lvalue val;
+    struct mapping mapping;
+    struct rule rule;
+};
+
+/*
+ * An included rules file, kept with the compiled rules files, so that
+ * the files which several of them include, or which a changed file
+ * includes, are not read again.
+ */
+struct rules_include {
+    struct rules_file_id id;
+    char *string;
+    size_t size;
+    /* The number of includes of it being parsed; see rules_db_include(). */
+    unsigned int parsing;
+};
+
+struct rules_cache {
+    darray(struct rules_db *) dbs;
+    darray(struct rules_include *) includes;
+};
+
+/* A %-expanded KcCGST value, in the expansions of the matcher. */
+struct expansion {
+    xkb_atom_t value;
+    unsigned int start, len;
+};
+
 /*
  * This is the main object used to match a given RMLVO against a rules
- * file and aggragate the results in a KcCGST. It goes through a simple
- * matching state machine, with tokens as transitions (see
- * matcher_match()).
+ * database and aggragate the results in a KcCGST.
  */
 struct matcher {
     struct xkb_context *ctx;
+    const struct rules_db *db;
     /* Input.*/
     struct rule_names rmlvo;
-    union lvalue val;
-    darray(struct group) groups;
-    /* Current mapping. */
-    struct mapping mapping;
-    /* Current rule. */
-    struct rule rule;
+    /* The rules of the current set to try, by position. */
+    darray(unsigned int) candidates;
+    /*
+     * The values expanded so far; a value gives the same expansion
+     * wherever it is used, since its layout index is part of it.
+     */
+    darray(struct expansion) expansions;
+    darray_char expanded;
     /* Output. */
     darray_char kccgst[_KCCGST_NUM_ENTRIES];
 };
@@ -299,8 +388,33 @@ split_comma_separated_mlvo(const char *s)
     return arr;
 }
 
+static xkb_atom_t
+rules_db_intern(struct rules_db *db, struct sval val)
+{
+    return atom_intern(db->atoms, val.start, val.len, true);
+}
+
+static xkb_atom_t
+rules_db_lookup(const struct rules_db *db, struct sval val)
+{
+    if (!val.start)
+        return XKB_ATOM_NONE;
+
+    /* Does not modify the table once it is settled; see rules_db_new(). */
+    return atom_intern(db->atoms, val.start, val.len, false);
+}
+
+static void
+lookup_values(const struct rules_db *db, darray_matched_sval *values)
+{
+    struct matched_sval *val;
+
+    darray_foreach(val, *values)
+        val->atom = rules_db_lookup(db, val->sval);
+}
+
 static struct matcher *
-matcher_new(struct xkb_context *ctx,
+matcher_new(struct xkb_context *ctx, const struct rules_db *db,
             const struct xkb_rule_names *rmlvo)
 {
     struct matcher *m = calloc(1, sizeof(*m));
@@ -308,11 +422,16 @@ matcher_new(struct xkb_context *ctx,
         return NULL;
 
     m->ctx = ctx;
+    m->db = db;
     m->rmlvo.model.sval.start = rmlvo->model;
     m->rmlvo.model.sval.len = strlen_safe(rmlvo->model);
+    m->rmlvo.model.atom = rules_db_lookup(db, m->rmlvo.model.sval);
     m->rmlvo.layouts = split_comma_separated_mlvo(rmlvo->layout);
     m->rmlvo.variants = split_comma_separated_mlvo(rmlvo->variant);
     m->rmlvo.options = split_comma_separated_mlvo(rmlvo->options);
+    lookup_values(db, &m->rmlvo.layouts);
+    lookup_values(db, &m->rmlvo.variants);
+    lookup_values(db, &m->rmlvo.options);
 
     return m;
 }
@@ -320,54 +439,226 @@ matcher_new(struct xkb_context *ctx,
 static void
 matcher_free(struct matcher *m)
 {
-    struct group *group;
     if (!m)
         return;
     darray_free(m->rmlvo.layouts);
     darray_free(m->rmlvo.variants);
     darray_free(m->rmlvo.options);
-    darray_foreach(group, m->groups)
-        darray_free(group->elements);
+    darray_free(m->candidates);
+    darray_free(m->expansions);
+    darray_free(m->expanded);
     for (int i = 0; i < _KCCGST_NUM_ENTRIES; i++)
         darray_free(m->kccgst[i]);
-    darray_free(m->groups);
     free(m);
 }
 
 static void
-matcher_group_start_new(struct matcher *m, struct sval name)
+rules_db_free(struct rules_db *db)
+{
+    struct rules_file_id *id;
+    struct group *group;
+    struct rule_set *set;
+    darray_char *key;
+
+    if (!db)
+        return;
+    darray_foreach(id, db->files)
+        free(id->path);
+    darray_foreach(key, db->disk_cache_keys)
+        darray_free(*key);
+    darray_free(db->disk_cache_keys);
+    darray_free(db->files);
+    darray_foreach(group, db->groups)
+        hash_atom_set_free(&group->elements);
+    darray_free(db->groups);
+    darray_foreach(set, db->sets) {
+        darray_free(set->rules);
+        darray_free(set->by_value);
+        darray_free(set->others);
+    }
+    darray_free(db->sets);
+    atom_table_free(db->atoms);
+    free(db);
+}
+
+/* The modification time of a file, in nanoseconds if available. */
+static intmax_t
+file_mtime_ns(const struct stat *st)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return (intmax_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#else
+    return (intmax_t) st->st_mtime * 1000000000;
+#endif
+}
+
+static bool
+same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+           a->st_size == b->st_size &&
+           file_mtime_ns(a) == file_mtime_ns(b);
+}
+
+/* Record the file at @path, which does not exist if @st is NULL. */
+static void
+rules_db_add_file(struct rules_db *db, const char *path,
+                  const struct stat *st)
+{
+    struct rules_file_id *id;
+    struct rules_file_id new = { NULL };
+
+    darray_foreach(id, db->files)
+        if (streq(id->path, path))
+            return;
+
+    new.path = strdup(path);
+    if (st) {
+        new.exists = true;
+        new.st = *st;
+    }
+    darray_append(db->files, new);
+}
+
+static void
+rules_db_group_start_new(struct rules_db *db, struct sval name)
 {
-    struct group group = { .name = name, .elements = darray_new() };
-    darray_append(m->groups, group);
+    struct group group = { .name = rules_db_intern(db, name) };
+    darray_append(db->groups, group);
 }
 
 static void
-matcher_group_add_element(struct matcher *m, struct scanner *s,
-                          struct sval element)
+rules_db_group_add_element(struct rules_db *db, struct scanner *s,
+                           struct sval element)
 {
-    darray_append(darray_item(m->groups, darray_size(m->groups) - 1).elements,
-                  element);
+    struct group *group = &darray_item(db->groups, darray_size(db->groups) - 1);
+
+    if (!hash_atom_set_insert(&group->elements, rules_db_intern(db, element)))
+        scanner_err(s, "couldn't allocate group element; ignored");
 }
 
+static char *
+read_rules_string(struct rules_db *db, FILE *file, const char *path,
+                  size_t *size_out);
+
 static bool
-read_rules_file(struct xkb_context *ctx,
-                struct matcher *matcher,
-                unsigned include_depth,
-                FILE *file,
-                const char *path);
+parse_rules_string(struct rules_db *db, unsigned include_depth,
+                   const char *string, size_t size, const char *path);
+
+static struct rules_include *
+find_rules_include(struct rules_cache *cache, const char *path)
+{
+    struct rules_include **inc;
 
+    darray_foreach(inc, cache->includes)
+        if (streq((*inc)->id.path, path))
+            return *inc;
+
+    return NULL;
+}
+
+/*
+ * Keep the contents of the included file at @path on the context, unless
+ * the previous ones are being parsed.  Takes ownership of @string.
+ */
 static void
-matcher_include(struct matcher *m, struct scanner *parent_scanner,
-                unsigned include_depth,
-                struct sval inc)
+keep_rules_include(struct rules_db *db, const char *path,
+                   const struct stat *st, char *string, size_t size)
 {
-    struct scanner s; /* parses the !include value */
+    struct rules_cache *cache = db->ctx->rules_cache;
+    struct rules_include *inc = find_rules_include(cache, path);
+
+    if (inc && inc->parsing > 0) {
+        free(string);
+        return;
+    }
+
+    if (!inc) {
+        inc = calloc(1, sizeof(*inc));
+        if (inc)
+            inc->id.path = strdup(path);
+        if (!inc || !inc->id.path) {
+            free(inc);
+            free(string);
+            return;
+        }
+        darray_append(cache->includes, inc);
+    }
+
+    free(inc->string);
+    inc->id.exists = true;
+    inc->id.st = *st;
+    inc->string = string;
+    inc->size = size;
+}
+
+/* Parse the included file at @path, from the context if it is unchanged. */
+static bool
+rules_db_read_include(struct rules_db *db, unsigned include_depth,
+                      const char *path)
+{
+    struct rules_include *inc = find_rules_include(db->ctx->rules_cache, path);
+    struct stat st;
     FILE *file;
+    char *string;
+    size_t size;
+    bool ret;
+    int prev_phase;
+
+    if (inc && stat(path, &st) == 0 && same_file(&st, &inc->id.st)) {
+        rules_db_add_file(db, path, &st);
+        /* It may include itself, until the maximum depth. */
+        inc->parsing++;
+        ret = parse_rules_string(db, include_depth, inc->string, inc->size,
+                                 path);
+        inc->parsing--;
+        return ret;
+    }
+
+    prev_phase = profile_enter_phase(db->ctx, XKB_COMPILE_PHASE_FILE_IO);
+    file = fopen(path, "rb");
+    profile_leave_phase(db->ctx, prev_phase);
+    if (!file) {
+        /* Also when missing, so that the database is rebuilt once it exists. */
+        rules_db_add_file(db, path, NULL);
+        log_err(db->ctx, "Failed to open included XKB rules \"%s\"\n", path);
+        return true;
+    }
+
+    profile_count(db->ctx, XKB_COMPILE_COUNTER_FILES_OPENED, 1);
+    if (fstat(fileno(file), &st) != 0) {
+        rules_db_add_file(db, path, NULL);
+        string = NULL;
+    }
+    else {
+        rules_db_add_file(db, path, &st);
+        string = read_rules_string(db, file, path, &size);
+    }
+    fclose(file);
+    if (!string)
+        return false;
+
+    ret = parse_rules_string(db, include_depth, string, size, path);
+    keep_rules_include(db, path, &st, string, size);
+    return ret;
+}
+
+static void
+rules_db_include(struct rules_db *db, struct scanner *parent_scanner,
+                 unsigned include_depth,
+                 struct sval inc)
+{
+    struct scanner s; /* parses the !include value */
 
-    scanner_init(&s, m->ctx, inc.start, inc.len,
+    /*
+     * The include value is a substring of the parent's input; scan it in
+     * place, so that diagnostics point at the parent's !include token.
+     */
+    scanner_init(&s, db->ctx, parent_scanner->s,
+                 (size_t) (inc.start - parent_scanner->s) + inc.len,
                  parent_scanner->file_name, NULL);
-    s.token_line = parent_scanner->token_line;
-    s.token_column = parent_scanner->token_column;
+    s.pos = (size_t) (inc.start - parent_scanner->s);
+    s.token_pos = parent_scanner->token_pos;
     s.buf_pos = 0;
 
     if (include_depth >= MAX_INCLUDE_DEPTH) {
@@ -393,14 +684,14 @@ matcher_include(struct matcher *m, struct scanner *parent_scanner,
                 }
             }
             else if (chr(&s, 'S')) {
-                const char *default_root = xkb_context_include_path_get_system_path(m->ctx);
+                const char *default_root = xkb_context_include_path_get_system_path(db->ctx);
                 if (!buf_appends(&s, default_root) || !buf_appends(&s, "/rules")) {
                     scanner_err(&s, "include path after expanding %%S is too long");
                     return;
                 }
             }
             else if (chr(&s, 'E')) {
-                const char *default_root = xkb_context_include_path_get_extra_path(m->ctx);
+                const char *default_root = xkb_context_include_path_get_extra_path(db->ctx);
                 if (!buf_appends(&s, default_root) || !buf_appends(&s, "/rules")) {
                     scanner_err(&s, "include path after expanding %%E is too long");
                     return;
@@ -420,29 +711,22 @@ matcher_include(struct matcher *m, struct scanner *parent_scanner,
         return;
     }
 
-    file = fopen(s.buf, "rb");
-    if (file) {
-        bool ret = read_rules_file(m->ctx, m, include_depth + 1, file, s.buf);
-        if (!ret)
-            log_err(m->ctx, "No components returned from included XKB rules \"%s\"\n", s.buf);
-        fclose(file);
-    } else {
-        log_err(m->ctx, "Failed to open included XKB rules \"%s\"\n", s.buf);
-    }
+    if (!rules_db_read_include(db, include_depth + 1, s.buf))
+        log_err(db->ctx, "No components returned from included XKB rules \"%s\"\n", s.buf);
 }
 
 static void
-matcher_mapping_start_new(struct matcher *m)
+rules_db_mapping_start_new(struct rules_db *db)
 {
     for (unsigned i = 0; i < _MLVO_NUM_ENTRIES; i++)
-        m->mapping.mlvo_at_pos[i] = -1;
+        db->mapping.mlvo_at_pos[i] = -1;
     for (unsigned i = 0; i < _KCCGST_NUM_ENTRIES; i++)
-        m->mapping.kccgst_at_pos[i] = -1;
-    m->mapping.layout_idx = m->mapping.variant_idx = XKB_LAYOUT_INVALID;
-    m->mapping.num_mlvo = m->mapping.num_kccgst = 0;
-    m->mapping.defined_mlvo_mask = 0;
-    m->mapping.defined_kccgst_mask = 0;
-    m->mapping.skip = false;
+        db->mapping.kccgst_at_pos[i] = -1;
+    db->mapping.layout_idx = db->mapping.variant_idx = XKB_LAYOUT_INVALID;
+    db->mapping.num_mlvo = db->mapping.num_kccgst = 0;
+    db->mapping.defined_mlvo_mask = 0;
+    db->mapping.defined_kccgst_mask = 0;
+    db->mapping.skip = false;
 }
 
 static int
@@ -462,8 +746,8 @@ extract_layout_index(const char *s, size_t max_len, xkb_layout_index_t *out)
 }
 
 static void
-matcher_mapping_set_mlvo(struct matcher *m, struct scanner *s,
-                         struct sval ident)
+rules_db_mapping_set_mlvo(struct rules_db *db, struct scanner *s,
+                          struct sval ident)
 {
     enum rules_mlvo mlvo;
     struct sval mlvo_sval;
@@ -479,14 +763,14 @@ matcher_mapping_set_mlvo(struct matcher *m, struct scanner *s,
     if (mlvo >= _MLVO_NUM_ENTRIES) {
         scanner_err(s, "invalid mapping: %.*s is not a valid value here; ignoring rule set",
                     ident.len, ident.start);
-        m->mapping.skip = true;
+        db->mapping.skip = true;
         return;
     }
 
-    if (m->mapping.defined_mlvo_mask & (1u << mlvo)) {
+    if (db->mapping.defined_mlvo_mask & (1u << mlvo)) {
         scanner_err(s, "invalid mapping: %.*s appears twice on the same line; ignoring rule set",
                     mlvo_sval.len, mlvo_sval.start);
-        m->mapping.skip = true;
+        db->mapping.skip = true;
         return;
     }
 
@@ -498,31 +782,32 @@ matcher_mapping_set_mlvo(struct matcher *m, struct scanner *s,
         if ((int) (ident.len - mlvo_sval.len) != consumed) {
             scanner_err(s, "invalid mapping: \"%.*s\" may only be followed by a valid group index; ignoring rule set",
                         mlvo_sval.len, mlvo_sval.start);
-            m->mapping.skip = true;
+            db->mapping.skip = true;
             return;
         }
 
         if (mlvo == MLVO_LAYOUT) {
-            m->mapping.layout_idx = idx;
+            db->mapping.layout_idx = idx;
         }
         else if (mlvo == MLVO_VARIANT) {
-            m->mapping.variant_idx = idx;
+            db->mapping.variant_idx = idx;
         }
         else {
             scanner_err(s, "invalid mapping: \"%.*s\" cannot be followed by a group index; ignoring rule set",
                         mlvo_sval.len, mlvo_sval.start);
-            m->mapping.skip = true;
+            db->mapping.skip = true;
             return;
         }
     }
 
-    m->mapping.mlvo_at_pos[m->mapping.num_mlvo] = mlvo;
-    m->mapping.defined_mlvo_mask |= 1u << mlvo;
-    m->mapping.num_mlvo++;
+    db->mapping.mlvo_at_pos[db->mapping.num_mlvo] = mlvo;
+    db->mapping.defined_mlvo_mask |= 1u << mlvo;
+    db->mapping.num_mlvo++;
 }
 
 static void
-matcher_mapping_set_kccgst(struct matcher *m, struct scanner *s, struct sval ident)
+rules_db_mapping_set_kccgst(struct rules_db *db, struct scanner *s,
+                            struct sval ident)
 {
     enum rules_kccgst kccgst;
     struct sval kccgst_sval;
@@ -538,172 +823,272 @@ matcher_mapping_set_kccgst(struct matcher *m, struct scanner *s, struct sval ide
     if (kccgst >= _KCCGST_NUM_ENTRIES) {
         scanner_err(s, "invalid mapping: %.*s is not a valid value here; ignoring rule set",
                     ident.len, ident.start);
-        m->mapping.skip = true;
+        db->mapping.skip = true;
         return;
     }
 
-    if (m->mapping.defined_kccgst_mask & (1u << kccgst)) {
+    if (db->mapping.defined_kccgst_mask & (1u << kccgst)) {
         scanner_err(s, "invalid mapping: %.*s appears twice on the same line; ignoring rule set",
                     kccgst_sval.len, kccgst_sval.start);
-        m->mapping.skip = true;
+        db->mapping.skip = true;
         return;
     }
 
-    m->mapping.kccgst_at_pos[m->mapping.num_kccgst] = kccgst;
-    m->mapping.defined_kccgst_mask |= 1u << kccgst;
-    m->mapping.num_kccgst++;
+    db->mapping.kccgst_at_pos[db->mapping.num_kccgst] = kccgst;
+    db->mapping.defined_kccgst_mask |= 1u << kccgst;
+    db->mapping.num_kccgst++;
 }
 
 static void
-matcher_mapping_verify(struct matcher *m, struct scanner *s)
+rules_db_mapping_verify(struct rules_db *db, struct scanner *s)
 {
-    if (m->mapping.num_mlvo == 0) {
+    struct rule_set set = { .mapping = db->mapping };
+
+    if (db->mapping.num_mlvo == 0) {
         scanner_err(s, "invalid mapping: must have at least one value on the left hand side; ignoring rule set");
         goto skip;
     }
 
-    if (m->mapping.num_kccgst == 0) {
+    if (db->mapping.num_kccgst == 0) {
         scanner_err(s, "invalid mapping: must have at least one value on the right hand side; ignoring rule set");
         goto skip;
     }
 
-    /*
-     * This following is very stupid, but this is how it works.
-     * See the "Notes" section in the overview above.
-     */
+    /* Whether it applies to the RMLVO is checked when matching. */
+    darray_append(db->sets, set);
+    return;
+
+skip:
+    db->mapping.skip = true;
+}
 
-    if (m->mapping.defined_mlvo_mask & (1u << MLVO_LAYOUT)) {
-        if (m->mapping.layout_idx == XKB_LAYOUT_INVALID) {
+/*
+ * This following is very stupid, but this is how it works.
+ * See the "Notes" section in the overview above.
+ */
+static bool
+matcher_mapping_applies(struct matcher *m, const struct mapping *mapping)
+{
+    if (mapping->defined_mlvo_mask & (1u << MLVO_LAYOUT)) {
+        if (mapping->layout_idx == XKB_LAYOUT_INVALID) {
             if (darray_size(m->rmlvo.layouts) > 1)
-                goto skip;
+                return false;
         }
         else {
             if (darray_size(m->rmlvo.layouts) == 1 ||
-                m->mapping.layout_idx >= darray_size(m->rmlvo.layouts))
-                goto skip;
+                mapping->layout_idx >= darray_size(m->rmlvo.layouts))
+                return false;
         }
     }
 
-    if (m->mapping.defined_mlvo_mask & (1u << MLVO_VARIANT)) {
-        if (m->mapping.variant_idx == XKB_LAYOUT_INVALID) {
+    if (mapping->defined_mlvo_mask & (1u << MLVO_VARIANT)) {
+        if (mapping->variant_idx == XKB_LAYOUT_INVALID) {
             if (darray_size(m->rmlvo.variants) > 1)
-                goto skip;
+                return false;
         }
         else {
             if (darray_size(m->rmlvo.variants) == 1 ||
-                m->mapping.variant_idx >= darray_size(m->rmlvo.variants))
-                goto skip;
+                mapping->variant_idx >= darray_size(m->rmlvo.variants))
+                return false;
         }
     }
 
-    return;
-
-skip:
-    m->mapping.skip = true;
+    return true;
 }
 
 static void
-matcher_rule_start_new(struct matcher *m)
+rules_db_rule_start_new(struct rules_db *db)
 {
-    memset(&m->rule, 0, sizeof(m->rule));
-    m->rule.skip = m->mapping.skip;
+    memset(&db->rule, 0, sizeof(db->rule));
+    db->rule.skip = db->mapping.skip;
 }
 
 static void
-matcher_rule_set_mlvo_common(struct matcher *m, struct scanner *s,
-                             struct sval ident,
-                             enum mlvo_match_type match_type)
+rules_db_rule_set_mlvo_common(struct rules_db *db, struct scanner *s,
+                              xkb_atom_t value, int group,
+                              enum mlvo_match_type match_type)
 {
-    if (m->rule.num_mlvo_values + 1 > m->mapping.num_mlvo) {
+    if (db->rule.num_mlvo_values + 1 > db->mapping.num_mlvo) {
         scanner_err(s, "invalid rule: has more values than the mapping line; ignoring rule");
-        m->rule.skip = true;
+        db->rule.skip = true;
         return;
     }
-    m->rule.match_type_at_pos[m->rule.num_mlvo_values] = match_type;
-    m->rule.mlvo_value_at_pos[m->rule.num_mlvo_values] = ident;
-    m->rule.num_mlvo_values++;
+    db->rule.match_type_at_pos[db->rule.num_mlvo_values] = match_type;
+    db->rule.mlvo_value_at_pos[db->rule.num_mlvo_values] = value;
+    db->rule.group_at_pos[db->rule.num_mlvo_values] = group;
+    db->rule.num_mlvo_values++;
 }
 
 static void
-matcher_rule_set_mlvo_wildcard(struct matcher *m, struct scanner *s)
+rules_db_rule_set_mlvo_wildcard(struct rules_db *db, struct scanner *s)
 {
-    struct sval dummy = { NULL, 0 };
-    matcher_rule_set_mlvo_common(m, s, dummy, MLVO_MATCH_WILDCARD);
+    rules_db_rule_set_mlvo_common(db, s, XKB_ATOM_NONE, -1,
+                                  MLVO_MATCH_WILDCARD);
 }
 
 static void
-matcher_rule_set_mlvo_group(struct matcher *m, struct scanner *s,
-                            struct sval ident)
+rules_db_rule_set_mlvo_group(struct rules_db *db, struct scanner *s,
+                             struct sval ident)
 {
-    matcher_rule_set_mlvo_common(m, s, ident, MLVO_MATCH_GROUP);
+    xkb_atom_t name = rules_db_intern(db, ident);
+    int group = -1;
+
+    /*
+     * Only the groups defined so far are visible.  rules/evdev
+     * intentionally uses some undeclared group names in rules (e.g.
+     * commented group definitions which may be uncommented if needed);
+     * these never match.
+     */
+    for (unsigned i = 0; i < darray_size(db->groups); i++) {
+        if (darray_item(db->groups, i).name == name) {
+            group = (int) i;
+            break;
+        }
+    }
+
+    rules_db_rule_set_mlvo_common(db, s, name, group, MLVO_MATCH_GROUP);
 }
 
 static void
-matcher_rule_set_mlvo(struct matcher *m, struct scanner *s,
-                      struct sval ident)
+rules_db_rule_set_mlvo(struct rules_db *db, struct scanner *s,
+                       struct sval ident)
 {
-    matcher_rule_set_mlvo_common(m, s, ident, MLVO_MATCH_NORMAL);
+    rules_db_rule_set_mlvo_common(db, s, rules_db_intern(db, ident), -1,
+                                  MLVO_MATCH_NORMAL);
+}
+
+/*
+ * Parse the %-expansion starting after the '%' at str[*i], and advance
+ * *i past it.  Returns NULL if it is valid, or else the reason why not,
+ * which may be empty.
+ */
+static const char *
+parse_expansion(const char *str, size_t len, size_t *i,
+                enum rules_mlvo *mlv, xkb_layout_index_t *idx,
+                char *pfx, char *sfx)
+{
+    if (*i >= len) return "";
+
+    *pfx = *sfx = 0;
+
+    /* Check for prefix. */
+    if (str[*i] == '(' || str[*i] == '+' || str[*i] == '|' ||
+        str[*i] == '_' || str[*i] == '-') {
+        *pfx = str[*i];
+        if (str[*i] == '(') *sfx = ')';
+        if (++*i >= len) return "";
+    }
+
+    /* Mandatory model/layout/variant specifier. */
+    switch (str[(*i)++]) {
+    case 'm': *mlv = MLVO_MODEL; break;
+    case 'l': *mlv = MLVO_LAYOUT; break;
+    case 'v': *mlv = MLVO_VARIANT; break;
+    default: return "";
+    }
+
+    /* Check for index. */
+    *idx = XKB_LAYOUT_INVALID;
+    if (*i < len && str[*i] == '[') {
+        int consumed;
+
+        if (*mlv != MLVO_LAYOUT && *mlv != MLVO_VARIANT)
+            return "invalid index in %-expansion; may only index layout or variant";
+
+        consumed = extract_layout_index(str + *i, len - *i, idx);
+        if (consumed == -1) return "";
+        *i += consumed;
+    }
+
+    /* Check for suffix, if there supposed to be one. */
+    if (*sfx != 0) {
+        if (*i >= len) return "";
+        if (str[(*i)++] != *sfx) return "";
+    }
+
+    return NULL;
 }
 
 static void
-matcher_rule_set_kccgst(struct matcher *m, struct scanner *s,
-                        struct sval ident)
+rules_db_rule_set_kccgst(struct rules_db *db, struct scanner *s,
+                         struct sval ident)
 {
-    if (m->rule.num_kccgst_values + 1 > m->mapping.num_kccgst) {
+    xkb_atom_t value = rules_db_intern(db, ident);
+
+    if (db->rule.num_kccgst_values + 1 > db->mapping.num_kccgst) {
         scanner_err(s, "invalid rule: has more values than the mapping line; ignoring rule");
-        m->rule.skip = true;
+        db->rule.skip = true;
         return;
     }
-    m->rule.kccgst_value_at_pos[m->rule.num_kccgst_values] = ident;
-    m->rule.num_kccgst_values++;
-}
 
-static bool
-match_group(struct matcher *m, struct sval group_name, struct sval to)
-{
-    struct group *group;
-    struct sval *element;
-    bool found = false;
+    /* Check the %-expansions now, rather than each time it matches. */
+    for (size_t i = 0; i < ident.len; ) {
+        enum rules_mlvo mlv;
+        xkb_layout_index_t idx;
+        char pfx, sfx;
+        const char *error;
+
+        if (ident.start[i++] != '%')
+            continue;
 
-    darray_foreach(group, m->groups) {
-        if (svaleq(group->name, group_name)) {
-            found = true;
+        error = parse_expansion(ident.start, ident.len, &i,
+                                &mlv, &idx, &pfx, &sfx);
+        if (error) {
+            if (error[0] != '\0')
+                scanner_err(s, "%s", error);
+            scanner_err(s, "invalid %%-expansion in value; not used");
+            value = XKB_ATOM_NONE;
             break;
         }
     }
 
-    if (!found) {
-        /*
-         * rules/evdev intentionally uses some undeclared group names
-         * in rules (e.g. commented group definitions which may be
-         * uncommented if needed). So we continue silently.
-         */
-        return false;
+    db->rule.kccgst_value_at_pos[db->rule.num_kccgst_values] = value;
+    db->rule.num_kccgst_values++;
+}
+
+static void
+rules_db_rule_verify(struct rules_db *db, struct scanner *s)
+{
+    if (db->rule.num_mlvo_values != db->mapping.num_mlvo ||
+        db->rule.num_kccgst_values != db->mapping.num_kccgst) {
+        scanner_err(s, "invalid rule: must have same number of values as mapping line; ignoring rule");
+        db->rule.skip = true;
     }
+}
 
-    darray_foreach(element, group->elements)
-        if (svaleq(to, *element))
-            return true;
+static void
+rules_db_rule_add(struct rules_db *db)
+{
+    darray_append(darray_item(db->sets, darray_size(db->sets) - 1).rules,
+                  db->rule);
+}
 
-    return false;
+static bool
+match_group(struct matcher *m, int group, xkb_atom_t to)
+{
+    if (group < 0 || to == XKB_ATOM_NONE)
+        return false;
+
+    return hash_atom_set_contains(&darray_item(m->db->groups, group).elements,
+                                  to);
 }
 
 static bool
-match_value(struct matcher *m, struct sval val, struct sval to,
+match_value(struct matcher *m, xkb_atom_t val, int group, xkb_atom_t to,
             enum mlvo_match_type match_type)
 {
     if (match_type == MLVO_MATCH_WILDCARD)
         return true;
     if (match_type == MLVO_MATCH_GROUP)
-        return match_group(m, val, to);
-    return svaleq(val, to);
+        return match_group(m, group, to);
+    return to != XKB_ATOM_NONE && val == to;
 }
 
 static bool
-match_value_and_mark(struct matcher *m, struct sval val,
+match_value_and_mark(struct matcher *m, xkb_atom_t val, int group,
                      struct matched_sval *to, enum mlvo_match_type match_type)
 {
-    bool matched = match_value(m, val, to->sval, match_type);
+    bool matched = match_value(m, val, group, to->atom, match_type);
     if (matched)
         to->matched = true;
     return matched;
@@ -711,22 +1096,32 @@ match_value_and_mark(struct matcher *m, struct sval val,
 
 /*
  * This function performs %-expansion on @value (see overview above),
- * and appends the result to @to.
+ * which is the text @str, and returns the result.  The value was checked
+ * when the rules were read.
  */
-static bool
-append_expanded_kccgst_value(struct matcher *m, struct scanner *s,
-                             darray_char *to, struct sval value)
+static struct sval
+matcher_expand_value(struct matcher *m, xkb_atom_t value, const char *str)
 {
-    const char *str = value.start;
-    darray_char expanded = darray_new();
-    char ch;
-    bool expanded_plus, to_plus;
+    const size_t len = strlen(str);
+    const struct expansion *e;
+    struct expansion new;
+
+    /* Most values expand to themselves. */
+    if (!memchr(str, '%', len))
+        return (struct sval) { str, len };
+
+    darray_foreach(e, m->expansions)
+        if (e->value == value)
+            return (struct sval) { &darray_item(m->expanded, e->start), e->len };
+
+    new.value = value;
+    new.start = darray_size(m->expanded);
 
     /*
      * Some ugly hand-lexing here, but going through the scanner is more
      * trouble than it's worth, and the format is ugly on its own merit.
      */
-    for (unsigned i = 0; i < value.len; ) {
+    for (size_t i = 0; i < len; ) {
         enum rules_mlvo mlv;
         xkb_layout_index_t idx;
         char pfx, sfx;
@@ -735,49 +1130,13 @@ append_expanded_kccgst_value(struct matcher *m, struct scanner *s,
         /* Check if that's a start of an expansion. */
         if (str[i] != '%') {
             /* Just a normal character. */
-            darray_appends_nullterminate(expanded, &str[i++], 1);
+            darray_append(m->expanded, str[i++]);
             continue;
         }
-        if (++i >= value.len) goto error;
-
-        pfx = sfx = 0;
-
-        /* Check for prefix. */
-        if (str[i] == '(' || str[i] == '+' || str[i] == '|' ||
-            str[i] == '_' || str[i] == '-') {
-            pfx = str[i];
-            if (str[i] == '(') sfx = ')';
-            if (++i >= value.len) goto error;
-        }
+        i++;
 
-        /* Mandatory model/layout/variant specifier. */
-        switch (str[i++]) {
-        case 'm': mlv = MLVO_MODEL; break;
-        case 'l': mlv = MLVO_LAYOUT; break;
-        case 'v': mlv = MLVO_VARIANT; break;
-        default: goto error;
-        }
-
-        /* Check for index. */
-        idx = XKB_LAYOUT_INVALID;
-        if (i < value.len && str[i] == '[') {
-            int consumed;
-
-            if (mlv != MLVO_LAYOUT && mlv != MLVO_VARIANT) {
-                scanner_err(s, "invalid index in %%-expansion; may only index layout or variant");
-                goto error;
-            }
-
-            consumed = extract_layout_index(str + i, value.len - i, &idx);
-            if (consumed == -1) goto error;
-            i += consumed;
-        }
-
-        /* Check for suffix, if there supposed to be one. */
-        if (sfx != 0) {
-            if (i >= value.len) goto error;
-            if (str[i++] != sfx) goto error;
-        }
+        if (parse_expansion(str, len, &i, &mlv, &idx, &pfx, &sfx))
+            break;
 
         /* Get the expanded value. */
         expanded_value = NULL;
@@ -809,15 +1168,31 @@ append_expanded_kccgst_value(struct matcher *m, struct scanner *s,
             continue;
 
         if (pfx != 0)
-            darray_appends_nullterminate(expanded, &pfx, 1);
-        darray_appends_nullterminate(expanded,
-                                     expanded_value->sval.start,
-                                     expanded_value->sval.len);
+            darray_append(m->expanded, pfx);
+        darray_append_items(m->expanded, expanded_value->sval.start,
+                            expanded_value->sval.len);
         if (sfx != 0)
-            darray_appends_nullterminate(expanded, &sfx, 1);
+            darray_append(m->expanded, sfx);
         expanded_value->matched = true;
     }
 
+    new.len = darray_size(m->expanded) - new.start;
+    darray_append(m->expansions, new);
+
+    return (struct sval) { &darray_item(m->expanded, new.start), new.len };
+}
+
+/* Expand @value and append the result to @to. */
+static void
+append_expanded_kccgst_value(struct matcher *m, darray_char *to,
+                             xkb_atom_t value)
+{
+    struct sval expanded;
+    char ch;
+    bool expanded_plus, to_plus;
+
+    expanded = matcher_expand_value(m, value, atom_text(m->db->atoms, value));
+
     /*
      * Appending  bar to  foo ->  foo (not an error if this happens)
      * Appending +bar to  foo ->  foo+bar
@@ -825,134 +1200,233 @@ append_expanded_kccgst_value(struct matcher *m, struct scanner *s,
      * Appending +bar to +foo -> +foo+bar
      */
 
-    ch = (darray_empty(expanded) ? '\0' : darray_item(expanded, 0));
+    ch = (expanded.len == 0 ? '\0' : expanded.start[0]);
     expanded_plus = (ch == '+' || ch == '|');
     ch = (darray_empty(*to) ? '\0' : darray_item(*to, 0));
     to_plus = (ch == '+' || ch == '|');
 
     if (expanded_plus || darray_empty(*to))
-        darray_appends_nullterminate(*to, expanded.item, expanded.size);
+        darray_appends_nullterminate(*to, expanded.start, expanded.len);
     else if (to_plus)
-        darray_prepends_nullterminate(*to, expanded.item, expanded.size);
-
-    darray_free(expanded);
-    return true;
-
-error:
-    darray_free(expanded);
-    scanner_err(s, "invalid %%-expansion in value; not used");
-    return false;
-}
-
-static void
-matcher_rule_verify(struct matcher *m, struct scanner *s)
-{
-    if (m->rule.num_mlvo_values != m->mapping.num_mlvo ||
-        m->rule.num_kccgst_values != m->mapping.num_kccgst) {
-        scanner_err(s, "invalid rule: must have same number of values as mapping line; ignoring rule");
-        m->rule.skip = true;
-    }
+        darray_prepends_nullterminate(*to, expanded.start, expanded.len);
 }
 
-static void
-matcher_rule_apply_if_matches(struct matcher *m, struct scanner *s)
+static bool
+matcher_rule_apply_if_matches(struct matcher *m, const struct mapping *mapping,
+                              const struct rule *rule)
 {
-    for (unsigned i = 0; i < m->mapping.num_mlvo; i++) {
-        enum rules_mlvo mlvo = m->mapping.mlvo_at_pos[i];
-        struct sval value = m->rule.mlvo_value_at_pos[i];
-        enum mlvo_match_type match_type = m->rule.match_type_at_pos[i];
+    for (unsigned i = 0; i < mapping->num_mlvo; i++) {
+        enum rules_mlvo mlvo = mapping->mlvo_at_pos[i];
+        xkb_atom_t value = rule->mlvo_value_at_pos[i];
+        int group = rule->group_at_pos[i];
+        enum mlvo_match_type match_type = rule->match_type_at_pos[i];
         struct matched_sval *to;
         bool matched = false;
 
         if (mlvo == MLVO_MODEL) {
             to = &m->rmlvo.model;
-            matched = match_value_and_mark(m, value, to, match_type);
+            matched = match_value_and_mark(m, value, group, to, match_type);
         }
         else if (mlvo == MLVO_LAYOUT) {
-            xkb_layout_index_t idx = m->mapping.layout_idx;
+            xkb_layout_index_t idx = mapping->layout_idx;
             idx = (idx == XKB_LAYOUT_INVALID ? 0 : idx);
             to = &darray_item(m->rmlvo.layouts, idx);
-            matched = match_value_and_mark(m, value, to, match_type);
+            matched = match_value_and_mark(m, value, group, to, match_type);
         }
         else if (mlvo == MLVO_VARIANT) {
-            xkb_layout_index_t idx = m->mapping.layout_idx;
+            xkb_layout_index_t idx = mapping->layout_idx;
             idx = (idx == XKB_LAYOUT_INVALID ? 0 : idx);
             to = &darray_item(m->rmlvo.variants, idx);
-            matched = match_value_and_mark(m, value, to, match_type);
+            matched = match_value_and_mark(m, value, group, to, match_type);
         }
         else if (mlvo == MLVO_OPTION) {
             darray_foreach(to, m->rmlvo.options) {
-                matched = match_value_and_mark(m, value, to, match_type);
+                matched = match_value_and_mark(m, value, group, to,
+                                               match_type);
                 if (matched)
                     break;
             }
         }
 
         if (!matched)
-            return;
+            return false;
     }
 
-    for (unsigned i = 0; i < m->mapping.num_kccgst; i++) {
-        enum rules_kccgst kccgst = m->mapping.kccgst_at_pos[i];
-        struct sval value = m->rule.kccgst_value_at_pos[i];
-        append_expanded_kccgst_value(m, s, &m->kccgst[kccgst], value);
+    for (unsigned i = 0; i < mapping->num_kccgst; i++) {
+        enum rules_kccgst kccgst = mapping->kccgst_at_pos[i];
+        xkb_atom_t value = rule->kccgst_value_at_pos[i];
+        if (value != XKB_ATOM_NONE)
+            append_expanded_kccgst_value(m, &m->kccgst[kccgst], value);
     }
 
-    /*
-     * If a rule matches in a rule set, the rest of the set should be
-     * skipped. However, rule sets matching against options may contain
-     * several legitimate rules, so they are processed entirely.
-     */
-    if (!(m->mapping.defined_mlvo_mask & (1 << MLVO_OPTION)))
-        m->mapping.skip = true;
+    return true;
 }
 
-static enum rules_token
-gettok(struct matcher *m, struct scanner *s)
+static int
+cmp_rule_ref(const void *a, const void *b)
 {
-    return lex(s, &m->val);
+    const struct rule_ref *ra = a, *rb = b;
+
+    if (ra->value != rb->value)
+        return ra->value < rb->value ? -1 : 1;
+    return ra->rule < rb->rule ? -1 : ra->rule > rb->rule;
 }
 
-static bool
-matcher_match(struct matcher *m, struct scanner *s,
-              unsigned include_depth,
-              const char *string, size_t len,
-              const char *file_name)
+static int
+cmp_uint(const void *a, const void *b)
 {
-    enum rules_token tok;
+    const unsigned int ua = *(const unsigned int *) a;
+    const unsigned int ub = *(const unsigned int *) b;
 
-    if (!m)
-        return false;
+    return ua < ub ? -1 : ua > ub;
+}
 
-initial:
-    switch (tok = gettok(m, s)) {
-    case TOK_BANG:
-        goto bang;
-    case TOK_END_OF_LINE:
-        goto initial;
-    case TOK_END_OF_FILE:
-        goto finish;
-    default:
-        goto unexpected;
-    }
+static void
+rule_set_build_index(struct rule_set *set)
+{
+    for (unsigned i = 0; i < darray_size(set->rules); i++) {
+        const struct rule *rule = &darray_item(set->rules, i);
+
+        if (rule->match_type_at_pos[0] == MLVO_MATCH_NORMAL) {
+            struct rule_ref ref = { rule->mlvo_value_at_pos[0], i };
+            darray_append(set->by_value, ref);
+        }
+        else {
+            darray_append(set->others, i);
+        }
+    }
+
+    if (!darray_empty(set->by_value))
+        qsort(set->by_value.item, darray_size(set->by_value),
+              sizeof(struct rule_ref), cmp_rule_ref);
+}
+
+/* Add the literal rules whose first value is @value to the candidates. */
+static void
+matcher_add_candidates(struct matcher *m, const struct rule_set *set,
+                       xkb_atom_t value)
+{
+    size_t lo = 0, hi = darray_size(set->by_value);
+
+    if (value == XKB_ATOM_NONE)
+        return;
+
+    /* Find the first one. */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (darray_item(set->by_value, mid).value < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < darray_size(set->by_value) &&
+           darray_item(set->by_value, lo).value == value; lo++)
+        darray_append(m->candidates, darray_item(set->by_value, lo).rule);
+}
+
+static void
+matcher_match_set(struct matcher *m, const struct rule_set *set)
+{
+    const struct mapping *mapping = &set->mapping;
+    const struct matched_sval *val;
+    xkb_layout_index_t idx;
+    unsigned int *rule;
+
+    if (!matcher_mapping_applies(m, mapping))
+        return;
+
+    /*
+     * Only the rules whose first value may match are tried, in the
+     * order of the file.
+     */
+    darray_resize(m->candidates, 0);
+    if (!darray_empty(set->others))
+        darray_append_items(m->candidates, set->others.item,
+                            darray_size(set->others));
+    idx = mapping->layout_idx == XKB_LAYOUT_INVALID ? 0 : mapping->layout_idx;
+    switch (mapping->mlvo_at_pos[0]) {
+    case MLVO_MODEL:
+        matcher_add_candidates(m, set, m->rmlvo.model.atom);
+        break;
+    case MLVO_LAYOUT:
+        matcher_add_candidates(m, set, darray_item(m->rmlvo.layouts, idx).atom);
+        break;
+    case MLVO_VARIANT:
+        /* Like matcher_rule_apply_if_matches(), by the layout index. */
+        matcher_add_candidates(m, set, darray_item(m->rmlvo.variants, idx).atom);
+        break;
+    case MLVO_OPTION:
+        darray_foreach(val, m->rmlvo.options)
+            matcher_add_candidates(m, set, val->atom);
+        break;
+    }
+    if (darray_size(m->candidates) > darray_size(set->others))
+        qsort(m->candidates.item, darray_size(m->candidates),
+              sizeof(unsigned int), cmp_uint);
+
+    darray_foreach(rule, m->candidates) {
+        /* Options may be listed twice. */
+        if (rule != &darray_item(m->candidates, 0) && rule[-1] == rule[0])
+            continue;
+
+        if (!matcher_rule_apply_if_matches(m, mapping,
+                                           &darray_item(set->rules, *rule)))
+            continue;
+
+        /*
+         * If a rule matches in a rule set, the rest of the set should be
+         * skipped. However, rule sets matching against options may contain
+         * several legitimate rules, so they are processed entirely.
+         */
+        if (!(mapping->defined_mlvo_mask & (1 << MLVO_OPTION)))
+            break;
+    }
+}
+
+static enum rules_token
+gettok(struct rules_db *db, struct scanner *s)
+{
+    return lex(s, &db->val);
+}
+
+static bool
+rules_db_parse(struct rules_db *db, struct scanner *s,
+               unsigned include_depth,
+               const char *string, size_t len,
+               const char *file_name)
+{
+    enum rules_token tok;
+
+initial:
+    switch (tok = gettok(db, s)) {
+    case TOK_BANG:
+        goto bang;
+    case TOK_END_OF_LINE:
+        goto initial;
+    case TOK_END_OF_FILE:
+        goto finish;
+    default:
+        goto unexpected;
+    }
 
 bang:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_GROUP_NAME:
-        matcher_group_start_new(m, m->val.string);
+        rules_db_group_start_new(db, db->val.string);
         goto group_name;
     case TOK_INCLUDE:
         goto include_statement;
     case TOK_IDENTIFIER:
-        matcher_mapping_start_new(m);
-        matcher_mapping_set_mlvo(m, s, m->val.string);
+        rules_db_mapping_start_new(db);
+        rules_db_mapping_set_mlvo(db, s, db->val.string);
         goto mapping_mlvo;
     default:
         goto unexpected;
     }
 
 group_name:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_EQUALS:
         goto group_element;
     default:
@@ -960,9 +1434,9 @@ group_name:
     }
 
 group_element:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_IDENTIFIER:
-        matcher_group_add_element(m, s, m->val.string);
+        rules_db_group_add_element(db, s, db->val.string);
         goto group_element;
     case TOK_END_OF_LINE:
         goto initial;
@@ -971,19 +1445,19 @@ group_element:
     }
 
 include_statement:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_IDENTIFIER:
-        matcher_include(m, s, include_depth, m->val.string);
+        rules_db_include(db, s, include_depth, db->val.string);
         goto initial;
     default:
         goto unexpected;
     }
 
 mapping_mlvo:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_IDENTIFIER:
-        if (!m->mapping.skip)
-            matcher_mapping_set_mlvo(m, s, m->val.string);
+        if (!db->mapping.skip)
+            rules_db_mapping_set_mlvo(db, s, db->val.string);
         goto mapping_mlvo;
     case TOK_EQUALS:
         goto mapping_kccgst;
@@ -992,21 +1466,21 @@ mapping_mlvo:
     }
 
 mapping_kccgst:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_IDENTIFIER:
-        if (!m->mapping.skip)
-            matcher_mapping_set_kccgst(m, s, m->val.string);
+        if (!db->mapping.skip)
+            rules_db_mapping_set_kccgst(db, s, db->val.string);
         goto mapping_kccgst;
     case TOK_END_OF_LINE:
-        if (!m->mapping.skip)
-            matcher_mapping_verify(m, s);
+        if (!db->mapping.skip)
+            rules_db_mapping_verify(db, s);
         goto rule_mlvo_first;
     default:
         goto unexpected;
     }
 
 rule_mlvo_first:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_BANG:
         goto bang;
     case TOK_END_OF_LINE:
@@ -1014,25 +1488,25 @@ rule_mlvo_first:
     case TOK_END_OF_FILE:
         goto finish;
     default:
-        matcher_rule_start_new(m);
+        rules_db_rule_start_new(db);
         goto rule_mlvo_no_tok;
     }
 
 rule_mlvo:
-    tok = gettok(m, s);
+    tok = gettok(db, s);
 rule_mlvo_no_tok:
     switch (tok) {
     case TOK_IDENTIFIER:
-        if (!m->rule.skip)
-            matcher_rule_set_mlvo(m, s, m->val.string);
+        if (!db->rule.skip)
+            rules_db_rule_set_mlvo(db, s, db->val.string);
         goto rule_mlvo;
     case TOK_STAR:
-        if (!m->rule.skip)
-            matcher_rule_set_mlvo_wildcard(m, s);
+        if (!db->rule.skip)
+            rules_db_rule_set_mlvo_wildcard(db, s);
         goto rule_mlvo;
     case TOK_GROUP_NAME:
-        if (!m->rule.skip)
-            matcher_rule_set_mlvo_group(m, s, m->val.string);
+        if (!db->rule.skip)
+            rules_db_rule_set_mlvo_group(db, s, db->val.string);
         goto rule_mlvo;
     case TOK_EQUALS:
         goto rule_kccgst;
@@ -1041,16 +1515,16 @@ rule_mlvo_no_tok:
     }
 
 rule_kccgst:
-    switch (tok = gettok(m, s)) {
+    switch (tok = gettok(db, s)) {
     case TOK_IDENTIFIER:
-        if (!m->rule.skip)
-            matcher_rule_set_kccgst(m, s, m->val.string);
+        if (!db->rule.skip)
+            rules_db_rule_set_kccgst(db, s, db->val.string);
         goto rule_kccgst;
     case TOK_END_OF_LINE:
-        if (!m->rule.skip)
-            matcher_rule_verify(m, s);
-        if (!m->rule.skip)
-            matcher_rule_apply_if_matches(m, s);
+        if (!db->rule.skip)
+            rules_db_rule_verify(db, s);
+        if (!db->rule.skip)
+            rules_db_rule_add(db);
         goto rule_mlvo_first;
     default:
         goto unexpected;
@@ -1073,32 +1547,595 @@ error:
     return false;
 }
 
+/* Read the contents of @file, found at @path, into a new buffer. */
+static char *
+read_rules_string(struct rules_db *db, FILE *file, const char *path,
+                  size_t *size_out)
+{
+    char *map, *string = NULL;
+    size_t size;
+    bool ok;
+    int prev_phase;
+
+    prev_phase = profile_enter_phase(db->ctx, XKB_COMPILE_PHASE_FILE_IO);
+    ok = map_file(file, &map, &size);
+    if (ok) {
+        string = malloc(size > 0 ? size : 1);
+        if (string)
+            memcpy(string, map, size);
+        unmap_file(map, size);
+    }
+    profile_leave_phase(db->ctx, prev_phase);
+    if (!ok) {
+        log_err(db->ctx, "Couldn't read rules file \"%s\": %s\n",
+                path, strerror(errno));
+        return NULL;
+    }
+    if (!string) {
+        log_err(db->ctx, "Couldn't allocate the rules file \"%s\"\n", path);
+        return NULL;
+    }
+
+    *size_out = size;
+    return string;
+}
+
 static bool
-read_rules_file(struct xkb_context *ctx,
-                struct matcher *matcher,
-                unsigned include_depth,
-                FILE *file,
-                const char *path)
+parse_rules_string(struct rules_db *db, unsigned include_depth,
+                   const char *string, size_t size, const char *path)
 {
-    bool ret = false;
+    struct scanner scanner;
+
+    scanner_init(&scanner, db->ctx, string, size, path, NULL);
+
+    return rules_db_parse(db, &scanner, include_depth, string, size, path);
+}
+
+static struct rules_db *
+rules_db_new(struct xkb_context *ctx, FILE *file, const char *path)
+{
+    struct rule_set *set;
+    struct stat st;
     char *string;
     size_t size;
-    struct scanner scanner;
+    struct rules_db *db = calloc(1, sizeof(*db));
+    if (!db)
+        return NULL;
 
-    ret = map_file(file, &string, &size);
-    if (!ret) {
-        log_err(ctx, "Couldn't read rules file \"%s\": %s\n",
-                path, strerror(errno));
-        goto out;
+    db->ctx = ctx;
+    db->atoms = atom_table_new();
+    if (!db->atoms) {
+        free(db);
+        return NULL;
     }
 
-    scanner_init(&scanner, matcher->ctx, string, size, path, NULL);
+    rules_db_add_file(db, path,
+                      fstat(fileno(file), &st) == 0 ? &st : NULL);
+    string = read_rules_string(db, file, path, &size);
+    if (!string || !parse_rules_string(db, 0, string, size, path)) {
+        free(string);
+        rules_db_free(db);
+        return NULL;
+    }
+    free(string);
 
-    ret = matcher_match(matcher, &scanner, include_depth, string, size, path);
+    darray_foreach(set, db->sets)
+        rule_set_build_index(set);
+
+    /*
+     * Interning grows the index of the atoms lazily, on the next call;
+     * do it now, so that lookups never modify the database.
+     */
+    atom_intern(db->atoms, "", 0, false);
+    db->ctx = NULL;
+
+    return db;
+}
+
+/* Whether none of the files of @db changed since it was built. */
+static bool
+rules_db_is_current(const struct rules_db *db, FILE *file)
+{
+    const struct rules_file_id *id;
+    struct stat st;
+
+    darray_foreach(id, db->files) {
+        bool exists;
+
+        if (id == &darray_item(db->files, 0))
+            exists = fstat(fileno(file), &st) == 0;
+        else
+            exists = stat(id->path, &st) == 0;
+        if (exists != id->exists || (exists && !same_file(&st, &id->st)))
+            return false;
+    }
+
+    return true;
+}
+
+/* Find the database of the rules file @file, found at @path, if any. */
+static unsigned int
+find_rules_db(struct rules_cache *cache, const char *path)
+{
+    unsigned int i;
+
+    for (i = 0; i < darray_size(cache->dbs); i++)
+        if (streq(darray_item(darray_item(cache->dbs, i)->files, 0).path, path))
+            break;
+
+    return i;
+}
+
+/* The up to date database of the rules file on the context, if any. */
+static struct rules_db *
+find_current_rules_db(struct xkb_context *ctx, FILE *file, const char *path)
+{
+    struct rules_cache *cache = ctx->rules_cache;
+    unsigned int i;
+
+    if (!cache)
+        return NULL;
+
+    i = find_rules_db(cache, path);
+    if (i < darray_size(cache->dbs) &&
+        rules_db_is_current(darray_item(cache->dbs, i), file))
+        return darray_item(cache->dbs, i);
+
+    return NULL;
+}
+
+/*
+ * Get the database of the rules file @file, found at @path, from the
+ * cache of the context, or build it.
+ */
+static struct rules_db *
+get_rules_db(struct xkb_context *ctx, FILE *file, const char *path)
+{
+    struct rules_cache *cache = ctx->rules_cache;
+    struct rules_db *db;
+    unsigned int i;
+
+    if (!cache) {
+        cache = calloc(1, sizeof(*cache));
+        if (!cache)
+            return NULL;
+        ctx->rules_cache = cache;
+    }
+
+    i = find_rules_db(cache, path);
+    if (i < darray_size(cache->dbs) &&
+        rules_db_is_current(darray_item(cache->dbs, i), file))
+        return darray_item(cache->dbs, i);
+
+    /* Build it afresh, as if the whole file was read for the first time. */
+    db = rules_db_new(ctx, file, path);
+    if (!db)
+        return NULL;
+
+    if (i < darray_size(cache->dbs)) {
+        rules_db_free(darray_item(cache->dbs, i));
+        darray_item(cache->dbs, i) = db;
+    }
+    else {
+        darray_append(cache->dbs, db);
+    }
+
+    return db;
+}
+
+void
+xkb_context_free_rules_cache(struct xkb_context *ctx)
+{
+    struct rules_cache *cache = ctx->rules_cache;
+    struct rules_db **db;
+    struct rules_include **inc;
+
+    if (!cache)
+        return;
+
+    darray_foreach(db, cache->dbs)
+        rules_db_free(*db);
+    darray_free(cache->dbs);
+    darray_foreach(inc, cache->includes) {
+        free((*inc)->id.path);
+        free((*inc)->string);
+        free(*inc);
+    }
+    darray_free(cache->includes);
+    free(cache);
+    ctx->rules_cache = NULL;
+}
+
+/*
+ * The disk cache: with XKB_CONTEXT_RULES_DISK_CACHE, the KcCGST which
+ * a rules file gives for a RMLVO is stored under
+ * $XDG_CACHE_HOME/xkbcommon, so that other processes need not read the
+ * rules at all.
+ *
+ * There is one entry per rules file and RMLVO, named after a hash of
+ * them.  It is a text file with the following records, where each
+ * string is given by its length and then follows on its own line:
+ *
+ *     xkbcommon-rules-cache 2
+ *     key <length>
+ *     file <exists> <dev> <ino> <size> <mtime in ns> <length>
+ *     ...
+ *     kccgst <length>
+ *     ... (4 times: keycodes, types, compat, symbols)
+ *
+ * The entry is used if its key matches, and none of the files changed;
+ * they are the rules file and its includes.  Entries are written to a
+ * temporary file which is then renamed, so that concurrent processes
+ * only ever see complete entries.
+ */
+#ifdef HAVE_UNISTD_H
+
+#define RULES_DISK_CACHE_MAGIC "xkbcommon-rules-cache 2"
+
+static void
+append_key_value(darray_char *key, const char *value)
+{
+    darray_append_string(*key, value ? value : "");
+    /* The values may not contain NUL bytes, so they separate them. */
+    darray_append(*key, '\0');
+}
+
+static void
+append_key_list(darray_char *key, const char *list)
+{
+    darray_matched_sval values = split_comma_separated_mlvo(list);
+    struct matched_sval *val;
+
+    darray_foreach(val, values) {
+        if (val != &darray_item(values, 0))
+            darray_append(*key, ',');
+        if (val->sval.len > 0)
+            darray_append_items(*key, val->sval.start, val->sval.len);
+    }
+    darray_append(*key, '\0');
+    darray_free(values);
+}
+
+/*
+ * What the KcCGST depends on, besides the files: the RMLVO, with the
+ * spaces around the values removed, and what %H, %S and %E expand to.
+ */
+static void
+rules_disk_cache_key(struct xkb_context *ctx, const char *path,
+                     const struct xkb_rule_names *rmlvo, darray_char *key)
+{
+    struct sval model = {
+        rmlvo->model ? rmlvo->model : "", strlen_safe(rmlvo->model)
+    };
+
+    model = strip_spaces(model);
+    append_key_value(key, path);
+    darray_append_items(*key, model.start, model.len);
+    darray_append(*key, '\0');
+    append_key_list(key, rmlvo->layout);
+    append_key_list(key, rmlvo->variant);
+    append_key_list(key, rmlvo->options);
+    append_key_value(key, secure_getenv("HOME"));
+    append_key_value(key, xkb_context_include_path_get_system_path(ctx));
+    append_key_value(key, xkb_context_include_path_get_extra_path(ctx));
+}
+
+static char *
+rules_disk_cache_dir(void)
+{
+    const char *xdg = secure_getenv("XDG_CACHE_HOME");
+    const char *home;
+
+    if (xdg && xdg[0] == '/')
+        return asprintf_safe("%s/xkbcommon", xdg);
+
+    home = secure_getenv("HOME");
+    if (home && home[0] == '/')
+        return asprintf_safe("%s/.cache/xkbcommon", home);
+
+    return NULL;
+}
+
+static char *
+rules_disk_cache_path(const char *dir, const darray_char *key)
+{
+    uint64_t hash = 0xcbf29ce484222325u;
+
+    /* FNV-1a; collisions are caught by comparing the keys. */
+    for (unsigned i = 0; i < darray_size(*key); i++) {
+        hash ^= (uint8_t) darray_item(*key, i);
+        hash *= 0x100000001b3u;
+    }
+
+    return asprintf_safe("%s/rules-%016" PRIx64, dir, hash);
+}
+
+/* Read a record of the entry: its line, then its string, if any. */
+static bool
+read_record(const char **pos, const char *end, char line[256],
+            const char **str, size_t *len)
+{
+    const char *eol = memchr(*pos, '\n', end - *pos);
+    const char *len_str;
+
+    if (!eol || eol - *pos >= 256)
+        return false;
+    memcpy(line, *pos, eol - *pos);
+    line[eol - *pos] = '\0';
+    *pos = eol + 1;
+
+    if (!str)
+        return true;
+
+    /* The length is the last field. */
+    len_str = strrchr(line, ' ');
+    if (!len_str)
+        return false;
+    *len = strtoul(len_str + 1, NULL, 10);
+    if (*len >= (size_t) (end - *pos) || (*pos)[*len] != '\n')
+        return false;
+    *str = *pos;
+    *pos += *len + 1;
+    return true;
+}
+
+static bool
+rules_disk_cache_load(const char *entry_path, const darray_char *key,
+                      struct xkb_component_names *out)
+{
+    FILE *file;
+    char *string;
+    size_t size;
+    const char *pos, *end, *str;
+    size_t len;
+    char line[256];
+    char **kccgst[] = {
+        &out->keycodes, &out->types, &out->compat, &out->symbols
+    };
+    unsigned i;
+    bool ok = false;
+
+    file = fopen(entry_path, "rb");
+    if (!file)
+        return false;
+    if (!map_file(file, &string, &size)) {
+        fclose(file);
+        return false;
+    }
+    pos = string;
+    end = string + size;
+
+    if (!read_record(&pos, end, line, NULL, NULL) ||
+        !streq(line, RULES_DISK_CACHE_MAGIC))
+        goto out;
+
+    if (!read_record(&pos, end, line, &str, &len) ||
+        strncmp(line, "key ", 4) != 0 ||
+        len != darray_size(*key) || memcmp(str, key->item, len) != 0)
+        goto out;
+
+    /* The files, until the KcCGST. */
+    while (true) {
+        int exists;
+        uintmax_t dev, ino;
+        intmax_t file_size, mtime;
+        char *file_path;
+        struct stat st;
+        bool same;
+
+        if (!read_record(&pos, end, line, &str, &len))
+            goto out;
+        if (strncmp(line, "kccgst ", 7) == 0)
+            break;
+        if (sscanf(line, "file %d %ju %ju %jd %jd", &exists, &dev, &ino,
+                   &file_size, &mtime) != 5)
+            goto out;
+
+        file_path = strndup(str, len);
+        if (!file_path)
+            goto out;
+        if (stat(file_path, &st) != 0)
+            same = !exists;
+        else
+            same = exists && st.st_dev == (dev_t) dev &&
+                   st.st_ino == (ino_t) ino &&
+                   st.st_size == (off_t) file_size &&
+                   file_mtime_ns(&st) == mtime;
+        free(file_path);
+        if (!same)
+            goto out;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(kccgst); i++) {
+        if (i > 0 && (!read_record(&pos, end, line, &str, &len) ||
+                      strncmp(line, "kccgst ", 7) != 0))
+            break;
+        *kccgst[i] = strndup(str, len);
+        if (!*kccgst[i])
+            break;
+    }
+    ok = i == ARRAY_SIZE(kccgst) && pos == end;
+    if (!ok)
+        while (i-- > 0)
+            free(*kccgst[i]);
 
-    unmap_file(string, size);
 out:
-    return ret;
+    unmap_file(string, size);
+    fclose(file);
+    return ok;
+}
+
+static bool
+rules_disk_cache_is_valid(const char *entry_path, const darray_char *key)
+{
+    struct xkb_component_names cached = { NULL, NULL, NULL, NULL };
+
+    if (!rules_disk_cache_load(entry_path, key, &cached))
+        return false;
+
+    free(cached.keycodes);
+    free(cached.types);
+    free(cached.compat);
+    free(cached.symbols);
+    return true;
+}
+
+static bool
+rules_db_has_disk_cache_key(const struct rules_db *db, const darray_char *key)
+{
+    const darray_char *other;
+
+    darray_foreach(other, db->disk_cache_keys)
+        if (darray_size(*other) == darray_size(*key) &&
+            memcmp(other->item, key->item, darray_size(*key)) == 0)
+            return true;
+
+    return false;
+}
+
+static void
+rules_db_add_disk_cache_key(struct rules_db *db, const darray_char *key)
+{
+    darray_char copy = darray_new();
+
+    darray_copy(copy, *key);
+    darray_append(db->disk_cache_keys, copy);
+}
+
+static void
+write_record(FILE *file, const char *str, size_t len)
+{
+    fwrite(str, 1, len, file);
+    fputc('\n', file);
+}
+
+static void
+rules_disk_cache_store(struct xkb_context *ctx, const char *dir,
+                       const char *entry_path, const darray_char *key,
+                       const struct rules_db *db,
+                       const struct xkb_component_names *kccgst)
+{
+    const char *values[] = {
+        kccgst->keycodes, kccgst->types, kccgst->compat, kccgst->symbols
+    };
+    const struct rules_file_id *id;
+    char *tmp_path, *parent;
+    FILE *file;
+    int fd;
+    bool ok;
+
+    /* The directory, and $XDG_CACHE_HOME or ~/.cache if need be. */
+    parent = strdup(dir);
+    if (!parent)
+        return;
+    *strrchr(parent, '/') = '\0';
+    if (mkdir(parent, 0700) != 0 && errno != EEXIST) {
+        free(parent);
+        return;
+    }
+    free(parent);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+        return;
+
+    tmp_path = asprintf_safe("%s/.rules-XXXXXX", dir);
+    if (!tmp_path)
+        return;
+#ifdef HAVE_MKOSTEMP
+    fd = mkostemp(tmp_path, O_CLOEXEC);
+#else
+    fd = mkstemp(tmp_path);
+#endif
+    if (fd < 0) {
+        free(tmp_path);
+        return;
+    }
+    file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return;
+    }
+
+    fprintf(file, "%s\nkey %u\n", RULES_DISK_CACHE_MAGIC, darray_size(*key));
+    write_record(file, key->item, darray_size(*key));
+    darray_foreach(id, db->files) {
+        fprintf(file, "file %d %ju %ju %jd %jd %zu\n", id->exists,
+                (uintmax_t) (id->exists ? id->st.st_dev : 0),
+                (uintmax_t) (id->exists ? id->st.st_ino : 0),
+                (intmax_t) (id->exists ? id->st.st_size : 0),
+                id->exists ? file_mtime_ns(&id->st) : 0,
+                strlen(id->path));
+        write_record(file, id->path, strlen(id->path));
+    }
+    for (unsigned i = 0; i < ARRAY_SIZE(values); i++) {
+        fprintf(file, "kccgst %zu\n", strlen(values[i]));
+        write_record(file, values[i], strlen(values[i]));
+    }
+
+    ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (ok && rename(tmp_path, entry_path) == 0)
+        log_dbg(ctx, "Stored the rules result in \"%s\"\n", entry_path);
+    else
+        unlink(tmp_path);
+    free(tmp_path);
+}
+
+#endif
+
+/*
+ * Take the KcCGST out of @m, which was matched against the rules file at
+ * @path, and report the names which no rule matched.
+ */
+static bool
+matcher_get_components(struct matcher *m, const char *path,
+                       struct xkb_component_names *out, bool *all_matched)
+{
+    struct matched_sval *mval;
+
+    if (darray_empty(m->kccgst[KCCGST_KEYCODES]) ||
+        darray_empty(m->kccgst[KCCGST_TYPES]) ||
+        darray_empty(m->kccgst[KCCGST_COMPAT]) ||
+        /* darray_empty(m->kccgst[KCCGST_GEOMETRY]) || */
+        darray_empty(m->kccgst[KCCGST_SYMBOLS])) {
+        log_err(m->ctx, "No components returned from XKB rules \"%s\"\n", path);
+        return false;
+    }
+
+    darray_steal(m->kccgst[KCCGST_KEYCODES], &out->keycodes, NULL);
+    darray_steal(m->kccgst[KCCGST_TYPES], &out->types, NULL);
+    darray_steal(m->kccgst[KCCGST_COMPAT], &out->compat, NULL);
+    darray_steal(m->kccgst[KCCGST_SYMBOLS], &out->symbols, NULL);
+    darray_free(m->kccgst[KCCGST_GEOMETRY]);
+
+    *all_matched = true;
+    mval = &m->rmlvo.model;
+    if (!mval->matched && mval->sval.len > 0) {
+        log_err(m->ctx, "Unrecognized RMLVO model \"%.*s\" was ignored\n",
+                mval->sval.len, mval->sval.start);
+        *all_matched = false;
+    }
+    darray_foreach(mval, m->rmlvo.layouts)
+        if (!mval->matched && mval->sval.len > 0) {
+            log_err(m->ctx, "Unrecognized RMLVO layout \"%.*s\" was ignored\n",
+                    mval->sval.len, mval->sval.start);
+            *all_matched = false;
+        }
+    darray_foreach(mval, m->rmlvo.variants)
+        if (!mval->matched && mval->sval.len > 0) {
+            log_err(m->ctx, "Unrecognized RMLVO variant \"%.*s\" was ignored\n",
+                    mval->sval.len, mval->sval.start);
+            *all_matched = false;
+        }
+    darray_foreach(mval, m->rmlvo.options)
+        if (!mval->matched && mval->sval.len > 0) {
+            log_err(m->ctx, "Unrecognized RMLVO option \"%.*s\" was ignored\n",
+                    mval->sval.len, mval->sval.start);
+            *all_matched = false;
+        }
+
+    return true;
 }
 
 bool
@@ -1109,55 +2146,257 @@ xkb_components_from_rules(struct xkb_context *ctx,
     bool ret = false;
     FILE *file;
     char *path = NULL;
+    struct rules_db *db;
     struct matcher *matcher = NULL;
-    struct matched_sval *mval;
+    const struct rule_set *set;
     unsigned int offset = 0;
+    bool all_matched = true;
+#ifdef HAVE_UNISTD_H
+    char *cache_dir = NULL, *entry_path = NULL;
+    darray_char key = darray_new();
+    bool store = false;
+#endif
 
     file = FindFileInXkbPath(ctx, rmlvo->rules, FILE_TYPE_RULES, &path, &offset);
     if (!file)
         goto err_out;
 
-    matcher = matcher_new(ctx, rmlvo);
+#ifdef HAVE_UNISTD_H
+    if (ctx->rules_disk_cache)
+        cache_dir = rules_disk_cache_dir();
+    if (cache_dir) {
+        rules_disk_cache_key(ctx, path, rmlvo, &key);
+        entry_path = rules_disk_cache_path(cache_dir, &key);
+    }
+    if (entry_path) {
+        struct rules_db *current = find_current_rules_db(ctx, file, path);
+
+        /* Reading the rules is faster once they are on the context. */
+        if (current) {
+            /* Still write the entry if it is missing or stale. */
+            if (!rules_db_has_disk_cache_key(current, &key)) {
+                store = !rules_disk_cache_is_valid(entry_path, &key);
+                if (!store)
+                    rules_db_add_disk_cache_key(current, &key);
+            }
+        }
+        else if (rules_disk_cache_load(entry_path, &key, out)) {
+            ret = true;
+            goto err_out;
+        }
+        else {
+            store = true;
+        }
+    }
+#endif
 
-    ret = read_rules_file(ctx, matcher, 0, file, path);
-    if (!ret ||
-        darray_empty(matcher->kccgst[KCCGST_KEYCODES]) ||
-        darray_empty(matcher->kccgst[KCCGST_TYPES]) ||
-        darray_empty(matcher->kccgst[KCCGST_COMPAT]) ||
-        /* darray_empty(matcher->kccgst[KCCGST_GEOMETRY]) || */
-        darray_empty(matcher->kccgst[KCCGST_SYMBOLS])) {
+    db = get_rules_db(ctx, file, path);
+    if (!db) {
         log_err(ctx, "No components returned from XKB rules \"%s\"\n", path);
-        ret = false;
         goto err_out;
     }
 
-    darray_steal(matcher->kccgst[KCCGST_KEYCODES], &out->keycodes, NULL);
-    darray_steal(matcher->kccgst[KCCGST_TYPES], &out->types, NULL);
-    darray_steal(matcher->kccgst[KCCGST_COMPAT], &out->compat, NULL);
-    darray_steal(matcher->kccgst[KCCGST_SYMBOLS], &out->symbols, NULL);
-    darray_free(matcher->kccgst[KCCGST_GEOMETRY]);
+    matcher = matcher_new(ctx, db, rmlvo);
+    if (!matcher)
+        goto err_out;
 
-    mval = &matcher->rmlvo.model;
-    if (!mval->matched && mval->sval.len > 0)
-        log_err(matcher->ctx, "Unrecognized RMLVO model \"%.*s\" was ignored\n",
-                mval->sval.len, mval->sval.start);
-    darray_foreach(mval, matcher->rmlvo.layouts)
-        if (!mval->matched && mval->sval.len > 0)
-            log_err(matcher->ctx, "Unrecognized RMLVO layout \"%.*s\" was ignored\n",
-                    mval->sval.len, mval->sval.start);
-    darray_foreach(mval, matcher->rmlvo.variants)
-        if (!mval->matched && mval->sval.len > 0)
-            log_err(matcher->ctx, "Unrecognized RMLVO variant \"%.*s\" was ignored\n",
-                    mval->sval.len, mval->sval.start);
-    darray_foreach(mval, matcher->rmlvo.options)
-        if (!mval->matched && mval->sval.len > 0)
-            log_err(matcher->ctx, "Unrecognized RMLVO option \"%.*s\" was ignored\n",
-                    mval->sval.len, mval->sval.start);
+    darray_foreach(set, db->sets)
+        matcher_match_set(matcher, set);
+
+    ret = matcher_get_components(matcher, path, out, &all_matched);
+    if (!ret)
+        goto err_out;
+
+#ifdef HAVE_UNISTD_H
+    if (store) {
+        /* Keep the warnings for when the RMLVO is fixed. */
+        if (all_matched)
+            rules_disk_cache_store(ctx, cache_dir, entry_path, &key, db, out);
+        rules_db_add_disk_cache_key(db, &key);
+    }
+#endif
 
 err_out:
+#ifdef HAVE_UNISTD_H
+    darray_free(key);
+    free(entry_path);
+    free(cache_dir);
+#endif
     if (file)
         fclose(file);
     matcher_free(matcher);
     free(path);
     return ret;
 }
+
+/*
+ * The RMLVO names of a batch are matched by several threads at once;
+ * this works since the database is not modified by lookups.  Each
+ * thread takes every num_threads-th names, and keeps their matcher for
+ * the calling thread, which then reports the results in order.
+ */
+struct rules_batch {
+    struct xkb_context *ctx;
+    const struct rules_db *db;
+    const struct xkb_rule_names *names;
+    struct matcher **matchers;
+    size_t count;
+    unsigned int num_threads;
+};
+
+struct rules_batch_worker {
+    struct rules_batch *batch;
+    unsigned int index;
+};
+
+/* The names matched by each thread, so that small batches use one. */
+#define RULES_BATCH_MIN_PER_THREAD 64
+#define RULES_BATCH_MAX_THREADS 16
+
+static void *
+match_rules_batch(void *data)
+{
+    const struct rules_batch_worker *worker = data;
+    struct rules_batch *batch = worker->batch;
+    const struct rule_set *set;
+
+    for (size_t i = worker->index; i < batch->count; i += batch->num_threads) {
+        struct matcher *m = matcher_new(batch->ctx, batch->db,
+                                        &batch->names[i]);
+        if (m)
+            darray_foreach(set, batch->db->sets)
+                matcher_match_set(m, set);
+        batch->matchers[i] = m;
+    }
+
+    return NULL;
+}
+
+static unsigned int
+rules_batch_num_threads(size_t count)
+{
+    long num_threads = 1;
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (num_threads > RULES_BATCH_MAX_THREADS)
+        num_threads = RULES_BATCH_MAX_THREADS;
+    if ((size_t) num_threads > count / RULES_BATCH_MIN_PER_THREAD)
+        num_threads = count / RULES_BATCH_MIN_PER_THREAD;
+
+    return num_threads > 1 ? num_threads : 1;
+}
+
+static void
+run_rules_batch(struct rules_batch *batch)
+{
+    struct rules_batch_worker workers[RULES_BATCH_MAX_THREADS];
+#ifdef HAVE_PTHREAD
+    pthread_t threads[RULES_BATCH_MAX_THREADS];
+    bool started[RULES_BATCH_MAX_THREADS] = { false };
+#endif
+
+    for (unsigned int i = 0; i < batch->num_threads; i++) {
+        workers[i].batch = batch;
+        workers[i].index = i;
+#ifdef HAVE_PTHREAD
+        /* The first share is matched by the calling thread. */
+        if (i > 0)
+            started[i] = pthread_create(&threads[i], NULL, match_rules_batch,
+                                        &workers[i]) == 0;
+#endif
+    }
+
+    for (unsigned int i = 0; i < batch->num_threads; i++) {
+#ifdef HAVE_PTHREAD
+        if (started[i])
+            continue;
+#endif
+        match_rules_batch(&workers[i]);
+    }
+
+#ifdef HAVE_PTHREAD
+    for (unsigned int i = 0; i < batch->num_threads; i++)
+        if (started[i])
+            pthread_join(threads[i], NULL);
+#endif
+}
+
+XKB_EXPORT size_t
+xkb_components_from_names_batch(struct xkb_context *ctx, const char *rules,
+                                const struct xkb_rule_names *names,
+                                size_t count,
+                                struct xkb_component_names *components)
+{
+    struct rules_batch batch = { .ctx = ctx, .count = count };
+    struct xkb_rule_names *sanitized = NULL;
+    FILE *file;
+    char *path = NULL;
+    unsigned int offset = 0;
+    size_t resolved = 0;
+    int prev_phase;
+
+    if (count > 0 && (!names || !components)) {
+        log_err_func1(ctx, "no names or components specified\n");
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        memset(&components[i], 0, sizeof(components[i]));
+    if (count == 0)
+        return 0;
+
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_RULES);
+
+    /* The names must outlive the matchers, which point into them. */
+    sanitized = calloc(count, sizeof(*sanitized));
+    batch.matchers = calloc(count, sizeof(*batch.matchers));
+    if (!sanitized || !batch.matchers) {
+        log_err_func(ctx, "couldn't allocate the batch of %zu names\n", count);
+        goto out;
+    }
+    for (size_t i = 0; i < count; i++) {
+        sanitized[i] = names[i];
+        sanitized[i].rules = rules;
+        xkb_context_sanitize_rule_names(ctx, &sanitized[i]);
+    }
+    batch.names = sanitized;
+
+    file = FindFileInXkbPath(ctx, sanitized[0].rules, FILE_TYPE_RULES,
+                             &path, &offset);
+    if (!file) {
+        log_err(ctx, "Couldn't look up rules '%s'\n", sanitized[0].rules);
+        goto out;
+    }
+
+    batch.db = get_rules_db(ctx, file, path);
+    fclose(file);
+    if (!batch.db) {
+        log_err(ctx, "No components returned from XKB rules \"%s\"\n", path);
+        goto out;
+    }
+
+    batch.num_threads = rules_batch_num_threads(count);
+    run_rules_batch(&batch);
+
+    for (size_t i = 0; i < count; i++) {
+        bool all_matched;
+
+        if (!batch.matchers[i]) {
+            log_err_func1(ctx, "couldn't allocate a matcher\n");
+            continue;
+        }
+        if (matcher_get_components(batch.matchers[i], path,
+                                   &components[i], &all_matched))
+            resolved++;
+        matcher_free(batch.matchers[i]);
+    }
+
+out:
+    free(batch.matchers);
+    free(sanitized);
+    free(path);
+    profile_leave_phase(ctx, prev_phase);
+    return resolved;
+}
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include "xkbcomp-priv.h"
+#include "ast-build.h"
 #include "parser-priv.h"
 #include "scanner-utils.h"
 
@@ -69,7 +70,7 @@ _xkbcommon_lex(YYSTYPE *yylval, struct scanner *s)
 
 skip_more_whitespace_and_comments:
     /* Skip spaces. */
-    while (is_space(peek(s))) next(s);
+    skip_space(s);
 
     /* Skip comments. */
     if (lit(s, "//") || chr(s, '#')) {
@@ -81,14 +82,18 @@ skip_more_whitespace_and_comments:
     if (eof(s)) return END_OF_FILE;
 
     /* New token. */
-    s->token_line = s->line;
-    s->token_column = s->column;
+    s->token_pos = s->pos;
     s->buf_pos = 0;
 
     /* String literal. */
     if (chr(s, '\"')) {
         while (!eof(s) && !eol(s) && peek(s) != '\"') {
-            if (chr(s, '\\')) {
+            const size_t n = span_string(s->s + s->pos, s->len - s->pos);
+            if (n > 0) {
+                buf_appendn(s, s->s + s->pos, n);
+                s->pos += n;
+            }
+            else if (chr(s, '\\')) {
                 uint8_t o;
                 if      (chr(s, '\\')) buf_append(s, '\\');
                 else if (chr(s, 'n'))  buf_append(s, '\n');
@@ -103,8 +108,6 @@ skip_more_whitespace_and_comments:
                     scanner_warn(s, "unknown escape sequence in string literal");
                     /* Ignore. */
                 }
-            } else {
-                buf_append(s, next(s));
             }
         }
         if (!buf_append(s, '\0') || !chr(s, '\"')) {
@@ -150,9 +153,10 @@ skip_more_whitespace_and_comments:
 
     /* Identifier. */
     if (is_alpha(peek(s)) || peek(s) == '_') {
+        const size_t n = span_ident(s->s + s->pos, s->len - s->pos);
         s->buf_pos = 0;
-        while (is_alnum(peek(s)) || peek(s) == '_')
-            buf_append(s, next(s));
+        buf_appendn(s, s->s + s->pos, n);
+        s->pos += n;
         if (!buf_append(s, '\0')) {
             scanner_err(s, "identifier too long");
             return ERROR_TOK;
@@ -186,8 +190,46 @@ XkbParseString(struct xkb_context *ctx, const char *string, size_t len,
                const char *file_name, const char *map)
 {
     struct scanner scanner;
+    XkbFile *xkb_file;
+    int prev_phase;
+
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_PARSE);
+    scanner_init(&scanner, ctx, string, len, file_name, NULL);
+    xkb_file = parse(ctx, &scanner, map);
+
+    if (unlikely(ctx->profile)) {
+        struct ast_stats stats = { 0 };
+        CountXkbFile(xkb_file, &stats);
+        profile_count(ctx, XKB_COMPILE_COUNTER_BYTES_LEXED, len);
+        profile_count(ctx, XKB_COMPILE_COUNTER_AST_NODES, stats.nodes);
+        profile_count(ctx, XKB_COMPILE_COUNTER_ALLOCATIONS, stats.allocations);
+    }
+    profile_leave_phase(ctx, prev_phase);
+
+    return xkb_file;
+}
+
+/*
+ * Run only the lexer over the string, e.g. for benchmarking it.
+ * Returns the number of tokens, or -1 if an invalid token was found.
+ */
+int
+XkbLexString(struct xkb_context *ctx, const char *string, size_t len,
+             const char *file_name)
+{
+    struct scanner scanner;
+    YYSTYPE val;
+    int tok, count = 0;
+
     scanner_init(&scanner, ctx, string, len, file_name, NULL);
-    return parse(ctx, &scanner, map);
+    while ((tok = _xkbcommon_lex(&val, &scanner)) != END_OF_FILE) {
+        if (tok == ERROR_TOK)
+            return -1;
+        if (tok == STRING || tok == IDENT)
+            free(val.str);
+        count++;
+    }
+    return count;
 }
 
 XkbFile *
@@ -198,8 +240,11 @@ XkbParseFile(struct xkb_context *ctx, FILE *file,
     XkbFile *xkb_file;
     char *string;
     size_t size;
+    int prev_phase;
 
+    prev_phase = profile_enter_phase(ctx, XKB_COMPILE_PHASE_FILE_IO);
     ok = map_file(file, &string, &size);
+    profile_leave_phase(ctx, prev_phase);
     if (!ok) {
         log_err(ctx, "Couldn't read XKB file %s: %s\n",
                 file_name, strerror(errno));
@@ -54,6 +54,7 @@
 #include "config.h"
 
 #include "xkbcomp-priv.h"
+#include "hash.h"
 #include "text.h"
 #include "expr.h"
 #include "action.h"
@@ -175,8 +176,15 @@ typedef struct {
     enum merge_mode merge;
     xkb_layout_index_t explicit_group;
     darray(KeyInfo) keys;
+    /* Index of keys by name. */
+    struct hash_index key_index;
     KeyInfo default_key;
     ActionsInfo *actions;
+    /*
+     * The names and aliases of the keys kept in a keymap compiled for a
+     * device, see device_keys; NULL if it is not compiled for a device.
+     */
+    const struct hash_atom_set *device_keys;
     darray(xkb_atom_t) group_names;
     darray(ModMapEntry) modmaps;
     struct xkb_mod_set mods;
@@ -188,7 +196,9 @@ typedef struct {
 
 static void
 InitSymbolsInfo(SymbolsInfo *info, const struct xkb_keymap *keymap,
-                ActionsInfo *actions, const struct xkb_mod_set *mods)
+                ActionsInfo *actions,
+                const struct hash_atom_set *device_keys,
+                const struct xkb_mod_set *mods)
 {
     memset(info, 0, sizeof(*info));
     info->ctx = keymap->ctx;
@@ -196,6 +206,7 @@ InitSymbolsInfo(SymbolsInfo *info, const struct xkb_keymap *keymap,
     info->merge = MERGE_OVERRIDE;
     InitKeyInfo(keymap->ctx, &info->default_key);
     info->actions = actions;
+    info->device_keys = device_keys;
     info->mods = *mods;
     info->explicit_group = XKB_LAYOUT_INVALID;
 }
@@ -208,6 +219,7 @@ ClearSymbolsInfo(SymbolsInfo *info)
     darray_foreach(keyi, info->keys)
         ClearKeyInfo(keyi);
     darray_free(info->keys);
+    hash_index_free(&info->key_index);
     darray_free(info->group_names);
     darray_free(info->modmaps);
     ClearKeyInfo(&info->default_key);
@@ -224,7 +236,6 @@ MergeGroups(SymbolsInfo *info, GroupInfo *into, GroupInfo *from, bool clobber,
             bool report, xkb_layout_index_t group, xkb_atom_t key_name)
 {
     xkb_level_index_t i, levels_in_both;
-    struct xkb_level *level;
 
     /* First find the type of the merged group. */
     if (into->type != from->type) {
@@ -324,10 +335,12 @@ MergeGroups(SymbolsInfo *info, GroupInfo *into, GroupInfo *from, bool clobber,
             }
         }
     }
-    /* If @from has extra levels, get them as well. */
-    darray_foreach_from(level, from->levels, levels_in_both) {
-        darray_append(into->levels, *level);
-        level->num_syms = 0;
+    /* If @from has extra levels, move them over. */
+    if (darray_size(from->levels) > levels_in_both) {
+        darray_append_items(into->levels,
+                            &darray_item(from->levels, levels_in_both),
+                            darray_size(from->levels) - levels_in_both);
+        darray_resize(from->levels, levels_in_both);
     }
     into->defined |= (from->defined & GROUP_FIELD_ACTS);
     into->defined |= (from->defined & GROUP_FIELD_SYMS);
@@ -370,16 +383,27 @@ MergeKeys(SymbolsInfo *info, KeyInfo *into, KeyInfo *from, bool same_file)
         return true;
     }
 
-    groups_in_both = MIN(darray_size(into->groups), darray_size(from->groups));
-    for (i = 0; i < groups_in_both; i++)
-        MergeGroups(info,
-                    &darray_item(into->groups, i),
-                    &darray_item(from->groups, i),
-                    clobber, report, i, into->name);
-    /* If @from has extra groups, just move them to @into. */
-    for (i = groups_in_both; i < darray_size(from->groups); i++) {
-        darray_append(into->groups, darray_item(from->groups, i));
-        InitGroupInfo(&darray_item(from->groups, i));
+    if (darray_empty(into->groups)) {
+        /* Nothing to merge with; take the groups array as is. */
+        darray_free(into->groups);
+        into->groups = from->groups;
+        darray_init(from->groups);
+    }
+    else {
+        groups_in_both = MIN(darray_size(into->groups),
+                             darray_size(from->groups));
+        for (i = 0; i < groups_in_both; i++)
+            MergeGroups(info,
+                        &darray_item(into->groups, i),
+                        &darray_item(from->groups, i),
+                        clobber, report, i, into->name);
+        /* If @from has extra groups, just move them to @into. */
+        if (darray_size(from->groups) > groups_in_both) {
+            darray_append_items(into->groups,
+                                &darray_item(from->groups, groups_in_both),
+                                darray_size(from->groups) - groups_in_both);
+            darray_resize(from->groups, groups_in_both);
+        }
     }
 
     if (UseNewKeyField(KEY_FIELD_VMODMAP, into->defined, from->defined,
@@ -416,6 +440,37 @@ MergeKeys(SymbolsInfo *info, KeyInfo *into, KeyInfo *from, bool same_file)
     return true;
 }
 
+static bool
+KeyIndexMatch(const void *keys, unsigned pos, const void *name)
+{
+    return ((const KeyInfo *) keys)[pos].name == *(const xkb_atom_t *) name;
+}
+
+static unsigned
+KeyIndexHash(const void *keys, unsigned pos)
+{
+    return hash_int(((const KeyInfo *) keys)[pos].name);
+}
+
+static KeyInfo *
+FindKeyInfo(const SymbolsInfo *info, xkb_atom_t name)
+{
+    unsigned pos = hash_index_find(&info->key_index, hash_int(name),
+                                   KeyIndexMatch, info->keys.item, &name);
+    if (pos == HASH_INDEX_NONE)
+        return NULL;
+
+    return &darray_item(info->keys, pos);
+}
+
+/* Add the last key in info->keys to the index. */
+static bool
+IndexLastKeyInfo(SymbolsInfo *info)
+{
+    return hash_index_add_last(&info->key_index, KeyIndexHash,
+                               info->keys.item, darray_size(info->keys), 64);
+}
+
 /* TODO: Make it so this function doesn't need the entire keymap. */
 static bool
 AddKeySymbols(SymbolsInfo *info, KeyInfo *keyi, bool same_file)
@@ -426,19 +481,23 @@ AddKeySymbols(SymbolsInfo *info, KeyInfo *keyi, bool same_file)
     /*
      * Don't keep aliases in the keys array; this guarantees that
      * searching for keys to merge with by straight comparison (see the
-     * following loop) is enough, and we won't get multiple KeyInfo's
+     * index lookup below) is enough, and we won't get multiple KeyInfo's
      * for the same key because of aliases.
      */
     real_name = XkbResolveKeyAlias(info->keymap, keyi->name);
     if (real_name != XKB_ATOM_NONE)
         keyi->name = real_name;
 
-    darray_foreach(iter, info->keys)
-        if (iter->name == keyi->name)
-            return MergeKeys(info, iter, keyi, same_file);
+    iter = FindKeyInfo(info, keyi->name);
+    if (iter)
+        return MergeKeys(info, iter, keyi, same_file);
 
     darray_append(info->keys, *keyi);
     InitKeyInfo(info->ctx, keyi);
+    if (!IndexLastKeyInfo(info)) {
+        log_err(info->ctx, "Couldn't allocate the symbols key index\n");
+        return false;
+    }
     return true;
 }
 
@@ -524,6 +583,9 @@ MergeIncludedSymbols(SymbolsInfo *into, SymbolsInfo *from,
     if (darray_empty(into->keys)) {
         into->keys = from->keys;
         darray_init(from->keys);
+        hash_index_free(&into->key_index);
+        into->key_index = from->key_index;
+        from->key_index = (struct hash_index) { NULL, 0 };
     }
     else {
         KeyInfo *keyi;
@@ -556,7 +618,8 @@ HandleIncludeSymbols(SymbolsInfo *info, IncludeStmt *include)
 {
     SymbolsInfo included;
 
-    InitSymbolsInfo(&included, info->keymap, info->actions, &info->mods);
+    InitSymbolsInfo(&included, info->keymap, info->actions,
+                    info->device_keys, &info->mods);
     included.name = include->stmt;
     include->stmt = NULL;
 
@@ -572,7 +635,7 @@ HandleIncludeSymbols(SymbolsInfo *info, IncludeStmt *include)
         }
 
         InitSymbolsInfo(&next_incl, info->keymap, info->actions,
-                        &included.mods);
+                        info->device_keys, &included.mods);
         if (stmt->modifier) {
             next_incl.explicit_group = atoi(stmt->modifier) - 1;
             if (next_incl.explicit_group >= XKB_MAX_GROUPS) {
@@ -790,6 +853,8 @@ static const LookupEntry repeatEntries[] = {
     { NULL, 0 }
 };
 
+static const LookupTable repeatNames = LOOKUP_TABLE_LINEAR(repeatEntries);
+
 static bool
 SetSymbolsField(SymbolsInfo *info, KeyInfo *keyi, const char *field,
                 ExprDef *arrayNdx, ExprDef *value)
@@ -876,7 +941,7 @@ SetSymbolsField(SymbolsInfo *info, KeyInfo *keyi, const char *field,
              istreq(field, "repeat")) {
         unsigned int val;
 
-        if (!ExprResolveEnum(info->ctx, value, &val, repeatEntries)) {
+        if (!ExprResolveEnum(info->ctx, value, &val, &repeatNames)) {
             log_err(info->ctx,
                     "Illegal repeat setting for %s; "
                     "Non-boolean repeat setting ignored\n",
@@ -1113,11 +1178,41 @@ SetExplicitGroup(SymbolsInfo *info, KeyInfo *keyi)
     return true;
 }
 
+static bool
+InitDeviceKeyNames(struct hash_atom_set *names,
+                   const struct xkb_keymap *keymap)
+{
+    const struct xkb_key *key;
+
+    xkb_keys_foreach(key, keymap)
+        if (key->name != XKB_ATOM_NONE &&
+            !hash_atom_set_insert(names, key->name))
+            return false;
+    /* The aliases of the keys the device lacks are already dropped. */
+    for (unsigned i = 0; i < keymap->num_key_aliases; i++)
+        if (!hash_atom_set_insert(names, keymap->key_aliases[i].alias))
+            return false;
+
+    return true;
+}
+
+/* Whether a key was left out of a keymap compiled for a device. */
+static bool
+KeyNotOnDevice(SymbolsInfo *info, xkb_atom_t name)
+{
+    return info->device_keys &&
+           !hash_atom_set_contains(info->device_keys, name);
+}
+
 static bool
 HandleSymbolsDef(SymbolsInfo *info, SymbolsDef *stmt)
 {
     KeyInfo keyi;
 
+    /* Don't bother with the symbols of keys the device lacks. */
+    if (KeyNotOnDevice(info, stmt->keyName))
+        return true;
+
     keyi = info->default_key;
     darray_init(keyi.groups);
     darray_copy(keyi.groups, info->default_key.groups);
@@ -1235,44 +1330,95 @@ HandleSymbolsFile(SymbolsInfo *info, XkbFile *file, enum merge_mode merge)
     }
 }
 
+/*
+ * Index of the keys by the keysyms they generate, for resolving
+ * modifier_map entries which refer to keysyms. Each keysym maps to the
+ * key which FindKeyForSymbol() would return.
+ */
+struct keysym_key_entry {
+    xkb_keysym_t sym;
+    xkb_layout_index_t group;
+    xkb_level_index_t level;
+    /* NULL if the slot is empty. */
+    struct xkb_key *key;
+};
+
+struct keysym_key_index {
+    /* Open addressing hash table. */
+    struct keysym_key_entry *entries;
+    unsigned size_mask;
+};
+
+static struct keysym_key_entry *
+KeysymKeyIndexSlot(const struct keysym_key_index *index, xkb_keysym_t sym)
+{
+    unsigned slot = hash_int(sym) & index->size_mask;
+
+    while (index->entries[slot].key && index->entries[slot].sym != sym)
+        slot = hash_table_next_slot(slot, index->size_mask + 1);
+
+    return &index->entries[slot];
+}
+
+static bool
+InitKeysymKeyIndex(struct keysym_key_index *index, struct xkb_keymap *keymap)
+{
+    struct xkb_key *key;
+    unsigned count = 0, size;
+
+    xkb_keys_foreach(key, keymap)
+        for (xkb_layout_index_t group = 0; group < key->num_groups; group++)
+            count += XkbKeyNumLevels(key, group);
+
+    size = hash_table_size(count, 1);
+    index->size_mask = size - 1;
+    index->entries = calloc(size, sizeof(*index->entries));
+    if (!index->entries)
+        return false;
+
+    /*
+     * Since there can be many keys which generates the keysym, the key
+     * is chosen first by lowest group in which the keysym appears, than
+     * by lowest level and than by lowest key code. The keys are visited
+     * by increasing key code, so only replace on a lower group or level.
+     */
+    xkb_keys_foreach(key, keymap) {
+        for (xkb_layout_index_t group = 0; group < key->num_groups; group++) {
+            for (xkb_level_index_t level = 0;
+                 level < XkbKeyNumLevels(key, group); level++) {
+                const struct xkb_level *leveli =
+                    &key->groups[group].levels[level];
+                struct keysym_key_entry *entry;
+
+                if (leveli->num_syms != 1)
+                    continue;
+
+                entry = KeysymKeyIndexSlot(index, leveli->u.sym);
+                if (!entry->key || group < entry->group ||
+                    (group == entry->group && level < entry->level)) {
+                    entry->sym = leveli->u.sym;
+                    entry->group = group;
+                    entry->level = level;
+                    entry->key = key;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
 /**
  * Given a keysym @sym, return a key which generates it, or NULL.
  * This is used for example in a modifier map definition, such as:
  *      modifier_map Lock           { Caps_Lock };
  * where we want to add the Lock modifier to the modmap of the key
  * which matches the keysym Caps_Lock.
- * Since there can be many keys which generates the keysym, the key
- * is chosen first by lowest group in which the keysym appears, than
- * by lowest level and than by lowest key code.
  */
 static struct xkb_key *
-FindKeyForSymbol(struct xkb_keymap *keymap, xkb_keysym_t sym)
+FindKeyForSymbol(const struct keysym_key_index *index, xkb_keysym_t sym)
 {
-    struct xkb_key *key;
-    xkb_layout_index_t group;
-    bool got_one_group, got_one_level;
-
-    group = 0;
-    do {
-        xkb_level_index_t level = 0;
-        got_one_group = false;
-        do {
-            got_one_level = false;
-            xkb_keys_foreach(key, keymap) {
-                if (group < key->num_groups &&
-                    level < XkbKeyNumLevels(key, group)) {
-                    got_one_group = got_one_level = true;
-                    if (key->groups[group].levels[level].num_syms == 1 &&
-                        key->groups[group].levels[level].u.sym == sym)
-                        return key;
-                }
-            }
-            level++;
-        } while (got_one_level);
-        group++;
-    } while (got_one_group);
-
-    return NULL;
+    return KeysymKeyIndexSlot(index, sym)->key;
 }
 
 /*
@@ -1287,19 +1433,19 @@ FindKeyForSymbol(struct xkb_keymap *keymap, xkb_keysym_t sym)
  *
  * FIXME: Decide how to handle multiple-syms-per-level, and do it.
  */
-static xkb_atom_t
-FindAutomaticType(struct xkb_context *ctx, GroupInfo *groupi)
+xkb_atom_t
+FindAutomaticType(struct xkb_context *ctx, const struct xkb_level *levels,
+                  xkb_level_index_t width)
 {
     xkb_keysym_t sym0, sym1;
-    const xkb_level_index_t width = darray_size(groupi->levels);
 
 #define GET_SYM(level) \
-    (darray_item(groupi->levels, level).num_syms == 0 ? \
+    (levels[level].num_syms == 0 ? \
         XKB_KEY_NoSymbol : \
-     darray_item(groupi->levels, level).num_syms == 1 ? \
-        darray_item(groupi->levels, level).u.sym : \
+     levels[level].num_syms == 1 ? \
+        levels[level].u.sym : \
      /* num_syms > 1 */ \
-        darray_item(groupi->levels, level).u.syms[0])
+        levels[level].u.syms[0])
 
     if (width == 1 || width <= 0)
         return xkb_atom_intern_literal(ctx, "ONE_LEVEL");
@@ -1355,7 +1501,8 @@ FindTypeForGroup(struct xkb_keymap *keymap, KeyInfo *keyi,
             type_name  = keyi->default_type;
         }
         else {
-            type_name = FindAutomaticType(keymap->ctx, groupi);
+            type_name = FindAutomaticType(keymap->ctx, groupi->levels.item,
+                                          darray_size(groupi->levels));
             if (type_name != XKB_ATOM_NONE)
                 *explicit_type = false;
         }
@@ -1496,6 +1643,7 @@ CopySymbolsDefToKeymap(struct xkb_keymap *keymap, SymbolsInfo *info,
 
 static bool
 CopyModMapDefToKeymap(struct xkb_keymap *keymap, SymbolsInfo *info,
+                      const struct keysym_key_index *index,
                       ModMapEntry *entry)
 {
     struct xkb_key *key;
@@ -1503,22 +1651,24 @@ CopyModMapDefToKeymap(struct xkb_keymap *keymap, SymbolsInfo *info,
     if (!entry->haveSymbol) {
         key = XkbKeyByName(keymap, entry->u.keyName, true);
         if (!key) {
-            log_vrb(info->ctx, 5,
-                    "Key %s not found in keycodes; "
-                    "Modifier map entry for %s not updated\n",
-                    KeyNameText(info->ctx, entry->u.keyName),
-                    ModIndexText(info->ctx, &info->mods, entry->modifier));
+            if (!keymap->device_keys)
+                log_vrb(info->ctx, 5,
+                        "Key %s not found in keycodes; "
+                        "Modifier map entry for %s not updated\n",
+                        KeyNameText(info->ctx, entry->u.keyName),
+                        ModIndexText(info->ctx, &info->mods, entry->modifier));
             return false;
         }
     }
     else {
-        key = FindKeyForSymbol(keymap, entry->u.keySym);
+        key = FindKeyForSymbol(index, entry->u.keySym);
         if (!key) {
-            log_vrb(info->ctx, 5,
-                    "Key \"%s\" not found in symbol map; "
-                    "Modifier map entry for %s not updated\n",
-                    KeysymText(info->ctx, entry->u.keySym),
-                    ModIndexText(info->ctx, &info->mods, entry->modifier));
+            if (!keymap->device_keys)
+                log_vrb(info->ctx, 5,
+                        "Key \"%s\" not found in symbol map; "
+                        "Modifier map entry for %s not updated\n",
+                        KeysymText(info->ctx, entry->u.keySym),
+                        ModIndexText(info->ctx, &info->mods, entry->modifier));
             return false;
         }
     }
@@ -1532,6 +1682,8 @@ CopySymbolsToKeymap(struct xkb_keymap *keymap, SymbolsInfo *info)
 {
     KeyInfo *keyi;
     ModMapEntry *mm;
+    struct keysym_key_index index = { NULL, 0 };
+    bool need_index = false;
 
     keymap->symbols_section_name = strdup_safe(info->name);
     XkbEscapeMapName(keymap->symbols_section_name);
@@ -1560,9 +1712,16 @@ CopySymbolsToKeymap(struct xkb_keymap *keymap, SymbolsInfo *info)
     }
 
     darray_foreach(mm, info->modmaps)
-        if (!CopyModMapDefToKeymap(keymap, info, mm))
+        need_index |= mm->haveSymbol;
+    if (need_index && !InitKeysymKeyIndex(&index, keymap))
+        return false;
+
+    darray_foreach(mm, info->modmaps)
+        if (!CopyModMapDefToKeymap(keymap, info, &index, mm))
             info->errorCount++;
 
+    free(index.entries);
+
     /* XXX: If we don't ignore errorCount, things break. */
     return true;
 }
@@ -1573,12 +1732,20 @@ CompileSymbols(XkbFile *file, struct xkb_keymap *keymap,
 {
     SymbolsInfo info;
     ActionsInfo *actions;
+    struct hash_atom_set device_keys = { NULL, 0, 0 };
 
     actions = NewActionsInfo();
     if (!actions)
         return false;
 
-    InitSymbolsInfo(&info, keymap, actions, &keymap->mods);
+    if (keymap->device_keys && !InitDeviceKeyNames(&device_keys, keymap)) {
+        hash_atom_set_free(&device_keys);
+        FreeActionsInfo(actions);
+        return false;
+    }
+
+    InitSymbolsInfo(&info, keymap, actions,
+                    keymap->device_keys ? &device_keys : NULL, &keymap->mods);
     info.default_key.merge = merge;
 
     HandleSymbolsFile(&info, file, merge);
@@ -1591,10 +1758,12 @@ CompileSymbols(XkbFile *file, struct xkb_keymap *keymap,
 
     ClearSymbolsInfo(&info);
     FreeActionsInfo(actions);
+    hash_atom_set_free(&device_keys);
     return true;
 
 err_info:
     FreeActionsInfo(actions);
     ClearSymbolsInfo(&info);
+    hash_atom_set_free(&device_keys);
     return false;
 }
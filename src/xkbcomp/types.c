@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include "xkbcomp-priv.h"
+#include "hash.h"
 #include "text.h"
 #include "vmod.h"
 #include "expr.h"
@@ -55,6 +56,8 @@ typedef struct {
     int errorCount;
 
     darray(KeyTypeInfo) types;
+    /* Index of types by name. */
+    struct hash_index type_index;
     struct xkb_mod_set mods;
 
     struct xkb_context *ctx;
@@ -119,18 +122,40 @@ ClearKeyTypesInfo(KeyTypesInfo *info)
 {
     free(info->name);
     darray_free(info->types);
+    hash_index_free(&info->type_index);
+}
+
+static bool
+TypeIndexMatch(const void *types, unsigned pos, const void *name)
+{
+    return ((const KeyTypeInfo *) types)[pos].name ==
+           *(const xkb_atom_t *) name;
+}
+
+static unsigned
+TypeIndexHash(const void *types, unsigned pos)
+{
+    return hash_int(((const KeyTypeInfo *) types)[pos].name);
 }
 
 static KeyTypeInfo *
 FindMatchingKeyType(KeyTypesInfo *info, xkb_atom_t name)
 {
-    KeyTypeInfo *old;
+    unsigned pos = hash_index_find(&info->type_index, hash_int(name),
+                                   TypeIndexMatch, info->types.item, &name);
+    if (pos == HASH_INDEX_NONE)
+        return NULL;
 
-    darray_foreach(old, info->types)
-        if (old->name == name)
-            return old;
+    return &darray_item(info->types, pos);
+}
 
-    return NULL;
+/* Add the last type in info->types to the index. */
+static bool
+IndexLastKeyType(KeyTypesInfo *info)
+{
+    return hash_index_add_last(&info->type_index, TypeIndexHash,
+                               info->types.item, darray_size(info->types),
+                               32);
 }
 
 static bool
@@ -167,6 +192,10 @@ AddKeyType(KeyTypesInfo *info, KeyTypeInfo *new, bool same_file)
     }
 
     darray_append(info->types, *new);
+    if (!IndexLastKeyType(info)) {
+        log_err(info->ctx, "Couldn't allocate the key types index\n");
+        return false;
+    }
     return true;
 }
 
@@ -191,6 +220,9 @@ MergeIncludedKeyTypes(KeyTypesInfo *into, KeyTypesInfo *from,
     if (darray_empty(into->types)) {
         into->types = from->types;
         darray_init(from->types);
+        hash_index_free(&into->type_index);
+        into->type_index = from->type_index;
+        from->type_index = (struct hash_index) { NULL, 0 };
     }
     else {
         KeyTypeInfo *type;
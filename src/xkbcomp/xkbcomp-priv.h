@@ -30,15 +30,18 @@
 #include "keymap.h"
 #include "ast.h"
 
-struct xkb_component_names {
-    char *keycodes;
-    char *types;
-    char *compat;
-    char *symbols;
-};
+char *
+text_v1_keymap_get_as_string(struct xkb_keymap *keymap,
+                             enum xkb_keymap_serialize_flags flags);
+
+bool
+text_v1_keymap_write(struct xkb_keymap *keymap,
+                     enum xkb_keymap_serialize_flags flags,
+                     xkb_keymap_write_fn_t write_fn, void *data);
 
+/* Write the keymap as a C source file defining a struct xkb_static_keymap. */
 char *
-text_v1_keymap_get_as_string(struct xkb_keymap *keymap);
+keymap_get_as_c_source(struct xkb_keymap *keymap, const char *name);
 
 XkbFile *
 XkbParseFile(struct xkb_context *ctx, FILE *file,
@@ -49,6 +52,10 @@ XkbParseString(struct xkb_context *ctx,
                const char *string, size_t len,
                const char *file_name, const char *map);
 
+int
+XkbLexString(struct xkb_context *ctx, const char *string, size_t len,
+             const char *file_name);
+
 void
 FreeXkbFile(XkbFile *file);
 
@@ -76,6 +83,21 @@ bool
 CompileKeymap(XkbFile *file, struct xkb_keymap *keymap,
               enum merge_mode merge);
 
+bool
+UpdateDerivedKeymapFields(struct xkb_keymap *keymap);
+
+bool
+UpdateDerivedKeyFields(struct xkb_keymap *keymap,
+                       const xkb_keycode_t *keycodes, size_t num_keycodes);
+
+xkb_atom_t
+FindAutomaticType(struct xkb_context *ctx, const struct xkb_level *levels,
+                  xkb_level_index_t width);
+
+bool
+CompileKeymapSymbols(XkbFile *file, struct xkb_keymap *keymap,
+                     const struct xkb_keymap *base, enum merge_mode merge);
+
 /***====================================================================***/
 
 static inline bool
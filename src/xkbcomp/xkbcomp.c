@@ -52,12 +52,12 @@ compile_keymap_file(struct xkb_keymap *keymap, XkbFile *file)
 }
 
 static bool
-text_v1_keymap_new_from_names(struct xkb_keymap *keymap,
-                              const struct xkb_rule_names *rmlvo)
+components_from_names(struct xkb_keymap *keymap,
+                      const struct xkb_rule_names *rmlvo)
 {
     bool ok;
     struct xkb_component_names kccgst;
-    XkbFile *file;
+    int prev_phase;
 
     log_dbg(keymap->ctx,
             "Compiling from RMLVO: rules '%s', model '%s', layout '%s', "
@@ -65,7 +65,9 @@ text_v1_keymap_new_from_names(struct xkb_keymap *keymap,
             rmlvo->rules, rmlvo->model, rmlvo->layout, rmlvo->variant,
             rmlvo->options);
 
+    prev_phase = profile_enter_phase(keymap->ctx, XKB_COMPILE_PHASE_RULES);
     ok = xkb_components_from_rules(keymap->ctx, rmlvo, &kccgst);
+    profile_leave_phase(keymap->ctx, prev_phase);
     if (!ok) {
         log_err(keymap->ctx,
                 "Couldn't look up rules '%s', model '%s', layout '%s', "
@@ -80,24 +82,106 @@ text_v1_keymap_new_from_names(struct xkb_keymap *keymap,
             "compat '%s', symbols '%s'\n",
             kccgst.keycodes, kccgst.types, kccgst.compat, kccgst.symbols);
 
-    file = XkbFileFromComponents(keymap->ctx, &kccgst);
+    /* Keep the components around for xkb_keymap_new_from_names_incremental. */
+    keymap->components = calloc(1, sizeof(*keymap->components));
+    if (!keymap->components) {
+        free(kccgst.keycodes);
+        free(kccgst.types);
+        free(kccgst.compat);
+        free(kccgst.symbols);
+        return false;
+    }
+
+    keymap->components->keycodes = kccgst.keycodes;
+    keymap->components->types = kccgst.types;
+    keymap->components->compat = kccgst.compat;
+    keymap->components->symbols = kccgst.symbols;
+    return true;
+}
+
+static XkbFile *
+keymap_file_from_components(struct xkb_keymap *keymap)
+{
+    /* The include statements are parsed in place; keep ours intact. */
+    struct xkb_component_names kccgst = {
+        .keycodes = strdup_safe(keymap->components->keycodes),
+        .types = strdup_safe(keymap->components->types),
+        .compat = strdup_safe(keymap->components->compat),
+        .symbols = strdup_safe(keymap->components->symbols),
+    };
+    XkbFile *file = NULL;
+
+    if (kccgst.keycodes && kccgst.types && kccgst.compat && kccgst.symbols)
+        file = XkbFileFromComponents(keymap->ctx, &kccgst);
 
     free(kccgst.keycodes);
     free(kccgst.types);
     free(kccgst.compat);
     free(kccgst.symbols);
 
-    if (!file) {
+    if (!file)
         log_err(keymap->ctx,
                 "Failed to generate parsed XKB file from components\n");
+
+    return file;
+}
+
+static bool
+text_v1_keymap_new_from_names(struct xkb_keymap *keymap,
+                              const struct xkb_rule_names *rmlvo)
+{
+    bool ok;
+    XkbFile *file;
+
+    if (!components_from_names(keymap, rmlvo))
+        return false;
+
+    file = keymap_file_from_components(keymap);
+    if (!file)
         return false;
-    }
 
     ok = compile_keymap_file(keymap, file);
     FreeXkbFile(file);
     return ok;
 }
 
+static bool
+text_v1_keymap_new_from_names_incremental(struct xkb_keymap *keymap,
+                                          const struct xkb_keymap *base,
+                                          const struct xkb_rule_names *rmlvo)
+{
+    bool ok;
+    XkbFile *file;
+
+    if (!components_from_names(keymap, rmlvo))
+        return false;
+
+    file = keymap_file_from_components(keymap);
+    if (!file)
+        return false;
+
+    /*
+     * Only the symbols section can be compiled on its own, on top of the
+     * others; if anything else changed, start from scratch.
+     */
+    if (base->format == keymap->format && base->components &&
+        streq(base->components->keycodes, keymap->components->keycodes) &&
+        streq(base->components->types, keymap->components->types) &&
+        streq(base->components->compat, keymap->components->compat)) {
+        log_dbg(keymap->ctx,
+                "Reusing the keycodes, types and compat of the base keymap\n");
+        ok = CompileKeymapSymbols(file, keymap, base, MERGE_OVERRIDE);
+        if (!ok)
+            log_err(keymap->ctx, "Failed to compile keymap\n");
+    }
+    else {
+        ok = compile_keymap_file(keymap, file);
+    }
+
+    FreeXkbFile(file);
+    return ok;
+}
+
 static bool
 text_v1_keymap_new_from_string(struct xkb_keymap *keymap,
                                const char *string, size_t len)
@@ -135,7 +219,9 @@ text_v1_keymap_new_from_file(struct xkb_keymap *keymap, FILE *file)
 
 const struct xkb_keymap_format_ops text_v1_keymap_format_ops = {
     .keymap_new_from_names = text_v1_keymap_new_from_names,
+    .keymap_new_from_names_incremental = text_v1_keymap_new_from_names_incremental,
     .keymap_new_from_string = text_v1_keymap_new_from_string,
     .keymap_new_from_file = text_v1_keymap_new_from_file,
     .keymap_get_as_string = text_v1_keymap_get_as_string,
+    .keymap_write = text_v1_keymap_write,
 };
@@ -470,6 +470,45 @@ test_from_locale(struct xkb_context *ctx)
     unsetenv("XLOCALEDIR");
 }
 
+static void
+test_from_locale_async(struct xkb_context *ctx)
+{
+    struct xkb_compose_table_async *async;
+    struct xkb_compose_table *table;
+    struct xkb_compose_state *state;
+    char *path;
+
+    path = test_get_path("locale");
+    setenv("XLOCALEDIR", path, 1);
+    free(path);
+
+    async = xkb_compose_table_new_from_locale_async(ctx, "en_US.UTF-8",
+                                                    XKB_COMPOSE_COMPILE_NO_FLAGS);
+    assert(async);
+    table = xkb_compose_table_async_finish(async);
+    assert(table);
+    state = xkb_compose_state_new(table, XKB_COMPOSE_STATE_NO_FLAGS);
+    assert(state);
+    xkb_compose_state_feed(state, XKB_KEY_dead_acute);
+    xkb_compose_state_feed(state, XKB_KEY_a);
+    assert(xkb_compose_state_get_status(state) == XKB_COMPOSE_COMPOSED);
+    assert(xkb_compose_state_get_one_sym(state) == XKB_KEY_aacute);
+    xkb_compose_state_unref(state);
+    xkb_compose_table_unref(table);
+
+    async = xkb_compose_table_new_from_locale_async(ctx, "en_US.UTF-8",
+                                                    XKB_COMPOSE_COMPILE_NO_FLAGS);
+    assert(async);
+    xkb_compose_table_async_cancel(async);
+
+    async = xkb_compose_table_new_from_locale_async(ctx, "blabla",
+                                                    XKB_COMPOSE_COMPILE_NO_FLAGS);
+    assert(async);
+    assert(!xkb_compose_table_async_finish(async));
+
+    unsetenv("XLOCALEDIR");
+}
+
 
 static void
 test_modifier_syntax(struct xkb_context *ctx)
@@ -572,6 +611,7 @@ main(int argc, char *argv[])
     test_conflicting(ctx);
     test_XCOMPOSEFILE(ctx);
     test_from_locale(ctx);
+    test_from_locale_async(ctx);
     test_state(ctx);
     test_modifier_syntax(ctx);
     test_include(ctx);
@@ -0,0 +1,378 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+/* The keymap built in test_build, as the compiler sees it. */
+static const char keymap_text[] =
+    "xkb_keymap {\n"
+    "  xkb_keycodes {\n"
+    "    <LFSH> = 50; <AC01> = 38; <AB01> = 52; <AD01> = 24; <RALT> = 108;\n"
+    "    <CAPS> = 66; <NMLK> = 77;\n"
+    "  };\n"
+    "  xkb_types {\n"
+    "    virtual_modifiers LevelThree, NumLock = Mod2;\n"
+    "    type \"ONE_LEVEL\" { modifiers = none; };\n"
+    "    type \"TWO_LEVEL\" { modifiers = Shift; map[Shift] = 2; };\n"
+    "    type \"ALPHABETIC\" {\n"
+    "      modifiers = Shift + Lock;\n"
+    "      map[Shift] = 2; map[Lock] = 2; preserve[Lock] = Lock;\n"
+    "    };\n"
+    "    type \"THREE_LEVEL\" {\n"
+    "      modifiers = Shift + LevelThree;\n"
+    "      map[Shift] = 2; map[LevelThree] = 3; map[Shift+LevelThree] = 3;\n"
+    "    };\n"
+    "  };\n"
+    "  xkb_compat { };\n"
+    "  xkb_symbols {\n"
+    "    name[1] = \"English\"; name[2] = \"Russian\";\n"
+    "    key <LFSH> { repeat = no, [ Shift_L ],\n"
+    "                 actions[1] = [ SetMods(modifiers = modMapMods) ] };\n"
+    "    key <CAPS> { [ Caps_Lock ],\n"
+    "                 actions[1] = [ LockMods(modifiers = Lock) ] };\n"
+    "    key <RALT> { [ ISO_Level3_Shift ], vmods = LevelThree,\n"
+    "                 actions[1] = [ SetMods(modifiers = LevelThree, clearLocks) ] };\n"
+    "    key <AC01> { [ a, A ], [ Cyrillic_ef, Cyrillic_EF ] };\n"
+    "    key <AB01> { type = \"THREE_LEVEL\", [ z, Z, zcaron ] };\n"
+    "    key <AD01> { [ q, Q, { q, u }, Q ] };\n"
+    "    key <NMLK> { [ Num_Lock ],\n"
+    "                 actions[1] = [ LockGroup(group = +1) ] };\n"
+    "    modifier_map Shift { <LFSH> };\n"
+    "    modifier_map Lock { <CAPS> };\n"
+    "    modifier_map Mod5 { <RALT> };\n"
+    "  };\n"
+    "};\n";
+
+static struct xkb_keymap *
+build_keymap(struct xkb_keymap_builder *builder)
+{
+    const xkb_keysym_t qu[] = { XKB_KEY_q, XKB_KEY_u };
+    struct xkb_keymap_builder_action action;
+    xkb_mod_index_t shift, lock, mod2, mod5, level3;
+    int one, two, alpha, three;
+
+    shift = xkb_keymap_builder_add_mod(builder, "Shift", 0);
+    lock = xkb_keymap_builder_add_mod(builder, "Lock", 0);
+    mod2 = xkb_keymap_builder_add_mod(builder, "Mod2", 0);
+    mod5 = xkb_keymap_builder_add_mod(builder, "Mod5", 0);
+    level3 = xkb_keymap_builder_add_mod(builder, "LevelThree", 0);
+    assert(shift == 0 && lock == 1 && mod2 == 4 && mod5 == 7);
+    assert(level3 == 8);
+    assert(xkb_keymap_builder_add_mod(builder, "NumLock", 1u << mod2) == 9);
+    assert(xkb_keymap_builder_add_mod(builder, "Shift", 1u << mod2) ==
+           XKB_MOD_INVALID);
+
+    one = xkb_keymap_builder_add_type(builder, "ONE_LEVEL", 0, 1);
+    two = xkb_keymap_builder_add_type(builder, "TWO_LEVEL", 1u << shift, 2);
+    alpha = xkb_keymap_builder_add_type(builder, "ALPHABETIC",
+                                        (1u << shift) | (1u << lock), 2);
+    three = xkb_keymap_builder_add_type(builder, "THREE_LEVEL",
+                                        (1u << shift) | (1u << level3), 3);
+    assert(one == 0 && two == 1 && alpha == 2 && three == 3);
+    assert(xkb_keymap_builder_add_type(builder, "ONE_LEVEL", 0, 1) == -1);
+    assert(xkb_keymap_builder_type_add_entry(builder, two, 1u << shift, 1, 0));
+    assert(xkb_keymap_builder_type_add_entry(builder, alpha, 1u << shift, 1, 0));
+    assert(xkb_keymap_builder_type_add_entry(builder, alpha, 1u << lock, 1,
+                                             1u << lock));
+    assert(xkb_keymap_builder_type_add_entry(builder, three, 1u << shift, 1, 0));
+    assert(xkb_keymap_builder_type_add_entry(builder, three, 1u << level3, 2, 0));
+    assert(xkb_keymap_builder_type_add_entry(builder, three,
+                                             (1u << shift) | (1u << level3),
+                                             2, 0));
+    assert(!xkb_keymap_builder_type_add_entry(builder, three, 0, 3, 0));
+
+    assert(xkb_keymap_builder_add_key(builder, 50, "LFSH"));
+    assert(xkb_keymap_builder_add_key(builder, 38, "AC01"));
+    assert(xkb_keymap_builder_add_key(builder, 52, "AB01"));
+    assert(xkb_keymap_builder_add_key(builder, 24, "AD01"));
+    assert(xkb_keymap_builder_add_key(builder, 108, "RALT"));
+    assert(xkb_keymap_builder_add_key(builder, 66, "CAPS"));
+    assert(xkb_keymap_builder_add_key(builder, 77, "NMLK"));
+    assert(!xkb_keymap_builder_add_key(builder, 77, "FOO"));
+    assert(!xkb_keymap_builder_add_key(builder, 78, "AC01"));
+
+    assert(xkb_keymap_builder_set_layout_name(builder, 0, "English"));
+    assert(xkb_keymap_builder_set_layout_name(builder, 1, "Russian"));
+
+    /* Shift. */
+    assert(xkb_keymap_builder_key_set_syms(builder, 50, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_Shift_L },
+                                           1));
+    action = (struct xkb_keymap_builder_action) {
+        .type = XKB_KEYMAP_BUILDER_ACTION_MOD_SET,
+        .flags = XKB_KEYMAP_BUILDER_ACTION_USE_MODMAP,
+    };
+    assert(xkb_keymap_builder_key_set_action(builder, 50, 0, 0, &action));
+    assert(xkb_keymap_builder_key_set_mods(builder, 50, 1u << shift));
+    assert(xkb_keymap_builder_key_set_repeats(builder, 50, 0));
+
+    /* Caps Lock. */
+    assert(xkb_keymap_builder_key_set_syms(builder, 66, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_Caps_Lock },
+                                           1));
+    action = (struct xkb_keymap_builder_action) {
+        .type = XKB_KEYMAP_BUILDER_ACTION_MOD_LOCK,
+        .mods = 1u << lock,
+    };
+    assert(xkb_keymap_builder_key_set_action(builder, 66, 0, 0, &action));
+    assert(xkb_keymap_builder_key_set_mods(builder, 66, 1u << lock));
+
+    /* Level 3, with the virtual modifier mapped through the key. */
+    assert(xkb_keymap_builder_key_set_syms(builder, 108, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_ISO_Level3_Shift },
+                                           1));
+    action = (struct xkb_keymap_builder_action) {
+        .type = XKB_KEYMAP_BUILDER_ACTION_MOD_SET,
+        .flags = XKB_KEYMAP_BUILDER_ACTION_CLEAR_LOCKS,
+        .mods = 1u << level3,
+    };
+    assert(xkb_keymap_builder_key_set_action(builder, 108, 0, 0, &action));
+    assert(xkb_keymap_builder_key_set_mods(builder, 108,
+                                           (1u << mod5) | (1u << level3)));
+
+    /* Automatic types, in two layouts. */
+    assert(xkb_keymap_builder_key_set_syms(builder, 38, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_a }, 1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 38, 0, 1,
+                                           &(xkb_keysym_t) { XKB_KEY_A }, 1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 38, 1, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_Cyrillic_ef },
+                                           1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 38, 1, 1,
+                                           &(xkb_keysym_t) { XKB_KEY_Cyrillic_EF },
+                                           1));
+
+    /* Explicit type. */
+    assert(xkb_keymap_builder_key_set_type(builder, 52, 0, three));
+    assert(xkb_keymap_builder_key_set_syms(builder, 52, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_z }, 1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 52, 0, 1,
+                                           &(xkb_keysym_t) { XKB_KEY_Z }, 1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 52, 0, 2,
+                                           &(xkb_keysym_t) { XKB_KEY_zcaron },
+                                           1));
+
+    /* Too many levels for the automatic type; multiple keysyms. */
+    assert(xkb_keymap_builder_key_set_syms(builder, 24, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_q }, 1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 24, 0, 1,
+                                           &(xkb_keysym_t) { XKB_KEY_Q }, 1));
+    assert(xkb_keymap_builder_key_set_syms(builder, 24, 0, 2, qu, 2));
+    assert(xkb_keymap_builder_key_set_syms(builder, 24, 0, 3,
+                                           &(xkb_keysym_t) { XKB_KEY_Q }, 1));
+
+    /* Relative layout switch. */
+    assert(xkb_keymap_builder_key_set_syms(builder, 77, 0, 0,
+                                           &(xkb_keysym_t) { XKB_KEY_Num_Lock },
+                                           1));
+    action = (struct xkb_keymap_builder_action) {
+        .type = XKB_KEYMAP_BUILDER_ACTION_GROUP_LOCK,
+        .group = 1,
+    };
+    assert(xkb_keymap_builder_key_set_action(builder, 77, 0, 0, &action));
+
+    /* Errors. */
+    assert(!xkb_keymap_builder_key_set_syms(builder, 25, 0, 0,
+                                            &(xkb_keysym_t) { XKB_KEY_w }, 1));
+    assert(!xkb_keymap_builder_key_set_syms(builder, 24, 4, 0,
+                                            &(xkb_keysym_t) { XKB_KEY_w }, 1));
+    assert(!xkb_keymap_builder_key_set_type(builder, 24, 0, 4));
+    assert(!xkb_keymap_builder_key_set_mods(builder, 24, 1u << 10));
+
+    return xkb_keymap_builder_build(builder);
+}
+
+static void
+test_build(void)
+{
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap_builder *builder;
+    struct xkb_keymap *built, *compiled, *recompiled;
+    struct xkb_state *state;
+    char *built_str, *compiled_str;
+
+    assert(ctx);
+    builder = xkb_keymap_builder_new(ctx, 0);
+    assert(builder);
+
+    built = build_keymap(builder);
+    compiled = test_compile_string(ctx, keymap_text);
+    assert(built && compiled);
+
+    /*
+     * The sections of a built keymap have no names, so go through the
+     * compiler once more to compare them.
+     */
+    built_str = xkb_keymap_get_as_string(built, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(built_str);
+    recompiled = test_compile_string(ctx, built_str);
+    assert(recompiled);
+    free(built_str);
+    built_str = xkb_keymap_get_as_string(recompiled, XKB_KEYMAP_FORMAT_TEXT_V1);
+    compiled_str = xkb_keymap_get_as_string(compiled,
+                                            XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(built_str && compiled_str);
+    xkb_keymap_unref(recompiled);
+    if (!streq(built_str, compiled_str)) {
+        fprintf(stderr, "built keymap:\n%s\n", built_str);
+        fprintf(stderr, "compiled keymap:\n%s\n", compiled_str);
+        assert(!"built and compiled keymaps differ");
+    }
+    free(built_str);
+    free(compiled_str);
+
+    assert(xkb_keymap_num_layouts(built) == 2);
+    assert(streq(xkb_keymap_layout_get_name(built, 1), "Russian"));
+    assert(xkb_keymap_key_repeats(built, 38));
+    assert(!xkb_keymap_key_repeats(built, 50));
+
+    state = xkb_state_new(built);
+    assert(state);
+    xkb_state_update_key(state, 50 + 0, XKB_KEY_DOWN);
+    assert(xkb_state_key_get_one_sym(state, 38) == XKB_KEY_A);
+    xkb_state_update_key(state, 50 + 0, XKB_KEY_UP);
+    xkb_state_update_key(state, 108, XKB_KEY_DOWN);
+    assert(xkb_state_key_get_one_sym(state, 52) == XKB_KEY_zcaron);
+    assert(xkb_state_mod_name_is_active(state, "Mod5",
+                                        XKB_STATE_MODS_EFFECTIVE) > 0);
+    xkb_state_update_key(state, 108, XKB_KEY_UP);
+    xkb_state_update_key(state, 77, XKB_KEY_DOWN);
+    xkb_state_update_key(state, 77, XKB_KEY_UP);
+    assert(xkb_state_key_get_one_sym(state, 38) == XKB_KEY_Cyrillic_ef);
+    xkb_state_unref(state);
+
+    xkb_keymap_unref(compiled);
+    xkb_keymap_unref(built);
+
+    /* The builder starts over after building. */
+    built = xkb_keymap_builder_build(builder);
+    assert(built);
+    assert(xkb_keymap_num_layouts(built) == 0);
+    assert(xkb_keymap_num_mods(built) == 8);
+    xkb_keymap_unref(built);
+
+    xkb_keymap_builder_destroy(builder);
+    xkb_context_unref(ctx);
+}
+
+static void
+test_patch(void)
+{
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap *base, *patched, *patched2;
+    struct xkb_state *state;
+    const xkb_keysym_t *syms;
+    const xkb_keysym_t ydiaeresis[] = { XKB_KEY_ydiaeresis };
+    const xkb_keysym_t b[] = { XKB_KEY_b, XKB_KEY_B };
+    const xkb_keysym_t shift_r[] = { XKB_KEY_Shift_R };
+    xkb_keycode_t unused;
+    char *dump;
+
+    assert(ctx);
+    base = test_compile_rules(ctx, "evdev", "pc105", "us", "", "");
+    assert(base);
+
+    for (unused = xkb_keymap_min_keycode(base);
+         unused <= xkb_keymap_max_keycode(base); unused++)
+        if (xkb_keymap_num_layouts_for_key(base, unused) == 0)
+            break;
+    assert(unused <= xkb_keymap_max_keycode(base));
+
+    {
+        const struct xkb_keymap_key_patch patches[] = {
+            { unused, ydiaeresis, 1 },
+            { 38, b, 2 },
+            { 50, shift_r, 1 },
+        };
+        patched = xkb_keymap_new_patched(base, patches, ARRAY_SIZE(patches));
+        assert(patched);
+    }
+
+    /* The base keymap is kept alive by the patched one. */
+    xkb_keymap_unref(base);
+
+    assert(xkb_keymap_key_get_syms_by_level(patched, unused, 0, 0, &syms) == 1);
+    assert(syms[0] == XKB_KEY_ydiaeresis);
+    assert(xkb_keymap_num_levels_for_key(patched, 38, 0) == 2);
+    assert(xkb_keymap_key_get_syms_by_level(patched, 38, 0, 1, &syms) == 1);
+    assert(syms[0] == XKB_KEY_B);
+    assert(xkb_keymap_key_get_syms_by_level(patched, 39, 0, 0, &syms) == 1);
+    assert(syms[0] == XKB_KEY_s);
+
+    /* Actions are bound from the interprets, the modifier map is kept. */
+    state = xkb_state_new(patched);
+    assert(state);
+    xkb_state_update_key(state, 50, XKB_KEY_DOWN);
+    assert(xkb_state_mod_name_is_active(state, XKB_MOD_NAME_SHIFT,
+                                        XKB_STATE_MODS_EFFECTIVE) > 0);
+    assert(xkb_state_key_get_one_sym(state, 38) == XKB_KEY_B);
+    xkb_state_unref(state);
+
+    dump = xkb_keymap_get_as_string(patched, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(dump);
+    free(dump);
+
+    /* Patch a patched keymap, the same key twice. */
+    {
+        const struct xkb_keymap_key_patch patches[] = {
+            { unused, b, 2 },
+            { unused, NULL, 0 },
+        };
+        patched2 = xkb_keymap_new_patched(patched, patches,
+                                          ARRAY_SIZE(patches));
+        assert(patched2);
+    }
+    assert(xkb_keymap_num_layouts_for_key(patched2, unused) == 0);
+    assert(xkb_keymap_key_get_syms_by_level(patched2, 38, 0, 1, &syms) == 1);
+    assert(syms[0] == XKB_KEY_B);
+    assert(xkb_keymap_key_get_syms_by_level(patched, unused, 0, 0, &syms) == 1);
+    assert(syms[0] == XKB_KEY_ydiaeresis);
+
+    /* Out of range. */
+    {
+        const struct xkb_keymap_key_patch patches[] = {
+            { xkb_keymap_max_keycode(patched) + 1, b, 2 },
+        };
+        assert(!xkb_keymap_new_patched(patched, patches, 1));
+    }
+
+    xkb_keymap_unref(patched);
+    xkb_keymap_unref(patched2);
+    xkb_context_unref(ctx);
+}
+
+int
+main(void)
+{
+    test_build();
+    test_patch();
+
+    return 0;
+}
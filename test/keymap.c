@@ -28,8 +28,11 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "test.h"
+#include "keymap.h"
+#include "text.h"
 
 static void
 test_garbage_key(void)
@@ -149,11 +152,53 @@ test_keymap(void)
     xkb_context_unref(context);
 }
 
+static void
+test_lookup_tables(void)
+{
+    const LookupTable *tables[] = {
+        &ctrlMaskNames, &modComponentMaskNames, &groupComponentMaskNames,
+        &groupMaskNames, &groupNames, &levelNames, &buttonNames,
+        &useModMapValueNames, &actionTypeNames, &symInterpretMatchMaskNames,
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(tables); i++) {
+        const LookupTable *tab = tables[i];
+        for (size_t j = 0; j < tab->num_entries; j++) {
+            const LookupEntry *entry = &tab->entries[j];
+            char upper[64];
+            unsigned int value;
+
+            /* Case-insensitive duplicates resolve to the first entry. */
+            size_t first = 0;
+            while (!istreq(tab->entries[first].name, entry->name))
+                first++;
+
+            assert(LookupString(tab, entry->name, &value));
+            assert(value == tab->entries[first].value);
+
+            assert(strlen(entry->name) < sizeof(upper));
+            for (size_t k = 0; k <= strlen(entry->name); k++) {
+                char c = entry->name[k];
+                upper[k] = (c >= 'a' && c <= 'z') ? (char) (c - 'a' + 'A') : c;
+            }
+            assert(LookupString(tab, upper, &value));
+            assert(value == tab->entries[first].value);
+        }
+
+    }
+
+    unsigned int value;
+    assert(!LookupString(&ctrlMaskNames, "", &value));
+    assert(!LookupString(&ctrlMaskNames, "NoSuchControl", &value));
+    assert(!LookupString(&actionTypeNames, "SetModsX", &value));
+}
+
 int
 main(void)
 {
     test_garbage_key();
     test_keymap();
+    test_lookup_tables();
 
     return 0;
 }
@@ -253,6 +253,13 @@ main(void)
     assert(test_utf32_to_keysym('-', XKB_KEY_minus));
     assert(test_utf32_to_keysym(0x10fffd, 0x110fffd));
 
+    // Codepoints with several legacy keysyms get the first one of keysymtab[]
+    assert(test_utf32_to_keysym(0x2500, XKB_KEY_horizconnector));
+    assert(test_utf32_to_keysym(0x20a9, XKB_KEY_Korean_Won));
+    assert(test_utf32_to_keysym(0x20ac, 0x13a4)); /* Euro */
+    assert(test_utf32_to_keysym(0x2227, XKB_KEY_logicaland));
+    assert(test_utf32_to_keysym(0x318e, XKB_KEY_Hangul_AraeAE));
+
     // Unicode non-characters
     assert(test_utf32_to_keysym(0xfdd0, XKB_KEY_NoSymbol));
     assert(test_utf32_to_keysym(0xfdef, XKB_KEY_NoSymbol));
@@ -23,6 +23,10 @@
 
 #include "config.h"
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "test.h"
 #include "xkbcomp/xkbcomp-priv.h"
 #include "xkbcomp/rules.h"
@@ -86,6 +90,310 @@ test_rules(struct xkb_context *ctx, struct test_data *data)
     return passed;
 }
 
+static void
+write_file(const char *path, const char *contents)
+{
+    FILE *file = fopen(path, "w");
+    assert(file);
+    assert(fputs(contents, file) >= 0);
+    assert(fclose(file) == 0);
+}
+
+/* The compiled rules are kept on the context, but not once they change. */
+static void
+test_rules_change(void)
+{
+    char tmpdir[] = "/tmp/xkbcommon-test.XXXXXX";
+    char rules_dir[64], main_path[128], inc_path[128], other_path[128];
+    char buf[256];
+    struct xkb_context *ctx;
+    uint64_t opened;
+
+    assert(mkdtemp(tmpdir) == tmpdir);
+    snprintf(rules_dir, sizeof(rules_dir), "%s/rules", tmpdir);
+    snprintf(main_path, sizeof(main_path), "%s/changing", rules_dir);
+    snprintf(inc_path, sizeof(inc_path), "%s/changing-inc", rules_dir);
+    snprintf(other_path, sizeof(other_path), "%s/sharing", rules_dir);
+    assert(mkdir(rules_dir, 0777) == 0);
+
+    ctx = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES |
+                          XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+    assert(ctx);
+    assert(xkb_context_include_path_append(ctx, tmpdir));
+    xkb_context_set_compile_profiling(ctx, 1);
+
+    snprintf(buf, sizeof(buf),
+             "! model = keycodes types compat\n"
+             "  *     = my_keycodes my_types my_compat\n"
+             "! include %s\n", inc_path);
+    write_file(main_path, buf);
+    write_file(inc_path,
+               "! layout = symbols\n"
+               "  *      = pc+%l\n");
+
+    struct test_data before = {
+        .rules = "changing",
+
+        .model = "", .layout = "us", .variant = "", .options = "",
+
+        .keycodes = "my_keycodes", .types = "my_types",
+        .compat = "my_compat", .symbols = "pc+us",
+    };
+    assert(test_rules(ctx, &before));
+    assert(test_rules(ctx, &before));
+
+    /* A different size, in case the time stamp does not change. */
+    write_file(inc_path,
+               "! layout = symbols\n"
+               "  us     = us_symbols\n"
+               "  *      = pc+%l\n");
+    struct test_data inc_changed = {
+        .rules = "changing",
+
+        .model = "", .layout = "us", .variant = "", .options = "",
+
+        .keycodes = "my_keycodes", .types = "my_types",
+        .compat = "my_compat", .symbols = "us_symbols",
+    };
+    assert(test_rules(ctx, &inc_changed));
+
+    /* Another rules file does not read the include again. */
+    snprintf(buf, sizeof(buf),
+             "! model = keycodes types compat\n"
+             "  *     = other_keycodes my_types my_compat\n"
+             "! include %s\n", inc_path);
+    write_file(other_path, buf);
+    struct test_data sharing = {
+        .rules = "sharing",
+
+        .model = "", .layout = "us", .variant = "", .options = "",
+
+        .keycodes = "other_keycodes", .types = "my_types",
+        .compat = "my_compat", .symbols = "us_symbols",
+    };
+    opened = xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_FILES_OPENED);
+    assert(test_rules(ctx, &sharing));
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_FILES_OPENED) ==
+           opened + 1);
+
+    snprintf(buf, sizeof(buf),
+             "! model = keycodes types compat symbols\n"
+             "  *     = other_keycodes my_types my_compat other_symbols\n");
+    write_file(main_path, buf);
+    struct test_data main_changed = {
+        .rules = "changing",
+
+        .model = "", .layout = "us", .variant = "", .options = "",
+
+        .keycodes = "other_keycodes", .types = "my_types",
+        .compat = "my_compat", .symbols = "other_symbols",
+    };
+    assert(test_rules(ctx, &main_changed));
+
+    xkb_context_unref(ctx);
+    unlink(main_path);
+    unlink(inc_path);
+    unlink(other_path);
+    rmdir(rules_dir);
+    rmdir(tmpdir);
+}
+
+/* The entries of the cache directory, and the path of the last one. */
+static unsigned
+find_cache_entries(const char *dir, char *path, size_t size)
+{
+    DIR *d = opendir(dir);
+    struct dirent *ent;
+    unsigned count = 0;
+
+    if (!d)
+        return 0;
+    while ((ent = readdir(d))) {
+        if (strncmp(ent->d_name, "rules-", 6) != 0)
+            continue;
+        snprintf(path, size, "%s/%s", dir, ent->d_name);
+        count++;
+    }
+    closedir(d);
+    return count;
+}
+
+/* Change an entry behind the cache's back, to see whether it is used. */
+static void
+tamper_cache_entry(const char *path, const char *from, const char *to)
+{
+    char buf[4096];
+    FILE *file = fopen(path, "r+");
+    size_t len, i;
+
+    assert(file);
+    len = fread(buf, 1, sizeof(buf), file);
+    assert(strlen(from) == strlen(to));
+
+    /* The key holds NUL bytes. */
+    for (i = 0; i + strlen(from) <= len; i++)
+        if (memcmp(buf + i, from, strlen(from)) == 0)
+            break;
+    assert(i + strlen(from) <= len);
+    assert(fseek(file, i, SEEK_SET) == 0);
+    assert(fputs(to, file) >= 0);
+    assert(fclose(file) == 0);
+}
+
+static struct xkb_context *
+disk_cache_context(const char *tmpdir)
+{
+    struct xkb_context *ctx;
+
+    ctx = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES |
+                          XKB_CONTEXT_NO_ENVIRONMENT_NAMES |
+                          XKB_CONTEXT_RULES_DISK_CACHE);
+    assert(ctx);
+    assert(xkb_context_include_path_append(ctx, tmpdir));
+    return ctx;
+}
+
+/* With the disk cache, other contexts do not need to read the rules. */
+static void
+test_rules_disk_cache(void)
+{
+    char tmpdir[] = "/tmp/xkbcommon-test.XXXXXX";
+    char rules_dir[64], cache_dir[64], rules_path[128], entry_path[512];
+    struct xkb_context *ctx;
+    struct test_data good = {
+        .rules = "cached",
+
+        .model = "pc105", .layout = " us , de ", .variant = "", .options = "",
+
+        .keycodes = "my_keycodes", .types = "my_types",
+        .compat = "my_compat", .symbols = "pc+us+de:2",
+    };
+    struct test_data unknown = {
+        .rules = "cached",
+
+        .model = "pc105", .layout = "us", .variant = "", .options = "bogus",
+
+        .keycodes = "my_keycodes", .types = "my_types",
+        .compat = "my_compat", .symbols = "pc+us",
+    };
+
+    assert(mkdtemp(tmpdir) == tmpdir);
+    snprintf(rules_dir, sizeof(rules_dir), "%s/rules", tmpdir);
+    snprintf(cache_dir, sizeof(cache_dir), "%s/xkbcommon", tmpdir);
+    snprintf(rules_path, sizeof(rules_path), "%s/cached", rules_dir);
+    assert(mkdir(rules_dir, 0777) == 0);
+    setenv("XDG_CACHE_HOME", tmpdir, 1);
+
+    write_file(rules_path,
+               "! model = keycodes types compat\n"
+               "  *     = my_keycodes my_types my_compat\n"
+               "! layout[1] = symbols\n"
+               "  *         = pc+%l[1]\n"
+               "! layout[2] = symbols\n"
+               "  *         = +%l[2]:2\n"
+               "! layout = symbols\n"
+               "  *      = pc+%l\n");
+
+    /* Written by the first context which reads the rules... */
+    ctx = disk_cache_context(tmpdir);
+    assert(test_rules(ctx, &good));
+    assert(find_cache_entries(cache_dir, entry_path, sizeof(entry_path)) == 1);
+    /* ...but not with unrecognized names. */
+    assert(test_rules(ctx, &unknown));
+    assert(find_cache_entries(cache_dir, entry_path, sizeof(entry_path)) == 1);
+    xkb_context_unref(ctx);
+
+    /* A stale entry is written again, even if the context has the rules... */
+    tamper_cache_entry(entry_path, "rules-cache", "rules-cachf");
+    ctx = disk_cache_context(tmpdir);
+    assert(test_rules(ctx, &unknown));
+    assert(test_rules(ctx, &good));
+    assert(find_cache_entries(cache_dir, entry_path, sizeof(entry_path)) == 1);
+    /* ...but it is only checked once with them. */
+    tamper_cache_entry(entry_path, "rules-cache", "rules-cachf");
+    assert(test_rules(ctx, &good));
+    tamper_cache_entry(entry_path, "rules-cachf", "rules-cache");
+    xkb_context_unref(ctx);
+
+    /* Read by the others, whatever the spacing. */
+    tamper_cache_entry(entry_path, "pc+us+de:2", "pc+us+de:3");
+    good.layout = "us,de";
+    good.symbols = "pc+us+de:3";
+    ctx = disk_cache_context(tmpdir);
+    assert(test_rules(ctx, &good));
+    xkb_context_unref(ctx);
+
+    /* Not once the rules change. */
+    write_file(rules_path,
+               "! model = keycodes types compat symbols\n"
+               "  *     = other_keycodes my_types my_compat other_symbols\n");
+    good.keycodes = "other_keycodes";
+    good.symbols = "other_symbols";
+    ctx = disk_cache_context(tmpdir);
+    assert(test_rules(ctx, &good));
+    xkb_context_unref(ctx);
+    assert(find_cache_entries(cache_dir, entry_path, sizeof(entry_path)) == 1);
+
+    unsetenv("XDG_CACHE_HOME");
+    unlink(entry_path);
+    rmdir(cache_dir);
+    unlink(rules_path);
+    rmdir(rules_dir);
+    rmdir(tmpdir);
+}
+
+/* Resolving many names at once gives what resolving each of them does. */
+static void
+test_rules_batch(struct xkb_context *ctx)
+{
+    const char *models[] = { "pc104", "pc105", "thinkpad" };
+    const char *layouts[] = { "us", "de", "us,de", "ru,us", "ch", "us,il,ru,ca" };
+    const char *variants[] = { "", "intl", ",nodeadkeys" };
+    const char *options[] = {
+        "", "grp:alts_toggle", "ctrl:nocaps,compose:rwin", "bogus",
+    };
+    enum {
+        NUM_NAMES = ARRAY_SIZE(models) * ARRAY_SIZE(layouts) *
+                    ARRAY_SIZE(variants) * ARRAY_SIZE(options)
+    };
+    struct xkb_rule_names names[NUM_NAMES];
+    struct xkb_component_names components[NUM_NAMES];
+    struct xkb_component_names kccgst;
+    size_t n = 0;
+
+    for (size_t m = 0; m < ARRAY_SIZE(models); m++)
+    for (size_t l = 0; l < ARRAY_SIZE(layouts); l++)
+    for (size_t v = 0; v < ARRAY_SIZE(variants); v++)
+    for (size_t o = 0; o < ARRAY_SIZE(options); o++)
+        names[n++] = (struct xkb_rule_names) {
+            .rules = "evdev", .model = models[m], .layout = layouts[l],
+            .variant = variants[v], .options = options[o],
+        };
+
+    assert(xkb_components_from_names_batch(ctx, "evdev", names, NUM_NAMES,
+                                           components) == NUM_NAMES);
+    for (n = 0; n < NUM_NAMES; n++) {
+        assert(xkb_components_from_rules(ctx, &names[n], &kccgst));
+        assert(streq(components[n].keycodes, kccgst.keycodes));
+        assert(streq(components[n].types, kccgst.types));
+        assert(streq(components[n].compat, kccgst.compat));
+        assert(streq(components[n].symbols, kccgst.symbols));
+        free(kccgst.keycodes);
+        free(kccgst.types);
+        free(kccgst.compat);
+        free(kccgst.symbols);
+        free(components[n].keycodes);
+        free(components[n].types);
+        free(components[n].compat);
+        free(components[n].symbols);
+    }
+
+    assert(xkb_components_from_names_batch(ctx, "does-not-exist", names, 2,
+                                           components) == 0);
+    assert(!components[0].keycodes && !components[1].symbols);
+    assert(xkb_components_from_names_batch(ctx, "evdev", NULL, 0, NULL) == 0);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -170,6 +478,10 @@ main(int argc, char *argv[])
     };
     assert(test_rules(ctx, &test7));
 
+    test_rules_batch(ctx);
     xkb_context_unref(ctx);
+
+    test_rules_change();
+    test_rules_disk_cache();
     return 0;
 }
@@ -23,6 +23,10 @@
 
 #include "config.h"
 
+#ifdef HAVE_UNISTD_H
+#include <poll.h>
+#endif
+
 #include "evdev-scancodes.h"
 #include "test.h"
 
@@ -107,6 +111,414 @@ test_rmlvo_env(struct xkb_context *ctx, const char *rules, const char *model,
     return ret;
 }
 
+/* Parallel include parsing must not change the resulting keymap. */
+static void
+test_parallel_compile(void)
+{
+    const struct xkb_rule_names names[] = {
+        { "evdev", "pc105", "us,il,ru,ca", ",,,multix",
+          "grp:alts_toggle,ctrl:nocaps,compose:rwin" },
+        { "evdev", "pc105", "us", "intl", "" },
+        { "evdev", "", "us:20", "", "" },
+        { "base", "empty", "empty", "", "" },
+    };
+    struct xkb_context *serial_ctx, *parallel_ctx;
+    char *path;
+
+    serial_ctx = test_get_context(0);
+    assert(serial_ctx);
+    parallel_ctx = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES |
+                                   XKB_CONTEXT_NO_ENVIRONMENT_NAMES |
+                                   XKB_CONTEXT_PARALLEL_COMPILE);
+    assert(parallel_ctx);
+    path = test_get_path("");
+    assert(path);
+    assert(xkb_context_include_path_append(parallel_ctx, path));
+    free(path);
+
+    for (unsigned i = 0; i < ARRAY_SIZE(names); i++) {
+        struct xkb_keymap *serial, *parallel;
+        char *serial_str, *parallel_str;
+
+        serial = xkb_keymap_new_from_names(serial_ctx, &names[i], 0);
+        parallel = xkb_keymap_new_from_names(parallel_ctx, &names[i], 0);
+        assert(serial && parallel);
+
+        serial_str = xkb_keymap_get_as_string(serial,
+                                              XKB_KEYMAP_FORMAT_TEXT_V1);
+        parallel_str = xkb_keymap_get_as_string(parallel,
+                                                XKB_KEYMAP_FORMAT_TEXT_V1);
+        assert(serial_str && parallel_str);
+        assert(streq(serial_str, parallel_str));
+
+        free(serial_str);
+        free(parallel_str);
+        xkb_keymap_unref(serial);
+        xkb_keymap_unref(parallel);
+    }
+
+    xkb_context_unref(serial_ctx);
+    xkb_context_unref(parallel_ctx);
+}
+
+static void
+test_compile_profiling(void)
+{
+    const struct xkb_rule_names names = {
+        "evdev", "pc105", "us,ru", "", "grp:alts_toggle",
+    };
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap *keymap;
+    uint64_t total = 0;
+
+    assert(ctx);
+
+    /* Nothing is collected unless asked for. */
+    keymap = xkb_keymap_new_from_names(ctx, &names, 0);
+    assert(keymap);
+    xkb_keymap_unref(keymap);
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_FILES_OPENED) == 0);
+
+    assert(xkb_context_set_compile_profiling(ctx, 1) == 0);
+    keymap = xkb_keymap_new_from_names(ctx, &names, 0);
+    assert(keymap);
+    xkb_keymap_unref(keymap);
+
+    for (int phase = XKB_COMPILE_PHASE_RULES;
+         phase <= XKB_COMPILE_PHASE_DERIVED; phase++)
+        total += xkb_context_get_compile_phase_time(ctx, phase);
+    assert(total > 0);
+    /* The rules file and at least one file per section. */
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_FILES_OPENED) >= 5);
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_BYTES_LEXED) > 0);
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_AST_NODES) > 0);
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_ALLOCATIONS) >=
+           xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_AST_NODES));
+
+    /* Re-enabling starts over. */
+    assert(xkb_context_set_compile_profiling(ctx, 1) == 0);
+    assert(xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_BYTES_LEXED) == 0);
+    assert(xkb_context_set_compile_profiling(ctx, 0) == 0);
+    assert(xkb_context_get_compile_phase_time(ctx, XKB_COMPILE_PHASE_PARSE) == 0);
+
+    xkb_context_unref(ctx);
+}
+
+/* Incremental recompilation must give the same keymap as a full one. */
+static void
+test_incremental_compile(void)
+{
+    const struct xkb_rule_names names[] = {
+        { "evdev", "pc105", "us", "", "" },
+        { "evdev", "pc105", "us,de", "", "grp:alt_shift_toggle" },
+        { "evdev", "pc105", "us,de,ru", ",nodeadkeys,",
+          "grp:alt_shift_toggle,lv3:ralt_switch,ctrl:nocaps" },
+        /* Changes the compat section. */
+        { "evdev", "pc105", "us,de", "", "grp_led:scroll" },
+        { "evdev", "pc105", "il", "", "grp_led:scroll,compose:rwin" },
+        /* Changes the types section. */
+        { "evdev", "pc105", "us", "", "numpad:microsoft" },
+        { "evdev", "pc105", "ca", "multix", "" },
+    };
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap *base, *keymap, *full;
+    char *keymap_str, *full_str;
+    uint64_t files_full, files_incremental;
+
+    assert(ctx);
+
+    base = xkb_keymap_new_from_names(ctx, &names[0], 0);
+    assert(base);
+
+    for (unsigned i = 1; i < ARRAY_SIZE(names); i++) {
+        keymap = xkb_keymap_new_from_names_incremental(base, &names[i], 0);
+        full = xkb_keymap_new_from_names(ctx, &names[i], 0);
+        assert(keymap && full);
+
+        keymap_str = xkb_keymap_get_as_string(keymap,
+                                              XKB_KEYMAP_FORMAT_TEXT_V1);
+        full_str = xkb_keymap_get_as_string(full, XKB_KEYMAP_FORMAT_TEXT_V1);
+        assert(keymap_str && full_str);
+        assert(streq(keymap_str, full_str));
+
+        free(keymap_str);
+        free(full_str);
+        xkb_keymap_unref(full);
+        xkb_keymap_unref(base);
+        base = keymap;
+    }
+
+    /* Only the symbols files are opened when nothing else changes. */
+    assert(xkb_context_set_compile_profiling(ctx, 1) == 0);
+    full = xkb_keymap_new_from_names(ctx, &names[1], 0);
+    assert(full);
+    files_full =
+        xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_FILES_OPENED);
+    assert(xkb_context_set_compile_profiling(ctx, 1) == 0);
+    keymap = xkb_keymap_new_from_names_incremental(full, &names[2], 0);
+    assert(keymap);
+    files_incremental =
+        xkb_context_get_compile_counter(ctx, XKB_COMPILE_COUNTER_FILES_OPENED);
+    assert(files_incremental > 0 && files_incremental < files_full);
+    assert(xkb_context_set_compile_profiling(ctx, 0) == 0);
+    xkb_keymap_unref(keymap);
+    xkb_keymap_unref(full);
+
+    /* A keymap not compiled from names is not reused. */
+    keymap_str = xkb_keymap_get_as_string(base, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(keymap_str);
+    xkb_keymap_unref(base);
+    base = xkb_keymap_new_from_string(ctx, keymap_str,
+                                      XKB_KEYMAP_FORMAT_TEXT_V1, 0);
+    free(keymap_str);
+    assert(base);
+    keymap = xkb_keymap_new_from_names_incremental(base, &names[1], 0);
+    full = xkb_keymap_new_from_names(ctx, &names[1], 0);
+    assert(keymap && full);
+    keymap_str = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    full_str = xkb_keymap_get_as_string(full, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(keymap_str && full_str);
+    assert(streq(keymap_str, full_str));
+    free(keymap_str);
+    free(full_str);
+    xkb_keymap_unref(keymap);
+    xkb_keymap_unref(full);
+    xkb_keymap_unref(base);
+
+    xkb_context_unref(ctx);
+}
+
+static void
+test_device_compile(void)
+{
+    const struct xkb_rule_names names = {
+        "evdev", "pc105", "us,de", "", "grp:alt_shift_toggle"
+    };
+    const int numpad[] = {
+        KEY_NUMLOCK, KEY_KPSLASH, KEY_KPASTERISK, KEY_KPMINUS, KEY_KPPLUS,
+        KEY_KPENTER, KEY_KPDOT, KEY_KP0, KEY_KP1, KEY_KP2, KEY_KP3, KEY_KP4,
+        KEY_KP5, KEY_KP6, KEY_KP7, KEY_KP8, KEY_KP9,
+    };
+    const size_t long_bits = sizeof(unsigned long) * 8;
+    unsigned long bits[(KEY_MAX + 1) / (sizeof(unsigned long) * 8)];
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap *keymap, *full;
+    char *keymap_str, *full_str;
+    xkb_keycode_t kc;
+
+    assert(ctx);
+
+    memset(bits, 0, sizeof(bits));
+    for (unsigned i = 0; i < ARRAY_SIZE(numpad); i++)
+        bits[numpad[i] / long_bits] |= 1ul << (numpad[i] % long_bits);
+
+    keymap = xkb_keymap_new_from_names_for_device(ctx, &names, bits,
+                                                  sizeof(bits), 0);
+    full = xkb_keymap_new_from_names(ctx, &names, 0);
+    assert(keymap && full);
+
+    assert(xkb_keymap_min_keycode(keymap) == KEY_KPASTERISK + 8);
+    assert(xkb_keymap_max_keycode(keymap) == KEY_KPSLASH + 8);
+    assert(xkb_keymap_key_by_name(keymap, "AC01") == XKB_KEYCODE_INVALID);
+    assert(xkb_keymap_key_get_name(keymap, KEY_F11 + 8) == NULL);
+    assert(xkb_keymap_num_layouts(keymap) == xkb_keymap_num_layouts(full));
+    assert(xkb_keymap_num_mods(keymap) == xkb_keymap_num_mods(full));
+
+    /* The keys of the device are the same as in the full keymap. */
+    for (kc = xkb_keymap_min_keycode(keymap);
+         kc <= xkb_keymap_max_keycode(keymap); kc++) {
+        const char *name = xkb_keymap_key_get_name(keymap, kc);
+        xkb_layout_index_t num_layouts;
+
+        if (!name)
+            continue;
+        assert(streq(name, xkb_keymap_key_get_name(full, kc)));
+        num_layouts = xkb_keymap_num_layouts_for_key(keymap, kc);
+        assert(num_layouts == xkb_keymap_num_layouts_for_key(full, kc));
+        for (xkb_layout_index_t layout = 0; layout < num_layouts; layout++) {
+            xkb_level_index_t num_levels =
+                xkb_keymap_num_levels_for_key(keymap, kc, layout);
+            assert(num_levels ==
+                   xkb_keymap_num_levels_for_key(full, kc, layout));
+            for (xkb_level_index_t level = 0; level < num_levels; level++) {
+                const xkb_keysym_t *syms, *full_syms;
+                int num_syms =
+                    xkb_keymap_key_get_syms_by_level(keymap, kc, layout,
+                                                     level, &syms);
+                assert(num_syms ==
+                       xkb_keymap_key_get_syms_by_level(full, kc, layout,
+                                                        level, &full_syms));
+                assert(num_syms == 0 ||
+                       memcmp(syms, full_syms, num_syms * sizeof(*syms)) == 0);
+            }
+        }
+    }
+
+    assert(test_key_seq(keymap,
+                        KEY_KP1,        BOTH, XKB_KEY_KP_End,   NEXT,
+                        KEY_NUMLOCK,    BOTH, XKB_KEY_Num_Lock, NEXT,
+                        KEY_KP1,        BOTH, XKB_KEY_KP_1,     FINISH));
+
+    /* The dump only has the keys of the device, and compiles back. */
+    keymap_str = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    full_str = xkb_keymap_get_as_string(full, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(keymap_str && full_str);
+    assert(strlen(keymap_str) < strlen(full_str) / 2);
+    assert(!strstr(keymap_str, "<AC01>"));
+    xkb_keymap_unref(keymap);
+    keymap = test_compile_string(ctx, keymap_str);
+    assert(keymap);
+    free(full_str);
+    full_str = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(full_str);
+    assert(streq(keymap_str, full_str));
+
+    free(keymap_str);
+    free(full_str);
+    xkb_keymap_unref(keymap);
+    xkb_keymap_unref(full);
+
+    assert(!xkb_keymap_new_from_names_for_device(ctx, &names, NULL, 0, 0));
+
+    xkb_context_unref(ctx);
+}
+
+ATTR_PRINTF(3, 0) static void
+count_log(struct xkb_context *ctx, enum xkb_log_level level,
+          const char *fmt, va_list args)
+{
+    int *count = xkb_context_get_user_data(ctx);
+
+    /* Cleared right after a cancel, see test_async_log(). */
+    assert(count);
+    (*count)++;
+}
+
+static void
+test_async_log(void)
+{
+    const struct xkb_rule_names broken = { "does-not-exist" };
+    const struct xkb_rule_names names = {
+        "evdev", "pc105", "us,de", "", "grp:alt_shift_toggle"
+    };
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap_async *async;
+    struct xkb_keymap *keymap;
+    int *count = calloc(1, sizeof(*count));
+
+    assert(ctx && count);
+    xkb_context_set_log_level(ctx, XKB_LOG_LEVEL_ERROR);
+    xkb_context_set_log_fn(ctx, count_log);
+    xkb_context_set_user_data(ctx, count);
+
+    /* The messages of the compilation reach the log function. */
+    async = xkb_keymap_new_from_names_async(ctx, &broken, 0);
+    assert(async);
+    assert(!xkb_keymap_async_finish(async));
+    assert(*count > 0);
+
+    /* Once cancelled, the log data can go away. */
+    async = xkb_keymap_new_from_names_async(ctx, &broken, 0);
+    assert(async);
+    xkb_keymap_async_cancel(async);
+    xkb_context_set_user_data(ctx, NULL);
+    free(count);
+
+    /* Give the cancelled compilation time to finish. */
+    xkb_context_set_log_level(ctx, XKB_LOG_LEVEL_CRITICAL);
+    keymap = xkb_keymap_new_from_names(ctx, &names, 0);
+    assert(keymap);
+    xkb_keymap_unref(keymap);
+
+    xkb_context_unref(ctx);
+}
+
+static void
+test_async_compile(void)
+{
+    const struct xkb_rule_names names = {
+        "evdev", "pc105", "us,de", "", "grp:alt_shift_toggle"
+    };
+    const struct xkb_rule_names other = {
+        "evdev", "pc104", "de", "", ""
+    };
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_keymap_async *async, *async2;
+    struct xkb_keymap *keymap, *sync;
+    char *keymap_str, *sync_str;
+    int fd;
+
+    assert(ctx);
+
+    sync = xkb_keymap_new_from_names(ctx, &names, 0);
+    assert(sync);
+    sync_str = xkb_keymap_get_as_string(sync, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(sync_str);
+
+    async = xkb_keymap_new_from_names_async(ctx, &names, 0);
+    assert(async);
+
+    /* The context can be used meanwhile. */
+    keymap = xkb_keymap_new_from_names(ctx, &other, 0);
+    assert(keymap);
+    assert(test_key_seq(keymap,
+                        KEY_Y,          BOTH, XKB_KEY_z,        FINISH));
+    xkb_keymap_unref(keymap);
+
+    fd = xkb_keymap_async_get_fd(async);
+#ifdef HAVE_UNISTD_H
+    if (fd >= 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        assert(poll(&pfd, 1, -1) == 1);
+        assert(pfd.revents & POLLIN);
+    }
+#else
+    (void) fd;
+#endif
+
+    /* The result is the same as compiling synchronously. */
+    keymap = xkb_keymap_async_finish(async);
+    assert(keymap);
+    assert(xkb_keymap_key_by_name(keymap, "AC01") == KEY_A + 8);
+    keymap_str = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(keymap_str);
+    assert(streq(keymap_str, sync_str));
+    assert(test_key_seq(keymap,
+                        KEY_Y,          BOTH, XKB_KEY_y,        NEXT,
+                        KEY_LEFTSHIFT,  DOWN, XKB_KEY_Shift_L,  NEXT,
+                        KEY_LEFTALT,    BOTH, XKB_KEY_ISO_Next_Group, NEXT,
+                        KEY_LEFTSHIFT,  UP,   XKB_KEY_Shift_L,  NEXT,
+                        KEY_Y,          BOTH, XKB_KEY_z,        FINISH));
+    free(keymap_str);
+    xkb_keymap_unref(keymap);
+
+    /* Cancelled compilations don't leak, finished or not. */
+    async = xkb_keymap_new_from_names_async(ctx, &names, 0);
+    async2 = xkb_keymap_new_from_names_async(ctx, &other, 0);
+    assert(async && async2);
+    xkb_keymap_async_cancel(async);
+    keymap = xkb_keymap_async_finish(async2);
+    assert(keymap);
+    xkb_keymap_unref(keymap);
+    async = xkb_keymap_new_from_names_async(ctx, &names, 0);
+    assert(async);
+    xkb_keymap_async_cancel(async);
+    xkb_keymap_async_cancel(NULL);
+
+    /* Failures are reported by finish. */
+    {
+        const struct xkb_rule_names broken = { "does-not-exist" };
+        async = xkb_keymap_new_from_names_async(ctx, &broken, 0);
+        assert(async);
+        assert(!xkb_keymap_async_finish(async));
+    }
+    assert(!xkb_keymap_new_from_names_async(ctx, &names, 5453));
+
+    free(sync_str);
+    xkb_keymap_unref(sync);
+    xkb_context_unref(ctx);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -201,5 +613,13 @@ main(int argc, char *argv[])
     }
 
     xkb_context_unref(ctx);
+
+    test_parallel_compile();
+    test_compile_profiling();
+    test_incremental_compile();
+    test_device_compile();
+    test_async_compile();
+    test_async_log();
+
     return 0;
 }
@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2026 libxkbcommon contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "evdev-scancodes.h"
+#include "xkbcomp/xkbcomp-priv.h"
+
+/*
+ * Generated into static-us.c at build time with:
+ *   compile-keymap --include test/data --rules evdev --model pc104 \
+ *       --layout us --variant '' --options '' --emit-c=static_keymap_us
+ */
+extern struct xkb_static_keymap static_keymap_us;
+
+static struct xkb_keymap *
+compile_us(struct xkb_context *ctx)
+{
+    /* Empty options, not the default ones, as for the generated file. */
+    const struct xkb_rule_names names = {
+        .rules = "evdev", .model = "pc104", .layout = "us",
+        .variant = "", .options = ""
+    };
+
+    return xkb_keymap_new_from_names(ctx, &names, 0);
+}
+
+static void
+test_load(void)
+{
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_context *other = test_get_context(0);
+    struct xkb_keymap *keymap, *compiled;
+    char *dump, *expected;
+
+    assert(ctx && other);
+    compiled = compile_us(ctx);
+    assert(compiled);
+    expected = xkb_keymap_get_as_string(compiled, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(expected);
+
+    keymap = xkb_keymap_new_from_static(ctx, &static_keymap_us);
+    assert(keymap);
+    dump = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(dump);
+    assert(streq(dump, expected));
+    free(dump);
+
+    assert(xkb_keymap_key_by_name(keymap, "AC01") == KEY_A + 8);
+    assert(xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_SHIFT) == 0);
+    assert(test_key_seq(keymap,
+                        KEY_A,         BOTH, XKB_KEY_a,       NEXT,
+                        KEY_LEFTSHIFT, DOWN, XKB_KEY_Shift_L, NEXT,
+                        KEY_A,         BOTH, XKB_KEY_A,       NEXT,
+                        KEY_LEFTSHIFT, UP,   XKB_KEY_Shift_L, NEXT,
+                        KEY_CAPSLOCK,  BOTH, XKB_KEY_Caps_Lock, NEXT,
+                        KEY_A,         BOTH, XKB_KEY_A,       FINISH));
+
+    /* Loading it again only takes a reference. */
+    assert(xkb_keymap_new_from_static(ctx, &static_keymap_us) == keymap);
+    xkb_keymap_unref(keymap);
+
+    /* It is bound to ctx until released. */
+    assert(!xkb_keymap_new_from_static(other, &static_keymap_us));
+    xkb_keymap_unref(keymap);
+
+    /* The atoms of other differ from the ones of ctx. */
+    assert(xkb_atom_intern_literal(other, "not in the keymap") !=
+           XKB_ATOM_NONE);
+    keymap = xkb_keymap_new_from_static(other, &static_keymap_us);
+    assert(keymap);
+    dump = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(dump);
+    assert(streq(dump, expected));
+    free(dump);
+    xkb_keymap_unref(keymap);
+
+    free(expected);
+    xkb_keymap_unref(compiled);
+    xkb_context_unref(other);
+    xkb_context_unref(ctx);
+}
+
+static void
+test_patch(void)
+{
+    struct xkb_context *ctx = test_get_context(0);
+    struct xkb_context *other = test_get_context(0);
+    struct xkb_keymap *keymap, *patched;
+    const xkb_keysym_t syms[] = { XKB_KEY_Greek_alpha };
+    const struct xkb_keymap_key_patch patch = {
+        .key = KEY_A + 8, .syms = syms, .num_levels = ARRAY_SIZE(syms),
+    };
+
+    assert(ctx && other);
+    keymap = xkb_keymap_new_from_static(ctx, &static_keymap_us);
+    assert(keymap);
+    patched = xkb_keymap_new_patched(keymap, &patch, 1);
+    assert(patched);
+    assert(test_key_seq(patched,
+                        KEY_A, BOTH, XKB_KEY_Greek_alpha, FINISH));
+
+    /* Releasing the patch leaves the static keymap alone. */
+    xkb_keymap_unref(patched);
+    assert(streq(xkb_keymap_key_get_name(keymap, KEY_A + 8), "AC01"));
+    assert(test_key_seq(keymap,
+                        KEY_A, BOTH, XKB_KEY_a, FINISH));
+
+    /* The patch held no reference of its own once released. */
+    xkb_keymap_unref(keymap);
+    keymap = xkb_keymap_new_from_static(other, &static_keymap_us);
+    assert(keymap);
+    xkb_keymap_unref(keymap);
+
+    xkb_context_unref(other);
+    xkb_context_unref(ctx);
+}
+
+int
+main(void)
+{
+    test_load();
+    test_patch();
+
+    return 0;
+}
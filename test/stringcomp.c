@@ -31,6 +31,241 @@
 
 #define DATA_PATH "keymaps/stringcomp.data"
 
+struct chunks {
+    char text[200000];
+    size_t size;
+    unsigned num_chunks;
+    unsigned max_chunks;
+};
+
+static int
+write_chunk(void *data, const char *chunk, size_t length)
+{
+    struct chunks *chunks = data;
+
+    assert(length > 0);
+    if (chunks->num_chunks == chunks->max_chunks)
+        return 0;
+    assert(chunks->size + length < sizeof(chunks->text));
+    memcpy(chunks->text + chunks->size, chunk, length);
+    chunks->size += length;
+    chunks->num_chunks++;
+    return 1;
+}
+
+/* Writing the keymap in chunks gives the same text as dumping it. */
+static void
+test_write(struct xkb_keymap *keymap, const char *dump)
+{
+    static struct chunks chunks;
+    FILE *file;
+    char *text;
+    size_t size = strlen(dump);
+
+    chunks.size = chunks.num_chunks = 0;
+    chunks.max_chunks = 10000;
+    assert(xkb_keymap_write(keymap, XKB_KEYMAP_USE_ORIGINAL_FORMAT, 0,
+                            write_chunk, &chunks));
+    assert(chunks.size == size);
+    assert(memcmp(chunks.text, dump, size) == 0);
+    /* The text is streamed through a small buffer. */
+    assert(chunks.num_chunks > 1);
+
+    /* The write function can stop it. */
+    chunks.size = chunks.num_chunks = 0;
+    chunks.max_chunks = 2;
+    assert(!xkb_keymap_write(keymap, XKB_KEYMAP_USE_ORIGINAL_FORMAT, 0,
+                             write_chunk, &chunks));
+    assert(chunks.num_chunks == 2);
+    assert(!xkb_keymap_write(keymap, 4893, 0, write_chunk, &chunks));
+    assert(!xkb_keymap_write(keymap, XKB_KEYMAP_FORMAT_TEXT_V1, 0, NULL, NULL));
+
+    file = tmpfile();
+    assert(file);
+    assert(xkb_keymap_write_to_fd(keymap, XKB_KEYMAP_FORMAT_TEXT_V1, 0,
+                                  fileno(file)));
+    text = calloc(1, size + 2);
+    assert(text);
+    rewind(file);
+    assert(fread(text, 1, size + 1, file) == size);
+    assert(streq(text, dump));
+    free(text);
+    fclose(file);
+
+    assert(!xkb_keymap_write_to_fd(keymap, XKB_KEYMAP_FORMAT_TEXT_V1, 0, -1));
+}
+
+/* The keymaps behave the same: same keysyms, on the same modifiers. */
+static void
+assert_keymaps_equivalent(struct xkb_keymap *a, struct xkb_keymap *b)
+{
+    assert(xkb_keymap_min_keycode(a) == xkb_keymap_min_keycode(b));
+    assert(xkb_keymap_max_keycode(a) == xkb_keymap_max_keycode(b));
+
+    for (xkb_keycode_t kc = xkb_keymap_min_keycode(a);
+         kc <= xkb_keymap_max_keycode(a); kc++) {
+        xkb_layout_index_t num_layouts = xkb_keymap_num_layouts_for_key(a, kc);
+
+        assert(xkb_keymap_num_layouts_for_key(b, kc) == num_layouts);
+        for (xkb_layout_index_t layout = 0; layout < num_layouts; layout++) {
+            xkb_level_index_t num_levels =
+                xkb_keymap_num_levels_for_key(a, kc, layout);
+
+            assert(xkb_keymap_num_levels_for_key(b, kc, layout) == num_levels);
+            for (xkb_level_index_t level = 0; level < num_levels; level++) {
+                const xkb_keysym_t *syms_a, *syms_b;
+                xkb_mod_mask_t masks_a[64], masks_b[64];
+                int num_syms, num_masks;
+
+                num_syms = xkb_keymap_key_get_syms_by_level(a, kc, layout,
+                                                            level, &syms_a);
+                assert(xkb_keymap_key_get_syms_by_level(b, kc, layout, level,
+                                                        &syms_b) == num_syms);
+                assert(num_syms == 0 ||
+                       memcmp(syms_a, syms_b, num_syms * sizeof(*syms_a)) == 0);
+
+                /* Level 1 entries are redundant, and not written. */
+                if (level == 0)
+                    continue;
+
+                num_masks = xkb_keymap_key_get_mods_for_level(a, kc, layout,
+                                                              level, masks_a,
+                                                              ARRAY_SIZE(masks_a));
+                assert(xkb_keymap_key_get_mods_for_level(b, kc, layout, level,
+                                                         masks_b,
+                                                         ARRAY_SIZE(masks_b)) ==
+                       (size_t) num_masks);
+                for (int i = 0; i < num_masks; i++) {
+                    int j = 0;
+                    while (j < num_masks && masks_b[j] != masks_a[i])
+                        j++;
+                    assert(j < num_masks);
+                }
+            }
+        }
+    }
+}
+
+#define CANONICAL_KEYMAP(types, symbols) \
+    "xkb_keymap {\n" \
+    "  xkb_keycodes { <AE01> = 10; <AC01> = 38; <LFSH> = 50; };\n" \
+    "  xkb_types { virtual_modifiers NumLock; " types " };\n" \
+    "  xkb_compatibility { };\n" \
+    "  xkb_symbols {\n" \
+    "    key <LFSH> { [ Shift_L ] };\n" \
+    "    modifier_map Shift { <LFSH> };\n" \
+    symbols \
+    "  };\n" \
+    "};\n"
+
+#define TYPE_ONE_LEVEL "type \"ONE_LEVEL\" { modifiers = none; };"
+#define TYPE_TWO_LEVEL(name) \
+    "type \"" name "\" { modifiers = Shift; map[Shift] = 2; };"
+#define TYPE_ALPHABETIC \
+    "type \"ALPHABETIC\" { modifiers = Shift+Lock; " \
+    "map[Lock] = 2; map[Shift] = 2; };"
+#define TYPE_UNUSED \
+    "type \"UNUSED\" { modifiers = Control; map[Control] = 2; };"
+
+static void
+test_canonical_types(struct xkb_context *ctx)
+{
+    const enum xkb_keymap_serialize_flags flags =
+        XKB_KEYMAP_SERIALIZE_CANONICAL_TYPES;
+    /*
+     * Keymaps which only differ in the order of the types and their
+     * entries, unused and duplicate types, and explicit automatic types.
+     */
+    const char *equivalent[] = {
+        CANONICAL_KEYMAP(
+            TYPE_ONE_LEVEL TYPE_TWO_LEVEL("TWO_LEVEL") TYPE_ALPHABETIC,
+            "    key <AE01> { [ 1, exclam ] };\n"
+            "    key <AC01> { [ a, A ] };\n"),
+        CANONICAL_KEYMAP(
+            TYPE_UNUSED TYPE_ALPHABETIC TYPE_TWO_LEVEL("TWO_LEVEL")
+            "type \"ALPHABETIC\" { modifiers = Lock+Shift; "
+            "map[Shift] = 2; map[Lock] = 2; };"
+            TYPE_ONE_LEVEL,
+            "    key <AE01> { type = \"TWO_LEVEL\", [ 1, exclam ] };\n"
+            "    key <AC01> { [ a, A ] };\n"),
+        CANONICAL_KEYMAP(
+            TYPE_ONE_LEVEL TYPE_TWO_LEVEL("ZZ_TWO_LEVEL")
+            TYPE_TWO_LEVEL("TWO_LEVEL") TYPE_ALPHABETIC TYPE_UNUSED,
+            "    key <AE01> { type = \"ZZ_TWO_LEVEL\", [ 1, exclam ] };\n"
+            "    key <AC01> { type = \"ALPHABETIC\", [ a, A ] };\n"),
+    };
+    struct xkb_keymap *keymap, *recompiled;
+    char *dump, *canonical, *first = NULL;
+
+    for (unsigned i = 0; i < ARRAY_SIZE(equivalent); i++) {
+        keymap = test_compile_string(ctx, equivalent[i]);
+        assert(keymap);
+        canonical = xkb_keymap_get_as_string_flags(keymap,
+                                                   XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                   flags);
+        assert(canonical);
+        assert(!strstr(canonical, "UNUSED"));
+        assert(!strstr(canonical, "ZZ_TWO_LEVEL"));
+        assert(!strstr(canonical, "type="));
+        if (first)
+            assert(streq(canonical, first));
+        else
+            first = canonical;
+        if (canonical != first)
+            free(canonical);
+        xkb_keymap_unref(keymap);
+    }
+    free(first);
+
+    /* The types are needed explicitly where they are not automatic. */
+    keymap = test_compile_string(ctx, CANONICAL_KEYMAP(
+        TYPE_ONE_LEVEL TYPE_TWO_LEVEL("ZZ_TWO_LEVEL") TYPE_ALPHABETIC,
+        "    key <AE01> { type = \"ZZ_TWO_LEVEL\", [ 1, exclam ] };\n"
+        "    key <AC01> { [ a, A ] };\n"));
+    assert(keymap);
+    canonical = xkb_keymap_get_as_string_flags(keymap,
+                                               XKB_KEYMAP_FORMAT_TEXT_V1,
+                                               flags);
+    assert(canonical);
+    assert(strstr(canonical, "type= \"ZZ_TWO_LEVEL\""));
+    recompiled = test_compile_string(ctx, canonical);
+    assert(recompiled);
+    assert_keymaps_equivalent(keymap, recompiled);
+    xkb_keymap_unref(recompiled);
+    xkb_keymap_unref(keymap);
+    free(canonical);
+
+    /*
+     * A keymap from rules has many unused types.  Its canonical text
+     * compiles to an equivalent keymap, which gives the same text.
+     */
+    keymap = test_compile_rules(ctx, "evdev", "pc104", "us,ru,il,de",
+                                ",,,neo", "grp:menu_toggle");
+    assert(keymap);
+    dump = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    assert(dump);
+    canonical = xkb_keymap_get_as_string_flags(keymap,
+                                               XKB_KEYMAP_FORMAT_TEXT_V1,
+                                               flags);
+    assert(canonical);
+    assert(strlen(canonical) < strlen(dump));
+    recompiled = test_compile_string(ctx, canonical);
+    assert(recompiled);
+    assert_keymaps_equivalent(keymap, recompiled);
+    free(dump);
+    dump = xkb_keymap_get_as_string_flags(recompiled,
+                                          XKB_KEYMAP_FORMAT_TEXT_V1, flags);
+    assert(dump);
+    assert(streq(dump, canonical));
+    xkb_keymap_unref(recompiled);
+    free(dump);
+    free(canonical);
+
+    assert(!xkb_keymap_get_as_string_flags(keymap, XKB_KEYMAP_FORMAT_TEXT_V1,
+                                           0xff));
+    xkb_keymap_unref(keymap);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -97,6 +332,9 @@ main(int argc, char *argv[])
     assert(!xkb_keymap_get_as_string(keymap, 0));
     assert(!xkb_keymap_get_as_string(keymap, 4893));
 
+    test_write(keymap, dump);
+    test_canonical_types(ctx);
+
     xkb_keymap_unref(keymap);
     free(dump);
     free(dump2);
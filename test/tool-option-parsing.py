@@ -190,6 +190,7 @@ class TestXkbcli(unittest.TestCase):
             # ['--kccgst'],
             ['--verbose', '--rmlvo'],
             # ['--verbose', '--kccgst'],
+            ['--profile'],
         ):
             with self.subTest(args=args):
                 self.xkbcli_compile_keymap.run_command_success(args)
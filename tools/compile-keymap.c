@@ -24,8 +24,10 @@
 #include "config.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -41,12 +43,16 @@
 #define DEFAULT_INCLUDE_PATH_PLACEHOLDER "__defaults__"
 
 static bool verbose = false;
+static bool profile = false;
 static enum output_format {
     FORMAT_RMLVO,
     FORMAT_KEYMAP,
     FORMAT_KCCGST,
+    FORMAT_KCCGST_BATCH,
     FORMAT_KEYMAP_FROM_XKB,
+    FORMAT_C_SOURCE,
 } output_format = FORMAT_KEYMAP;
+static const char *c_source_name = "builtin_keymap";
 static const char *includes[64];
 static size_t num_includes = 0;
 
@@ -63,7 +69,17 @@ usage(char **argv)
 #if ENABLE_PRIVATE_APIS
            " --kccgst\n"
            "    Print a keymap which only includes the KcCGST component names instead of the full keymap\n"
+           " --emit-c[=<name>]\n"
+           "    Print the keymap as a C source file defining a static keymap\n"
+           "    <name> (default: 'builtin_keymap'), to be loaded with\n"
+           "    xkb_keymap_new_from_static()\n"
 #endif
+           " --kccgst-batch\n"
+           "    Read RMLVO names from stdin, one set per line as tab-separated\n"
+           "    model, layout, variant and options, and print the KcCGST for\n"
+           "    each of them on a line, as tab-separated keycodes, types,\n"
+           "    compat and symbols, or an empty line if they cannot be resolved.\n"
+           "    All of them use the rules given with --rules\n"
            " --rmlvo\n"
            "    Print the full RMLVO with the defaults filled in for missing elements\n"
            " --from-xkb\n"
@@ -81,6 +97,9 @@ usage(char **argv)
            "    Add the default set of include directories.\n"
            "    This option is order-dependent, include paths given first\n"
            "    are searched first.\n"
+           " --profile\n"
+           "    Print the time spent in each compilation phase and some\n"
+           "    compilation statistics to stderr\n"
            "\n"
            "XKB-specific options:\n"
            " --rules <rules>\n"
@@ -100,16 +119,30 @@ usage(char **argv)
            DEFAULT_XKB_OPTIONS ? DEFAULT_XKB_OPTIONS : "<none>");
 }
 
+static bool
+is_c_identifier(const char *s)
+{
+    if (!(isalpha((unsigned char) *s) || *s == '_'))
+        return false;
+    for (s++; *s; s++)
+        if (!(isalnum((unsigned char) *s) || *s == '_'))
+            return false;
+    return true;
+}
+
 static bool
 parse_options(int argc, char **argv, struct xkb_rule_names *names)
 {
     enum options {
         OPT_VERBOSE,
         OPT_KCCGST,
+        OPT_KCCGST_BATCH,
+        OPT_EMIT_C,
         OPT_RMLVO,
         OPT_FROM_XKB,
         OPT_INCLUDE,
         OPT_INCLUDE_DEFAULTS,
+        OPT_PROFILE,
         OPT_RULES,
         OPT_MODEL,
         OPT_LAYOUT,
@@ -121,11 +154,14 @@ parse_options(int argc, char **argv, struct xkb_rule_names *names)
         {"verbose",          no_argument,            0, OPT_VERBOSE},
 #if ENABLE_PRIVATE_APIS
         {"kccgst",           no_argument,            0, OPT_KCCGST},
+        {"emit-c",           optional_argument,      0, OPT_EMIT_C},
 #endif
+        {"kccgst-batch",     no_argument,            0, OPT_KCCGST_BATCH},
         {"rmlvo",            no_argument,            0, OPT_RMLVO},
         {"from-xkb",         no_argument,            0, OPT_FROM_XKB},
         {"include",          required_argument,      0, OPT_INCLUDE},
         {"include-defaults", no_argument,            0, OPT_INCLUDE_DEFAULTS},
+        {"profile",          no_argument,            0, OPT_PROFILE},
         {"rules",            required_argument,      0, OPT_RULES},
         {"model",            required_argument,      0, OPT_MODEL},
         {"layout",           required_argument,      0, OPT_LAYOUT},
@@ -151,6 +187,20 @@ parse_options(int argc, char **argv, struct xkb_rule_names *names)
         case OPT_KCCGST:
             output_format = FORMAT_KCCGST;
             break;
+        case OPT_KCCGST_BATCH:
+            output_format = FORMAT_KCCGST_BATCH;
+            break;
+        case OPT_EMIT_C:
+            output_format = FORMAT_C_SOURCE;
+            if (optarg) {
+                if (!is_c_identifier(optarg)) {
+                    fprintf(stderr, "error: invalid C identifier '%s'\n",
+                            optarg);
+                    exit(EXIT_INVALID_USAGE);
+                }
+                c_source_name = optarg;
+            }
+            break;
         case OPT_RMLVO:
             output_format = FORMAT_RMLVO;
             break;
@@ -171,6 +221,9 @@ parse_options(int argc, char **argv, struct xkb_rule_names *names)
             }
             includes[num_includes++] = DEFAULT_INCLUDE_PATH_PLACEHOLDER;
             break;
+        case OPT_PROFILE:
+            profile = true;
+            break;
         case OPT_RULES:
             names->rules = optarg;
             break;
@@ -196,6 +249,39 @@ parse_options(int argc, char **argv, struct xkb_rule_names *names)
     return true;
 }
 
+static void
+print_profile(struct xkb_context *ctx)
+{
+    static const char *phases[] = {
+        [XKB_COMPILE_PHASE_RULES] = "rules",
+        [XKB_COMPILE_PHASE_FILE_IO] = "file I/O",
+        [XKB_COMPILE_PHASE_PARSE] = "parse",
+        [XKB_COMPILE_PHASE_KEYCODES] = "keycodes",
+        [XKB_COMPILE_PHASE_TYPES] = "types",
+        [XKB_COMPILE_PHASE_COMPAT] = "compat",
+        [XKB_COMPILE_PHASE_SYMBOLS] = "symbols",
+        [XKB_COMPILE_PHASE_DERIVED] = "derived fields",
+    };
+    static const char *counters[] = {
+        [XKB_COMPILE_COUNTER_FILES_OPENED] = "files opened",
+        [XKB_COMPILE_COUNTER_BYTES_LEXED] = "bytes lexed",
+        [XKB_COMPILE_COUNTER_AST_NODES] = "AST nodes",
+        [XKB_COMPILE_COUNTER_ALLOCATIONS] = "allocations",
+    };
+    uint64_t total = 0;
+
+    fprintf(stderr, "Compile profile:\n");
+    for (size_t i = 0; i < ARRAY_SIZE(phases); i++) {
+        uint64_t ns = xkb_context_get_compile_phase_time(ctx, i);
+        total += ns;
+        fprintf(stderr, "  %-16s %10.3f ms\n", phases[i], ns / 1e6);
+    }
+    fprintf(stderr, "  %-16s %10.3f ms\n", "total", total / 1e6);
+    for (size_t i = 0; i < ARRAY_SIZE(counters); i++)
+        fprintf(stderr, "  %-16s %10" PRIu64 "\n", counters[i],
+                xkb_context_get_compile_counter(ctx, i));
+}
+
 static bool
 print_rmlvo(struct xkb_context *ctx, const struct xkb_rule_names *rmlvo)
 {
@@ -233,6 +319,108 @@ print_kccgst(struct xkb_context *ctx, const struct xkb_rule_names *rmlvo)
 #endif
 }
 
+/* Split @line at the tabs into up to @max fields; the rest are NULL. */
+static void
+split_fields(char *line, const char **fields, size_t max)
+{
+    for (size_t i = 0; i < max; i++) {
+        fields[i] = line;
+        if (line) {
+            line = strchr(line, '\t');
+            if (line)
+                *line++ = '\0';
+        }
+    }
+}
+
+static bool
+print_kccgst_batch(struct xkb_context *ctx, const struct xkb_rule_names *rmlvo)
+{
+    struct xkb_rule_names *names = NULL;
+    struct xkb_component_names *components = NULL;
+    char **lines = NULL;
+    size_t count = 0, allocated = 0, resolved = 0;
+    const char *fields[4];
+    char buf[4096];
+    bool success = false;
+
+    while (fgets(buf, sizeof(buf), stdin)) {
+        size_t len = strlen(buf);
+
+        if (len > 0 && buf[len - 1] == '\n')
+            buf[--len] = '\0';
+        else if (!feof(stdin)) {
+            fprintf(stderr, "Line %zu is too long\n", count + 1);
+            goto out;
+        }
+
+        if (count == allocated) {
+            size_t new_allocated = allocated ? allocated * 2 : 256;
+            char **new_lines = realloc(lines, new_allocated * sizeof(*lines));
+            struct xkb_rule_names *new_names =
+                realloc(names, new_allocated * sizeof(*names));
+
+            if (new_lines)
+                lines = new_lines;
+            if (new_names)
+                names = new_names;
+            if (!new_lines || !new_names) {
+                fprintf(stderr, "Failed to allocate the names\n");
+                goto out;
+            }
+            allocated = new_allocated;
+        }
+
+        lines[count] = strdup(buf);
+        if (!lines[count]) {
+            fprintf(stderr, "Failed to allocate the names\n");
+            goto out;
+        }
+        split_fields(lines[count], fields, ARRAY_SIZE(fields));
+        names[count] = (struct xkb_rule_names) {
+            .model = fields[0],
+            .layout = fields[1],
+            .variant = fields[2],
+            .options = fields[3],
+        };
+        count++;
+    }
+    if (ferror(stdin)) {
+        fprintf(stderr, "Failed to read from stdin\n");
+        goto out;
+    }
+
+    components = calloc(count ? count : 1, sizeof(*components));
+    if (!components) {
+        fprintf(stderr, "Failed to allocate the components\n");
+        goto out;
+    }
+
+    resolved = xkb_components_from_names_batch(ctx, rmlvo->rules, names,
+                                               count, components);
+    for (size_t i = 0; i < count; i++) {
+        if (components[i].keycodes)
+            printf("%s\t%s\t%s\t%s\n",
+                   components[i].keycodes, components[i].types,
+                   components[i].compat, components[i].symbols);
+        else
+            printf("\n");
+        free(components[i].keycodes);
+        free(components[i].types);
+        free(components[i].compat);
+        free(components[i].symbols);
+    }
+    success = resolved == count;
+
+out:
+    for (size_t i = 0; i < count; i++)
+        free(lines[i]);
+    free(lines);
+    free(names);
+    free(components);
+    return success;
+}
+
 static bool
 print_keymap(struct xkb_context *ctx, const struct xkb_rule_names *rmlvo)
 {
@@ -248,6 +436,30 @@ print_keymap(struct xkb_context *ctx, const struct xkb_rule_names *rmlvo)
     return true;
 }
 
+static bool
+print_c_source(struct xkb_context *ctx, const struct xkb_rule_names *rmlvo)
+{
+#if ENABLE_PRIVATE_APIS
+    struct xkb_keymap *keymap;
+    char *source;
+
+    keymap = xkb_keymap_new_from_names(ctx, rmlvo, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (keymap == NULL)
+        return false;
+
+    source = keymap_get_as_c_source(keymap, c_source_name);
+    xkb_keymap_unref(keymap);
+    if (!source)
+        return false;
+
+    fputs(source, stdout);
+    free(source);
+    return true;
+#else
+    return false;
+#endif
+}
+
 static bool
 print_keymap_from_file(struct xkb_context *ctx)
 {
@@ -359,16 +571,29 @@ main(int argc, char **argv)
             xkb_context_include_path_append(ctx, include);
     }
 
+    if (profile && xkb_context_set_compile_profiling(ctx, 1) != 0) {
+        fprintf(stderr, "Couldn't enable compile profiling\n");
+        goto out;
+    }
+
     if (output_format == FORMAT_RMLVO) {
         rc = print_rmlvo(ctx, &names) ? EXIT_SUCCESS : EXIT_FAILURE;
     } else if (output_format == FORMAT_KEYMAP) {
         rc = print_keymap(ctx, &names) ? EXIT_SUCCESS : EXIT_FAILURE;
     } else if (output_format == FORMAT_KCCGST) {
         rc = print_kccgst(ctx, &names) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (output_format == FORMAT_KCCGST_BATCH) {
+        rc = print_kccgst_batch(ctx, &names) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (output_format == FORMAT_C_SOURCE) {
+        rc = print_c_source(ctx, &names) ? EXIT_SUCCESS : EXIT_FAILURE;
     } else if (output_format == FORMAT_KEYMAP_FROM_XKB) {
         rc = print_keymap_from_file(ctx);
     }
 
+    if (profile)
+        print_profile(ctx);
+
+out:
     xkb_context_unref(ctx);
 
     return rc;